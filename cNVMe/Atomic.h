@@ -0,0 +1,94 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Atomic.h - A header file for atomic accesses to memory shared with the host
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif // _WIN32
+
+namespace cnvme
+{
+	namespace atomic
+	{
+		/// <summary>
+		/// Reads a 16 or 32 bit value the other side writes, with acquire ordering.
+		/// Queue memory and registers are plain memory, so they can't be viewed as std::atomic.
+		/// </summary>
+		/// <param name="value">The value to read</param>
+		/// <returns>Copy of the value</returns>
+		template <typename T>
+		T loadAcquire(const T* value)
+		{
+			static_assert(sizeof(T) == sizeof(UINT_16) || sizeof(T) == sizeof(UINT_32), "Only 16 and 32 bit values are accessed atomically");
+#ifdef _WIN32
+			return *(const volatile T*)value; // Volatile reads have acquire semantics with /volatile:ms
+#else
+			return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif // _WIN32
+		}
+
+		/// <summary>
+		/// Writes a 16 or 32 bit value the other side polls, publishing it with release ordering
+		/// </summary>
+		/// <param name="value">The value to write</param>
+		/// <param name="newValue">What to write</param>
+		template <typename T>
+		void storeRelease(T* value, T newValue)
+		{
+			static_assert(sizeof(T) == sizeof(UINT_16) || sizeof(T) == sizeof(UINT_32), "Only 16 and 32 bit values are accessed atomically");
+#ifdef _WIN32
+			*(volatile T*)value = newValue; // Volatile writes have release semantics with /volatile:ms
+#else
+			__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif // _WIN32
+		}
+
+		/// <summary>
+		/// ORs bits into a 16 or 32 bit value the other side polls, publishing them with release ordering
+		/// </summary>
+		/// <param name="value">The value to OR into</param>
+		/// <param name="bits">Bits to set</param>
+		template <typename T>
+		void orRelease(T* value, T bits)
+		{
+			static_assert(sizeof(T) == sizeof(UINT_16) || sizeof(T) == sizeof(UINT_32), "Only 16 and 32 bit values are accessed atomically");
+#ifdef _WIN32
+			if (sizeof(T) == sizeof(UINT_16))
+			{
+				_InterlockedOr16((volatile short*)value, (short)bits); // Full barrier
+			}
+			else
+			{
+				_InterlockedOr((volatile long*)value, (long)bits); // Full barrier
+			}
+#else
+			__atomic_fetch_or(value, bits, __ATOMIC_RELEASE);
+#endif // _WIN32
+		}
+	}
+}
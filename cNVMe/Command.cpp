@@ -196,8 +196,17 @@ namespace cnvme
 				case nvm::WRITE_ZEROES:
 					break;
 				case nvm::DATASET_MANAGEMENT:
-					LOG_ERROR("Not supported cmd: DSM");
-					break; //
+					transferSize = ONE_BASED_FROM_ZERO_BASED(this->DW10_DatasetManagement.NR) * sizeof(DATASET_MANAGEMENT_RANGE);
+					break;
+				case nvm::ZONE_MANAGEMENT_SEND:
+					break; // Only Set Zone Descriptor Extension has data, and we don't support it
+				case nvm::ZONE_MANAGEMENT_RECEIVE:
+					transferSize = ONE_BASED_FROM_ZERO_BASED((UINT_64)this->NUMD) * sizeof(UINT_32);
+					break;
+				case nvm::ZONE_APPEND:
+					ASSERT_IF_LT(sectorSizeInBytes, 512, "Invalid sector size to determine transfer size");
+					transferSize = ONE_BASED_FROM_ZERO_BASED(this->DW12_IO.NLB) * sectorSizeInBytes;
+					break;
 				case nvm::RESERVATION_REGISTER:
 					LOG_ERROR("Not supported cmd: RReg");
 					break; //
@@ -181,11 +181,44 @@ namespace cnvme
 							UINT_32 BPID : 1; // Boot Partition ID
 						} DW10_FirmwareCommit;
 
+						struct
+						{
+							UINT_32 SEL : 4; // Select (create/delete)
+							UINT_32 NAMESPACE_MANAGEMENT_DW10_RSVD : 28;
+						} DW10_NamespaceManagement;
+
+						struct
+						{
+							UINT_32 SEL : 4; // Select (attach/detach)
+							UINT_32 NAMESPACE_ATTACHMENT_DW10_RSVD : 28;
+						} DW10_NamespaceAttachment;
+
+						struct
+						{
+							UINT_32 NR : 8; // Number of Ranges (0-based)
+							UINT_32 DATASET_MANAGEMENT_DW10_RSVD : 24;
+						} DW10_DatasetManagement;
+
+						struct
+						{
+							UINT_32 FID : 8; // Feature Identifier
+							UINT_32 SEL : 3; // Select (Get Features only)
+							UINT_32 FEATURES_DW10_RSVD : 20;
+							UINT_32 SV : 1; // Save (Set Features only)
+						} DW10_Features; // Both get/set
+
 						UINT_32 DWord10; // Command Specific DW10
 					};
 
 					union
 					{
+						struct
+						{
+							UINT_32 CNSSID : 16; // CNS Specific Identifier
+							UINT_32 IDENTIFY_DW11_RSVD : 8;
+							UINT_32 CSI : 8; // Command Set Identifier
+						} DW11_Identify;
+
 						struct
 						{
 							UINT_32 PC : 1; // Physically Contiguous
@@ -208,14 +241,56 @@ namespace cnvme
 							UINT_32 GET_LOG_PAGE_DW11_RSVD : 16;
 						} DW11_GetLogPage;
 
+						struct
+						{
+							UINT_32 IDR : 1; // Integral Dataset for Read
+							UINT_32 IDW : 1; // Integral Dataset for Write
+							UINT_32 AD : 1; // Deallocate
+							UINT_32 DATASET_MANAGEMENT_DW11_RSVD : 29;
+						} DW11_DatasetManagement;
+
+						struct
+						{
+							UINT_32 PS : 5; // Power State
+							UINT_32 WH : 3; // Workload Hint
+							UINT_32 POWER_MANAGEMENT_DW11_RSVD : 24;
+						} DW11_PowerManagement;
+
+						struct
+						{
+							UINT_32 WCE : 1; // Volatile Write Cache Enable
+							UINT_32 VOLATILE_WRITE_CACHE_DW11_RSVD : 31;
+						} DW11_VolatileWriteCache;
+
+						struct
+						{
+							UINT_32 APSTE : 1; // Autonomous Power State Transition Enable
+							UINT_32 AUTONOMOUS_POWER_STATE_TRANSITION_DW11_RSVD : 31;
+						} DW11_AutonomousPowerStateTransition;
+
+						struct
+						{
+							UINT_32 NAMESPACE_MANAGEMENT_DW11_RSVD : 24;
+							UINT_32 CSI : 8; // Command Set Identifier (create only)
+						} DW11_NamespaceManagement;
+
+						struct
+						{
+							UINT_32 SQID : 16; // Submission Queue Identifier (if SQ is set)
+							UINT_32 QOS_LIMITS_DW11_RSVD : 15;
+							UINT_32 SQ : 1; // The limits are for submission queue SQID instead of the namespace in NSID
+						} DW11_QosLimits;
+
 						UINT_32 DWord11; // Command Specific DW11
 					};
 				};
-				UINT_64 SLBA; // Starting LBA
+				UINT_64 SLBA; // Starting LBA (or Zone Start LBA for zone commands)
 			};
 			union
 			{
 				UINT_32 DWord12; // Command Specific DW12
+				UINT_32 NUMD; // Number of Dwords (0-based) for Zone Management Receive
+				UINT_32 IOPSL; // IOPS Limit for the QoS Limits feature (0 is unlimited)
 				struct
 				{
 					UINT_32 NLB : 16; // Number of Logical Blocks
@@ -225,9 +300,38 @@ namespace cnvme
 					UINT_32 LR : 1; // Limited Retry
 				} DW12_IO;
 			};
-			UINT_32 DWord13; // Command Specific DW13
-			UINT_32 DWord14; // Command Specific DW14
-			UINT_32 DWord15; // Command Specific DW15
+			union
+			{
+				UINT_32 DWord13; // Command Specific DW13
+				UINT_32 BWL; // Bandwidth Limit in KiB/s for the QoS Limits feature (0 is unlimited)
+				struct
+				{
+					UINT_32 ZSA : 8; // Zone Send Action
+					UINT_32 SELECT_ALL : 1; // Select All (the SLBA is ignored)
+					UINT_32 ZONE_MANAGEMENT_SEND_DW13_RSVD : 23;
+				} DW13_ZoneManagementSend;
+				struct
+				{
+					UINT_32 ZRA : 8; // Zone Receive Action
+					UINT_32 ZRASF : 8; // Zone Receive Action Specific Field
+					UINT_32 PARTIAL : 1; // Partial Report
+					UINT_32 ZONE_MANAGEMENT_RECEIVE_DW13_RSVD : 15;
+				} DW13_ZoneManagementReceive;
+			};
+			union
+			{
+				UINT_32 DWord14; // Command Specific DW14
+				UINT_32 EILBRT; // (Expected) Initial Logical Block Reference Tag
+			};
+			union
+			{
+				UINT_32 DWord15; // Command Specific DW15
+				struct
+				{
+					UINT_32 ELBAT : 16; // (Expected) Logical Block Application Tag
+					UINT_32 ELBATM : 16; // (Expected) Logical Block Application Tag Mask
+				} DW15_IO;
+			};
 
 			std::string toString() const;
 
@@ -243,7 +347,7 @@ namespace cnvme
 		typedef struct COMPLETION_QUEUE_ENTRY
 		{
 			UINT_32 DWord0; // Command Specific
-			UINT_32 DWord1; // Reserved
+			UINT_32 DWord1; // Reserved (upper half of the assigned LBA for Zone Append, bandwidth limit for Get Features QoS Limits)
 
 			union
 			{
@@ -287,5 +391,48 @@ namespace cnvme
 		}COMPLETION_QUEUE_ENTRY, *PCOMPLETION_QUEUE_ENTRY;
 		static_assert(sizeof(COMPLETION_QUEUE_ENTRY) == 16, "COMPLETION_QUEUE_ENTRY should be 16 byte(s) in size.");
 
+		typedef struct DATASET_MANAGEMENT_RANGE
+		{
+			UINT_32 ContextAttributes;
+			UINT_32 LengthInLogicalBlocks; // Not 0-based
+			UINT_64 StartingLBA;
+		}DATASET_MANAGEMENT_RANGE, *PDATASET_MANAGEMENT_RANGE;
+		static_assert(sizeof(DATASET_MANAGEMENT_RANGE) == 16, "DATASET_MANAGEMENT_RANGE should be 16 byte(s) in size.");
+
+		/// <summary>
+		/// Starts the data of a Zone Management Receive (Report Zones). Zone descriptors follow.
+		/// </summary>
+		typedef struct ZONE_REPORT_HEADER
+		{
+			UINT_64 NumberOfZones; // Matching zones, or just those in the report if it is partial
+			UINT_8 RSVD_8_63[56];
+		}ZONE_REPORT_HEADER, *PZONE_REPORT_HEADER;
+		static_assert(sizeof(ZONE_REPORT_HEADER) == 64, "ZONE_REPORT_HEADER should be 64 byte(s) in size.");
+
+		typedef struct ZONE_DESCRIPTOR
+		{
+			UINT_8 ZT; // Zone Type
+			UINT_8 ZONE_DESCRIPTOR_RSVD_8_11 : 4;
+			UINT_8 ZS : 4; // Zone State
+			UINT_8 ZA; // Zone Attributes
+			UINT_8 RSVD_3_7[5];
+			UINT_64 ZCAP; // Zone Capacity
+			UINT_64 ZSLBA; // Zone Start LBA
+			UINT_64 WP; // Write Pointer
+			UINT_8 RSVD_32_63[32];
+		}ZONE_DESCRIPTOR, *PZONE_DESCRIPTOR;
+		static_assert(sizeof(ZONE_DESCRIPTOR) == 64, "ZONE_DESCRIPTOR should be 64 byte(s) in size.");
+
+		/// <summary>
+		/// End-to-end protection information in the first or last 8 bytes of a logical block's metadata. Every field is big endian.
+		/// </summary>
+		typedef struct PROTECTION_INFORMATION
+		{
+			UINT_8 Guard[2]; // CRC16 T10-DIF of the logical block data
+			UINT_8 ApplicationTag[2];
+			UINT_8 ReferenceTag[4];
+		}PROTECTION_INFORMATION, *PPROTECTION_INFORMATION;
+		static_assert(sizeof(PROTECTION_INFORMATION) == 8, "PROTECTION_INFORMATION should be 8 byte(s) in size.");
+
 	}
 }
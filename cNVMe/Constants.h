@@ -76,6 +76,11 @@ namespace cnvme
 				const UINT_8 RESERVATION_REPORT = 0x0E;
 				const UINT_8 RESERVATION_ACQUIRE = 0x11;
 				const UINT_8 RESERVATION_RELEASE = 0x15;
+
+				// Zoned Namespace Command Set
+				const UINT_8 ZONE_MANAGEMENT_SEND = 0x79;
+				const UINT_8 ZONE_MANAGEMENT_RECEIVE = 0x7A;
+				const UINT_8 ZONE_APPEND = 0x7D;
 			}
 		}
 
@@ -161,6 +166,16 @@ namespace cnvme
 					const UINT_8 CONFLICTING_ATTRIBUTES = 0x80;
 					const UINT_8 INVALID_PROTECTION_INFORMATION = 0x81;
 					const UINT_8 ATTEMPTED_WRITE_TO_READ_ONLY_RANGE = 0x82;
+
+					// Zoned Namespace Command Set Specific
+					const UINT_8 ZONE_BOUNDARY_ERROR = 0xB8;
+					const UINT_8 ZONE_IS_FULL = 0xB9;
+					const UINT_8 ZONE_IS_READ_ONLY = 0xBA;
+					const UINT_8 ZONE_IS_OFFLINE = 0xBB;
+					const UINT_8 ZONE_INVALID_WRITE = 0xBC;
+					const UINT_8 TOO_MANY_ACTIVE_ZONES = 0xBD;
+					const UINT_8 TOO_MANY_OPEN_ZONES = 0xBE;
+					const UINT_8 INVALID_ZONE_STATE_TRANSITION = 0xBF;
 				}
 
 				namespace integrity
@@ -188,6 +203,8 @@ namespace cnvme
 					const UINT_8 CONTROLLER = 0x01;
 					const UINT_8 NAMESPACES_ACTIVE = 0x02;
 					const UINT_8 NAMESPACE_DESCRIPTOR = 0x03;
+					const UINT_8 NAMESPACE_ACTIVE_COMMAND_SET_SPECIFIC = 0x05;
+					const UINT_8 CONTROLLER_COMMAND_SET_SPECIFIC = 0x06;
 					const UINT_8 NAMESPACES_ALL = 0x10;
 					const UINT_8 NAMESPACES_ALLOCATED = 0x11;
 					const UINT_8 CONTROLLERS_ATTACHED_TO_NAMESPACE = 0x12;
@@ -196,6 +213,12 @@ namespace cnvme
 					const UINT_8 SECONDARY_CONTROLLER_LIST = 0x15;
 				}
 
+				namespace csi
+				{
+					const UINT_8 NVM = 0x00;
+					const UINT_8 ZONED_NAMESPACE = 0x02;
+				}
+
 				namespace sizes
 				{
 					const UINT_32 IDENTIFY_SIZE = 4096;
@@ -204,16 +227,70 @@ namespace cnvme
 					const UINT_8 MAX_FW_SLOTS = 7;
 				}
 
+				namespace dlfeat
+				{
+					const UINT_8 NOT_REPORTED = 0b000;
+					const UINT_8 DEALLOCATED_READS_ZEROES = 0b001;
+					const UINT_8 DEALLOCATED_READS_ONES = 0b010;
+				}
+
+				namespace fuses
+				{
+					const UINT_16 COMPARE_AND_WRITE = 0x0001;
+				}
+
+				namespace vwc
+				{
+					const UINT_8 PRESENT = 0b001;
+					const UINT_8 FLUSH_ALL_NAMESPACES_SUPPORTED = 0b110; // Flush with NSID FFFFFFFFh flushes every namespace
+				}
+
+				namespace mc
+				{
+					const UINT_8 EXTENDED_LBA = 0b01;
+					const UINT_8 SEPARATE_BUFFER = 0b10;
+				}
+
+				namespace dpc
+				{
+					const UINT_8 TYPE_1 = 0b00001;
+					const UINT_8 TYPE_2 = 0b00010;
+					const UINT_8 TYPE_3 = 0b00100;
+					const UINT_8 FIRST_EIGHT_BYTES = 0b01000;
+					const UINT_8 LAST_EIGHT_BYTES = 0b10000;
+				}
+
+				namespace dps
+				{
+					const UINT_8 PI_TYPE_MASK = 0b0111;
+					const UINT_8 FIRST_EIGHT_BYTES = 0b1000;
+				}
+
 				namespace ns_identifiers
 				{
 					const UINT_32 IEEE_EXTENDED = 0x01;
 					const UINT_32 NGUID = 0x02;
 					const UINT_32 NAMESPACE_UUID = 0x03;
+					const UINT_32 COMMAND_SET_IDENTIFIER = 0x04;
 				}
 
+				namespace ozcs
+				{
+					const UINT_16 READ_ACROSS_ZONE_BOUNDARIES = 0b01;
+				}
+
+				const UINT_32 NO_ZONE_RESOURCE_LIMIT = 0xFFFFFFFF; // For MAR and MOR
+
 				const std::string EMPTY_NQN = "nqn.2014-08.org.nvmexpress:uuid:        -    -    -    -            ";
 			}
 
+			namespace fuse
+			{
+				const UINT_8 NORMAL_OPERATION = 0b00;
+				const UINT_8 FIRST_COMMAND = 0b01;
+				const UINT_8 SECOND_COMMAND = 0b10;
+			}
+
 			namespace fw_commit
 			{
 				namespace commit_action
@@ -237,6 +314,32 @@ namespace cnvme
 				}
 			}
 
+			namespace features
+			{
+				namespace fid
+				{
+					const UINT_8 POWER_MANAGEMENT = 0x02;
+					const UINT_8 VOLATILE_WRITE_CACHE = 0x06;
+					const UINT_8 AUTONOMOUS_POWER_STATE_TRANSITION = 0x0C;
+					const UINT_8 QOS_LIMITS = 0xC0; // Vendor specific: IOPS and bandwidth limits for a namespace or submission queue
+				}
+
+				namespace sel
+				{
+					const UINT_8 CURRENT = 0b000;
+					const UINT_8 DEFAULT = 0b001;
+					const UINT_8 SAVED = 0b010;
+					const UINT_8 SUPPORTED_CAPABILITIES = 0b011;
+				}
+
+				namespace capabilities
+				{
+					const UINT_32 SAVEABLE = 0b001;
+					const UINT_32 NAMESPACE_SPECIFIC = 0b010;
+					const UINT_32 CHANGEABLE = 0b100;
+				}
+			}
+
 			namespace format
 			{
 				namespace ses
@@ -245,17 +348,126 @@ namespace cnvme
 					const UINT_32 USER_DATA_ERASE = 0b001;
 					const UINT_32 CRYPTOGRAPHIC_ERASE = 0b010;
 				}
+
+				namespace pi
+				{
+					const UINT_32 DISABLED = 0b000;
+					const UINT_32 TYPE_1 = 0b001;
+					const UINT_32 TYPE_2 = 0b010;
+					const UINT_32 TYPE_3 = 0b011;
+				}
+			}
+
+			namespace io
+			{
+				namespace prinfo
+				{
+					const UINT_8 PRACT = 0b1000; // Protection Information Action: the controller inserts/strips the protection information
+					const UINT_8 CHECK_GUARD = 0b0100;
+					const UINT_8 CHECK_APPLICATION_TAG = 0b0010;
+					const UINT_8 CHECK_REFERENCE_TAG = 0b0001;
+				}
+
+				namespace tags
+				{
+					const UINT_16 ESCAPE_APPLICATION_TAG = 0xFFFF;
+					const UINT_32 ESCAPE_REFERENCE_TAG = 0xFFFFFFFF;
+				}
+			}
+
+			namespace ns_management
+			{
+				namespace sel
+				{
+					const UINT_8 CREATE_NAMESPACE = 0x0;
+					const UINT_8 DELETE_NAMESPACE = 0x1;
+				}
+			}
+
+			namespace zones
+			{
+				namespace zsa // Zone Send Action
+				{
+					const UINT_8 CLOSE_ZONE = 0x01;
+					const UINT_8 FINISH_ZONE = 0x02;
+					const UINT_8 OPEN_ZONE = 0x03;
+					const UINT_8 RESET_ZONE = 0x04;
+					const UINT_8 OFFLINE_ZONE = 0x05;
+					const UINT_8 SET_ZONE_DESCRIPTOR_EXTENSION = 0x10;
+				}
+
+				namespace zra // Zone Receive Action
+				{
+					const UINT_8 REPORT_ZONES = 0x00;
+					const UINT_8 EXTENDED_REPORT_ZONES = 0x01;
+				}
+
+				namespace zrasf // Zone Receive Action Specific Field (which zones to report)
+				{
+					const UINT_8 ALL_ZONES = 0x00;
+					const UINT_8 EMPTY = 0x01;
+					const UINT_8 IMPLICITLY_OPENED = 0x02;
+					const UINT_8 EXPLICITLY_OPENED = 0x03;
+					const UINT_8 CLOSED = 0x04;
+					const UINT_8 FULL = 0x05;
+					const UINT_8 READ_ONLY = 0x06;
+					const UINT_8 OFFLINE = 0x07;
+				}
+
+				namespace zs // Zone State
+				{
+					const UINT_8 EMPTY = 0x1;
+					const UINT_8 IMPLICITLY_OPENED = 0x2;
+					const UINT_8 EXPLICITLY_OPENED = 0x3;
+					const UINT_8 CLOSED = 0x4;
+					const UINT_8 READ_ONLY = 0xD;
+					const UINT_8 FULL = 0xE;
+					const UINT_8 OFFLINE = 0xF;
+				}
+
+				namespace zt // Zone Type
+				{
+					const UINT_8 SEQUENTIAL_WRITE_REQUIRED = 0x2;
+				}
 			}
 
 			namespace ns_attachment
 			{
+				namespace sel
+				{
+					const UINT_8 ATTACH_CONTROLLERS = 0x0;
+					const UINT_8 DETACH_CONTROLLERS = 0x1;
+				}
+
 				namespace sizes
 				{
-					const UINT_32 CONTROLLER_LIST_SIZE = 1024;
+					const UINT_32 CONTROLLER_LIST_SIZE = 4096; // Up to 2047 controller identifiers after the count
 				}
 			}
 		}
 	
+		namespace image
+		{
+			const std::string MAGIC = "cNVMeImg";
+			const UINT_32 VERSION = 2; // 2 added zones to namespaces
+
+			namespace types
+			{
+				const UINT_32 NAMESPACE_IMAGE = 0;
+				const UINT_32 CONTROLLER_IMAGE = 1;
+			}
+		}
+
+		namespace ftl
+		{
+			namespace gc_policy // How garbage collection picks the block to collect next
+			{
+				const UINT_32 GREEDY = 0; // Fewest valid pages
+				const UINT_32 FIFO = 1; // Oldest data
+				const UINT_32 COST_BENEFIT = 2; // Most space gained per page moved, weighted by the age of the data
+			}
+		}
+
 		namespace crapi
 		{
 			const UINT_8 CRAPI_HANDLED = 0;
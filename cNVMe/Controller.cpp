@@ -25,12 +25,10 @@ Controller.cpp - An implementation file for the NVMe Controller
 
 #define NVME_CALLER_IMPLEMENTATION(commandName) void Controller::commandName(NVME_COMMAND& command, COMPLETION_QUEUE_ENTRY& completionQueueEntryToPost)
 
-#define ALL_NAMESPACES 0xFFFFFFFF
-#define DEFAULT_NAMESPACE_SIZE 16384 // 16 kilobytes
-
 #include "Command.h"
 #include "Constants.h"
 #include "Controller.h"
+#include "Memory.h"
 #include "PRP.h"
 #include "Strings.h"
 #include "System.h"
@@ -39,7 +37,11 @@ namespace cnvme
 {
 	namespace controller
 	{
-		Controller::Controller()
+		Controller::Controller() : Controller(DEFAULT_DOORBELL_STRIDE)
+		{
+		}
+
+		Controller::Controller(UINT_8 doorbellStride) : IoWorkers(IO_WORKER_THREADS), CompletionTimers(std::chrono::microseconds(COMPLETION_TIMER_TICK_US), COMPLETION_TIMER_SLOTS)
 		{
 			this->CommandResponseApiFilePath = "";
 
@@ -50,18 +52,24 @@ namespace cnvme
 			UINT_64 BAR0Address = (UINT_64)PciHeader->MLBAR.BA + ((UINT_64)PciHeader->MUBAR.BA << 18);
 			ControllerRegisters = new controller::registers::ControllerRegisters(BAR0Address, this); // Put the controller registers in BAR0/BAR1
 			ControllerRegisters->waitForChangeLoop();
+			ASSERT_IF(!ControllerRegisters->setDoorbellStride(doorbellStride), "Unable to set the doorbell stride to " + std::to_string(doorbellStride));
+
+			this->NextCompletionTimerDeadline = std::chrono::steady_clock::time_point::max();
+			this->StopCompletionTimerThread = false;
 
 #ifndef SINGLE_THREADED
 			DoorbellWatcher = LoopingThread([&] {Controller::checkForChanges(); }, CHANGE_CHECK_SLEEP_MS);
 			DoorbellWatcher.start();
+			CompletionTimerThread = std::thread(&Controller::runCompletionTimers, this);
 #endif
 
 			// Setup the IC with default values.
 			memset(&this->IdentifyController, 0, sizeof(this->IdentifyController));
 			resetIdentifyController();
+			this->VolatileWriteCacheEnabled = false;
 
 			// Create default namespace
-			this->NamespaceIdToActiveNamespace[1] = ns::Namespace(DEFAULT_NAMESPACE_SIZE);
+			this->NamespaceIdToActiveNamespace[1] = std::make_shared<ns::Namespace>(DEFAULT_NAMESPACE_SIZE);
 
 			// Setup firmware slot info
 			this->FirmwareSlotInfo = { 0 };
@@ -73,6 +81,16 @@ namespace cnvme
 		Controller::~Controller()
 		{
 			DoorbellWatcher.end();
+			if (CompletionTimerThread.joinable())
+			{
+				{
+					std::unique_lock<std::mutex> lock(this->CompletionTimerMutex);
+					this->StopCompletionTimerThread = true;
+				}
+				this->CompletionTimerCondition.notify_one();
+				CompletionTimerThread.join();
+			}
+			waitForDeferredCompletions(); // Nothing may still be writing to host memory
 
 			// Delete Controller Registers first, because deleting the PCI registers first could lead to the ControllerRegisters loop segfaulting
 			if (ControllerRegisters)
@@ -96,6 +114,11 @@ namespace cnvme
 			{
 				delete q;
 			}
+
+			// Namespace media frees its data in the background. Let that finish so all of it is given back once we are gone.
+			this->NamespaceIdToActiveNamespace.clear();
+			this->NamespaceIdToInactiveNamespace.clear();
+			ns::Media::waitForBackgroundReclamation();
 		}
 
 		cnvme::controller::registers::ControllerRegisters* Controller::getControllerRegisters()
@@ -110,11 +133,10 @@ namespace cnvme
 
 		void Controller::checkForChanges()
 		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // A controller reset can come in from the register watcher
 			auto controllerRegisters = ControllerRegisters->getControllerRegisters();
-			// Admin doorbell is right after the Controller Registers... though we may not have it yet
-			controller::registers::QUEUE_DOORBELLS* doorbells = getControllerRegisters()->getQueueDoorbells();
 
-			if (controllerRegisters->CSTS.RDY == 0)
+			if (!registers::isControllerReady(controllerRegisters))
 			{
 				return; // Not ready... Don't do anything.
 			}
@@ -127,7 +149,7 @@ namespace cnvme
 			// Now that we have a SQ address, make it valid
 			if (ValidSubmissionQueues.size() == 0)
 			{
-				ValidSubmissionQueues.push_back(new Queue(controllerRegisters->AQA.ASQS + 1, ADMIN_QUEUE_ID, &doorbells[ADMIN_QUEUE_ID].SQTDBL.SQT, controllerRegisters->ASQ.ASQB));
+				ValidSubmissionQueues.push_back(new Queue(controllerRegisters->AQA.ASQS + 1, ADMIN_QUEUE_ID, ControllerRegisters->getSubmissionQueueTailDoorbell(ADMIN_QUEUE_ID), controllerRegisters->ASQ.ASQB));
 			}
 			else
 			{
@@ -145,7 +167,7 @@ namespace cnvme
 			// Now that we have a CQ address, make it valid
 			if (ValidCompletionQueues.size() == 0)
 			{
-				Queue* AdminCompletionQueue = new Queue(controllerRegisters->AQA.ACQS + 1, ADMIN_QUEUE_ID, &doorbells[ADMIN_QUEUE_ID].CQHDBL.CQH, controllerRegisters->ACQ.ACQB);
+				Queue* AdminCompletionQueue = new Queue(controllerRegisters->AQA.ACQS + 1, ADMIN_QUEUE_ID, ControllerRegisters->getCompletionQueueHeadDoorbell(ADMIN_QUEUE_ID), controllerRegisters->ACQ.ACQB);
 				AdminCompletionQueue->setMappedQueue(ValidSubmissionQueues[ADMIN_QUEUE_ID]); // Map CQ -> SQ
 				ValidCompletionQueues.push_back(AdminCompletionQueue);
 
@@ -162,29 +184,48 @@ namespace cnvme
 			}
 
 			// Made it this far, we have at least the admin queue
+			this->CompletionTimers.advance(std::chrono::steady_clock::now());
+			postFinishedDeferredCompletions();
+
 			// This is round-robin right now
 			size_t currentValidSubmissionQueuesSize = this->ValidSubmissionQueues.size();
 			for (size_t idx = 0; idx < currentValidSubmissionQueuesSize; idx++)
 			{
 				// Using this instead of foreach since the ValidSubmission/Completion Queues can change at runtime.
 				auto sq = this->ValidSubmissionQueues[idx];
+				UINT_16 submissionQueueTail = sq->readDoorbell(); // Acquire: makes the entries before the tail visible
 
-				if (doorbells[sq->getQueueId()].SQTDBL.SQT != sq->getTailPointer())
+				if (submissionQueueTail != sq->getTailPointer() || sq->getHeadPointer() != sq->getTailPointer())
 				{
-					if (!sq->setTailPointer(doorbells[sq->getQueueId()].SQTDBL.SQT)) // Set our internal Queue instance's tail
+					if (!sq->setTailPointer(submissionQueueTail)) // Set our internal Queue instance's tail
 					{
 						LOG_ERROR("Should trigger AER since the Tail pointer given was invalid"); // Stop early.
 						continue;
 					}
-					else
-					{
-						sq->getMappedQueue()->setTailPointer(sq->getTailPointer());  // Set in internal CQ as well
-					}
 
+					Queue* cq = sq->getMappedQueue();
 					while (sq->getHeadPointer() != sq->getTailPointer())
 					{
+						// The host gives completion queue entries back by moving the head doorbell.
+						//  If there is no room for a completion, leave the command in the submission queue for now.
+						if (!cq->setHeadPointer(cq->readDoorbell()))
+						{
+							LOG_ERROR("Should trigger AER since the completion queue head pointer given was invalid");
+							break;
+						}
+
+						if (cq->isFull())
+						{
+							break;
+						}
+
+						// Over its QoS limits: the command (and everything behind it in this queue) waits for a later pass
+						if (sq->getQueueId() != ADMIN_QUEUE_ID && !this->admitCommand(*sq))
+						{
+							break;
+						}
+
 						processCommandAndPostCompletion(*sq);
-						sq->incrementAndGetHeadCloserToTail();
 					}
 
 					// If the number of queues changed... maybe one got deleted or lost?
@@ -251,7 +292,11 @@ namespace cnvme
 					// AdminCommandCallers goes from OpCode to Function to call. 
 					//  All functions to call must have the same parameters and return value (no return since they are voids)
 					auto itr = this->NVMCommandCallers.find(command->DWord0Breakdown.OPC);
-					if (itr != this->NVMCommandCallers.end())
+					if (command->DWord0Breakdown.FUSE != constants::commands::fuse::NORMAL_OPERATION)
+					{
+						this->processFusedCommands(submissionQueue, *command, completionQueueEntryToPost);
+					}
+					else if (itr != this->NVMCommandCallers.end())
 					{
 						NVMeCaller caller = itr->second;
 						(this->*caller)(*command, completionQueueEntryToPost);
@@ -265,9 +310,379 @@ namespace cnvme
 					}
 				}
 			}
+
+			// The device may take longer than we did. (Look at the command before the host can reuse the entry.)
+			MODELED_COMMAND modeledCommand = this->startModeledCommand(submissionQueue.getQueueId(), *command);
+
+			// The controller is done with this entry. SQHD in the completion lets the host reuse it.
+			submissionQueue.incrementAndGetHeadCloserToTail();
+
+			if (this->DeferredWork)
+			{
+				// The handler will finish on an I/O worker. Keep a copy of the command since the host can reuse its slot now.
+				std::function<COMPLETION_QUEUE_ENTRY()> work = this->DeferredWork;
+				this->DeferredWork = nullptr;
+				NVME_COMMAND commandCopy = *command;
+				UINT_16 submissionQueueId = submissionQueue.getQueueId();
+
+				// Time it once the work is done, so garbage collection its writes caused is charged to it
+				IoWorkers.submit([this, work, commandCopy, submissionQueueId, modeledCommand]() mutable {
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = work();
+					this->addTimedCompletion(submissionQueueId, commandCopy, completionQueueEntry, this->finishModeledCommand(modeledCommand));
+				});
+				return;
+			}
+
+			std::chrono::steady_clock::time_point completionTime = this->finishModeledCommand(modeledCommand);
+
+			if (completionTime > std::chrono::steady_clock::now())
+			{
+				this->addTimedCompletion(submissionQueue.getQueueId(), *command, completionQueueEntryToPost, completionTime);
+				return;
+			}
+
 			postCompletion(*theCompletionQueue, completionQueueEntryToPost, command);
 		}
 
+		void Controller::processFusedCommands(Queue &submissionQueue, NVME_COMMAND &firstCommand, COMPLETION_QUEUE_ENTRY &completionQueueEntryToPost)
+		{
+			if (firstCommand.DWord0Breakdown.FUSE != constants::commands::fuse::FIRST_COMMAND)
+			{
+				// A second command without a first one right before it (or the reserved value)
+				LOG_ERROR("Got a fused command (FUSE: " + std::to_string(firstCommand.DWord0Breakdown.FUSE) + ") without the first command before it");
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::COMMAND_ABORTED_DUE_TO_MISSING_FUSED_COMMAND;
+				return;
+			}
+
+			// The second command has to be the very next entry, already behind the tail. The host should ring the doorbell once for both.
+			UINT_32 secondIndex = (submissionQueue.getHeadPointer() + 1) % submissionQueue.getQueueSize();
+			NVME_COMMAND* pSecondCommand = (NVME_COMMAND*)submissionQueue.getMemoryAddress() + secondIndex;
+			if (secondIndex == submissionQueue.getTailPointer() || pSecondCommand->DWord0Breakdown.FUSE != constants::commands::fuse::SECOND_COMMAND)
+			{
+				LOG_ERROR("The first command of a fused operation wasn't followed by the second one");
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::COMMAND_ABORTED_DUE_TO_MISSING_FUSED_COMMAND;
+				return;
+			}
+
+			// The second command is ours now. processCommandAndPostCompletion() moves the head past it.
+			submissionQueue.incrementAndGetHeadCloserToTail();
+			NVME_COMMAND secondCommand = *pSecondCommand;
+			UINT_16 submissionQueueId = submissionQueue.getQueueId();
+			COMPLETION_QUEUE_ENTRY secondCompletionQueueEntry = { 0 };
+
+			if (!isValidCommandIdentifier(secondCommand.DWord0Breakdown.CID, submissionQueueId))
+			{
+				secondCompletionQueueEntry.DNR = 1;
+				secondCompletionQueueEntry.SC = constants::status::codes::generic::COMMAND_ID_CONFLICT;
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::COMMAND_ABORTED_DUE_TO_MISSING_FUSED_COMMAND;
+				this->addFinishedDeferredCompletion(submissionQueueId, secondCommand, secondCompletionQueueEntry);
+				return;
+			}
+
+			// Compare and Write is the only fused operation
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(firstCommand.NSID);
+			if (firstCommand.DWord0Breakdown.OPC != constants::opcodes::nvm::COMPARE || secondCommand.DWord0Breakdown.OPC != constants::opcodes::nvm::WRITE)
+			{
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+			}
+			else if (firstCommand.NSID != secondCommand.NSID || namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+			}
+			else if (!firstCommand.DPTR.DPTR1 || !secondCommand.DPTR.DPTR1)
+			{
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+			}
+			else if (namespacePair->second->isZoned())
+			{
+				// The write would have to land on the write pointer after the compare passed. Zone Append is for this.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+			}
+
+			if (completionQueueEntryToPost.SC)
+			{
+				// Neither half happens
+				completionQueueEntryToPost.DNR = 1;
+				secondCompletionQueueEntry = completionQueueEntryToPost;
+				this->addFinishedDeferredCompletion(submissionQueueId, secondCommand, secondCompletionQueueEntry);
+				return;
+			}
+
+			std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the compare and write is done
+			UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+			NVME_COMMAND compareCommand = firstCommand;
+			auto doCompareAndWrite = [this, theNamespace, compareCommand, secondCommand, submissionQueueId, memoryPageSize]() {
+				COMPLETION_QUEUE_ENTRY writeCompletionQueueEntry = { 0 };
+				COMPLETION_QUEUE_ENTRY compareCompletionQueueEntry = theNamespace->compareAndWrite(compareCommand, secondCommand, memoryPageSize, writeCompletionQueueEntry);
+				this->addFinishedDeferredCompletion(submissionQueueId, secondCommand, writeCompletionQueueEntry);
+				return compareCompletionQueueEntry;
+			};
+
+			if (theNamespace->isAsynchronous())
+			{
+				this->deferLbaRangeCompletion(*theNamespace, compareCommand.SLBA, ONE_BASED_FROM_ZERO_BASED(compareCommand.DW12_IO.NLB), true, doCompareAndWrite);
+			}
+			else
+			{
+				completionQueueEntryToPost = doCompareAndWrite();
+			}
+		}
+
+		void Controller::deferCompletion(std::function<COMPLETION_QUEUE_ENTRY()> work)
+		{
+			ASSERT_IF(this->DeferredWork != nullptr, "Only one completion can be deferred per command");
+			this->DeferredWork = work;
+		}
+
+		void Controller::deferLbaRangeCompletion(ns::Namespace &theNamespace, UINT_64 firstLba, UINT_64 numberOfLbas, bool exclusive, std::function<COMPLETION_QUEUE_ENTRY()> work)
+		{
+			std::shared_ptr<ns::LbaRangeLock::Range> lbaRange = theNamespace.reserveLbaRange(firstLba, numberOfLbas, exclusive);
+			this->deferCompletion([lbaRange, work]() {
+				std::lock_guard<ns::LbaRangeLock::Range> lock(*lbaRange);
+				return work();
+			});
+		}
+
+		void Controller::addFinishedDeferredCompletion(UINT_16 submissionQueueId, const NVME_COMMAND &command, COMPLETION_QUEUE_ENTRY completionQueueEntry)
+		{
+			DEFERRED_COMPLETION deferredCompletion = { submissionQueueId, command, completionQueueEntry };
+
+			std::unique_lock<std::mutex> lock(this->FinishedDeferredCompletionsMutex);
+			this->FinishedDeferredCompletions.push_back(deferredCompletion);
+		}
+
+		void Controller::addTimedCompletion(UINT_16 submissionQueueId, const NVME_COMMAND &command, COMPLETION_QUEUE_ENTRY completionQueueEntry, std::chrono::steady_clock::time_point completionTime)
+		{
+			if (completionTime <= std::chrono::steady_clock::now())
+			{
+				this->addFinishedDeferredCompletion(submissionQueueId, command, completionQueueEntry);
+				return;
+			}
+
+			NVME_COMMAND commandCopy = command;
+			this->CompletionTimers.schedule(completionTime, [this, submissionQueueId, commandCopy, completionQueueEntry]() {
+				this->addFinishedDeferredCompletion(submissionQueueId, commandCopy, completionQueueEntry);
+			});
+
+			// Wake the timer thread up sooner if this is due before what it is waiting for
+			std::unique_lock<std::mutex> lock(this->CompletionTimerMutex);
+			if (completionTime < this->NextCompletionTimerDeadline)
+			{
+				this->NextCompletionTimerDeadline = completionTime;
+				this->CompletionTimerCondition.notify_one();
+			}
+		}
+
+		void Controller::runCompletionTimers()
+		{
+			std::unique_lock<std::mutex> lock(this->CompletionTimerMutex);
+			while (!this->StopCompletionTimerThread)
+			{
+				if (this->NextCompletionTimerDeadline == std::chrono::steady_clock::time_point::max())
+				{
+					this->CompletionTimerCondition.wait(lock);
+				}
+				else
+				{
+					this->CompletionTimerCondition.wait_until(lock, this->NextCompletionTimerDeadline);
+				}
+
+				if (this->StopCompletionTimerThread || std::chrono::steady_clock::now() < this->NextCompletionTimerDeadline)
+				{
+					continue; // Woken up early, or for an earlier deadline
+				}
+
+				// The doorbell watcher takes QueueMutex and then CompletionTimerMutex (in addTimedCompletion()), so never hold both the other way
+				lock.unlock();
+				{
+					// Until the doorbell watcher has the queues set up, what comes due waits for it to post
+					std::unique_lock<std::mutex> queueLock(this->QueueMutex);
+					if (this->CompletionTimers.advance(std::chrono::steady_clock::now()) != 0 &&
+						registers::isControllerReady(ControllerRegisters->getControllerRegisters()) && !this->ValidCompletionQueues.empty())
+					{
+						this->postFinishedDeferredCompletions();
+					}
+				}
+				lock.lock();
+
+				// Anything scheduled since then is either in here already, or lowers the deadline after this
+				this->NextCompletionTimerDeadline = this->CompletionTimers.getNextDeadline();
+			}
+		}
+
+		MODELED_COMMAND Controller::startModeledCommand(UINT_16 submissionQueueId, const NVME_COMMAND &command)
+		{
+			MODELED_COMMAND modeledCommand;
+			modeledCommand.TimedCommand = { 0 };
+			modeledCommand.TimedCommand.Admin = submissionQueueId == ADMIN_QUEUE_ID;
+			modeledCommand.TimedCommand.Opcode = command.DWord0Breakdown.OPC;
+			modeledCommand.Model = this->CompletionTimingModel;
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (!modeledCommand.TimedCommand.Admin && namespacePair != this->NamespaceIdToActiveNamespace.end())
+			{
+				modeledCommand.Ftl = namespacePair->second->getFtl();
+			}
+
+			// I/O waits for the device to wake up, and runs slower in lower power states, with or without a timing model
+			auto now = std::chrono::steady_clock::now();
+			modeledCommand.StartTime = modeledCommand.TimedCommand.Admin ? now : this->PowerStates.wake(now);
+
+			// Only commands that move namespace data to or from the media spend time on the dies and channels
+			modeledCommand.TimedCommand.ByteCount = modeledCommand.Model ? this->getMediaTransferSizeBytes(submissionQueueId, command) : 0;
+			if (modeledCommand.TimedCommand.ByteCount)
+			{
+				modeledCommand.TimedCommand.ByteOffset = command.SLBA * namespacePair->second->getSectorSize();
+			}
+			return modeledCommand;
+		}
+
+		std::chrono::steady_clock::time_point Controller::finishModeledCommand(MODELED_COMMAND &modeledCommand)
+		{
+			TIMED_COMMAND &timedCommand = modeledCommand.TimedCommand;
+
+			// Garbage collection since the namespace's last command goes along with this one. Without a model it is just dropped.
+			if (modeledCommand.Ftl)
+			{
+				ns::FTL_WORK backgroundWork = modeledCommand.Ftl->takeBackgroundWork();
+				timedCommand.RelocatedBytes = backgroundWork.RelocatedBytes;
+				timedCommand.ErasedBlocks = backgroundWork.BlocksErased;
+			}
+
+			if (!modeledCommand.Model)
+			{
+				return timedCommand.Admin ? std::chrono::steady_clock::time_point() : this->PowerStates.finish(modeledCommand.StartTime, modeledCommand.StartTime);
+			}
+
+			std::chrono::steady_clock::time_point completionTime = modeledCommand.Model->getCompletionTime(timedCommand, modeledCommand.StartTime);
+			return timedCommand.Admin ? completionTime : this->PowerStates.finish(modeledCommand.StartTime, completionTime);
+		}
+
+		UINT_64 Controller::getMediaTransferSizeBytes(UINT_16 submissionQueueId, const NVME_COMMAND &command)
+		{
+			UINT_8 opcode = command.DWord0Breakdown.OPC;
+			if (submissionQueueId == ADMIN_QUEUE_ID || (opcode != constants::opcodes::nvm::READ && opcode != constants::opcodes::nvm::WRITE &&
+				opcode != constants::opcodes::nvm::COMPARE && opcode != constants::opcodes::nvm::ZONE_APPEND))
+			{
+				return 0;
+			}
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				return 0;
+			}
+
+			return command.getTransferSizeBytes(false, namespacePair->second->getSectorSize());
+		}
+
+		bool Controller::admitCommand(Queue &submissionQueue)
+		{
+			if (this->SubmissionQueueIdToQosLimiter.empty() && this->NamespaceIdToQosLimiter.empty())
+			{
+				return true;
+			}
+
+			NVME_COMMAND* command = (NVME_COMMAND*)submissionQueue.getMemoryAddress();
+			command += submissionQueue.getHeadPointer();
+
+			std::vector<QOS_LIMITER*> qosLimiters;
+			auto queueLimiter = this->SubmissionQueueIdToQosLimiter.find(submissionQueue.getQueueId());
+			if (queueLimiter != this->SubmissionQueueIdToQosLimiter.end())
+			{
+				qosLimiters.push_back(&queueLimiter->second);
+			}
+
+			auto namespaceLimiter = this->NamespaceIdToQosLimiter.find(command->NSID);
+			if (namespaceLimiter != this->NamespaceIdToQosLimiter.end())
+			{
+				qosLimiters.push_back(&namespaceLimiter->second);
+			}
+
+			// Only charge once every limit has room, so a command that waits doesn't use up anything
+			auto now = std::chrono::steady_clock::now();
+			UINT_64 numberOfBytes = this->getMediaTransferSizeBytes(submissionQueue.getQueueId(), *command);
+			for (auto qosLimiter : qosLimiters)
+			{
+				if (!qosLimiter->Commands.hasTokens(now) || (numberOfBytes && !qosLimiter->Bytes.hasTokens(now)))
+				{
+					return false;
+				}
+			}
+
+			for (auto qosLimiter : qosLimiters)
+			{
+				qosLimiter->Commands.consume(1);
+				qosLimiter->Bytes.consume(numberOfBytes);
+			}
+
+			return true;
+		}
+
+		std::map<UINT_32, QOS_LIMITER>* Controller::getQosLimiterMap(const NVME_COMMAND &command, COMPLETION_QUEUE_ENTRY &completionQueueEntryToPost)
+		{
+			if (command.DW11_QosLimits.SQ)
+			{
+				if (command.DW11_QosLimits.SQID != ADMIN_QUEUE_ID && getQueueWithId(this->ValidSubmissionQueues, command.DW11_QosLimits.SQID))
+				{
+					return &this->SubmissionQueueIdToQosLimiter;
+				}
+
+				LOG_ERROR("QoS limits are only for I/O submission queues. SQ " + std::to_string(command.DW11_QosLimits.SQID) + " isn't one.");
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return nullptr;
+			}
+
+			if (this->NamespaceIdToActiveNamespace.find(command.NSID) != this->NamespaceIdToActiveNamespace.end())
+			{
+				return &this->NamespaceIdToQosLimiter;
+			}
+
+			LOG_ERROR("QoS limits are only for active namespaces. NSID " + std::to_string(command.NSID) + " isn't one.");
+			completionQueueEntryToPost.DNR = 1;
+			completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+			completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+			return nullptr;
+		}
+
+		void Controller::postFinishedDeferredCompletions()
+		{
+			std::unique_lock<std::mutex> lock(this->FinishedDeferredCompletionsMutex);
+
+			auto itr = this->FinishedDeferredCompletions.begin();
+			while (itr != this->FinishedDeferredCompletions.end())
+			{
+				Queue* submissionQueue = getQueueWithId(this->ValidSubmissionQueues, itr->SubmissionQueueId);
+				Queue* completionQueue = submissionQueue ? submissionQueue->getMappedQueue() : nullptr;
+				if (!completionQueue)
+				{
+					LOG_ERROR("Dropping a deferred completion for CID " + std::to_string(itr->Command.DWord0Breakdown.CID) + " since SQ " + std::to_string(itr->SubmissionQueueId) + " is gone");
+					itr = this->FinishedDeferredCompletions.erase(itr);
+					continue;
+				}
+
+				// Same as for any other command, only post if the host has left room.
+				if (!completionQueue->setHeadPointer(completionQueue->readDoorbell()) || completionQueue->isFull())
+				{
+					itr++;
+					continue;
+				}
+
+				postCompletion(*completionQueue, itr->CompletionQueueEntry, &itr->Command);
+				itr = this->FinishedDeferredCompletions.erase(itr);
+			}
+		}
+
+		void Controller::waitForDeferredCompletions()
+		{
+			IoWorkers.waitForIdle();
+		}
+
 		Queue* Controller::getQueueWithId(std::vector<Queue*> &queues, UINT_16 id)
 		{
 			for (size_t i = 0; i < queues.size(); i++)
@@ -284,12 +699,9 @@ namespace cnvme
 
 		void Controller::postCompletion(Queue &completionQueue, COMPLETION_QUEUE_ENTRY completionEntry, NVME_COMMAND* command)
 		{
-			COMPLETION_QUEUE_ENTRY* completionQueueList = (COMPLETION_QUEUE_ENTRY*)MEMORY_ADDRESS_TO_8POINTER(completionQueue.getMemoryAddress());
-			ASSERT_IF(completionQueueList == nullptr, "completionQueueList cannot be NULL");
-			LOG_INFO("About to post completion to queue " + std::to_string(completionQueue.getQueueId()) + ". Head (just before moving): " +
-				std::to_string(completionQueue.getHeadPointer()) + ". Tail: " + std::to_string(completionQueue.getTailPointer()));
-
-			completionQueueList += completionQueue.getHeadPointer(); // Move pointer to correct index
+			ASSERT_IF(completionQueue.getMemoryAddress() == 0, "completionQueueList cannot be NULL");
+			LOG_INFO("About to post completion to queue " + std::to_string(completionQueue.getQueueId()) + ". Head: " +
+				std::to_string(completionQueue.getHeadPointer()) + ". Tail (just before moving): " + std::to_string(completionQueue.getTailPointer()));
 
 			Queue* submissionQueue = completionQueue.getMappedQueue();
 			ASSERT_IF(!submissionQueue, "Submission queue is NULL!");
@@ -298,38 +710,10 @@ namespace cnvme
 			completionEntry.SQHD = submissionQueue->getHeadPointer();
 			completionEntry.CID = command->DWord0Breakdown.CID;
 
-			bool phaseTag = false;
-			auto node = QueueToPhaseTag.find(submissionQueue->getQueueId());
-			if (node == QueueToPhaseTag.end())
-			{
-				QueueToPhaseTag[submissionQueue->getQueueId()] = false;    // start at false if not there... though it will flip to true below
-			}
-			else
-			{
-				phaseTag = QueueToPhaseTag[submissionQueue->getQueueId()]; // use existing
-			}
-
-			if (completionQueue.getHeadPointer() == 0) // need to flip
-			{
-				bool oldPhaseTag = QueueToPhaseTag[submissionQueue->getQueueId()];
-				QueueToPhaseTag[submissionQueue->getQueueId()] = !oldPhaseTag;
-				LOG_INFO("Inverting Phase Tag. Now Phase Tag == " + strings::toString(!oldPhaseTag));
-			}
-			phaseTag = QueueToPhaseTag[submissionQueue->getQueueId()]; // should be ready to be used (and flipped if needed).
-
-			completionEntry.P = (UINT_16)phaseTag;
-
-			UINT_32 completionQueueMemorySize = completionQueue.getQueueMemorySize();
-			completionQueueMemorySize -= (completionQueue.getHeadPointer() * sizeof(COMPLETION_QUEUE_ENTRY)); // calculate new remaining memory size
-			ASSERT_IF(completionQueueMemorySize < sizeof(COMPLETION_QUEUE_ENTRY), "completionQueueMemorySize must be greater than a single completion queue entry");
-			memcpy_s(completionQueueList, completionQueueMemorySize, &completionEntry, sizeof(completionEntry)); // Post
+			// Post. This fills in the phase tag and publishes the entry.
+			bool posted = completionQueue.postCompletionQueueEntry(completionEntry);
+			ASSERT_IF(!posted, "The completion queue was full. We should have checked for room before processing the command.");
 			LOG_INFO(completionEntry.toString());
-
-			completionQueue.incrementAndGetHeadCloserToTail(); // Move up CQ head
-
-			// ring doorbell after placing data in completion queue.
-			UINT_16* dbell = completionQueue.getDoorbell();
-			dbell[0] = completionQueue.getHeadPointer();
 		}
 
 		bool Controller::isValidCommandIdentifier(UINT_16 commandId, UINT_16 submissionQueueId)
@@ -393,8 +777,8 @@ namespace cnvme
 			this->IdentifyController.MaxCompletionQueueEntrySize = DEFAULT_COMPLETION_QUEUE_ENTRY_SIZE;
 			this->IdentifyController.RequiredCompletionQueueEntrySize = DEFAULT_COMPLETION_QUEUE_ENTRY_SIZE;
 
-			// Queues can process one command at a time right now. (Which is funny because it makes a lot of queue functionality useless)
-			this->IdentifyController.MAXCMD = 1; 
+			// Commands from a queue run at once under LBA range locks. What limits them is each needing its own command identifier.
+			this->IdentifyController.MAXCMD = MAX_COMMAND_IDENTIFIER;
 
 			this->IdentifyController.NN = DEFAULT_MAX_NAMESPACES;
 			this->IdentifyController.AVSCC = 1; // All VU commands must have DW10 be the NUMD
@@ -409,18 +793,37 @@ namespace cnvme
 			// Optional Commands Supported
 			this->IdentifyController.FormatNVMSupported = true;
 			this->IdentifyController.FirmwareDownloadAndCommitSupported = true;
+			this->IdentifyController.NamespaceCommandsSupported = true;
+			this->IdentifyController.CompareSupported = true;
+			this->IdentifyController.FUSES = constants::commands::identify::fuses::COMPARE_AND_WRITE;
+			this->IdentifyController.DatasetManagementSupported = true;
+			this->IdentifyController.WriteZeroesSupported = true;
+
+			// Namespaces on persistent media can have a write cache in front of them (see adminSetFeatures)
+			this->IdentifyController.VWC = constants::commands::identify::vwc::PRESENT | constants::commands::identify::vwc::FLUSH_ALL_NAMESPACES_SUPPORTED;
 
 			// Optional Features Supported
 			this->IdentifyController.FirmwareActivationWithoutResetSupported = true;
 			this->IdentifyController.NumberOfFirmwareSlots = constants::commands::identify::sizes::MAX_FW_SLOTS; // Support 7 FW slots
 
-			// Also I'm not setting the power state to anything. It lets us get away with all 0s for not reported. Wow.
+			// Power states (see PowerStateModel). NPSS is 0-based.
+			for (UINT_8 i = 0; i < NUMBER_OF_POWER_STATES; i++)
+			{
+				this->IdentifyController.PSD[i] = PowerStateModel::getPowerStateDescriptor(i);
+			}
+			this->IdentifyController.NPSS = NUMBER_OF_POWER_STATES - 1;
+			this->IdentifyController.APSTA = 1; // Autonomous power state transitions are supported
 		}
 
-		Payload Controller::getNamespaceListFromMap(std::map<UINT_32, ns::Namespace> namespaceMap, UINT_32 startingNsid, COMPLETION_QUEUE_ENTRY& completionQueueEntryToPost)
+		Payload Controller::getNamespaceListFromMap(const std::map<UINT_32, std::shared_ptr<ns::Namespace>>& namespaceMap, UINT_32 startingNsid, COMPLETION_QUEUE_ENTRY& completionQueueEntryToPost)
 		{
 			Payload transferPayload(constants::commands::identify::sizes::MAX_NSID_IN_NAMESPACE_LIST * sizeof(UINT_32));
 
+			if (namespaceMap.empty())
+			{
+				return transferPayload; // Every namespace may have been deleted (or detached). That's an empty list.
+			}
+
 			UINT_32 maxNsid = namespaceMap.rbegin()->first;
 
 			if (startingNsid > maxNsid)
@@ -452,9 +855,9 @@ namespace cnvme
 			return transferPayload;
 		}
 
-		std::map<UINT_32, ns::Namespace> Controller::getAllocatedNamespaceMap() const
+		std::map<UINT_32, std::shared_ptr<ns::Namespace>> Controller::getAllocatedNamespaceMap() const
 		{
-			std::map<UINT_32, ns::Namespace> tmp;
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> tmp;
 			for (auto &i : this->NamespaceIdToActiveNamespace)
 			{
 				tmp[i.first] = i.second;
@@ -466,6 +869,50 @@ namespace cnvme
 			return tmp;
 		}
 
+		std::shared_ptr<ns::Namespace> Controller::getAllocatedNamespace(UINT_32 namespaceId) const
+		{
+			auto namespaceSelected = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespaceSelected != this->NamespaceIdToActiveNamespace.end())
+			{
+				return namespaceSelected->second;
+			}
+
+			namespaceSelected = this->NamespaceIdToInactiveNamespace.find(namespaceId);
+			if (namespaceSelected != this->NamespaceIdToInactiveNamespace.end())
+			{
+				return namespaceSelected->second;
+			}
+
+			return nullptr;
+		}
+
+		UINT_32 Controller::getUnallocatedNamespaceId() const
+		{
+			for (UINT_32 nsid = 1; nsid <= this->IdentifyController.NN; nsid++)
+			{
+				if (!this->getAllocatedNamespace(nsid))
+				{
+					return nsid;
+				}
+			}
+
+			return 0;
+		}
+
+		Payload Controller::getControllerList(UINT_16 startingControllerId, bool includeThisController)
+		{
+			Payload transferPayload(sizeof(identify::structures::CONTROLLER_LIST));
+			auto pControllerList = (identify::structures::CONTROLLER_LIST*)transferPayload.getBuffer();
+
+			if (includeThisController && this->IdentifyController.CNTLID >= startingControllerId)
+			{
+				pControllerList->ControllerIdentifiers[pControllerList->NumberOfIdentifiers] = this->IdentifyController.CNTLID;
+				pControllerList->NumberOfIdentifiers++;
+			}
+
+			return transferPayload;
+		}
+
 		bool Controller::handledByCommandResponseApiFile(NVME_COMMAND& nvmeCommand, COMPLETION_QUEUE_ENTRY& completionQueueEntry, UINT_16 SQID)
 		{
 			if (this->CommandResponseApiFilePath.size() != 0)
@@ -484,7 +931,7 @@ namespace cnvme
 				auto namespaceIdToNamespaceObject = this->NamespaceIdToActiveNamespace.find(nvmeCommand.NSID);
 				if (namespaceIdToNamespaceObject != this->NamespaceIdToActiveNamespace.end())
 				{
-					auto identifyNamespace = namespaceIdToNamespaceObject->second.getIdentifyNamespaceStructure();
+					auto &identifyNamespace = namespaceIdToNamespaceObject->second->getIdentifyNamespaceStructure();
 
 					// calculate sector size per spec
 					assumedSectorSize = (UINT_32)std::pow(2, identifyNamespace.LBAF[identifyNamespace.FLBAS.CurrentLBAFormat].LBADS);
@@ -582,7 +1029,7 @@ namespace cnvme
 					if (namespaceSelected != this->NamespaceIdToActiveNamespace.end())
 					{
 						LOG_INFO("Grabbing Identify Namespace for NSID " + std::to_string(namespaceSelected->first));
-						auto identifyNamespaceStructure = namespaceSelected->second.getIdentifyNamespaceStructure();
+						auto &identifyNamespaceStructure = namespaceSelected->second->getIdentifyNamespaceStructure();
 						memcpy_s(transferPayload.getBuffer(), transferPayload.getSize(), &identifyNamespaceStructure, sizeof(identifyNamespaceStructure));
 					}
 					else
@@ -593,12 +1040,11 @@ namespace cnvme
 				}
 				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::NAMESPACES_ALLOCATED) // Identify Namespace (allocated)
 				{
-					auto namespaceMap = this->getAllocatedNamespaceMap();
-					auto namespaceSelected = namespaceMap.find(command.NSID);
-					if (namespaceSelected != namespaceMap.end())
+					auto namespaceSelected = this->getAllocatedNamespace(command.NSID);
+					if (namespaceSelected)
 					{
-						LOG_INFO("Grabbing Identify Namespace for NSID " + std::to_string(namespaceSelected->first));
-						auto identifyNamespaceStructure = namespaceSelected->second.getIdentifyNamespaceStructure();
+						LOG_INFO("Grabbing Identify Namespace for NSID " + std::to_string(command.NSID));
+						auto &identifyNamespaceStructure = namespaceSelected->getIdentifyNamespaceStructure();
 						memcpy_s(transferPayload.getBuffer(), transferPayload.getSize(), &identifyNamespaceStructure, sizeof(identifyNamespaceStructure));
 					}
 					else
@@ -615,9 +1061,9 @@ namespace cnvme
 				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::NAMESPACES_ALL)       // Identify Namespace All List
 				{
 					// make map with active/inactive
-					std::map<UINT_32, ns::Namespace> tmp = this->getAllocatedNamespaceMap();
+					auto allocatedNamespaceMap = this->getAllocatedNamespaceMap();
 
-					transferPayload = this->getNamespaceListFromMap(tmp, command.NSID, completionQueueEntryToPost);
+					transferPayload = this->getNamespaceListFromMap(allocatedNamespaceMap, command.NSID, completionQueueEntryToPost);
 				}
 				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::NAMESPACE_DESCRIPTOR) // Identify Namespace Descriptor List
 				{
@@ -625,7 +1071,7 @@ namespace cnvme
 					if (namespaceSelected != this->NamespaceIdToActiveNamespace.end())
 					{
 						LOG_INFO("Grabbing Namespace Descriptor List for NSID " + std::to_string(namespaceSelected->first));
-						transferPayload = namespaceSelected->second.getIdentifyNamespaceDescriptorList();
+						transferPayload = namespaceSelected->second->getIdentifyNamespaceDescriptorList();
 					}
 					else
 					{
@@ -634,17 +1080,69 @@ namespace cnvme
 						completionQueueEntryToPost.DNR = 1;
 					}
 				}
-				else
-				{
-					// I don't know what you wanted.
-					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
-					completionQueueEntryToPost.DNR = 1;
-				}
-
-				if (completionQueueEntryToPost.succeeded())
+				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::CONTROLLERS_ATTACHED_TO_NAMESPACE) // Identify Controller List (attached to NSID)
 				{
-					prp.placePayloadInExistingPRPs(transferPayload);
-				}
+					if (this->getAllocatedNamespace(command.NSID))
+					{
+						bool isActive = this->NamespaceIdToActiveNamespace.find(command.NSID) != this->NamespaceIdToActiveNamespace.end();
+						transferPayload = this->getControllerList(command.DW10_Identify.CNTID, isActive);
+					}
+					else
+					{
+						// Invalid namespace specified
+						completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+						completionQueueEntryToPost.DNR = 1;
+					}
+				}
+				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::CONTROLLERS_ALL)      // Identify Controller List (all in subsystem)
+				{
+					transferPayload = this->getControllerList(command.DW10_Identify.CNTID, true);
+				}
+				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::NAMESPACE_ACTIVE_COMMAND_SET_SPECIFIC) // Identify Namespace (I/O Command Set specific)
+				{
+					auto namespaceSelected = this->NamespaceIdToActiveNamespace.find(command.NSID);
+					if (command.DW11_Identify.CSI == constants::commands::identify::csi::NVM)
+					{
+						// Nothing in the NVM Command Set's structure applies to us, so it stays zero filled
+					}
+					else if (command.DW11_Identify.CSI == constants::commands::identify::csi::ZONED_NAMESPACE &&
+						(namespaceSelected == this->NamespaceIdToActiveNamespace.end() || namespaceSelected->second->isZoned()))
+					{
+						// Like CNS 00h, an inactive NSID gets a zero filled data structure
+						if (namespaceSelected != this->NamespaceIdToActiveNamespace.end())
+						{
+							LOG_INFO("Grabbing Identify Namespace (Zoned) for NSID " + std::to_string(namespaceSelected->first));
+							auto identifyNamespaceZonedStructure = namespaceSelected->second->getIdentifyNamespaceZonedStructure();
+							memcpy_s(transferPayload.getBuffer(), transferPayload.getSize(), &identifyNamespaceZonedStructure, sizeof(identifyNamespaceZonedStructure));
+						}
+					}
+					else
+					{
+						// The namespace isn't in that command set
+						completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+						completionQueueEntryToPost.DNR = 1;
+					}
+				}
+				else if (command.DW10_Identify.CNS == constants::commands::identify::cns::CONTROLLER_COMMAND_SET_SPECIFIC) // Identify Controller (I/O Command Set specific)
+				{
+					// Both are zero filled. For zones that is a ZASL of 0: Zone Append can move as much as MDTS lets any command move.
+					if (command.DW11_Identify.CSI != constants::commands::identify::csi::NVM && command.DW11_Identify.CSI != constants::commands::identify::csi::ZONED_NAMESPACE)
+					{
+						completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+						completionQueueEntryToPost.DNR = 1;
+					}
+				}
+				else
+				{
+					// I don't know what you wanted.
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+					completionQueueEntryToPost.DNR = 1;
+				}
+
+				if (completionQueueEntryToPost.succeeded())
+				{
+					prp.placePayloadInExistingPRPs(transferPayload);
+				}
 			}
 			else
 			{
@@ -675,8 +1173,8 @@ namespace cnvme
 				return;
 			}
 
-			// Check if the queue exists. If it does already, fail the command
-			if (this->getQueueWithId(this->ValidCompletionQueues, command.DW10_CreateIoQueue.QID) != nullptr)
+			// Check if the queue exists or is past the doorbells we have. If so, fail the command
+			if (command.DW10_CreateIoQueue.QID >= MAX_QUEUE_PAIRS || this->getQueueWithId(this->ValidCompletionQueues, command.DW10_CreateIoQueue.QID) != nullptr)
 			{
 				completionQueueEntryToPost.DNR = 1; // Do Not Retry
 				completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
@@ -697,14 +1195,12 @@ namespace cnvme
 
 			// Checks passed. Hold onto the queue.
 
-			auto doorbells = this->ControllerRegisters->getQueueDoorbells();
-			doorbells += command.DW10_CreateIoQueue.QID; // find our doorbell
-
 			Queue* q = new Queue(ONE_BASED_FROM_ZERO_BASED(command.DW10_CreateIoQueue.QSIZE),
 				command.DW10_CreateIoQueue.QID,
-				(UINT_16*)&(doorbells->CQHDBL), // doorbell
+				this->ControllerRegisters->getCompletionQueueHeadDoorbell(command.DW10_CreateIoQueue.QID), // doorbell
 				command.DPTR.DPTR1
 			);
+			q->ringDoorbell(0); // A new queue starts empty, even if an old one with this id left its doorbell elsewhere
 			this->ValidCompletionQueues.push_back(q);
 
 			LOG_INFO("Held onto completion queue with an id of " + std::to_string(command.DW10_CreateIoQueue.QID));
@@ -731,8 +1227,8 @@ namespace cnvme
 				return;
 			}
 
-			// Check if the queue exists. If it does already, fail the command
-			if (this->getQueueWithId(this->ValidSubmissionQueues, command.DW10_CreateIoQueue.QID) != nullptr)
+			// Check if the queue exists or is past the doorbells we have. If so, fail the command
+			if (command.DW10_CreateIoQueue.QID >= MAX_QUEUE_PAIRS || this->getQueueWithId(this->ValidSubmissionQueues, command.DW10_CreateIoQueue.QID) != nullptr)
 			{
 				completionQueueEntryToPost.DNR = 1; // Do Not Retry
 				completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
@@ -769,14 +1265,12 @@ namespace cnvme
 
 			// Checks passed. Hold onto the queue.
 
-			auto doorbells = this->ControllerRegisters->getQueueDoorbells();
-			doorbells += command.DW10_CreateIoQueue.QID; // find our doorbell
-
 			Queue* subQ = new Queue(ONE_BASED_FROM_ZERO_BASED(command.DW10_CreateIoQueue.QSIZE),
 				command.DW10_CreateIoQueue.QID,
-				(UINT_16*)&(doorbells->CQHDBL), // doorbell
+				this->ControllerRegisters->getSubmissionQueueTailDoorbell(command.DW10_CreateIoQueue.QID), // doorbell
 				command.DPTR.DPTR1
 			);
+			subQ->ringDoorbell(0); // A new queue starts empty, even if an old one with this id left its doorbell elsewhere
 			this->ValidSubmissionQueues.push_back(subQ);
 
 			subQ->setMappedQueue(mappedCompletionQueue); // SQ -> CQ
@@ -828,6 +1322,19 @@ namespace cnvme
 				return;
 			}
 
+			// Anything still running for this queue gets its completion posted before the queue goes away
+			this->waitForDeferredCompletions();
+			this->postFinishedDeferredCompletions();
+			{
+				std::unique_lock<std::mutex> lock(this->FinishedDeferredCompletionsMutex);
+				size_t numberOfCompletions = this->FinishedDeferredCompletions.size();
+				this->FinishedDeferredCompletions.remove_if([&command](const DEFERRED_COMPLETION& deferredCompletion) { return deferredCompletion.SubmissionQueueId == command.DW10_DeleteIoQueue.QID; });
+				if (numberOfCompletions != this->FinishedDeferredCompletions.size())
+				{
+					LOG_ERROR("Dropped deferred completions for SQ " + std::to_string(command.DW10_DeleteIoQueue.QID) + " since its completion queue was full");
+				}
+			}
+
 			// don't let the completion queue map here anymore
 			q->getMappedQueue()->setMappedQueue(nullptr);
 
@@ -837,6 +1344,7 @@ namespace cnvme
 			// Remove from validity
 			this->ValidSubmissionQueues.erase(std::remove(this->ValidSubmissionQueues.begin(), this->ValidSubmissionQueues.end(), q), this->ValidSubmissionQueues.end());
 			this->SubmissionQueueIdToCommandIdentifiers[command.DW10_DeleteIoQueue.QID].clear();
+			this->SubmissionQueueIdToQosLimiter.erase(command.DW10_DeleteIoQueue.QID);
 		}
 
 		NVME_CALLER_IMPLEMENTATION(adminFirmwareCommit)
@@ -863,7 +1371,7 @@ namespace cnvme
 			if (command.DW10_FirmwareCommit.CA == REPLACE_IN_SLOT_NO_ACTIVATE || command.DW10_FirmwareCommit.CA == REPLACE_IN_SLOT_AND_ACTIVATE_ON_RESET)
 			{
 				UINT_64 currentDwOffset = 0;
-				Payload completeFirmwareBinary;
+				SegmentedPayload completeFirmwareBinary;
 
 				// Check if this->FirmwareImageDWordOffsetToData is valid and contiguous.
 				for (auto &fwDwOffsetToData : this->FirmwareImageDWordOffsetToData)
@@ -876,11 +1384,14 @@ namespace cnvme
 						return;
 					}
 					currentDwOffset += fwDwOffsetToData.second.getSize() / sizeof(UINT_32);
-					completeFirmwareBinary.append(fwDwOffsetToData.second);
+					completeFirmwareBinary.appendReference(fwDwOffsetToData.second.getBuffer(), fwDwOffsetToData.second.getSize());
 				}
 
+				// Only the eye catcher and the trailing firmware revision are needed, so don't materialize the whole image.
+				char eyeCatcher[sizeof(FIRMWARE_EYE_CATCHER)] = { 0 };
 				if (completeFirmwareBinary.getSize() <  (sizeof(identify::structures::IDENTIFY_CONTROLLER::FR) + sizeof(FIRMWARE_EYE_CATCHER)) ||
-					memcmp(completeFirmwareBinary.getBuffer(), FIRMWARE_EYE_CATCHER, sizeof(FIRMWARE_EYE_CATCHER) != 0))
+					!completeFirmwareBinary.copyTo(0, (BYTE*)eyeCatcher, sizeof(eyeCatcher)) ||
+					memcmp(eyeCatcher, FIRMWARE_EYE_CATCHER, sizeof(FIRMWARE_EYE_CATCHER)) != 0)
 				{
 					LOG_INFO("Attempt to commit a FW to a slot with an invalid FW buffer");
 					completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
@@ -889,8 +1400,8 @@ namespace cnvme
 				}
 
 				// Copy firmware name to FirmwareSlotInfo
-				memcpy_s(this->FirmwareSlotInfo.FRS[ZERO_BASED_FROM_ONE_BASED(firmwareSlot)], sizeof(this->FirmwareSlotInfo.FRS[ZERO_BASED_FROM_ONE_BASED(firmwareSlot)]),
-					completeFirmwareBinary.getBuffer() + completeFirmwareBinary.getSize() - sizeof(identify::structures::IDENTIFY_CONTROLLER::FR), sizeof(identify::structures::IDENTIFY_CONTROLLER::FR));
+				completeFirmwareBinary.copyTo(completeFirmwareBinary.getSize() - sizeof(identify::structures::IDENTIFY_CONTROLLER::FR),
+					(BYTE*)this->FirmwareSlotInfo.FRS[ZERO_BASED_FROM_ONE_BASED(firmwareSlot)], sizeof(identify::structures::IDENTIFY_CONTROLLER::FR));
 
 				if (command.DW10_FirmwareCommit.CA == REPLACE_IN_SLOT_AND_ACTIVATE_ON_RESET)
 				{
@@ -1008,7 +1519,9 @@ namespace cnvme
 			}
 
 			PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, (UINT_32)transferBytes, this->getControllerRegisters()->getMemoryPageSize());
-			this->FirmwareImageDWordOffsetToData[minOffsetInDwords] = prps.getPayloadCopy();
+			Payload& firmwareImagePiece = this->FirmwareImageDWordOffsetToData[minOffsetInDwords];
+			firmwareImagePiece.setAccountingSubsystem(memory::SUBSYSTEM_FIRMWARE_CACHE);
+			firmwareImagePiece = prps.getPayloadCopy();
 		}
 
 		NVME_CALLER_IMPLEMENTATION(adminFormatNvm)
@@ -1058,163 +1571,1397 @@ namespace cnvme
 				namespacesToFormat.insert(nsid->first);
 			}
 
-			// Call format on all namespacesToFormat... if any fail... fail the command
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> namespaces; // Stay alive until the format is done
+			bool anyAsynchronous = false;
 			for (auto &nsid : namespacesToFormat)
 			{
-				completionQueueEntryToPost = this->NamespaceIdToActiveNamespace[nsid].formatNVM(command);
+				namespaces[nsid] = this->NamespaceIdToActiveNamespace[nsid];
+				anyAsynchronous |= namespaces[nsid]->isAsynchronous();
+			}
 
-				if (completionQueueEntryToPost.SC != 0)
+			// Call format on all namespacesToFormat... if any fail... fail the command
+			// Erasing is O(1). The old data is freed in the background.
+			auto doFormat = [namespaces, command]() {
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+				for (auto &namespacePair : namespaces)
 				{
-					LOG_ERROR("Failed to format NSID " + std::to_string(nsid));
-					break; // make sure we leave this loop now.
+					completionQueueEntry = namespacePair.second->formatNVM(command);
+
+					if (completionQueueEntry.SC != 0)
+					{
+						LOG_ERROR("Failed to format NSID " + std::to_string(namespacePair.first));
+						break; // make sure we leave this loop now.
+					}
 				}
+				return completionQueueEntry;
+			};
+
+			if (!anyAsynchronous)
+			{
+				completionQueueEntryToPost = doFormat();
+				return;
 			}
-		}
 
-		NVME_CALLER_IMPLEMENTATION(adminKeepAlive)
-		{
-			// nop. We do nothing here.
+			// Don't erase media out from under I/O that is still running on it. Holding every LBA waits for just that I/O,
+			//   on an I/O worker, so the doorbells and I/O to other namespaces keep going.
+			std::vector<std::shared_ptr<ns::LbaRangeLock::Range>> formatRanges;
+			for (auto &namespacePair : namespaces)
+			{
+				formatRanges.push_back(namespacePair.second->reserveLbaRange(0, 0, true));
+			}
+
+			this->deferCompletion([formatRanges, doFormat]() {
+				for (auto &formatRange : formatRanges)
+				{
+					formatRange->lock();
+				}
+
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = doFormat();
+				for (auto &formatRange : formatRanges)
+				{
+					formatRange->unlock();
+				}
+				return completionQueueEntry;
+			});
 		}
 
-		NVME_CALLER_IMPLEMENTATION(nvmFlush)
+		NVME_CALLER_IMPLEMENTATION(adminGetFeatures)
 		{
-			// TODO: See if we can push this code higher up as it applies to all NVM commands.
+			using namespace constants::commands::features;
 
-			/*
-			Section 6.1 of NVMe 1.3
-			Unless otherwise noted, specifying an inactive namespace ID in a command that uses the namespace ID
-			shall cause the controller to abort the command with status Invalid Field in Command. Specifying an invalid
-			NSID in a command that uses the NSID field shall cause the controller to abort the command with status
-			Invalid Namespace or Format.
-			*/
+			if (command.DW10_Features.FID == fid::VOLATILE_WRITE_CACHE)
+			{
+				if (command.DW10_Features.SEL == sel::SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntryToPost.DWord0 = capabilities::CHANGEABLE;
+				}
+				else if (command.DW10_Features.SEL == sel::DEFAULT)
+				{
+					completionQueueEntryToPost.DWord0 = 0; // Off until the host turns it on
+				}
+				else if (command.DW10_Features.SEL == sel::CURRENT || command.DW10_Features.SEL == sel::SAVED) // Not saveable, so saved is current
+				{
+					completionQueueEntryToPost.DWord0 = this->VolatileWriteCacheEnabled ? 1 : 0;
+				}
+				else
+				{
+					completionQueueEntryToPost.DNR = 1;
+					completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				}
+			}
+			else if (command.DW10_Features.FID == fid::POWER_MANAGEMENT)
+			{
+				if (command.DW10_Features.SEL == sel::SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntryToPost.DWord0 = capabilities::CHANGEABLE;
+				}
+				else if (command.DW10_Features.SEL == sel::DEFAULT)
+				{
+					completionQueueEntryToPost.DWord0 = 0; // PS0
+				}
+				else if (command.DW10_Features.SEL == sel::CURRENT || command.DW10_Features.SEL == sel::SAVED) // Not saveable, so saved is current
+				{
+					// Includes the states APST went to on its own
+					completionQueueEntryToPost.DWord0 = this->PowerStates.getPowerState(std::chrono::steady_clock::now());
+				}
+				else
+				{
+					completionQueueEntryToPost.DNR = 1;
+					completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				}
+			}
+			else if (command.DW10_Features.FID == fid::AUTONOMOUS_POWER_STATE_TRANSITION)
+			{
+				if (command.DW10_Features.SEL == sel::SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntryToPost.DWord0 = capabilities::CHANGEABLE;
+					return;
+				}
 
-			// We have nothing to flush as everything is always 'safe'.. right?
+				// The APST table goes to the host along with APSTE
+				Payload apstTable(sizeof(APST_ENTRY) * APST_ENTRIES);
+				if (command.DW10_Features.SEL == sel::DEFAULT)
+				{
+					// Off, with an empty table
+				}
+				else if (command.DW10_Features.SEL == sel::CURRENT || command.DW10_Features.SEL == sel::SAVED) // Not saveable, so saved is current
+				{
+					completionQueueEntryToPost.DWord0 = this->PowerStates.isApstEnabled() ? 1 : 0;
+					this->PowerStates.getApstTable((PAPST_ENTRY)apstTable.getBuffer());
+				}
+				else
+				{
+					completionQueueEntryToPost.DNR = 1;
+					completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+					return;
+				}
 
-			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
-			if (namespacePair != this->NamespaceIdToActiveNamespace.end())
-			{
-				return; // We really don't have anything to do. We're done since this is an active NSID.
+				if (command.DPTR.DPTR1)
+				{
+					PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, apstTable.getSize(), this->getControllerRegisters()->getMemoryPageSize());
+					prps.placePayloadInExistingPRPs(apstTable);
+				}
+				else
+				{
+					// No PRP? Huh? Fail.
+					completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+					completionQueueEntryToPost.DNR = 1;
+				}
 			}
+			else if (command.DW10_Features.FID == fid::QOS_LIMITS)
+			{
+				if (command.DW10_Features.SEL == sel::SUPPORTED_CAPABILITIES)
+				{
+					completionQueueEntryToPost.DWord0 = capabilities::NAMESPACE_SPECIFIC | capabilities::CHANGEABLE;
+					return;
+				}
 
-			// not an active NSID
-			completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				auto qosLimiterMap = this->getQosLimiterMap(command, completionQueueEntryToPost);
+				if (!qosLimiterMap)
+				{
+					return;
+				}
 
-			namespacePair = this->NamespaceIdToInactiveNamespace.find(command.NSID);
-			if (namespacePair == this->NamespaceIdToInactiveNamespace.end())
+				if (command.DW10_Features.SEL == sel::DEFAULT)
+				{
+					// Unlimited until the host says otherwise
+				}
+				else if (command.DW10_Features.SEL == sel::CURRENT || command.DW10_Features.SEL == sel::SAVED) // Not saveable, so saved is current
+				{
+					auto qosLimiter = qosLimiterMap->find(command.DW11_QosLimits.SQ ? command.DW11_QosLimits.SQID : command.NSID);
+					if (qosLimiter != qosLimiterMap->end())
+					{
+						completionQueueEntryToPost.DWord0 = qosLimiter->second.IopsLimit;
+						completionQueueEntryToPost.DWord1 = qosLimiter->second.BandwidthLimit;
+					}
+				}
+				else
+				{
+					completionQueueEntryToPost.DNR = 1;
+					completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				}
+			}
+			else
 			{
-				// User specified an inactive NSID.
+				LOG_ERROR("Feature " + std::to_string(command.DW10_Features.FID) + " isn't supported");
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
 				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
 			}
+		}
 
-			// User specified an invalid NSID.
-			completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+		NVME_CALLER_IMPLEMENTATION(adminKeepAlive)
+		{
+			// nop. We do nothing here.
 		}
 
-		NVME_CALLER_IMPLEMENTATION(nvmRead)
+		NVME_CALLER_IMPLEMENTATION(adminNamespaceAttachment)
 		{
-			// Make sure the namespace exists
-			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
-			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			// Make sure this optional command is supported
+			if (!this->IdentifyController.NamespaceCommandsSupported)
 			{
 				completionQueueEntryToPost.DNR = 1; // Do Not Retry
-				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
-				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_COMMAND_OPCODE;
 				return;
 			}
 
-			// Do we have a PRP?
-			if (command.DPTR.DPTR1)
+			using namespace constants::commands::ns_attachment;
+			bool attach = (command.DW10_NamespaceAttachment.SEL == sel::ATTACH_CONTROLLERS);
+			if (!attach && command.DW10_NamespaceAttachment.SEL != sel::DETACH_CONTROLLERS)
 			{
-				Payload readData;
-				completionQueueEntryToPost = namespacePair->second.read(command, readData);
-				PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, readData.getSize(), ControllerRegisters->getMemoryPageSize());
-				prps.placePayloadInExistingPRPs(readData);
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return;
 			}
-			else
+
+			// NSID 0 and all namespaces (0xFFFFFFFF) can't be attached or detached
+			if (command.NSID == 0 || command.NSID == ALL_NAMESPACES)
 			{
-				// No PRP? Huh? Fail.
-				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
-				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return;
 			}
-		}
 
-		NVME_CALLER_IMPLEMENTATION(nvmWrite)
-		{
-			// Make sure the namespace exists
-			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
-			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			auto activeNamespace = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			auto inactiveNamespace = this->NamespaceIdToInactiveNamespace.find(command.NSID);
+			if (activeNamespace == this->NamespaceIdToActiveNamespace.end() && inactiveNamespace == this->NamespaceIdToInactiveNamespace.end())
 			{
 				completionQueueEntryToPost.DNR = 1; // Do Not Retry
-				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
 				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
 				return;
 			}
 
-			// Do we have a PRP?
-			if (command.DPTR.DPTR1)
-			{
-				UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
-				completionQueueEntryToPost = namespacePair->second.write(command, memoryPageSize);
-			}
-			else
+			if (command.DPTR.DPTR1 == 0)
 			{
-				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
 				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
-				completionQueueEntryToPost.DNR = 1;
+				return;
 			}
-		}
 
-		void Controller::controllerResetCallback()
-		{
-			LOG_INFO("Recv'd a controllerResetCallback request.");
+			PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, sizes::CONTROLLER_LIST_SIZE, this->getControllerRegisters()->getMemoryPageSize());
+			Payload controllerListPayload = prps.getPayloadCopy();
+			auto pControllerList = (identify::structures::CONTROLLER_LIST*)controllerListPayload.getBuffer();
 
-			for (size_t i = ValidSubmissionQueues.size() - 1; i != -1; i--)
+			// We are the only controller in the subsystem, so we must be the only one in the list.
+			if (pControllerList->NumberOfIdentifiers != 1 || pControllerList->ControllerIdentifiers[0] != this->IdentifyController.CNTLID)
 			{
-				if (ValidSubmissionQueues[i]->getQueueId() != ADMIN_QUEUE_ID)
-				{
-					delete ValidSubmissionQueues[i];
-					ValidSubmissionQueues.erase(ValidSubmissionQueues.begin() + i);
-				}
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+				completionQueueEntryToPost.SC = constants::status::codes::specific::CONTROLLER_LIST_INVALID;
+				return;
 			}
 
-			for (size_t i = ValidCompletionQueues.size() - 1; i != -1; i--)
+			if (attach)
 			{
-				if (ValidCompletionQueues[i]->getQueueId() != ADMIN_QUEUE_ID)
+				if (activeNamespace != this->NamespaceIdToActiveNamespace.end())
 				{
-					delete ValidCompletionQueues[i];
-					ValidCompletionQueues.erase(ValidCompletionQueues.begin() + i);
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+					completionQueueEntryToPost.SC = constants::status::codes::specific::NAMESPACE_ALREADY_ATTACHED;
+					return;
 				}
-			}
-
-			// Clear the SubQ to CID listing.
-			this->SubmissionQueueIdToCommandIdentifiers.clear();
 
-			// Clear phase tags.
-			this->QueueToPhaseTag.clear();
+				this->NamespaceIdToActiveNamespace[command.NSID] = inactiveNamespace->second;
+				this->NamespaceIdToInactiveNamespace.erase(inactiveNamespace);
+				LOG_INFO("Attached NSID " + std::to_string(command.NSID));
+			}
+			else
+			{
+				if (inactiveNamespace != this->NamespaceIdToInactiveNamespace.end())
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+					completionQueueEntryToPost.SC = constants::status::codes::specific::NAMESPACE_NOT_ATTACHED;
+					return;
+				}
 
-			// Clear FW Image Download Cache
-			this->FirmwareImageDWordOffsetToData.clear();
+				// I/O that is still running on this namespace finishes before it goes away
+				this->waitForDeferredCompletions();
 
-			// If a FW slot is given to update to on reset, do it now.
-			if (this->FirmwareSlotInfo.AFI.FirmwareSlotForNextControllerReset)
-			{
-				this->replaceRunningFirmwareWithOneInSlot(this->FirmwareSlotInfo.AFI.FirmwareSlotForNextControllerReset);
+				this->NamespaceIdToInactiveNamespace[command.NSID] = activeNamespace->second;
+				this->NamespaceIdToActiveNamespace.erase(activeNamespace);
+				LOG_INFO("Detached NSID " + std::to_string(command.NSID));
 			}
 		}
 
-		void Controller::waitForChangeLoop()
+		NVME_CALLER_IMPLEMENTATION(adminNamespaceManagement)
 		{
-#ifndef SINGLE_THREADED
-			DoorbellWatcher.waitForFlip();
-#else
-			checkForChanges();
-#endif
-		}
+			// Make sure this optional command is supported
+			if (!this->IdentifyController.NamespaceCommandsSupported)
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_COMMAND_OPCODE;
+				return;
+			}
 
-		void Controller::setCommandResponseFilePath(const std::string filePath)
-		{
-			LOG_INFO("Set CRAPI-F to " + filePath);
-			this->CommandResponseApiFilePath = filePath;
+			using namespace constants::commands::ns_management;
+			if (command.DW10_NamespaceManagement.SEL == sel::CREATE_NAMESPACE)
+			{
+				if (command.DPTR.DPTR1 == 0)
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+					return;
+				}
+
+				// The host gives us an Identify Namespace structure. Only NSZE, NCAP, FLBAS, DPS and NMIC are looked at.
+				PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, sizeof(identify::structures::IDENTIFY_NAMESPACE), this->getControllerRegisters()->getMemoryPageSize());
+				Payload hostIdentifyNamespacePayload = prps.getPayloadCopy();
+				auto pHostIdentifyNamespace = (identify::structures::IDENTIFY_NAMESPACE*)hostIdentifyNamespacePayload.getBuffer();
+
+				UINT_8 commandSet = (UINT_8)command.DW11_NamespaceManagement.CSI;
+				if (pHostIdentifyNamespace->NSZE == 0 || pHostIdentifyNamespace->NCAP > pHostIdentifyNamespace->NSZE ||
+					(commandSet != constants::commands::identify::csi::NVM && commandSet != constants::commands::identify::csi::ZONED_NAMESPACE))
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+					return;
+				}
+
+				auto newNamespace = std::make_shared<ns::Namespace>();
+				auto &newIdentifyNamespace = newNamespace->getIdentifyNamespaceStructure();
+				UINT_8 lbaFormat = pHostIdentifyNamespace->FLBAS.CurrentLBAFormat;
+				if (lbaFormat > newIdentifyNamespace.NLBAF)
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+					completionQueueEntryToPost.SC = constants::status::codes::specific::INVALID_FORMAT;
+					return;
+				}
+
+				UINT_8 lbads = newIdentifyNamespace.LBAF[lbaFormat].LBADS;
+				if (pHostIdentifyNamespace->NSZE > (((UINT_64)-1) >> lbads) ||
+					(commandSet == constants::commands::identify::csi::ZONED_NAMESPACE && (pHostIdentifyNamespace->NSZE << lbads) % DEFAULT_ZONE_SIZE != 0))
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+					return;
+				}
+
+				// We're thin provisioned: only NCAP has to fit in what we could still allocate. NSZE can be as big as the host likes.
+				if ((pHostIdentifyNamespace->NCAP << lbads) > sys::getUnallocatedRAMInBytes())
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+					completionQueueEntryToPost.SC = constants::status::codes::specific::NAMESPACE_INSUFFICIENT_CAPACITY;
+					return;
+				}
+
+				UINT_32 nsid = this->getUnallocatedNamespaceId();
+				if (nsid == 0)
+				{
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+					completionQueueEntryToPost.SC = constants::status::codes::specific::NAMESPACE_IDENTIFIER_UNAVAILABLE;
+					return;
+				}
+
+				// A format picks the LBA format and turns away metadata/protection information settings we don't support
+				NVME_COMMAND formatCommand = { 0 };
+				formatCommand.DW10_Format.LBAF = lbaFormat;
+				formatCommand.DW10_Format.MSET = pHostIdentifyNamespace->FLBAS.MetadataAtEndOfData;
+				formatCommand.DW10_Format.PI = pHostIdentifyNamespace->DPS & constants::commands::identify::dps::PI_TYPE_MASK;
+				formatCommand.DW10_Format.PIL = (pHostIdentifyNamespace->DPS & constants::commands::identify::dps::FIRST_EIGHT_BYTES) ? 1 : 0;
+				completionQueueEntryToPost = newNamespace->formatNVM(formatCommand);
+				if (!completionQueueEntryToPost.succeeded())
+				{
+					return;
+				}
+
+				// Sparse media costs nothing until it is written, so this is the same amount of work for any size.
+				bool mediaSet = newNamespace->setMedia(std::make_shared<ns::SparseMedia>(pHostIdentifyNamespace->NSZE << lbads));
+				ASSERT_IF(!mediaSet, "Unable to give the new namespace its media");
+
+				if (commandSet == constants::commands::identify::csi::ZONED_NAMESPACE)
+				{
+					bool zonesSet = newNamespace->setZoned(true);
+					ASSERT_IF(!zonesSet, "Unable to split the new namespace into zones");
+				}
+
+				// New namespaces aren't attached to any controller
+				this->NamespaceIdToInactiveNamespace[nsid] = newNamespace;
+				completionQueueEntryToPost.DWord0 = nsid;
+				LOG_INFO("Created NSID " + std::to_string(nsid) + " with " + std::to_string(pHostIdentifyNamespace->NSZE) + " sectors");
+			}
+			else if (command.DW10_NamespaceManagement.SEL == sel::DELETE_NAMESPACE)
+			{
+				std::set<UINT_32> namespacesToDelete;
+				if (command.NSID == ALL_NAMESPACES)
+				{
+					for (auto &i : this->getAllocatedNamespaceMap())
+					{
+						namespacesToDelete.insert(i.first);
+					}
+				}
+				else if (this->getAllocatedNamespace(command.NSID))
+				{
+					namespacesToDelete.insert(command.NSID);
+				}
+				else
+				{
+					// NSID 0 is never valid here. Any other NSID just isn't allocated.
+					completionQueueEntryToPost.DNR = 1; // Do Not Retry
+					completionQueueEntryToPost.SC = command.NSID == 0 ? constants::status::codes::generic::INVALID_FIELD_IN_COMMAND : constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+					return;
+				}
+
+				// Don't pull media out from under I/O that is still running
+				this->waitForDeferredCompletions();
+
+				for (auto &nsid : namespacesToDelete)
+				{
+					this->NamespaceIdToActiveNamespace.erase(nsid);
+					this->NamespaceIdToInactiveNamespace.erase(nsid);
+					this->NamespaceIdToQosLimiter.erase(nsid);
+					LOG_INFO("Deleted NSID " + std::to_string(nsid));
+				}
+			}
+			else
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(adminSetFeatures)
+		{
+			using namespace constants::commands::features;
+
+			if (command.DW10_Features.SV)
+			{
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SCT = constants::status::types::COMMAND_SPECIFIC;
+				completionQueueEntryToPost.SC = constants::status::codes::specific::FEATURE_IDENTIFIER_NOT_SAVEABLE;
+				return;
+			}
+
+			if (command.DW10_Features.FID == fid::VOLATILE_WRITE_CACHE)
+			{
+				bool enable = command.DW11_VolatileWriteCache.WCE == 1;
+				LOG_INFO(std::string(enable ? "Enabling" : "Disabling") + " the volatile write cache");
+
+				// Media gets swapped out from under the namespaces, so nothing can still be running on it
+				this->waitForDeferredCompletions();
+				std::vector<std::shared_ptr<ns::Namespace>> switchedNamespaces;
+				for (auto namespaceMap : { &this->NamespaceIdToActiveNamespace, &this->NamespaceIdToInactiveNamespace })
+				{
+					for (auto &i : *namespaceMap)
+					{
+						// Turning the cache off destages it first. If that fails the data is still cached, so stay on.
+						if (!i.second->setVolatileWriteCache(enable))
+						{
+							LOG_ERROR("Failed to " + std::string(enable ? "enable" : "disable") + " the volatile write cache for NSID " + std::to_string(i.first) + ". Switching the others back.");
+
+							// All or nothing, so Get Features has one answer for every namespace. Only destaging can fail, so going back to the cache can't.
+							for (auto &switchedNamespace : switchedNamespaces)
+							{
+								switchedNamespace->setVolatileWriteCache(!enable);
+							}
+
+							completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+							completionQueueEntryToPost.SC = constants::status::codes::generic::INTERNAL_ERROR;
+							return;
+						}
+						switchedNamespaces.push_back(i.second);
+					}
+				}
+
+				this->VolatileWriteCacheEnabled = enable;
+			}
+			else if (command.DW10_Features.FID == fid::POWER_MANAGEMENT)
+			{
+				// The workload hint is ignored
+				LOG_INFO("Going to power state " + std::to_string(command.DW11_PowerManagement.PS));
+				if (!this->PowerStates.setPowerState(command.DW11_PowerManagement.PS, std::chrono::steady_clock::now()))
+				{
+					LOG_ERROR("There is no power state " + std::to_string(command.DW11_PowerManagement.PS));
+					completionQueueEntryToPost.DNR = 1;
+					completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				}
+			}
+			else if (command.DW10_Features.FID == fid::AUTONOMOUS_POWER_STATE_TRANSITION)
+			{
+				if (!command.DPTR.DPTR1)
+				{
+					// No PRP? Huh? Fail.
+					completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+					completionQueueEntryToPost.DNR = 1;
+					return;
+				}
+
+				PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, sizeof(APST_ENTRY) * APST_ENTRIES, this->getControllerRegisters()->getMemoryPageSize());
+				Payload apstTable = prps.getPayloadCopy();
+				bool enable = command.DW11_AutonomousPowerStateTransition.APSTE == 1;
+				LOG_INFO(std::string(enable ? "Enabling" : "Disabling") + " autonomous power state transitions");
+
+				if (!this->PowerStates.setAutonomousPowerStateTransitions(enable, (PAPST_ENTRY)apstTable.getBuffer(), std::chrono::steady_clock::now()))
+				{
+					LOG_ERROR("An APST table entry transitions to a power state that isn't a supported non-operational one");
+					completionQueueEntryToPost.DNR = 1;
+					completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				}
+			}
+			else if (command.DW10_Features.FID == fid::QOS_LIMITS)
+			{
+				auto qosLimiterMap = this->getQosLimiterMap(command, completionQueueEntryToPost);
+				if (!qosLimiterMap)
+				{
+					return;
+				}
+
+				UINT_32 key = command.DW11_QosLimits.SQ ? command.DW11_QosLimits.SQID : command.NSID;
+				LOG_INFO("Limiting " + std::string(command.DW11_QosLimits.SQ ? "SQ " : "NSID ") + std::to_string(key) + " to " + std::to_string(command.IOPSL) +
+					" IOPS and " + std::to_string(command.BWL) + " KiB/s (0 is unlimited)");
+
+				if (command.IOPSL == 0 && command.BWL == 0)
+				{
+					qosLimiterMap->erase(key);
+					return;
+				}
+
+				// Buckets start full, so the host gets a burst right away
+				UINT_64 bytesPerSecond = (UINT_64)command.BWL * 1024;
+				QOS_LIMITER qosLimiter;
+				qosLimiter.IopsLimit = command.IOPSL;
+				qosLimiter.BandwidthLimit = command.BWL;
+				qosLimiter.Commands = TokenBucket(command.IOPSL, (std::max)((UINT_64)1, (UINT_64)command.IOPSL * QOS_BURST_MS / 1000));
+				qosLimiter.Bytes = TokenBucket(bytesPerSecond, (std::max)((UINT_64)1, bytesPerSecond * QOS_BURST_MS / 1000));
+				(*qosLimiterMap)[key] = qosLimiter;
+			}
+			else
+			{
+				LOG_ERROR("Feature " + std::to_string(command.DW10_Features.FID) + " isn't supported");
+				completionQueueEntryToPost.DNR = 1;
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmCompare)
+		{
+			// Make sure the namespace exists
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			// Do we have a PRP?
+			if (command.DPTR.DPTR1)
+			{
+				std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the compare is done
+				UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+				auto doCompare = [theNamespace, command, memoryPageSize]() {
+					return theNamespace->compare(command, memoryPageSize);
+				};
+
+				if (theNamespace->isAsynchronous())
+				{
+					this->deferLbaRangeCompletion(*theNamespace, command.SLBA, ONE_BASED_FROM_ZERO_BASED(command.DW12_IO.NLB), false, doCompare);
+				}
+				else
+				{
+					completionQueueEntryToPost = doCompare();
+				}
+			}
+			else
+			{
+				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+				completionQueueEntryToPost.DNR = 1;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmWriteZeroes)
+		{
+			// Make sure the namespace exists
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			// No PRP here, the zeros never come from the host
+			std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the zeroing is done
+			ns::ZONE_WRITE_RESERVATION zoneReservation = { 0 };
+			completionQueueEntryToPost = theNamespace->reserveZoneWrite(command, zoneReservation);
+			if (!completionQueueEntryToPost.succeeded())
+			{
+				return;
+			}
+
+			auto doWriteZeroes = [theNamespace, command, zoneReservation]() {
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = theNamespace->writeZeroes(command);
+				if (!completionQueueEntry.succeeded())
+				{
+					theNamespace->releaseZoneWrite(zoneReservation);
+				}
+				return completionQueueEntry;
+			};
+
+			if (theNamespace->isAsynchronous())
+			{
+				this->deferLbaRangeCompletion(*theNamespace, command.SLBA, ONE_BASED_FROM_ZERO_BASED(command.DW12_IO.NLB), true, doWriteZeroes);
+			}
+			else
+			{
+				completionQueueEntryToPost = doWriteZeroes();
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmDatasetManagement)
+		{
+			// Make sure the namespace exists
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			// Do we have a PRP (for the range list)?
+			if (command.DPTR.DPTR1)
+			{
+				std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the deallocate is done
+				UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+				auto doDatasetManagement = [theNamespace, command, memoryPageSize]() {
+					return theNamespace->datasetManagement(command, memoryPageSize);
+				};
+
+				if (theNamespace->isAsynchronous())
+				{
+					// The ranges are in host memory, so just hold the whole namespace
+					this->deferLbaRangeCompletion(*theNamespace, 0, 0, true, doDatasetManagement);
+				}
+				else
+				{
+					completionQueueEntryToPost = doDatasetManagement();
+				}
+			}
+			else
+			{
+				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+				completionQueueEntryToPost.DNR = 1;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmFlush)
+		{
+			// TODO: See if we can push this code higher up as it applies to all NVM commands.
+
+			/*
+			Section 6.1 of NVMe 1.3
+			Unless otherwise noted, specifying an inactive namespace ID in a command that uses the namespace ID
+			shall cause the controller to abort the command with status Invalid Field in Command. Specifying an invalid
+			NSID in a command that uses the NSID field shall cause the controller to abort the command with status
+			Invalid Namespace or Format.
+			*/
+
+			std::vector<std::shared_ptr<ns::Namespace>> namespacesToFlush; // Stay alive until the flush is done
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair != this->NamespaceIdToActiveNamespace.end())
+			{
+				namespacesToFlush.push_back(namespacePair->second);
+			}
+			else if (command.NSID == ALL_NAMESPACES)
+			{
+				// Identify Controller's VWC says we flush every namespace for this
+				for (auto &i : this->NamespaceIdToActiveNamespace)
+				{
+					namespacesToFlush.push_back(i.second);
+				}
+			}
+
+			if (!namespacesToFlush.empty() || command.NSID == ALL_NAMESPACES)
+			{
+				// In-memory media is always 'safe'.. file backed media actually gets synced to disk (after its write cache is destaged).
+				// Either of those can take a while, so they happen on the I/O workers.
+				bool shouldDefer = false;
+				for (auto &theNamespace : namespacesToFlush)
+				{
+					shouldDefer |= theNamespace->isAsynchronous() || theNamespace->hasVolatileWriteCache();
+				}
+
+				auto flushNamespaces = [namespacesToFlush]() {
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+					for (auto &theNamespace : namespacesToFlush)
+					{
+						completionQueueEntry = theNamespace->flush();
+						if (!completionQueueEntry.succeeded())
+						{
+							break;
+						}
+					}
+					return completionQueueEntry;
+				};
+
+				if (shouldDefer)
+				{
+					this->deferCompletion(flushNamespaces);
+				}
+				else
+				{
+					completionQueueEntryToPost = flushNamespaces();
+				}
+				return;
+			}
+
+			// not an active NSID
+			completionQueueEntryToPost.DNR = 1; // Do Not Retry
+
+			namespacePair = this->NamespaceIdToInactiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToInactiveNamespace.end())
+			{
+				// User specified an inactive NSID.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+			}
+
+			// User specified an invalid NSID.
+			completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmRead)
+		{
+			// Make sure the namespace exists
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			// Do we have a PRP?
+			if (command.DPTR.DPTR1)
+			{
+				std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the read is done
+				UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+				auto doRead = [theNamespace, command, memoryPageSize]() {
+					Payload readData;
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = theNamespace->read(command, readData);
+					PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, readData.getSize(), memoryPageSize);
+					prps.placePayloadInExistingPRPs(readData);
+					return completionQueueEntry;
+				};
+
+				if (theNamespace->isAsynchronous())
+				{
+					this->deferLbaRangeCompletion(*theNamespace, command.SLBA, ONE_BASED_FROM_ZERO_BASED(command.DW12_IO.NLB), false, doRead);
+				}
+				else
+				{
+					completionQueueEntryToPost = doRead();
+				}
+			}
+			else
+			{
+				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+				completionQueueEntryToPost.DNR = 1;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmWrite)
+		{
+			// Make sure the namespace exists
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			// Do we have a PRP?
+			if (command.DPTR.DPTR1)
+			{
+				std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the write is done
+				ns::ZONE_WRITE_RESERVATION zoneReservation = { 0 };
+				completionQueueEntryToPost = theNamespace->reserveZoneWrite(command, zoneReservation);
+				if (!completionQueueEntryToPost.succeeded())
+				{
+					return;
+				}
+
+				UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+				auto doWrite = [theNamespace, command, memoryPageSize, zoneReservation]() {
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = theNamespace->write(command, memoryPageSize);
+					if (!completionQueueEntry.succeeded())
+					{
+						// The zone only moves on for data that was written
+						theNamespace->releaseZoneWrite(zoneReservation);
+					}
+					return completionQueueEntry;
+				};
+
+				if (theNamespace->isAsynchronous())
+				{
+					this->deferLbaRangeCompletion(*theNamespace, command.SLBA, ONE_BASED_FROM_ZERO_BASED(command.DW12_IO.NLB), true, doWrite);
+				}
+				else
+				{
+					completionQueueEntryToPost = doWrite();
+				}
+			}
+			else
+			{
+				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+				completionQueueEntryToPost.DNR = 1;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmZoneManagementSend)
+		{
+			// Make sure the namespace exists and has zones
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the reset is done
+			if (!theNamespace->isZoned())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_COMMAND_OPCODE;
+				return;
+			}
+
+			// The zone states change now, in submission order. Reset zones still need their data thrown away.
+			std::vector<UINT_64> resetZoneStartLbas;
+			completionQueueEntryToPost = theNamespace->zoneManagementSend(command, resetZoneStartLbas);
+			if (!completionQueueEntryToPost.succeeded() || resetZoneStartLbas.empty())
+			{
+				return;
+			}
+
+			if (theNamespace->isAsynchronous())
+			{
+				// Wait for writes to those zones that are still running. Select All can reset any of them, so just hold the whole namespace.
+				this->deferLbaRangeCompletion(*theNamespace, 0, 0, true, [theNamespace, resetZoneStartLbas]() { return theNamespace->resetZoneData(resetZoneStartLbas); });
+			}
+			else
+			{
+				completionQueueEntryToPost = theNamespace->resetZoneData(resetZoneStartLbas);
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmZoneManagementReceive)
+		{
+			// Make sure the namespace exists and has zones
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			if (!namespacePair->second->isZoned())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_COMMAND_OPCODE;
+				return;
+			}
+
+			// Do we have a PRP?
+			if (command.DPTR.DPTR1)
+			{
+				// Zone states only change on this thread, so the report is made right here
+				Payload report;
+				completionQueueEntryToPost = namespacePair->second->zoneManagementReceive(command, report);
+				if (completionQueueEntryToPost.succeeded())
+				{
+					PRP prps(command.DPTR.DPTR1, command.DPTR.DPTR2, report.getSize(), ControllerRegisters->getMemoryPageSize());
+					prps.placePayloadInExistingPRPs(report);
+				}
+			}
+			else
+			{
+				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+				completionQueueEntryToPost.DNR = 1;
+			}
+		}
+
+		NVME_CALLER_IMPLEMENTATION(nvmZoneAppend)
+		{
+			// Make sure the namespace exists and has zones
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(command.NSID);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT;
+				return;
+			}
+
+			std::shared_ptr<ns::Namespace> theNamespace = namespacePair->second; // Stays alive until the append is done
+			if (!theNamespace->isZoned())
+			{
+				completionQueueEntryToPost.DNR = 1; // Do Not Retry
+				completionQueueEntryToPost.SC = constants::status::codes::generic::INVALID_COMMAND_OPCODE;
+				return;
+			}
+
+			// Do we have a PRP?
+			if (command.DPTR.DPTR1)
+			{
+				// The write pointer moves now, in submission order, so appends from any queue land one after another.
+				// From here on this is a write to where the append landed. (command is the host's entry, so don't change it.)
+				NVME_COMMAND appendCommand = command;
+				ns::ZONE_WRITE_RESERVATION zoneReservation = { 0 };
+				completionQueueEntryToPost = theNamespace->reserveZoneWrite(appendCommand, zoneReservation);
+				if (!completionQueueEntryToPost.succeeded())
+				{
+					return;
+				}
+
+				UINT_32 memoryPageSize = ControllerRegisters->getMemoryPageSize();
+				auto doAppend = [theNamespace, appendCommand, memoryPageSize, zoneReservation]() {
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = theNamespace->write(appendCommand, memoryPageSize);
+					if (completionQueueEntry.succeeded())
+					{
+						// The host finds out where its data went from the completion
+						completionQueueEntry.DWord0 = (UINT_32)appendCommand.SLBA;
+						completionQueueEntry.DWord1 = (UINT_32)(appendCommand.SLBA >> 32);
+					}
+					else
+					{
+						theNamespace->releaseZoneWrite(zoneReservation);
+					}
+					return completionQueueEntry;
+				};
+
+				if (theNamespace->isAsynchronous())
+				{
+					this->deferLbaRangeCompletion(*theNamespace, appendCommand.SLBA, ONE_BASED_FROM_ZERO_BASED(appendCommand.DW12_IO.NLB), true, doAppend);
+				}
+				else
+				{
+					completionQueueEntryToPost = doAppend();
+				}
+			}
+			else
+			{
+				// No PRP? Huh? Fail.
+				completionQueueEntryToPost.SC = constants::status::codes::generic::PRP_OFFSET_INVALID;
+				completionQueueEntryToPost.DNR = 1;
+			}
+		}
+
+		void Controller::controllerResetCallback()
+		{
+			LOG_INFO("Recv'd a controllerResetCallback request.");
+			std::unique_lock<std::mutex> lock(this->QueueMutex);
+
+			// Let in-flight I/O finish, then throw away its completions. The host is starting over.
+			this->waitForDeferredCompletions();
+			this->CompletionTimers.clear();
+			{
+				std::unique_lock<std::mutex> deferredLock(this->FinishedDeferredCompletionsMutex);
+				this->FinishedDeferredCompletions.clear();
+			}
+
+			for (size_t i = ValidSubmissionQueues.size() - 1; i != -1; i--)
+			{
+				if (ValidSubmissionQueues[i]->getQueueId() != ADMIN_QUEUE_ID)
+				{
+					delete ValidSubmissionQueues[i];
+					ValidSubmissionQueues.erase(ValidSubmissionQueues.begin() + i);
+				}
+			}
+
+			for (size_t i = ValidCompletionQueues.size() - 1; i != -1; i--)
+			{
+				if (ValidCompletionQueues[i]->getQueueId() != ADMIN_QUEUE_ID)
+				{
+					delete ValidCompletionQueues[i];
+					ValidCompletionQueues.erase(ValidCompletionQueues.begin() + i);
+				}
+			}
+
+			// Clear the SubQ to CID listing.
+			this->SubmissionQueueIdToCommandIdentifiers.clear();
+			this->SubmissionQueueIdToQosLimiter.clear();
+			this->PowerStates.reset(std::chrono::steady_clock::now());
+
+			// The admin queues start over empty.
+			for (Queue* q : this->ValidSubmissionQueues)
+			{
+				q->reset();
+				q->ringDoorbell(0);
+			}
+
+			for (Queue* q : this->ValidCompletionQueues)
+			{
+				q->reset();
+				q->ringDoorbell(0);
+			}
+
+			// Clear FW Image Download Cache
+			this->FirmwareImageDWordOffsetToData.clear();
+
+			// If a FW slot is given to update to on reset, do it now.
+			if (this->FirmwareSlotInfo.AFI.FirmwareSlotForNextControllerReset)
+			{
+				this->replaceRunningFirmwareWithOneInSlot(this->FirmwareSlotInfo.AFI.FirmwareSlotForNextControllerReset);
+			}
+		}
+
+		void Controller::waitForChangeLoop()
+		{
+#ifndef SINGLE_THREADED
+			DoorbellWatcher.waitForFlip();
+#else
+			checkForChanges();
+#endif
+		}
+
+		void Controller::setCommandResponseFilePath(const std::string filePath)
+		{
+			LOG_INFO("Set CRAPI-F to " + filePath);
+			this->CommandResponseApiFilePath = filePath;
+		}
+
+		bool Controller::setNamespaceMediaFile(UINT_32 namespaceId, const std::string filePath, UINT_64 sizeInBytes, bool directIo)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't set the media file for NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			std::shared_ptr<ns::Media> media;
+			if (directIo)
+			{
+				auto directFileMedia = std::make_shared<ns::DirectFileMedia>(filePath, sizeInBytes);
+				if (directFileMedia->isOpen())
+				{
+					media = directFileMedia;
+				}
+			}
+			else
+			{
+				auto mappedFileMedia = std::make_shared<ns::MappedFileMedia>(filePath, sizeInBytes);
+				if (mappedFileMedia->isMapped())
+				{
+					media = mappedFileMedia;
+				}
+			}
+
+			if (!media || !namespacePair->second->setMedia(media) || !namespacePair->second->setVolatileWriteCache(this->VolatileWriteCacheEnabled))
+			{
+				return false;
+			}
+
+			LOG_INFO("NSID " + std::to_string(namespaceId) + " is now backed by " + filePath);
+			return true;
+		}
+
+		bool Controller::snapshotNamespace(UINT_32 namespaceId)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't snapshot NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			return namespacePair->second->takeSnapshot();
+		}
+
+		bool Controller::revertNamespaceToSnapshot(UINT_32 namespaceId)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't revert NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			return namespacePair->second->revertToSnapshot();
+		}
+
+		bool Controller::setNamespaceDeduplicatedMedia(UINT_32 namespaceId, bool compress)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't deduplicate NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			UINT_64 sizeInBytes = namespacePair->second->getMedia()->getSize();
+			if (!namespacePair->second->setMedia(std::make_shared<ns::DedupMedia>(sizeInBytes, compress)))
+			{
+				return false;
+			}
+
+			LOG_INFO("NSID " + std::to_string(namespaceId) + " is now backed by deduplicated media" + (compress ? " with compression" : ""));
+			return true;
+		}
+
+		bool Controller::getNamespaceDedupStatistics(UINT_32 namespaceId, ns::DEDUP_STATISTICS &statistics)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't get deduplication statistics for NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			auto dedupMedia = std::dynamic_pointer_cast<ns::DedupMedia>(namespacePair->second->getMedia());
+			if (!dedupMedia)
+			{
+				LOG_ERROR("NSID " + std::to_string(namespaceId) + " isn't backed by deduplicated media");
+				return false;
+			}
+
+			statistics = dedupMedia->getStatistics();
+			return true;
+		}
+
+		bool Controller::setNamespaceFtl(UINT_32 namespaceId, const ns::FTL_PARAMETERS &parameters)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't model an FTL for NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			if (!namespacePair->second->setFtl(parameters))
+			{
+				return false;
+			}
+
+			LOG_INFO("NSID " + std::to_string(namespaceId) + " now has an FTL model with " + std::to_string(parameters.OverProvisioning) + "% over-provisioning");
+			return true;
+		}
+
+		bool Controller::removeNamespaceFtl(UINT_32 namespaceId)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't remove the FTL model for NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			return namespacePair->second->removeFtl();
+		}
+
+		bool Controller::getNamespaceFtlStatistics(UINT_32 namespaceId, ns::FTL_STATISTICS &statistics)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+
+			auto namespacePair = this->NamespaceIdToActiveNamespace.find(namespaceId);
+			if (namespacePair == this->NamespaceIdToActiveNamespace.end())
+			{
+				LOG_ERROR("Can't get FTL statistics for NSID " + std::to_string(namespaceId) + " since it isn't an active namespace");
+				return false;
+			}
+
+			auto ftl = namespacePair->second->getFtl();
+			if (!ftl)
+			{
+				LOG_ERROR("NSID " + std::to_string(namespaceId) + " doesn't have an FTL model");
+				return false;
+			}
+
+			statistics = ftl->getStatistics();
+			return true;
+		}
+
+		bool Controller::saveNamespaceImage(UINT_32 namespaceId, const std::string filePath)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			std::shared_ptr<ns::Namespace> theNamespace = this->getAllocatedNamespace(namespaceId);
+			if (!theNamespace)
+			{
+				LOG_ERROR("Can't save an image of NSID " + std::to_string(namespaceId) + " since it isn't an allocated namespace");
+				return false;
+			}
+
+			std::ofstream image(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+			this->writeImageHeader(image, constants::image::types::NAMESPACE_IMAGE);
+			if (!theNamespace->saveImage(image) || !image.flush())
+			{
+				LOG_ERROR("Failed to save an image of NSID " + std::to_string(namespaceId) + " to " + filePath);
+				return false;
+			}
+
+			LOG_INFO("Saved an image of NSID " + std::to_string(namespaceId) + " to " + filePath);
+			return true;
+		}
+
+		bool Controller::loadNamespaceImage(UINT_32 namespaceId, const std::string filePath)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			std::shared_ptr<ns::Namespace> theNamespace = this->getAllocatedNamespace(namespaceId);
+			if (!theNamespace)
+			{
+				LOG_ERROR("Can't load an image into NSID " + std::to_string(namespaceId) + " since it isn't an allocated namespace");
+				return false;
+			}
+
+			std::ifstream image(filePath, std::ios::in | std::ios::binary);
+			if (!this->readImageHeader(image, constants::image::types::NAMESPACE_IMAGE) || !theNamespace->loadImage(image))
+			{
+				LOG_ERROR("Failed to load an image into NSID " + std::to_string(namespaceId) + " from " + filePath);
+				return false;
+			}
+
+			LOG_INFO("Loaded an image into NSID " + std::to_string(namespaceId) + " from " + filePath);
+			return true;
+		}
+
+		bool Controller::saveControllerImage(const std::string filePath)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> allocatedNamespaces = this->getAllocatedNamespaceMap();
+
+			std::ofstream image(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+			this->writeImageHeader(image, constants::image::types::CONTROLLER_IMAGE);
+
+			CONTROLLER_IMAGE_HEADER header = { 0 };
+			header.IdentifyController = this->IdentifyController;
+			header.FirmwareSlotInfo = this->FirmwareSlotInfo;
+			header.NumberOfNamespaces = (UINT_32)allocatedNamespaces.size();
+			image.write((const char*)&header, sizeof(header));
+
+			for (auto &namespacePair : allocatedNamespaces)
+			{
+				IMAGE_NAMESPACE_ENTRY entry = { 0 };
+				entry.NamespaceId = namespacePair.first;
+				entry.Attached = this->NamespaceIdToActiveNamespace.count(namespacePair.first) ? 1 : 0;
+				image.write((const char*)&entry, sizeof(entry));
+
+				if (!namespacePair.second->saveImage(image))
+				{
+					LOG_ERROR("Failed to save NSID " + std::to_string(namespacePair.first) + " to the image " + filePath);
+					return false;
+				}
+			}
+
+			if (!image.flush())
+			{
+				LOG_ERROR("Failed to save the controller image " + filePath);
+				return false;
+			}
+
+			LOG_INFO("Saved a controller image with " + std::to_string(allocatedNamespaces.size()) + " namespace(s) to " + filePath);
+			return true;
+		}
+
+		bool Controller::loadControllerImage(const std::string filePath)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+			this->waitForDeferredCompletions();
+
+			std::ifstream image(filePath, std::ios::in | std::ios::binary);
+			if (!this->readImageHeader(image, constants::image::types::CONTROLLER_IMAGE))
+			{
+				return false;
+			}
+
+			CONTROLLER_IMAGE_HEADER header = { 0 };
+			if (!image.read((char*)&header, sizeof(header)))
+			{
+				LOG_ERROR("The controller image " + filePath + " ended before its header");
+				return false;
+			}
+
+			// Load everything before changing anything, so a bad image leaves the controller as it was
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> activeNamespaces;
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> inactiveNamespaces;
+			for (UINT_32 i = 0; i < header.NumberOfNamespaces; i++)
+			{
+				IMAGE_NAMESPACE_ENTRY entry = { 0 };
+				if (!image.read((char*)&entry, sizeof(entry)))
+				{
+					LOG_ERROR("The controller image " + filePath + " ended before all of its namespaces");
+					return false;
+				}
+
+				if (entry.NamespaceId == 0 || entry.NamespaceId > header.IdentifyController.NN ||
+					activeNamespaces.count(entry.NamespaceId) || inactiveNamespaces.count(entry.NamespaceId))
+				{
+					LOG_ERROR("The controller image " + filePath + " has a bad or repeated NSID: " + std::to_string(entry.NamespaceId));
+					return false;
+				}
+
+				auto theNamespace = std::make_shared<ns::Namespace>();
+				if (!theNamespace->loadImage(image))
+				{
+					LOG_ERROR("Failed to load NSID " + std::to_string(entry.NamespaceId) + " from the controller image " + filePath);
+					return false;
+				}
+
+				if (entry.Attached)
+				{
+					activeNamespaces[entry.NamespaceId] = theNamespace;
+				}
+				else
+				{
+					inactiveNamespaces[entry.NamespaceId] = theNamespace;
+				}
+			}
+
+			this->IdentifyController = header.IdentifyController;
+			this->FirmwareSlotInfo = header.FirmwareSlotInfo;
+			this->NamespaceIdToActiveNamespace.swap(activeNamespaces);
+			this->NamespaceIdToInactiveNamespace.swap(inactiveNamespaces);
+			this->NamespaceIdToQosLimiter.clear(); // They were for the namespaces that were just replaced
+
+			LOG_INFO("Loaded a controller image with " + std::to_string(header.NumberOfNamespaces) + " namespace(s) from " + filePath);
+			return true;
+		}
+
+		void Controller::setTimingModel(std::shared_ptr<TimingModel> timingModel)
+		{
+			std::unique_lock<std::mutex> lock(this->QueueMutex); // Commands are processed under this lock
+
+			// Completions already being held keep the times the old model gave them
+			this->CompletionTimingModel = timingModel;
+			LOG_INFO(std::string(timingModel ? "Using a" : "Not using a") + " timing model for completions");
+		}
+
+		bool Controller::readImageHeader(std::istream &image, UINT_32 imageType)
+		{
+			IMAGE_HEADER header = { 0 };
+			if (!image.read((char*)&header, sizeof(header)))
+			{
+				LOG_ERROR("Couldn't read an image header");
+				return false;
+			}
+
+			if (std::string(header.Magic, sizeof(header.Magic)) != constants::image::MAGIC || header.Version != constants::image::VERSION || header.Type != imageType)
+			{
+				LOG_ERROR("Not a version " + std::to_string(constants::image::VERSION) + " image of type " + std::to_string(imageType));
+				return false;
+			}
+
+			return true;
+		}
+
+		void Controller::writeImageHeader(std::ostream &image, UINT_32 imageType)
+		{
+			IMAGE_HEADER header = { 0 };
+			memcpy_s(header.Magic, sizeof(header.Magic), constants::image::MAGIC.c_str(), constants::image::MAGIC.size());
+			header.Version = constants::image::VERSION;
+			header.Type = imageType;
+			image.write((const char*)&header, sizeof(header));
 		}
 
 		const std::map<UINT_8, NVMeCaller> Controller::AdminCommandCallers = {
@@ -1225,14 +2972,24 @@ namespace cnvme
 			{ cnvme::constants::opcodes::admin::FIRMWARE_COMMIT, &cnvme::controller::Controller::adminFirmwareCommit},
 			{ cnvme::constants::opcodes::admin::FIRMWARE_IMAGE_DOWNLOAD, &cnvme::controller::Controller::adminFirmwareImageDownload},
 			{ cnvme::constants::opcodes::admin::FORMAT_NVM, &cnvme::controller::Controller::adminFormatNvm},
+			{ cnvme::constants::opcodes::admin::GET_FEATURES, &cnvme::controller::Controller::adminGetFeatures},
 			{ cnvme::constants::opcodes::admin::IDENTIFY, &cnvme::controller::Controller::adminIdentify},
-			{ cnvme::constants::opcodes::admin::KEEP_ALIVE, &cnvme::controller::Controller::adminKeepAlive}
+			{ cnvme::constants::opcodes::admin::KEEP_ALIVE, &cnvme::controller::Controller::adminKeepAlive},
+			{ cnvme::constants::opcodes::admin::NAMESPACE_ATTACHMENT, &cnvme::controller::Controller::adminNamespaceAttachment},
+			{ cnvme::constants::opcodes::admin::NAMESPACE_MANAGEMENT, &cnvme::controller::Controller::adminNamespaceManagement},
+			{ cnvme::constants::opcodes::admin::SET_FEATURES, &cnvme::controller::Controller::adminSetFeatures}
 		};
 
 		const std::map<UINT_8, NVMeCaller> Controller::NVMCommandCallers = {
+			{ cnvme::constants::opcodes::nvm::COMPARE, &cnvme::controller::Controller::nvmCompare},
+			{ cnvme::constants::opcodes::nvm::DATASET_MANAGEMENT, &cnvme::controller::Controller::nvmDatasetManagement},
+			{ cnvme::constants::opcodes::nvm::WRITE_ZEROES, &cnvme::controller::Controller::nvmWriteZeroes},
 			{ cnvme::constants::opcodes::nvm::FLUSH, &cnvme::controller::Controller::nvmFlush},
 			{ cnvme::constants::opcodes::nvm::READ, &cnvme::controller::Controller::nvmRead},
-			{ cnvme::constants::opcodes::nvm::WRITE, &cnvme::controller::Controller::nvmWrite}
+			{ cnvme::constants::opcodes::nvm::WRITE, &cnvme::controller::Controller::nvmWrite},
+			{ cnvme::constants::opcodes::nvm::ZONE_MANAGEMENT_SEND, &cnvme::controller::Controller::nvmZoneManagementSend},
+			{ cnvme::constants::opcodes::nvm::ZONE_MANAGEMENT_RECEIVE, &cnvme::controller::Controller::nvmZoneManagementReceive},
+			{ cnvme::constants::opcodes::nvm::ZONE_APPEND, &cnvme::controller::Controller::nvmZoneAppend}
 		};
 	}
 }
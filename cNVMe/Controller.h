@@ -31,13 +31,24 @@ Controller.h - A header file for the NVMe Controller
 #include "LogPages.h"
 #include "Namespace.h"
 #include "PCIe.h"
+#include "PowerState.h"
 #include "Types.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+#include "TimingModel.h"
+#include "TokenBucket.h"
 #include "Queue.h"
 
 #define ADMIN_QUEUE_ID 0
+#define ALL_NAMESPACES 0xFFFFFFFF
+#define DEFAULT_NAMESPACE_SIZE 16384 // 16 kilobytes
 #define FIRMWARE_EYE_CATCHER "cNVMe"
 #define MAX_COMMAND_IDENTIFIER 0xFFFF
 #define MAX_SUBMISSION_QUEUES  0xFFFF
+#define IO_WORKER_THREADS 4 // Threads that run I/O for namespaces with asynchronous media
+#define COMPLETION_TIMER_TICK_US 10 // Granularity of modeled completion times
+#define COMPLETION_TIMER_SLOTS 4096 // Ticks in a turn of the completion timer wheel
+#define QOS_BURST_MS 100 // A QoS limit lets this much time worth of commands or bytes through at once
 
 using namespace cnvme;
 using namespace cnvme::command;
@@ -50,6 +61,68 @@ namespace cnvme
 {
 	namespace controller
 	{
+		/// <summary>
+		/// A command that was run on an I/O worker thread and is waiting for the doorbell watcher to post its completion
+		/// </summary>
+		typedef struct DEFERRED_COMPLETION
+		{
+			UINT_16 SubmissionQueueId;
+			NVME_COMMAND Command;
+			COMPLETION_QUEUE_ENTRY CompletionQueueEntry;
+		} DEFERRED_COMPLETION, *PDEFERRED_COMPLETION;
+
+		/// <summary>
+		/// A command the timing model is asked about, from when it is fetched until its writes reach the media
+		/// </summary>
+		typedef struct MODELED_COMMAND
+		{
+			TIMED_COMMAND TimedCommand;
+			std::chrono::steady_clock::time_point StartTime; // When the device can start on it, once awake
+			std::shared_ptr<TimingModel> Model; // Timing model when the command was fetched. nullptr for none.
+			std::shared_ptr<ns::FtlMedia> Ftl; // FTL model of the command's namespace, if it has one
+		} MODELED_COMMAND, *PMODELED_COMMAND;
+
+		/// <summary>
+		/// Starts every image file
+		/// </summary>
+		typedef struct IMAGE_HEADER
+		{
+			char Magic[8]; // constants::image::MAGIC
+			UINT_32 Version;
+			UINT_32 Type; // constants::image::types
+		} IMAGE_HEADER, *PIMAGE_HEADER;
+		static_assert(sizeof(IMAGE_HEADER) == 16, "IMAGE_HEADER should be 16 byte(s) in size.");
+
+		/// <summary>
+		/// Follows the IMAGE_HEADER of a controller image. Each namespace follows it as an IMAGE_NAMESPACE_ENTRY then a namespace image.
+		/// </summary>
+		typedef struct CONTROLLER_IMAGE_HEADER
+		{
+			identify::structures::IDENTIFY_CONTROLLER IdentifyController;
+			log_pages::FIRMWARE_SLOT_INFO FirmwareSlotInfo;
+			UINT_32 NumberOfNamespaces;
+			UINT_32 RSVD;
+		} CONTROLLER_IMAGE_HEADER, *PCONTROLLER_IMAGE_HEADER;
+
+		/// <summary>
+		/// Says which namespace is next in a controller image
+		/// </summary>
+		typedef struct IMAGE_NAMESPACE_ENTRY
+		{
+			UINT_32 NamespaceId;
+			UINT_32 Attached; // 1 if the namespace is attached to (active on) the controller
+		} IMAGE_NAMESPACE_ENTRY, *PIMAGE_NAMESPACE_ENTRY;
+
+		/// <summary>
+		/// The QoS Limits feature for a namespace or submission queue
+		/// </summary>
+		typedef struct QOS_LIMITER
+		{
+			UINT_32 IopsLimit; // 0 is unlimited
+			UINT_32 BandwidthLimit; // KiB/s, 0 is unlimited
+			TokenBucket Commands;
+			TokenBucket Bytes;
+		} QOS_LIMITER, *PQOS_LIMITER;
 
 		class Controller
 		{
@@ -59,6 +132,12 @@ namespace cnvme
 			/// </summary>
 			Controller();
 
+			/// <summary>
+			/// Constructor for the controller with a given doorbell stride
+			/// </summary>
+			/// <param name="doorbellStride">CAP.DSTRD to report. Doorbells are (4 << doorbellStride) bytes apart.</param>
+			Controller(UINT_8 doorbellStride);
+
 			/// <summary>
 			/// Destructor for the controller
 			/// </summary>
@@ -94,6 +173,107 @@ namespace cnvme
 			/// <param name="filePath">path to file</param>
 			void setCommandResponseFilePath(const std::string filePath);
 
+			/// <summary>
+			/// Backs an active namespace with a file. The file is created if it doesn't exist.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="filePath">path to the file (or block device for direct I/O)</param>
+			/// <param name="sizeInBytes">Namespace size. 0 means use the size of the existing file.</param>
+			/// <param name="directIo">false to memory map the file. true to do direct I/O on it, with commands completing asynchronously.</param>
+			/// <returns>true on success</returns>
+			bool setNamespaceMediaFile(UINT_32 namespaceId, const std::string filePath, UINT_64 sizeInBytes, bool directIo);
+
+			/// <summary>
+			/// Snapshots the data in an active namespace (replacing its older snapshot). O(1) for in-memory namespaces.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <returns>true on success. false if the namespace isn't active or its media can't be cloned.</returns>
+			bool snapshotNamespace(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Puts the data in an active namespace back to its snapshot. The snapshot can be reverted to again later.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <returns>true on success. false if the namespace isn't active or doesn't have a snapshot.</returns>
+			bool revertNamespaceToSnapshot(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Backs an active namespace with new, empty deduplicated media of the same size. Its old data is dropped.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="compress">true to also compress the stored blocks</param>
+			/// <returns>true on success</returns>
+			bool setNamespaceDeduplicatedMedia(UINT_32 namespaceId, bool compress);
+
+			/// <summary>
+			/// Gets the deduplication statistics for an active namespace
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="statistics">Filled in with the statistics</param>
+			/// <returns>true on success. false if the namespace isn't active or isn't backed by deduplicated media.</returns>
+			bool getNamespaceDedupStatistics(UINT_32 namespaceId, ns::DEDUP_STATISTICS &statistics);
+
+			/// <summary>
+			/// Puts a new FTL model in front of an active namespace's media, replacing any older one. The data is kept.
+			/// Its garbage collection work is charged to the dies of the timing model, if there is one.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="parameters">Settings for the model</param>
+			/// <returns>true on success. false if the namespace isn't active, the settings don't fit it, or the write cache is on.</returns>
+			bool setNamespaceFtl(UINT_32 namespaceId, const ns::FTL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Takes the FTL model away from an active namespace. The data is kept.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <returns>true on success. false if the namespace isn't active or the write cache is on.</returns>
+			bool removeNamespaceFtl(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Gets the FTL statistics (write amplification, garbage collection and free blocks) for an active namespace
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="statistics">Filled in with the statistics</param>
+			/// <returns>true on success. false if the namespace isn't active or doesn't have an FTL model.</returns>
+			bool getNamespaceFtlStatistics(UINT_32 namespaceId, ns::FTL_STATISTICS &statistics);
+
+			/// <summary>
+			/// Saves an allocated namespace to an image file. Only the parts of it that have been written take up space.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the allocated namespace</param>
+			/// <param name="filePath">path to the image file. Overwritten if it exists.</param>
+			/// <returns>true on success</returns>
+			bool saveNamespaceImage(UINT_32 namespaceId, const std::string filePath);
+
+			/// <summary>
+			/// Replaces an allocated namespace (its data, LBA format and NGUID) with one from saveNamespaceImage()
+			/// </summary>
+			/// <param name="namespaceId">NSID of the allocated namespace</param>
+			/// <param name="filePath">path to the image file</param>
+			/// <returns>true on success. false (leaving the namespace as it was) if the image is bad.</returns>
+			bool loadNamespaceImage(UINT_32 namespaceId, const std::string filePath);
+
+			/// <summary>
+			/// Saves the controller to an image file: the Identify Controller structure, firmware slots, and every allocated namespace
+			/// </summary>
+			/// <param name="filePath">path to the image file. Overwritten if it exists.</param>
+			/// <returns>true on success</returns>
+			bool saveControllerImage(const std::string filePath);
+
+			/// <summary>
+			/// Replaces the Identify Controller structure, firmware slots and all namespaces with those from saveControllerImage()
+			/// </summary>
+			/// <param name="filePath">path to the image file</param>
+			/// <returns>true on success. false (leaving the controller as it was) if the image is bad.</returns>
+			bool loadControllerImage(const std::string filePath);
+
+			/// <summary>
+			/// Sets the model of how long the device takes for each command. Completions are held until the time it gives.
+			/// Completions still can't be posted before the command's work is done, or between passes of the doorbell watcher.
+			/// </summary>
+			/// <param name="timingModel">The model. nullptr to post completions as soon as the work is done.</param>
+			void setTimingModel(std::shared_ptr<TimingModel> timingModel);
+
 		private:
 
 			/// <summary>
@@ -140,6 +320,16 @@ namespace cnvme
 			/// <param name="submissionQueue">The internal submission queue object for this command</param>
 			void processCommandAndPostCompletion(Queue &submissionQueue);
 
+			/// <summary>
+			/// Handles both commands of a fused operation, given the first one.
+			/// The second command has to be the next entry in the submission queue. It is taken off the queue here and
+			///   its completion is posted along with the deferred ones.
+			/// </summary>
+			/// <param name="submissionQueue">The internal submission queue object. Its head is still at the first command.</param>
+			/// <param name="firstCommand">The first command of the fused operation</param>
+			/// <param name="completionQueueEntryToPost">Completion for the first command</param>
+			void processFusedCommands(Queue &submissionQueue, NVME_COMMAND &firstCommand, COMPLETION_QUEUE_ENTRY &completionQueueEntryToPost);
+
 			/// <summary>
 			/// Returns a Queue matching the given id
 			/// </summary>
@@ -158,6 +348,100 @@ namespace cnvme
 			/// <param name="command">The NVMe Command that is having its completion posted</param>
 			void postCompletion(Queue &completionQueue, command::COMPLETION_QUEUE_ENTRY completionEntry, command::NVME_COMMAND* command);
 
+			/// <summary>
+			/// Called by a command handler instead of filling in the completion.
+			/// The work runs on an I/O worker thread and the completion it returns is posted once it finishes.
+			/// </summary>
+			/// <param name="work">Does the command. Must not touch controller state, since it runs off the doorbell watcher.</param>
+			void deferCompletion(std::function<COMPLETION_QUEUE_ENTRY()> work);
+
+			/// <summary>
+			/// deferCompletion() for a command that touches a range of LBAs. The range is reserved now, in submission order,
+			///   and locked on the I/O worker around the work. So commands to other LBAs run in parallel,
+			///   while overlapping ones (unless both only read) run in the order they were submitted.
+			/// </summary>
+			/// <param name="theNamespace">Namespace the command is for</param>
+			/// <param name="firstLba">First LBA the command touches</param>
+			/// <param name="numberOfLbas">Number of LBAs the command touches (one based). 0 means through the last LBA.</param>
+			/// <param name="exclusive">true if the command writes the LBAs. false if it only reads them.</param>
+			/// <param name="work">Does the command. Must not touch controller state, since it runs off the doorbell watcher.</param>
+			void deferLbaRangeCompletion(ns::Namespace &theNamespace, UINT_64 firstLba, UINT_64 numberOfLbas, bool exclusive, std::function<COMPLETION_QUEUE_ENTRY()> work);
+
+			/// <summary>
+			/// Hands a finished completion to postFinishedDeferredCompletions(), which posts it once its completion queue has room.
+			/// Safe to call from any thread.
+			/// </summary>
+			/// <param name="submissionQueueId">Submission queue the command came from</param>
+			/// <param name="command">Copy of the command</param>
+			/// <param name="completionQueueEntry">Completion for the command</param>
+			void addFinishedDeferredCompletion(UINT_16 submissionQueueId, const NVME_COMMAND &command, COMPLETION_QUEUE_ENTRY completionQueueEntry);
+
+			/// <summary>
+			/// addFinishedDeferredCompletion(), but not before the given time. Safe to call from any thread.
+			/// </summary>
+			/// <param name="submissionQueueId">Submission queue the command came from</param>
+			/// <param name="command">Copy of the command</param>
+			/// <param name="completionQueueEntry">Completion for the command</param>
+			/// <param name="completionTime">Time the completion may be posted (from finishModeledCommand())</param>
+			void addTimedCompletion(UINT_16 submissionQueueId, const NVME_COMMAND &command, COMPLETION_QUEUE_ENTRY completionQueueEntry, std::chrono::steady_clock::time_point completionTime);
+
+			/// <summary>
+			/// Wakes the device for a command and gathers what the timing model needs to know about it. Call once per command, as it is fetched.
+			/// </summary>
+			/// <param name="submissionQueueId">Submission queue the command came from</param>
+			/// <param name="command">The command</param>
+			/// <returns>For finishModeledCommand()</returns>
+			MODELED_COMMAND startModeledCommand(UINT_16 submissionQueueId, const NVME_COMMAND &command);
+
+			/// <summary>
+			/// Asks the timing model when a command would finish. Garbage collection the namespace's FTL has done since is charged to the command,
+			///   so call once its writes have reached the media. Safe to call from any thread.
+			/// </summary>
+			/// <param name="modeledCommand">From startModeledCommand()</param>
+			/// <returns>Time its completion may be posted. Always in the past if there is no timing model.</returns>
+			std::chrono::steady_clock::time_point finishModeledCommand(MODELED_COMMAND &modeledCommand);
+
+			/// <summary>
+			/// Gets the number of bytes a command moves to or from namespace media
+			/// </summary>
+			/// <param name="submissionQueueId">Submission queue the command came from</param>
+			/// <param name="command">The command</param>
+			/// <returns>Bytes. 0 for commands that don't move namespace data.</returns>
+			UINT_64 getMediaTransferSizeBytes(UINT_16 submissionQueueId, const NVME_COMMAND &command);
+
+			/// <summary>
+			/// Checks the command at the head of an I/O submission queue against the QoS limits of its queue and namespace.
+			/// If it fits in both, it is charged to both.
+			/// </summary>
+			/// <param name="submissionQueue">The submission queue</param>
+			/// <returns>True if the command may run now. Otherwise it stays in the queue until a later pass.</returns>
+			bool admitCommand(Queue &submissionQueue);
+
+			/// <summary>
+			/// Finds the map of QoS limits a QoS Limits feature command is for. The command's key in it is its SQID or NSID.
+			/// </summary>
+			/// <param name="command">The Get/Set Features command</param>
+			/// <param name="completionQueueEntryToPost">Gets the error if there isn't such an I/O queue or active namespace</param>
+			/// <returns>The map of limits. nullptr on error.</returns>
+			std::map<UINT_32, QOS_LIMITER>* getQosLimiterMap(const NVME_COMMAND &command, COMPLETION_QUEUE_ENTRY &completionQueueEntryToPost);
+
+			/// <summary>
+			/// Posts the completions of finished deferred commands, as long as their completion queues have room.
+			/// Call with QueueMutex held, which keeps the caller the only producer for each completion queue.
+			/// </summary>
+			void postFinishedDeferredCompletions();
+
+			/// <summary>
+			/// Runs on CompletionTimerThread. Sleeps until the next timed completion is due, then advances CompletionTimers and posts it,
+			///   so modeled latencies shorter than the doorbell watcher's sleep aren't rounded up to it.
+			/// </summary>
+			void runCompletionTimers();
+
+			/// <summary>
+			/// Blocks until every deferred command has finished running (their completions may still need posting)
+			/// </summary>
+			void waitForDeferredCompletions();
+
 			/// <summary>
 			/// Returns true if the command id 
 			/// </summary>
@@ -166,15 +450,102 @@ namespace cnvme
 			/// <returns>true if valid, False otherwise.</returns>
 			bool isValidCommandIdentifier(UINT_16 commandId, UINT_16 submissionQueueId);
 
+			/// <summary>
+			/// Checks the IMAGE_HEADER at the start of an image file
+			/// </summary>
+			/// <param name="image">Stream to read the header from</param>
+			/// <param name="imageType">The constants::image::types the image should be</param>
+			/// <returns>true if it is an image of that type we can load</returns>
+			bool readImageHeader(std::istream &image, UINT_32 imageType);
+
+			/// <summary>
+			/// Writes the IMAGE_HEADER at the start of an image file
+			/// </summary>
+			/// <param name="image">Stream to write the header to</param>
+			/// <param name="imageType">The constants::image::types the image is</param>
+			void writeImageHeader(std::ostream &image, UINT_32 imageType);
+
 			/// <summary>
 			/// Resets the internal identify controller to default values.
 			/// </summary>
 			void resetIdentifyController();
 
 			/// <summary>
-			/// Corresponds with the phase tag in the completion queue entry for a queue
+			/// Guards the queues and namespaces. Commands are processed on the doorbell watcher,
+			///   but controller resets come from the register watcher and namespace media changes come from the host.
+			/// </summary>
+			std::mutex QueueMutex;
+
+			/// <summary>
+			/// Runs deferred commands
+			/// </summary>
+			ThreadPool IoWorkers;
+
+			/// <summary>
+			/// Set by deferCompletion() while a handler runs, then picked up by processCommandAndPostCompletion()
+			/// </summary>
+			std::function<COMPLETION_QUEUE_ENTRY()> DeferredWork;
+
+			/// <summary>
+			/// Deferred commands that have finished but haven't had their completions posted
+			/// </summary>
+			std::list<DEFERRED_COMPLETION> FinishedDeferredCompletions;
+
+			/// <summary>
+			/// Guards FinishedDeferredCompletions. I/O workers add to it, the doorbell watcher takes from it.
+			/// </summary>
+			std::mutex FinishedDeferredCompletionsMutex;
+
+			/// <summary>
+			/// Decides when completions may be posted. nullptr if they go out as soon as they can.
+			/// </summary>
+			std::shared_ptr<TimingModel> CompletionTimingModel;
+
+			/// <summary>
+			/// The power state the device is in, and when it goes to another one on its own. I/O waits for it to wake up.
+			/// </summary>
+			PowerStateModel PowerStates;
+
+			/// <summary>
+			/// Holds completions that are done before the timing model says they should be, until they are due.
+			/// CompletionTimerThread advances it at each deadline, and the doorbell watcher on each pass.
+			/// </summary>
+			TimerWheel CompletionTimers;
+
+			/// <summary>
+			/// Wakes up when the next timed completion is due (see runCompletionTimers())
+			/// </summary>
+			std::thread CompletionTimerThread;
+
+			/// <summary>
+			/// Signaled when a completion is due before NextCompletionTimerDeadline, or to stop CompletionTimerThread
+			/// </summary>
+			std::condition_variable CompletionTimerCondition;
+
+			/// <summary>
+			/// Guards NextCompletionTimerDeadline and StopCompletionTimerThread
+			/// </summary>
+			std::mutex CompletionTimerMutex;
+
+			/// <summary>
+			/// Time CompletionTimerThread is sleeping until. time_point::max() if nothing is scheduled.
+			/// </summary>
+			std::chrono::steady_clock::time_point NextCompletionTimerDeadline;
+
+			/// <summary>
+			/// Set to have CompletionTimerThread return
+			/// </summary>
+			bool StopCompletionTimerThread;
+
+			/// <summary>
+			/// QoS limits by NSID. Namespaces without limits aren't in here.
+			/// </summary>
+			std::map<UINT_32, QOS_LIMITER> NamespaceIdToQosLimiter;
+
+			/// <summary>
+			/// QoS limits by SQID. Submission queues without limits aren't in here.
 			/// </summary>
-			std::map<UINT_16, bool> QueueToPhaseTag;
+			std::map<UINT_32, QOS_LIMITER> SubmissionQueueIdToQosLimiter;
 
 			/// <summary>
 			/// Internal Identify Controller Structure
@@ -182,14 +553,15 @@ namespace cnvme
 			identify::structures::IDENTIFY_CONTROLLER IdentifyController;
 
 			/// <summary>
-			/// Internal map from NSID to active Namespace objects
+			/// Internal map from NSID to active Namespace objects.
+			/// Each namespace is owned once, here or in the inactive map. I/O that is still running holds its own reference.
 			/// </summary>
-			std::map<UINT_32, ns::Namespace> NamespaceIdToActiveNamespace;
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> NamespaceIdToActiveNamespace;
 
 			/// <summary>
 			/// Internal map from NSID to inactive Namespace objects
 			/// </summary>
-			std::map<UINT_32, ns::Namespace> NamespaceIdToInactiveNamespace;
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> NamespaceIdToInactiveNamespace;
 
 			/// <summary>
 			/// Gets a payload in the format of a namespace list (4-bytes per NSID)
@@ -198,13 +570,34 @@ namespace cnvme
 			/// <param name="startingNsid">NSID to start with</param>
 			/// <param name="completionQueueEntryToPost">CQE for an identify call to get this data</param>
 			/// <returns>Payload</returns>
-			Payload getNamespaceListFromMap(std::map<UINT_32, ns::Namespace> namespaceMap, UINT_32 startingNsid, COMPLETION_QUEUE_ENTRY& completionQueueEntryToPost);
+			Payload getNamespaceListFromMap(const std::map<UINT_32, std::shared_ptr<ns::Namespace>>& namespaceMap, UINT_32 startingNsid, COMPLETION_QUEUE_ENTRY& completionQueueEntryToPost);
 
 			/// <summary>
-			/// Gets a map of all namespaces (active or inactive)
+			/// Gets a map of all namespaces (active or inactive). Only the handles are copied.
 			/// </summary>
 			/// <returns></returns>
-			std::map<UINT_32, ns::Namespace> getAllocatedNamespaceMap() const;
+			std::map<UINT_32, std::shared_ptr<ns::Namespace>> getAllocatedNamespaceMap() const;
+
+			/// <summary>
+			/// Finds an allocated (active or inactive) namespace
+			/// </summary>
+			/// <param name="namespaceId">NSID to look for</param>
+			/// <returns>The namespace or nullptr if it isn't allocated</returns>
+			std::shared_ptr<ns::Namespace> getAllocatedNamespace(UINT_32 namespaceId) const;
+
+			/// <summary>
+			/// Gets the lowest NSID (up to IC.NN) that isn't given to an active or inactive namespace
+			/// </summary>
+			/// <returns>NSID or 0 if all are in use</returns>
+			UINT_32 getUnallocatedNamespaceId() const;
+
+			/// <summary>
+			/// Gets a payload in the format of a controller list. This controller is the only one in the subsystem.
+			/// </summary>
+			/// <param name="startingControllerId">Only controllers with an id at or above this one are listed</param>
+			/// <param name="includeThisController">false to give back an empty list</param>
+			/// <returns>Payload</returns>
+			Payload getControllerList(UINT_16 startingControllerId, bool includeThisController);
 
 			/// <summary>
 			/// Will attempt to call the command response api file (CRAPI-F)
@@ -246,6 +639,11 @@ namespace cnvme
 			/// </summary>
 			log_pages::FIRMWARE_SLOT_INFO FirmwareSlotInfo;
 
+			/// <summary>
+			/// The Volatile Write Cache feature. When set, namespaces on persistent media have a write cache in front of it.
+			/// </summary>
+			bool VolatileWriteCacheEnabled;
+
 			/// <summary>
 			/// Handling for the NVMe Identify Command
 			/// </summary>
@@ -286,11 +684,46 @@ namespace cnvme
 			/// </summary>
 			NVME_CALLER_HEADER(adminFormatNvm);
 
+			/// <summary>
+			/// Handling for the NVMe Get Features Command
+			/// </summary>
+			NVME_CALLER_HEADER(adminGetFeatures);
+
 			/// <summary>
 			/// Handling for the NVMe Keep Alive Command
 			/// </summary>
 			NVME_CALLER_HEADER(adminKeepAlive);
 
+			/// <summary>
+			/// Handling for the NVMe Namespace Attachment Command
+			/// </summary>
+			NVME_CALLER_HEADER(adminNamespaceAttachment);
+
+			/// <summary>
+			/// Handling for the NVMe Namespace Management Command
+			/// </summary>
+			NVME_CALLER_HEADER(adminNamespaceManagement);
+
+			/// <summary>
+			/// Handling for the NVMe Set Features Command
+			/// </summary>
+			NVME_CALLER_HEADER(adminSetFeatures);
+
+			/// <summary>
+			/// Handling for the NVM Compare command (when it isn't fused)
+			/// </summary>
+			NVME_CALLER_HEADER(nvmCompare);
+
+			/// <summary>
+			/// Handling for the NVM Write Zeroes command
+			/// </summary>
+			NVME_CALLER_HEADER(nvmWriteZeroes);
+
+			/// <summary>
+			/// Handling for the NVM Dataset Management command
+			/// </summary>
+			NVME_CALLER_HEADER(nvmDatasetManagement);
+
 			/// <summary>
 			/// Handling for the NVM Flush command
 			/// </summary>
@@ -305,6 +738,21 @@ namespace cnvme
 			/// Handling for the NVM Write command
 			/// </summary>
 			NVME_CALLER_HEADER(nvmWrite);
+
+			/// <summary>
+			/// Handling for the Zone Management Send command (Zoned Namespace Command Set)
+			/// </summary>
+			NVME_CALLER_HEADER(nvmZoneManagementSend);
+
+			/// <summary>
+			/// Handling for the Zone Management Receive command (Zoned Namespace Command Set)
+			/// </summary>
+			NVME_CALLER_HEADER(nvmZoneManagementReceive);
+
+			/// <summary>
+			/// Handling for the Zone Append command (Zoned Namespace Command Set)
+			/// </summary>
+			NVME_CALLER_HEADER(nvmZoneAppend);
 		};
 	}
 }
@@ -220,10 +220,23 @@ namespace cnvme
 				return retStr;
 			}
 
+			void setControllerEnable(CONTROLLER_REGISTERS* controllerRegisters, bool enable)
+			{
+				CONTROLLER_CONFIGURATION controllerConfiguration = readRegister(controllerRegisters->CC);
+				controllerConfiguration.EN = enable;
+				writeRegister(controllerRegisters->CC, controllerConfiguration);
+			}
+
+			bool isControllerReady(CONTROLLER_REGISTERS* controllerRegisters)
+			{
+				return readRegister(controllerRegisters->CSTS).RDY == 1;
+			}
+
 			ControllerRegisters::ControllerRegisters()
 			{
 				ControllerRegistersPointer = nullptr;
 				Controller = nullptr;
+				DoorbellStride = DEFAULT_DOORBELL_STRIDE;
 			}
 
 			ControllerRegisters::ControllerRegisters(UINT_64 memoryLocation) : ControllerRegisters::ControllerRegisters()
@@ -256,18 +269,21 @@ namespace cnvme
 			{
 				if (ControllerRegistersPointer)
 				{
-					if (ControllerRegistersPointer->CC.EN == 0 && !controllerResetInitiated)
+					CONTROLLER_CONFIGURATION controllerConfiguration = readRegister(ControllerRegistersPointer->CC);
+					if (controllerConfiguration.EN == 0 && !controllerResetInitiated)
 					{
 						LOG_INFO("CC.EN was flipped to 0. Initiating controller reset.");
 						controllerReset();
 						// CSTS.RDY should now be 0
 					}
 
-					if (controllerResetInitiated && ControllerRegistersPointer->CC.EN == 1)
+					if (controllerResetInitiated && controllerConfiguration.EN == 1)
 					{
 						LOG_INFO("CC.EN was set back to 1. Setting CSTS.RDY to 1.");
 						controllerResetInitiated = false; // the reset is complete
-						ControllerRegistersPointer->CSTS.RDY = 1; // Controller has been re-enabled. We are now ready.
+						CONTROLLER_STATUS controllerStatus = readRegister(ControllerRegistersPointer->CSTS);
+						controllerStatus.RDY = 1; // Controller has been re-enabled. We are now ready.
+						writeRegister(ControllerRegistersPointer->CSTS, controllerStatus);
 					}
 				}
 			}
@@ -278,6 +294,48 @@ namespace cnvme
 					+ sizeof(registers::CONTROLLER_REGISTERS));
 			}
 
+			UINT_16* ControllerRegisters::getSubmissionQueueTailDoorbell(UINT_16 queueId)
+			{
+				return getDoorbell(2 * (UINT_32)queueId);
+			}
+
+			UINT_16* ControllerRegisters::getCompletionQueueHeadDoorbell(UINT_16 queueId)
+			{
+				return getDoorbell((2 * (UINT_32)queueId) + 1);
+			}
+
+			bool ControllerRegisters::setDoorbellStride(UINT_8 doorbellStride)
+			{
+				if (doorbellStride > MAX_DOORBELL_STRIDE)
+				{
+					LOG_ERROR("Doorbell stride " + std::to_string(doorbellStride) + " is larger than the max of " + std::to_string(MAX_DOORBELL_STRIDE));
+					return false;
+				}
+
+				if (ControllerRegistersPointer && (readRegister(ControllerRegistersPointer->CC).EN || isControllerReady(ControllerRegistersPointer)))
+				{
+					LOG_ERROR("The doorbell stride can only be changed while the controller is disabled");
+					return false;
+				}
+
+				DoorbellStride = doorbellStride;
+				if (ControllerRegistersPointer)
+				{
+					ControllerRegistersPointer->CAP.DSTRD = DoorbellStride;
+				}
+				return true;
+			}
+
+			UINT_16* ControllerRegisters::getDoorbell(UINT_32 doorbellIndex)
+			{
+				if (!ControllerRegistersPointer || doorbellIndex >= 2 * MAX_QUEUE_PAIRS)
+				{
+					return nullptr;
+				}
+
+				return (UINT_16*)((UINT_8*)getQueueDoorbells() + (doorbellIndex * DOORBELL_STRIDE_IN_BYTES(DoorbellStride)));
+			}
+
 			void ControllerRegisters::waitForChangeLoop()
 			{
 #ifndef SINGLE_THREADED
@@ -292,7 +350,7 @@ namespace cnvme
 				CONTROLLER_REGISTERS* controllerRegisters = getControllerRegisters();
 				if (controllerRegisters)
 				{
-					return (UINT_32)pow(2, 12 + controllerRegisters->CC.MPS);
+					return (UINT_32)pow(2, 12 + readRegister(controllerRegisters->CC).MPS);
 				}
 				ASSERT("Unable to get memory page size due to the controller registers being NULL");
 				return 0;
@@ -305,12 +363,16 @@ namespace cnvme
 					LOG_INFO("Doing the controller level reset.");
 					controllerResetInitiated = true;
 
-					// Save this as it persists
-					ADMIN_QUEUE_ATTRIBUTES AQA = ControllerRegistersPointer->AQA;
-					ADMIN_SUBMISSION_QUEUE_BASE_ADDRESS ASQ = ControllerRegistersPointer->ASQ;
-					ADMIN_COMPLETION_QUEUE_BASE_ADDRESS ACQ = ControllerRegistersPointer->ACQ;
-
-					memset(ControllerRegistersPointer, 0, sizeof(CONTROLLER_REGISTERS));
+					// AQA, ASQ and ACQ persist, so they are left alone.
+					//  CC and CSTS are polled by the host while this runs, so they are cleared atomically.
+					CONTROLLER_CONFIGURATION controllerConfiguration = { 0 };
+					CONTROLLER_STATUS controllerStatus = { 0 };
+					memset(ControllerRegistersPointer, 0, offsetof(CONTROLLER_REGISTERS, CC));
+					writeRegister(ControllerRegistersPointer->CC, controllerConfiguration);
+					memset(ControllerRegistersPointer->RSVD0, 0, sizeof(ControllerRegistersPointer->RSVD0));
+					writeRegister(ControllerRegistersPointer->CSTS, controllerStatus);
+					memset(&ControllerRegistersPointer->NSSR, 0, sizeof(ControllerRegistersPointer->NSSR));
+					memset(&ControllerRegistersPointer->CMBLOC, 0, sizeof(CONTROLLER_REGISTERS) - offsetof(CONTROLLER_REGISTERS, CMBLOC));
 
 					ControllerRegistersPointer->CAP.MPSMAX = 0; // 4096 max
 					ControllerRegistersPointer->CAP.MPSMIN = 0; // 4096 min
@@ -319,6 +381,7 @@ namespace cnvme
 					ControllerRegistersPointer->CAP.TO = 32;    // Worst case of 16 seconds
 					ControllerRegistersPointer->CAP.MQES = 0xFFFF; // At most 0xFFFF + 1 (zero based) queue entries 
 					ControllerRegistersPointer->CAP.CQR = 1;    // Must use contiguous queues
+					ControllerRegistersPointer->CAP.DSTRD = DoorbellStride; // Doorbells are (4 << DSTRD) bytes apart
 
 					// NVMe 1.3
 					ControllerRegistersPointer->VS.MJR = 1;
@@ -327,11 +390,6 @@ namespace cnvme
 
 					// Todo: Interrupts
 
-					// Admin Queue persists 
-					ControllerRegistersPointer->AQA = AQA;
-					ControllerRegistersPointer->ASQ = ASQ;
-					ControllerRegistersPointer->ACQ = ACQ;
-
 					if (Controller)
 					{
 						LOG_INFO("Notifying the controller of the controller reset");
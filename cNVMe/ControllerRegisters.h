@@ -25,9 +25,18 @@ ControllerRegisters.h - A header file for the Controller Registers
 
 #pragma once
 
+#include "Atomic.h"
 #include "LoopingThread.h"
 #include "Types.h"
 
+#define MAX_QUEUE_PAIRS 1024          // Admin queue plus 1023 IO queues. Bounds the doorbell region of BAR0.
+#define DEFAULT_DOORBELL_STRIDE 4     // CAP.DSTRD of 4 is (4 << 4) = 64 bytes, so every doorbell gets its own cache line
+#define MAX_DOORBELL_STRIDE 5         // (4 << 5) = 128 bytes, for hosts that prefetch cache lines in pairs
+#define DOORBELL_STRIDE_IN_BYTES(doorbellStride) ((size_t)4 << (doorbellStride))
+
+// BAR0 holds the controller registers followed by a SQ tail and CQ head doorbell for each queue pair
+#define BAR0_SIZE (sizeof(cnvme::controller::registers::CONTROLLER_REGISTERS) + (2 * MAX_QUEUE_PAIRS * DOORBELL_STRIDE_IN_BYTES(MAX_DOORBELL_STRIDE)))
+
 namespace cnvme
 {
 	namespace controller
@@ -225,6 +234,50 @@ namespace cnvme
 			}CONTROLLER_REGISTERS, *PCONTROLLER_REGISTERS;
 			static_assert(sizeof(CONTROLLER_REGISTERS) == 4096, "CR should be 4096 byte(s) in size.");
 
+			/// <summary>
+			/// Reads a 32-bit register with acquire ordering.
+			/// CC and CSTS are polled by the host and the register watcher at the same time, so plain accesses would race.
+			/// </summary>
+			/// <param name="reg">The register</param>
+			/// <returns>Copy of the register</returns>
+			template <typename T>
+			T readRegister(const T& reg)
+			{
+				static_assert(sizeof(T) == sizeof(UINT_32), "Only 32-bit registers are accessed atomically");
+				UINT_32 rawValue = atomic::loadAcquire((const UINT_32*)&reg);
+				T value;
+				memcpy(&value, &rawValue, sizeof(value));
+				return value;
+			}
+
+			/// <summary>
+			/// Writes a 32-bit register with release ordering. See readRegister().
+			/// </summary>
+			/// <param name="reg">The register</param>
+			/// <param name="value">New value for the register</param>
+			template <typename T>
+			void writeRegister(T& reg, const T& value)
+			{
+				static_assert(sizeof(T) == sizeof(UINT_32), "Only 32-bit registers are accessed atomically");
+				UINT_32 rawValue = 0;
+				memcpy(&rawValue, &value, sizeof(value));
+				atomic::storeRelease((UINT_32*)&reg, rawValue);
+			}
+
+			/// <summary>
+			/// Sets CC.EN. This is how the host enables the controller or starts a controller reset.
+			/// </summary>
+			/// <param name="controllerRegisters">The controller registers</param>
+			/// <param name="enable">New value for CC.EN</param>
+			void setControllerEnable(CONTROLLER_REGISTERS* controllerRegisters, bool enable);
+
+			/// <summary>
+			/// Returns CSTS.RDY
+			/// </summary>
+			/// <param name="controllerRegisters">The controller registers</param>
+			/// <returns>true if the controller is ready</returns>
+			bool isControllerReady(CONTROLLER_REGISTERS* controllerRegisters);
+
 			class ControllerRegisters
 			{
 			public:
@@ -258,11 +311,35 @@ namespace cnvme
 				CONTROLLER_REGISTERS* getControllerRegisters();
 
 				/// <summary>
-				/// Returns a pointer to the queue doorbells
+				/// Returns a pointer to the start of the queue doorbells.
+				/// Entries are only back-to-back like this when CAP.DSTRD is 0, so prefer
+				///   getSubmissionQueueTailDoorbell() / getCompletionQueueHeadDoorbell() which honor the stride.
 				/// </summary>
 				/// <returns>Queue doorbells pointer</returns>
 				QUEUE_DOORBELLS* getQueueDoorbells();
 
+				/// <summary>
+				/// Returns a pointer to the Submission Queue y Tail Doorbell (at 1000h + ((2y) * (4 << CAP.DSTRD)))
+				/// </summary>
+				/// <param name="queueId">Id of the submission queue (y)</param>
+				/// <returns>Pointer to the SQT field, nullptr if the queue id has no doorbell</returns>
+				UINT_16* getSubmissionQueueTailDoorbell(UINT_16 queueId);
+
+				/// <summary>
+				/// Returns a pointer to the Completion Queue y Head Doorbell (at 1000h + ((2y + 1) * (4 << CAP.DSTRD)))
+				/// </summary>
+				/// <param name="queueId">Id of the completion queue (y)</param>
+				/// <returns>Pointer to the CQH field, nullptr if the queue id has no doorbell</returns>
+				UINT_16* getCompletionQueueHeadDoorbell(UINT_16 queueId);
+
+				/// <summary>
+				/// Sets the doorbell stride reported in CAP.DSTRD. Doorbells are (4 << doorbellStride) bytes apart.
+				/// Can only be changed while the controller is disabled, since queues hold onto their doorbell addresses.
+				/// </summary>
+				/// <param name="doorbellStride">New CAP.DSTRD value, at most MAX_DOORBELL_STRIDE</param>
+				/// <returns>true on success, false if the stride is invalid or the controller is enabled</returns>
+				bool setDoorbellStride(UINT_8 doorbellStride);
+
 				/// <summary>
 				/// Wait for an iteration of the interrupt loop
 				/// </summary>
@@ -296,6 +373,18 @@ namespace cnvme
 				/// </summary>
 				bool controllerResetInitiated;
 
+				/// <summary>
+				/// CAP.DSTRD to report. It is put back in CAP on each controller reset.
+				/// </summary>
+				UINT_8 DoorbellStride;
+
+				/// <summary>
+				/// Gets a pointer to the given doorbell, honoring CAP.DSTRD
+				/// </summary>
+				/// <param name="doorbellIndex">(2 * queue id) for a SQ tail doorbell, (2 * queue id + 1) for a CQ head doorbell</param>
+				/// <returns>Pointer to the doorbell, nullptr if there is no such doorbell</returns>
+				UINT_16* getDoorbell(UINT_32 doorbellIndex);
+
 				/// <summary>
 				/// Function to be called in loop looking for changes
 				/// </summary>
@@ -0,0 +1,109 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Crc.cpp - An implementation file for the CRC (helper) functions
+*/
+
+#include "Crc.h"
+
+#define CRC16_T10_DIF_POLYNOMIAL 0x8BB7
+#define CRC_SLICES 8
+
+namespace cnvme
+{
+	namespace crc
+	{
+		/// <summary>
+		/// Lookup tables for the CRC16 T10-DIF. Table[k][b] is the CRC of byte b followed by k zero bytes.
+		/// </summary>
+		struct CRC16_TABLES
+		{
+			/// <summary>
+			/// Constructor. Fills in the tables.
+			/// </summary>
+			CRC16_TABLES()
+			{
+				for (UINT_32 b = 0; b < 256; b++)
+				{
+					UINT_16 crc = (UINT_16)(b << 8);
+					for (int bit = 0; bit < 8; bit++)
+					{
+						crc = (crc & 0x8000) ? (UINT_16)((crc << 1) ^ CRC16_T10_DIF_POLYNOMIAL) : (UINT_16)(crc << 1);
+					}
+					Table[0][b] = crc;
+				}
+
+				for (int k = 1; k < CRC_SLICES; k++)
+				{
+					for (UINT_32 b = 0; b < 256; b++)
+					{
+						UINT_16 previous = Table[k - 1][b];
+						Table[k][b] = (UINT_16)(previous << 8) ^ Table[0][previous >> 8];
+					}
+				}
+			}
+
+			UINT_16 Table[CRC_SLICES][256];
+		};
+
+		/// <summary>
+		/// Gets the tables, which are filled in on first use
+		/// </summary>
+		/// <returns>CRC16_TABLES</returns>
+		static const CRC16_TABLES& getTables()
+		{
+			static const CRC16_TABLES tables;
+			return tables;
+		}
+
+		UINT_16 crc16T10Dif(const UINT_8* buffer, size_t byteSize, UINT_16 crc)
+		{
+			const CRC16_TABLES &tables = getTables();
+
+			while (byteSize >= CRC_SLICES)
+			{
+				// The CRC so far folds into the first two bytes. Each byte then goes through the table for how far it is from the end.
+				crc = tables.Table[7][buffer[0] ^ (crc >> 8)] ^ tables.Table[6][buffer[1] ^ (crc & 0xFF)] ^
+					tables.Table[5][buffer[2]] ^ tables.Table[4][buffer[3]] ^
+					tables.Table[3][buffer[4]] ^ tables.Table[2][buffer[5]] ^
+					tables.Table[1][buffer[6]] ^ tables.Table[0][buffer[7]];
+
+				buffer += CRC_SLICES;
+				byteSize -= CRC_SLICES;
+			}
+
+			return crc16T10DifBytewise(buffer, byteSize, crc);
+		}
+
+		UINT_16 crc16T10DifBytewise(const UINT_8* buffer, size_t byteSize, UINT_16 crc)
+		{
+			const CRC16_TABLES &tables = getTables();
+
+			for (size_t i = 0; i < byteSize; i++)
+			{
+				crc = (UINT_16)(crc << 8) ^ tables.Table[0][(crc >> 8) ^ buffer[i]];
+			}
+
+			return crc;
+		}
+	}
+}
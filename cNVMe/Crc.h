@@ -0,0 +1,53 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Crc.h - A header file for the CRC (helper) functions
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	namespace crc
+	{
+		/// <summary>
+		/// Computes the CRC16 T10-DIF (polynomial 0x8BB7, not reflected) used as the Guard in end-to-end protection information.
+		/// Slicing-by-8: eight table lookups per eight bytes instead of one per byte.
+		/// </summary>
+		/// <param name="buffer">Data to compute the CRC over</param>
+		/// <param name="byteSize">Number of bytes in the buffer</param>
+		/// <param name="crc">CRC of the data before this buffer, to continue from. 0 to start a new CRC.</param>
+		/// <returns>The CRC</returns>
+		UINT_16 crc16T10Dif(const UINT_8* buffer, size_t byteSize, UINT_16 crc = 0);
+
+		/// <summary>
+		/// Computes the CRC16 T10-DIF one byte (and one table lookup) at a time. Slow, but simple enough to check crc16T10Dif() against.
+		/// </summary>
+		/// <param name="buffer">Data to compute the CRC over</param>
+		/// <param name="byteSize">Number of bytes in the buffer</param>
+		/// <param name="crc">CRC of the data before this buffer, to continue from. 0 to start a new CRC.</param>
+		/// <returns>The CRC</returns>
+		UINT_16 crc16T10DifBytewise(const UINT_8* buffer, size_t byteSize, UINT_16 crc = 0);
+	}
+}
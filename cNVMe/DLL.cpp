@@ -34,6 +34,13 @@ typedef enum StatusCodes {
 	ALREADY_INITIALIZED,
 	ALREADY_UNINITIALIZED,
 	CONTROLLER_RESET_FAILED,
+	BUFFER_TOO_SMALL,
+	NAMESPACE_MEDIA_FILE_FAILED,
+	NAMESPACE_SNAPSHOT_FAILED,
+	NAMESPACE_DEDUPLICATION_FAILED,
+	IMAGE_FAILED,
+	INVALID_LATENCY_MODEL,
+	NAMESPACE_FTL_FAILED,
 } StatusCodes;
 
 char* getCharStarOfStringToSendOut(std::string retStr)
@@ -87,6 +94,34 @@ char* GetStatusString(long statusCode)
 	{
 		retStr = "The controller reset failed";
 	}
+	else if (statusCode == BUFFER_TOO_SMALL)
+	{
+		retStr = "The given buffer was too small";
+	}
+	else if (statusCode == NAMESPACE_MEDIA_FILE_FAILED)
+	{
+		retStr = "The namespace media file could not be used";
+	}
+	else if (statusCode == NAMESPACE_SNAPSHOT_FAILED)
+	{
+		retStr = "The namespace could not be snapshotted or reverted to its snapshot";
+	}
+	else if (statusCode == NAMESPACE_DEDUPLICATION_FAILED)
+	{
+		retStr = "The namespace could not be backed by deduplicated media, or isn't backed by it";
+	}
+	else if (statusCode == IMAGE_FAILED)
+	{
+		retStr = "The image could not be saved or loaded";
+	}
+	else if (statusCode == INVALID_LATENCY_MODEL)
+	{
+		retStr = "The latency model needs at least one channel, die, stripe byte and byte per second of bandwidth";
+	}
+	else if (statusCode == NAMESPACE_FTL_FAILED)
+	{
+		retStr = "The namespace could not be given that FTL model, or doesn't have one";
+	}
 
 	return getCharStarOfStringToSendOut(retStr);
 }
@@ -104,6 +139,13 @@ long Uninitialize()
 	{
 		delete staticDriver;
 		staticDriver = nullptr;
+
+		// Everything the simulator allocated should be gone by now
+		std::string leakReport = memory::getLeakReport();
+		if (leakReport.size())
+		{
+			LOG_ERROR("Memory still outstanding after Uninitialize:\n" + leakReport);
+		}
 		return NO_ERRORS;
 	}
 
@@ -144,4 +186,256 @@ long SetCommandResponseProcessingFile(char* filePath, UINT_32 filePathLength)
 	return ALREADY_UNINITIALIZED;
 }
 
+long SetNamespaceMediaFile(UINT_32 namespaceId, char* filePath, UINT_32 filePathLength, UINT_64 sizeInBytes, UINT_8 directIo)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->setNamespaceMediaFile(namespaceId, std::string(filePath, filePathLength), sizeInBytes, directIo != 0))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return NAMESPACE_MEDIA_FILE_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long SnapshotNamespace(UINT_32 namespaceId)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->snapshotNamespace(namespaceId))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return NAMESPACE_SNAPSHOT_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long RevertNamespaceToSnapshot(UINT_32 namespaceId)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->revertNamespaceToSnapshot(namespaceId))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return NAMESPACE_SNAPSHOT_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long SetNamespaceDeduplicatedMedia(UINT_32 namespaceId, UINT_8 compress)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->setNamespaceDeduplicatedMedia(namespaceId, compress != 0))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return NAMESPACE_DEDUPLICATION_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long GetNamespaceDedupStatistics(UINT_32 namespaceId, UINT_8* dedupStatisticsBuffer, size_t dedupStatisticsBufferLength)
+{
+	if (!dedupStatisticsBuffer || dedupStatisticsBufferLength < sizeof(ns::DEDUP_STATISTICS))
+	{
+		return BUFFER_TOO_SMALL;
+	}
+
+	if (staticDriver)
+	{
+		ns::DEDUP_STATISTICS dedupStatistics = { 0 };
+		if (staticDriver->getNamespaceDedupStatistics(namespaceId, dedupStatistics))
+		{
+			memcpy_s(dedupStatisticsBuffer, dedupStatisticsBufferLength, &dedupStatistics, sizeof(dedupStatistics));
+			return NO_ERRORS;
+		}
+		else
+		{
+			return NAMESPACE_DEDUPLICATION_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long SaveNamespaceImage(UINT_32 namespaceId, char* filePath, UINT_32 filePathLength)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->saveNamespaceImage(namespaceId, std::string(filePath, filePathLength)))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return IMAGE_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long LoadNamespaceImage(UINT_32 namespaceId, char* filePath, UINT_32 filePathLength)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->loadNamespaceImage(namespaceId, std::string(filePath, filePathLength)))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return IMAGE_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long SaveControllerImage(char* filePath, UINT_32 filePathLength)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->saveControllerImage(std::string(filePath, filePathLength)))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return IMAGE_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long LoadControllerImage(char* filePath, UINT_32 filePathLength)
+{
+	if (staticDriver)
+	{
+		if (staticDriver->loadControllerImage(std::string(filePath, filePathLength)))
+		{
+			return NO_ERRORS;
+		}
+		else
+		{
+			return IMAGE_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long GetMemoryStatistics(UINT_8* memoryStatisticsBuffer, size_t memoryStatisticsBufferLength)
+{
+	if (!memoryStatisticsBuffer || memoryStatisticsBufferLength < sizeof(memory::MEMORY_STATISTICS))
+	{
+		return BUFFER_TOO_SMALL;
+	}
+
+	memory::MEMORY_STATISTICS memoryStatistics = memory::getMemoryStatistics();
+	memcpy_s(memoryStatisticsBuffer, memoryStatisticsBufferLength, &memoryStatistics, sizeof(memoryStatistics));
+	return NO_ERRORS;
+}
+
+long SetLatencyModel(UINT_8* latencyModelParametersBuffer, size_t latencyModelParametersBufferLength)
+{
+	if (latencyModelParametersBuffer && latencyModelParametersBufferLength < sizeof(controller::LATENCY_MODEL_PARAMETERS))
+	{
+		return BUFFER_TOO_SMALL;
+	}
+
+	if (staticDriver)
+	{
+		if (!latencyModelParametersBuffer)
+		{
+			staticDriver->setTimingModel(nullptr);
+			return NO_ERRORS;
+		}
+
+		controller::LATENCY_MODEL_PARAMETERS parameters;
+		memcpy_s(&parameters, sizeof(parameters), latencyModelParametersBuffer, sizeof(parameters));
+		if (!controller::LatencyModel::isValid(parameters))
+		{
+			return INVALID_LATENCY_MODEL;
+		}
+
+		staticDriver->setTimingModel(std::make_shared<controller::LatencyModel>(parameters));
+		return NO_ERRORS;
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long SetNamespaceFtl(UINT_32 namespaceId, UINT_8* ftlParametersBuffer, size_t ftlParametersBufferLength)
+{
+	if (ftlParametersBuffer && ftlParametersBufferLength < sizeof(ns::FTL_PARAMETERS))
+	{
+		return BUFFER_TOO_SMALL;
+	}
+
+	if (staticDriver)
+	{
+		bool succeeded = false;
+		if (ftlParametersBuffer)
+		{
+			ns::FTL_PARAMETERS parameters;
+			memcpy_s(&parameters, sizeof(parameters), ftlParametersBuffer, sizeof(parameters));
+			succeeded = staticDriver->setNamespaceFtl(namespaceId, parameters);
+		}
+		else
+		{
+			succeeded = staticDriver->removeNamespaceFtl(namespaceId);
+		}
+
+		return succeeded ? NO_ERRORS : NAMESPACE_FTL_FAILED;
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
+long GetNamespaceFtlStatistics(UINT_32 namespaceId, UINT_8* ftlStatisticsBuffer, size_t ftlStatisticsBufferLength)
+{
+	if (!ftlStatisticsBuffer || ftlStatisticsBufferLength < sizeof(ns::FTL_STATISTICS))
+	{
+		return BUFFER_TOO_SMALL;
+	}
+
+	if (staticDriver)
+	{
+		ns::FTL_STATISTICS ftlStatistics = { 0 };
+		if (staticDriver->getNamespaceFtlStatistics(namespaceId, ftlStatistics))
+		{
+			memcpy_s(ftlStatisticsBuffer, ftlStatisticsBufferLength, &ftlStatistics, sizeof(ftlStatistics));
+			return NO_ERRORS;
+		}
+		else
+		{
+			return NAMESPACE_FTL_FAILED;
+		}
+	}
+
+	return ALREADY_UNINITIALIZED;
+}
+
 #endif // DLL_BUILD
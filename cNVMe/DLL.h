@@ -90,6 +90,81 @@ extern "C" {
 	/// </summary>
 	EXPORT long SetCommandResponseProcessingFile(char* filePath, UINT_32 filePathLength);
 
+	/// <summary>
+	/// Backs the given active namespace with a file (created if needed) so its data persists across runs.
+	/// A sizeInBytes of 0 uses the size of the existing file.
+	/// A directIo of 0 memory maps the file. Otherwise I/O goes straight to the file (or block device), completing asynchronously.
+	/// </summary>
+	EXPORT long SetNamespaceMediaFile(UINT_32 namespaceId, char* filePath, UINT_32 filePathLength, UINT_64 sizeInBytes, UINT_8 directIo);
+
+	/// <summary>
+	/// Snapshots the data in the given active namespace, replacing its older snapshot.
+	/// Takes the same time no matter the namespace size (file backed namespaces can't be snapshotted).
+	/// </summary>
+	EXPORT long SnapshotNamespace(UINT_32 namespaceId);
+
+	/// <summary>
+	/// Puts the data in the given active namespace back to its snapshot. The snapshot can be reverted to again.
+	/// </summary>
+	EXPORT long RevertNamespaceToSnapshot(UINT_32 namespaceId);
+
+	/// <summary>
+	/// Backs the given active namespace with empty deduplicated media of the same size (its old data is dropped).
+	/// Identical 4KB blocks are stored once and all zero blocks not at all. A compress of non-0 also compresses stored blocks.
+	/// </summary>
+	EXPORT long SetNamespaceDeduplicatedMedia(UINT_32 namespaceId, UINT_8 compress);
+
+	/// <summary>
+	/// Fills the given buffer with a DEDUP_STATISTICS structure for the given namespace, which must be backed by deduplicated media.
+	/// </summary>
+	EXPORT long GetNamespaceDedupStatistics(UINT_32 namespaceId, UINT_8* dedupStatisticsBuffer, size_t dedupStatisticsBufferLength);
+
+	/// <summary>
+	/// Saves the given allocated namespace to an image file. Parts of the namespace that were never written aren't in it.
+	/// </summary>
+	EXPORT long SaveNamespaceImage(UINT_32 namespaceId, char* filePath, UINT_32 filePathLength);
+
+	/// <summary>
+	/// Replaces the given allocated namespace (data, LBA format and NGUID) with one saved by SaveNamespaceImage.
+	/// </summary>
+	EXPORT long LoadNamespaceImage(UINT_32 namespaceId, char* filePath, UINT_32 filePathLength);
+
+	/// <summary>
+	/// Saves the whole controller (Identify Controller, firmware slots and every allocated namespace) to an image file.
+	/// </summary>
+	EXPORT long SaveControllerImage(char* filePath, UINT_32 filePathLength);
+
+	/// <summary>
+	/// Replaces the Identify Controller, firmware slots and namespaces with those saved by SaveControllerImage.
+	/// Much faster than writing the same data again through SendCommand.
+	/// </summary>
+	EXPORT long LoadControllerImage(char* filePath, UINT_32 filePathLength);
+
+	/// <summary>
+	/// Fills the given buffer with a MEMORY_STATISTICS structure (allocator statistics and per-subsystem accounting).
+	/// Can be called even while uninitialized, for example to check for leaks after Uninitialize().
+	/// </summary>
+	EXPORT long GetMemoryStatistics(UINT_8* memoryStatisticsBuffer, size_t memoryStatisticsBufferLength);
+
+	/// <summary>
+	/// Holds completions for as long as a device described by the given LATENCY_MODEL_PARAMETERS structure would take
+	/// (base latency per opcode, channel bandwidth, and how many channels and dies work in parallel).
+	/// A NULL buffer goes back to completing commands as fast as possible.
+	/// </summary>
+	EXPORT long SetLatencyModel(UINT_8* latencyModelParametersBuffer, size_t latencyModelParametersBufferLength);
+
+	/// <summary>
+	/// Puts an FTL model described by the given FTL_PARAMETERS structure in front of the given active namespace (its data is kept).
+	/// Its garbage collection keeps dies busy in the latency model. A NULL buffer takes the model away.
+	/// </summary>
+	EXPORT long SetNamespaceFtl(UINT_32 namespaceId, UINT_8* ftlParametersBuffer, size_t ftlParametersBufferLength);
+
+	/// <summary>
+	/// Fills the given buffer with an FTL_STATISTICS structure (write amplification, garbage collection and free blocks) for the given namespace,
+	/// which must have an FTL model.
+	/// </summary>
+	EXPORT long GetNamespaceFtlStatistics(UINT_32 namespaceId, UINT_8* ftlStatisticsBuffer, size_t ftlStatisticsBufferLength);
+
 #undef EXPORT
 #ifdef __cplusplus
 }
@@ -78,6 +78,10 @@ namespace cnvme
 			{
 				return "The IEN field must be set to 1 as we do not support disabled interrupt queues";
 			}
+			else if (s == SUBMISSION_QUEUE_FULL)
+			{
+				return "The submission queue was full";
+			}
 
 			ASSERT("Status not found in statusToString()");
 			return "Unknown";
@@ -106,7 +110,11 @@ namespace cnvme
 			return "Unknown";
 		}
 
-		Driver::Driver()
+		Driver::Driver() : Driver(DEFAULT_DOORBELL_STRIDE)
+		{
+		}
+
+		Driver::Driver(UINT_8 doorbellStride) : TheController(doorbellStride)
 		{
 			// We have a controller... it is not running.
 			auto controllerRegisters = this->TheController.getControllerRegisters()->getControllerRegisters();
@@ -128,17 +136,19 @@ namespace cnvme
 			Payload adminSubmissionQueuePayload(adminSubmissionQueueByteSize);
 			Payload adminCompletionQueuePayload(adminCompletionQueueByteSize);
 
-			// Set the payloads to all 0xFF (to not catch bad CIDs of 0)
+			// Set the submission queue to all 0xFF (to not catch bad CIDs of 0)
+			//  The completion queue stays 0 so no entry has the phase tag of the first lap.
 			memset(adminSubmissionQueuePayload.getBuffer(), 0xFF, adminSubmissionQueuePayload.getSize());
-			memset(adminCompletionQueuePayload.getBuffer(), 0xFF, adminCompletionQueuePayload.getSize());
 
-			// Make sure the payloads stay in scope.
+			// Make sure the payloads stay in scope. They are freed in the destructor.
+			adminSubmissionQueuePayload.setAccountingSubsystem(memory::SUBSYSTEM_QUEUE);
+			adminCompletionQueuePayload.setAccountingSubsystem(memory::SUBSYSTEM_QUEUE);
 			adminSubmissionQueuePayload.setDeleteOnScopeLoss(false);
 			adminCompletionQueuePayload.setDeleteOnScopeLoss(false);
 
 			// Get pointers to the doorbells for the admin queues
-			UINT_16* adminSubmissionQueueDoorbell = &this->TheController.getControllerRegisters()->getQueueDoorbells()->SQTDBL.SQT;
-			UINT_16* adminCompletionQueueDoorbell = &this->TheController.getControllerRegisters()->getQueueDoorbells()->CQHDBL.CQH;
+			UINT_16* adminSubmissionQueueDoorbell = this->TheController.getControllerRegisters()->getSubmissionQueueTailDoorbell(ADMIN_QUEUE_ID);
+			UINT_16* adminCompletionQueueDoorbell = this->TheController.getControllerRegisters()->getCompletionQueueHeadDoorbell(ADMIN_QUEUE_ID);
 
 			// Place the memory addresses in the registers
 			controllerRegisters->ASQ.ASQB = adminSubmissionQueuePayload.getMemoryAddress();
@@ -157,7 +167,7 @@ namespace cnvme
 			this->CompletionQueues[ADMIN_QUEUE_ID]->setMappedQueue(this->SubmissionQueues[ADMIN_QUEUE_ID]);
 
 			// Enable the controller
-			controllerRegisters->CC.EN = 1;
+			controller::registers::setControllerEnable(controllerRegisters, true);
 
 			// Wait for CSTS.RDY to go to 1
 			UINT_64 numberOfSecondsMaxToWait = (controllerRegisters->CAP.TO / 2);
@@ -166,7 +176,7 @@ namespace cnvme
 			bool controllerWentReady = false;
 			while (helpers::getTimeInMilliseconds() < maxWaitTime)
 			{
-				if (controllerRegisters->CSTS.RDY)
+				if (controller::registers::isControllerReady(controllerRegisters))
 				{
 					controllerWentReady = true;
 					break;
@@ -182,9 +192,16 @@ namespace cnvme
 		{
 			this->deleteAllIoQueues();
 
+			// Free memory from IO queue creations that timed out
+			for (auto &timedOutQueueMemory : this->TimedOutQueueMemory)
+			{
+				memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(timedOutQueueMemory.first), timedOutQueueMemory.second, memory::SUBSYSTEM_QUEUE);
+			}
+
 			// Delete admin queue
-			delete[]MEMORY_ADDRESS_TO_64POINTER(this->SubmissionQueues[0]->getMemoryAddress());
-			delete[]MEMORY_ADDRESS_TO_64POINTER(this->CompletionQueues[0]->getMemoryAddress());
+			// The admin queues came from Payloads that were told not to delete on scope loss, so give them back to the allocator
+			memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(this->SubmissionQueues[0]->getMemoryAddress()), this->SubmissionQueues[0]->getQueueSize() * sizeof(NVME_COMMAND), memory::SUBSYSTEM_QUEUE);
+			memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(this->CompletionQueues[0]->getMemoryAddress()), this->CompletionQueues[0]->getQueueMemorySize(), memory::SUBSYSTEM_QUEUE);
 			delete this->SubmissionQueues[0];
 			delete this->CompletionQueues[0];
 		}
@@ -267,6 +284,14 @@ namespace cnvme
 			// here goes nothing... send the command!
 			auto pSubmissionQueue = submissionQueueItr->second;
 
+			// The controller hasn't moved past enough entries (via SQHD) to make room for another one.
+			if (pSubmissionQueue->isFull())
+			{
+				LOG_ERROR("Submission queue " + std::to_string(pDriverCommand->QueueId) + " is full");
+				pDriverCommand->DriverStatus = SUBMISSION_QUEUE_FULL;
+				return;
+			}
+
 			// Add the CID to the command
 			pDriverCommand->Command.DWord0Breakdown.CID = getCommandIdForSubmissionQueueIdViaIncrementIfNeeded(pSubmissionQueue->getQueueId());
 
@@ -276,13 +301,14 @@ namespace cnvme
 
 			// create a contiguous buffer address. If not NULL will be used/deleted later
 			UINT_64 contiguousBufferAddress = NULL;
+			size_t contiguousBufferSize = 0;
 
 			// If MANUAL_PRPS, let the user deal with the PRP magic.
 			if (pDriverCommand->TransferDataDirection != MANUAL_PRPS)
 			{
 				if (this->commandRequiresContiguousBufferInsteadOfPrp(pDriverCommand->Command, pDriverCommand->QueueId == ADMIN_QUEUE_ID))
 				{
-					size_t allocationSize;
+					size_t allocationSize = 0;
 					if (pDriverCommand->Command.DWord0Breakdown.OPC == constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE)
 					{
 						allocationSize = ONE_BASED_FROM_ZERO_BASED(pDriverCommand->Command.DW10_CreateIoQueue.QSIZE) * sizeof(command::COMPLETION_QUEUE_ENTRY);
@@ -296,9 +322,17 @@ namespace cnvme
 						ASSERT("Invalid command for contiguous allocation.");
 					}
 
-					BYTE* contig = new BYTE[allocationSize];
-					memset(contig, 0xFF, allocationSize); // Set to high CID
+					BYTE* contig = memory::allocate(allocationSize, false, memory::SUBSYSTEM_QUEUE);
+					if (pDriverCommand->Command.DWord0Breakdown.OPC == constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE)
+					{
+						memset(contig, 0, allocationSize); // No entry has the phase tag of the first lap
+					}
+					else
+					{
+						memset(contig, 0xFF, allocationSize); // Set to high CID
+					}
 					contiguousBufferAddress = POINTER_TO_MEMORY_ADDRESS(contig);    // DONT FORGET TO FREE ME... later.
+					contiguousBufferSize = allocationSize;
 					pDriverCommand->Command.DPTR.DPTR1 = contiguousBufferAddress;   // Give drive new queue location
 				}
 				else
@@ -312,21 +346,13 @@ namespace cnvme
 				}
 			}
 
-			// Get a pointer to the location to place the command
-			UINT_8* theRawSubmissionQueue = MEMORY_ADDRESS_TO_8POINTER(pSubmissionQueue->getMemoryAddress());
-			NVME_COMMAND* nvmeCommand = (NVME_COMMAND*)theRawSubmissionQueue;
-			nvmeCommand += pSubmissionQueue->getTailPointer(); // Make sure we increment to the correct command.
-
 			// Copy the command into the submission queue
 			LOG_INFO("About to copy a command with an opcode of 0x" + cnvme::strings::toHexString(pDriverCommand->Command.DWord0Breakdown.OPC) + \
 				" to submission queue 0x" + cnvme::strings::toHexString(pDriverCommand->QueueId) + " and CID of 0x" + cnvme::strings::toHexString(pDriverCommand->Command.DWord0Breakdown.CID));
 
-			memcpy_s(nvmeCommand, sizeof(NVME_COMMAND), &pDriverCommand->Command, sizeof(pDriverCommand->Command));
-
-			// Move the tail pointer up and ring the doorbell. This is the 'sending' per-say.
-			pSubmissionQueue->incrementTailPointerAndRingDoorbell();
-
-			// The head pointer is not used here. Just the tail.
+			// Copy it in at the tail, move the tail pointer up and ring the doorbell. This is the 'sending' per-say.
+			bool submitted = pSubmissionQueue->submitCommand(pDriverCommand->Command);
+			ASSERT_IF(!submitted, "The submission queue became full even though we checked it.");
 
 			// The command has been sent!! 
 
@@ -336,38 +362,40 @@ namespace cnvme
 			bool commandTimedOut = true;
 			while (helpers::getTimeInMilliseconds() < deathTime)
 			{
-				bool foundCompletion = false;
-				COMPLETION_QUEUE_ENTRY* pCompletionQueueEntry = (COMPLETION_QUEUE_ENTRY*)MEMORY_ADDRESS_TO_8POINTER(pCompletionQueue->getMemoryAddress());
+				// Take completions in order. Anything new has the phase tag of the current lap.
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+				if (!pCompletionQueue->consumeCompletionQueueEntry(completionQueueEntry))
+				{
+					continue;
+				}
 
-				// Look for a completion queue entry with a matching Command ID
-				for (UINT_16 completionEntryIndex = 0; completionEntryIndex < pCompletionQueue->getQueueSize(); completionEntryIndex++)
+				// The controller has moved past the submission queue entries before SQHD, so they can be reused
+				auto completedSubmissionQueueItr = this->SubmissionQueues.find(completionQueueEntry.SQID);
+				if (completedSubmissionQueueItr != this->SubmissionQueues.end())
 				{
-					if (pCompletionQueueEntry->CID == pDriverCommand->Command.DWord0Breakdown.CID)
-					{
-						LOG_INFO("Found matching completion entry for CID " + strings::toHexString(pCompletionQueueEntry->CID) + " in CQE index " + \
-							strings::toHexString(completionEntryIndex));
+					completedSubmissionQueueItr->second->setHeadPointer(completionQueueEntry.SQHD);
+				}
 
-						memcpy_s(&pDriverCommand->CompletionQueueEntry, sizeof(pDriverCommand->CompletionQueueEntry), pCompletionQueueEntry, sizeof(COMPLETION_QUEUE_ENTRY));
+				if (completionQueueEntry.CID != pDriverCommand->Command.DWord0Breakdown.CID)
+				{
+					LOG_ERROR("Skipping a completion entry for CID " + strings::toHexString(completionQueueEntry.CID) + ". Did that command time out?");
+					continue;
+				}
 
-						// copy data back if this was a read.
-						if (pDriverCommand->TransferDataDirection == READ)
-						{
-							auto payloadOfReadData = prps.getPayloadCopy();
-							memcpy_s(&pDriverCommand->TransferData, driverCommandBufferSize - sizeof(DRIVER_COMMAND), payloadOfReadData.getBuffer(), pDriverCommand->TransferDataSize);
-						}
+				LOG_INFO("Found matching completion entry for CID " + strings::toHexString(completionQueueEntry.CID));
 
-						pDriverCommand->DriverStatus = SENT_SUCCESSFULLY;
-						foundCompletion = true;
-						break;
-					}
-					pCompletionQueueEntry++; // Increment through the completion queue
-				}
+				memcpy_s(&pDriverCommand->CompletionQueueEntry, sizeof(pDriverCommand->CompletionQueueEntry), &completionQueueEntry, sizeof(COMPLETION_QUEUE_ENTRY));
 
-				if (foundCompletion)
+				// copy data back if this was a read.
+				if (pDriverCommand->TransferDataDirection == READ)
 				{
-					commandTimedOut = false;
-					break;
+					auto payloadOfReadData = prps.getPayloadCopy();
+					memcpy_s(&pDriverCommand->TransferData, driverCommandBufferSize - sizeof(DRIVER_COMMAND), payloadOfReadData.getBuffer(), pDriverCommand->TransferDataSize);
 				}
+
+				pDriverCommand->DriverStatus = SENT_SUCCESSFULLY;
+				commandTimedOut = false;
+				break;
 			}
 
 			if (commandTimedOut)
@@ -378,13 +406,17 @@ namespace cnvme
 				// its debatable if we should free memory on a timeout...
 				// on the real (tm) driver they would do an NVMe Controller Reset and then deallocate everything.
 				//  the command could be in progress or something..
-				//   though right now this would leak on IO Queue Creation.
+				//   so hang onto IO Queue Creation memory until the driver goes away instead of leaking it.
+				if (contiguousBufferAddress)
+				{
+					LOG_ERROR("Holding onto the contiguous queue buffer of the timed out command until the driver is destroyed");
+					this->TimedOutQueueMemory.emplace_back(contiguousBufferAddress, contiguousBufferSize);
+				}
 			}
 			// We did the command and its a contiguous buffer cmd
 			else if (pDriverCommand->TransferDataDirection != MANUAL_PRPS && this->commandRequiresContiguousBufferInsteadOfPrp(pDriverCommand->Command, pDriverCommand->QueueId == ADMIN_QUEUE_ID))
 			{
-				auto doorbells = this->TheController.getControllerRegisters()->getQueueDoorbells();
-				doorbells += pDriverCommand->Command.DW10_CreateIoQueue.QID; // find our doorbell
+				auto controllerRegisters = this->TheController.getControllerRegisters();
 
 				// Command failed if (SC | SCT) != 0. Free the memory!
 				if (pDriverCommand->CompletionQueueEntry.SC | pDriverCommand->CompletionQueueEntry.SCT)
@@ -392,7 +424,7 @@ namespace cnvme
 					ASSERT_IF(contiguousBufferAddress == 0, "Somehow we sent a contiguous buffer address of 0. That could have killed the drive!");
 
 					LOG_ERROR("Freeing memory for contigous queue buffer since our queue creation failed!");
-					delete[]MEMORY_ADDRESS_TO_8POINTER(contiguousBufferAddress);
+					memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(contiguousBufferAddress), contiguousBufferSize, memory::SUBSYSTEM_QUEUE);
 				}
 				else if (pDriverCommand->Command.DWord0Breakdown.OPC == constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE)
 				{
@@ -400,7 +432,7 @@ namespace cnvme
 
 					this->CompletionQueues[pDriverCommand->Command.DW10_CreateIoQueue.QID] = new Queue(ONE_BASED_FROM_ZERO_BASED(pDriverCommand->Command.DW10_CreateIoQueue.QSIZE),
 						pDriverCommand->Command.DW10_CreateIoQueue.QID,
-						(UINT_16*)&(doorbells->CQHDBL), // doorbell
+						controllerRegisters->getCompletionQueueHeadDoorbell(pDriverCommand->Command.DW10_CreateIoQueue.QID), // doorbell
 						contiguousBufferAddress
 					);
 				}
@@ -418,7 +450,7 @@ namespace cnvme
 
 					Queue* subQ = new Queue(ONE_BASED_FROM_ZERO_BASED(pDriverCommand->Command.DW10_CreateIoQueue.QSIZE),
 						pDriverCommand->Command.DW10_CreateIoQueue.QID,
-						(UINT_16*)&(doorbells->SQTDBL), // doorbell
+						controllerRegisters->getSubmissionQueueTailDoorbell(pDriverCommand->Command.DW10_CreateIoQueue.QID), // doorbell
 						contiguousBufferAddress
 					);
 					this->SubmissionQueues[pDriverCommand->Command.DW10_CreateIoQueue.QID] = subQ;
@@ -427,7 +459,7 @@ namespace cnvme
 					mappedCompletionQueueItr->second->setMappedQueue(subQ); // CQ -> SQ
 				}
 			}
-			else if ((pDriverCommand->CompletionQueueEntry.SC | pDriverCommand->CompletionQueueEntry.SCT) == 0) // command passed
+			else if (pDriverCommand->QueueId == ADMIN_QUEUE_ID && (pDriverCommand->CompletionQueueEntry.SC | pDriverCommand->CompletionQueueEntry.SCT) == 0) // admin command passed (IO opcodes overlap the queue deletion ones)
 			{
 				if (pDriverCommand->Command.DWord0Breakdown.OPC == constants::opcodes::admin::DELETE_IO_SUBMISSION_QUEUE)
 				{
@@ -440,7 +472,7 @@ namespace cnvme
 					}
 					else
 					{
-						delete[] MEMORY_ADDRESS_TO_8POINTER(subQ->second->getMemoryAddress());
+						memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(subQ->second->getMemoryAddress()), subQ->second->getQueueSize() * sizeof(NVME_COMMAND), memory::SUBSYSTEM_QUEUE);
 						delete subQ->second;
 						this->SubmissionQueues.erase(subQ);
 					}
@@ -459,7 +491,7 @@ namespace cnvme
 					}
 					else
 					{
-						delete[] MEMORY_ADDRESS_TO_8POINTER(compQ->second->getMemoryAddress());
+						memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(compQ->second->getMemoryAddress()), compQ->second->getQueueMemorySize(), memory::SUBSYSTEM_QUEUE);
 						delete compQ->second;
 						this->CompletionQueues.erase(compQ);
 					}
@@ -467,17 +499,154 @@ namespace cnvme
 			}
 		}
 
+		void Driver::sendFusedCommands(UINT_8* firstDriverCommandBuffer, size_t firstDriverCommandBufferSize, UINT_8* secondDriverCommandBuffer, size_t secondDriverCommandBufferSize)
+		{
+			ASSERT_IF(firstDriverCommandBufferSize < sizeof(Status) || secondDriverCommandBufferSize < sizeof(Status), "The passed in buffer size wasn't even large enough to return a status");
+			DRIVER_COMMAND* pDriverCommands[] = { (DRIVER_COMMAND*)firstDriverCommandBuffer, (DRIVER_COMMAND*)secondDriverCommandBuffer };
+			size_t driverCommandBufferSizes[] = { firstDriverCommandBufferSize, secondDriverCommandBufferSize };
+			const size_t numberOfCommands = 2;
+
+			// Same checks as sendCommand(), on each command. If either is bad, neither is sent.
+			Status status = SENT_SUCCESSFULLY;
+			for (size_t i = 0; i < numberOfCommands && status == SENT_SUCCESSFULLY; i++)
+			{
+				if (driverCommandBufferSizes[i] < sizeof(DRIVER_COMMAND) || (driverCommandBufferSizes[i] < pDriverCommands[i]->TransferDataSize + sizeof(DRIVER_COMMAND)))
+				{
+					LOG_ERROR("The provided buffer was not large enough");
+					status = BUFFER_NOT_LARGE_ENOUGH;
+				}
+				else if (pDriverCommands[i]->TransferDataDirection >= DATA_DIRECTION_MAX || pDriverCommands[i]->TransferDataDirection == MANUAL_PRPS)
+				{
+					LOG_ERROR("Invalid data direction was provided for a fused command");
+					status = INVALID_DATA_DIRECTION;
+				}
+				else if (pDriverCommands[i]->TransferDataSize == 0 && pDriverCommands[i]->TransferDataDirection != NO_DATA)
+				{
+					LOG_ERROR("Transfer data size was 0 but the data direction is not no-data");
+					status = INVALID_DATA_LENGTH;
+				}
+				else if (pDriverCommands[i]->QueueId == ADMIN_QUEUE_ID || pDriverCommands[i]->QueueId != pDriverCommands[0]->QueueId)
+				{
+					LOG_ERROR("Both fused commands have to go to the same IO queue");
+					status = NO_MATCHING_SUBMISSION_QUEUE;
+				}
+			}
+
+			auto submissionQueueItr = this->SubmissionQueues.find(pDriverCommands[0]->QueueId);
+			if (status == SENT_SUCCESSFULLY && submissionQueueItr == this->SubmissionQueues.end())
+			{
+				LOG_ERROR("Couldn't find a submission queue with the id: " + std::to_string(pDriverCommands[0]->QueueId));
+				status = NO_MATCHING_SUBMISSION_QUEUE;
+			}
+
+			auto pCompletionQueue = status == SENT_SUCCESSFULLY ? submissionQueueItr->second->getMappedQueue() : nullptr;
+			if (status == SENT_SUCCESSFULLY && !pCompletionQueue)
+			{
+				LOG_ERROR("Couldn't find a linked completion queue for a submission queue with the id: " + std::to_string(pDriverCommands[0]->QueueId));
+				status = NO_LINKED_COMPLETION_QUEUE;
+			}
+
+			if (status != SENT_SUCCESSFULLY)
+			{
+				pDriverCommands[0]->DriverStatus = status;
+				pDriverCommands[1]->DriverStatus = status;
+				return;
+			}
+
+			auto pSubmissionQueue = submissionQueueItr->second;
+			UINT_32 memoryPageSize = this->TheController.getControllerRegisters()->getMemoryPageSize();
+
+			// Should stay in scope till the commands are done or we time out
+			PRP prps[numberOfCommands];
+			NVME_COMMAND commands[numberOfCommands];
+			for (size_t i = 0; i < numberOfCommands; i++)
+			{
+				pDriverCommands[i]->Command.DWord0Breakdown.FUSE = (i == 0) ? constants::commands::fuse::FIRST_COMMAND : constants::commands::fuse::SECOND_COMMAND;
+				pDriverCommands[i]->Command.DWord0Breakdown.CID = getCommandIdForSubmissionQueueIdViaIncrementIfNeeded(pSubmissionQueue->getQueueId());
+
+				prps[i].constructFromPayloadAndMemoryPageSize(cnvme::Payload(pDriverCommands[i]->TransferData, pDriverCommands[i]->TransferDataSize), memoryPageSize);
+				if (pDriverCommands[i]->TransferDataDirection != NO_DATA)
+				{
+					pDriverCommands[i]->Command.DPTR.DPTR1 = prps[i].getPRP1();
+					pDriverCommands[i]->Command.DPTR.DPTR2 = prps[i].getPRP2();
+				}
+				commands[i] = pDriverCommands[i]->Command;
+			}
+
+			// One doorbell ring for both, so the controller never sees half of the fused operation
+			if (!pSubmissionQueue->submitCommands(commands, numberOfCommands))
+			{
+				LOG_ERROR("Submission queue " + std::to_string(pDriverCommands[0]->QueueId) + " doesn't have room for both fused commands");
+				pDriverCommands[0]->DriverStatus = SUBMISSION_QUEUE_FULL;
+				pDriverCommands[1]->DriverStatus = SUBMISSION_QUEUE_FULL;
+				return;
+			}
+
+			pDriverCommands[0]->DriverStatus = TIMEOUT;
+			pDriverCommands[1]->DriverStatus = TIMEOUT;
+			size_t commandsCompleted = 0;
+
+			// Completions for the two can come in either order
+			UINT_64 deathTime = helpers::getTimeInMilliseconds() + (pDriverCommands[0]->Timeout * 1000);
+			while (commandsCompleted < numberOfCommands && helpers::getTimeInMilliseconds() < deathTime)
+			{
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+				if (!pCompletionQueue->consumeCompletionQueueEntry(completionQueueEntry))
+				{
+					continue;
+				}
+
+				// The controller has moved past the submission queue entries before SQHD, so they can be reused
+				auto completedSubmissionQueueItr = this->SubmissionQueues.find(completionQueueEntry.SQID);
+				if (completedSubmissionQueueItr != this->SubmissionQueues.end())
+				{
+					completedSubmissionQueueItr->second->setHeadPointer(completionQueueEntry.SQHD);
+				}
+
+				bool matched = false;
+				for (size_t i = 0; i < numberOfCommands; i++)
+				{
+					if (pDriverCommands[i]->DriverStatus == TIMEOUT && completionQueueEntry.CID == pDriverCommands[i]->Command.DWord0Breakdown.CID)
+					{
+						pDriverCommands[i]->CompletionQueueEntry = completionQueueEntry;
+
+						// copy data back if this was a read.
+						if (pDriverCommands[i]->TransferDataDirection == READ)
+						{
+							auto payloadOfReadData = prps[i].getPayloadCopy();
+							memcpy_s(&pDriverCommands[i]->TransferData, driverCommandBufferSizes[i] - sizeof(DRIVER_COMMAND), payloadOfReadData.getBuffer(), pDriverCommands[i]->TransferDataSize);
+						}
+
+						pDriverCommands[i]->DriverStatus = SENT_SUCCESSFULLY;
+						commandsCompleted++;
+						matched = true;
+						break;
+					}
+				}
+
+				if (!matched)
+				{
+					LOG_ERROR("Skipping a completion entry for CID " + strings::toHexString(completionQueueEntry.CID) + ". Did that command time out?");
+				}
+			}
+
+			if (commandsCompleted != numberOfCommands)
+			{
+				LOG_ERROR("A fused command timed out");
+			}
+		}
+
 		bool Driver::controllerReset()
 		{
 			auto CR = this->TheController.getControllerRegisters()->getControllerRegisters();
 			auto timeoutMs = CR->CAP.TO * 500; // CAP.TO is in 500 millisecond intervals
 
-			CR->CC.EN = 0; // Begin Reset
+			controller::registers::setControllerEnable(CR, false); // Begin Reset
 			auto deathTime = helpers::getTimeInMilliseconds() + timeoutMs;
 			bool rdyTo0 = false;
 			while (helpers::getTimeInMilliseconds() < deathTime)
 			{
-				if (CR->CSTS.RDY == 0)
+				if (!controller::registers::isControllerReady(CR))
 				{
 					rdyTo0 = true;
 					break;
@@ -486,12 +655,12 @@ namespace cnvme
 
 			FAIL_IF(rdyTo0 == false, "CSTS.RDY did not transition to 0 after CC.EN was set to 0");
 
-			CR->CC.EN = 1; // Enable controller and wait till ready
+			controller::registers::setControllerEnable(CR, true); // Enable controller and wait till ready
 			bool rdyTo1 = false;
 			deathTime = helpers::getTimeInMilliseconds() + timeoutMs;
 			while (helpers::getTimeInMilliseconds() < deathTime)
 			{
-				if (CR->CSTS.RDY == 1)
+				if (controller::registers::isControllerReady(CR))
 				{
 					rdyTo1 = true;
 					break;
@@ -499,6 +668,12 @@ namespace cnvme
 			}
 			FAIL_IF(rdyTo1 == false, "CSTS.RDY did not transition to 1 after CC.EN was set to 1");
 
+			// The controller started the admin queues over, so do the same. Clearing the completion queue makes old phase tags stale.
+			Queue* adminCompletionQueue = this->CompletionQueues[ADMIN_QUEUE_ID];
+			memset(MEMORY_ADDRESS_TO_8POINTER(adminCompletionQueue->getMemoryAddress()), 0, adminCompletionQueue->getQueueMemorySize());
+			adminCompletionQueue->reset();
+			this->SubmissionQueues[ADMIN_QUEUE_ID]->reset();
+
 			LOG_INFO("Deleting all IO Queues");
 			this->deleteAllIoQueues();
 			LOG_INFO("Controller Reset succeeded!");
@@ -511,6 +686,76 @@ namespace cnvme
 			this->TheController.setCommandResponseFilePath(filePath);
 		}
 
+		bool Driver::setNamespaceMediaFile(UINT_32 namespaceId, std::string filePath, UINT_64 sizeInBytes, bool directIo)
+		{
+			return this->TheController.setNamespaceMediaFile(namespaceId, filePath, sizeInBytes, directIo);
+		}
+
+		bool Driver::snapshotNamespace(UINT_32 namespaceId)
+		{
+			return this->TheController.snapshotNamespace(namespaceId);
+		}
+
+		bool Driver::revertNamespaceToSnapshot(UINT_32 namespaceId)
+		{
+			return this->TheController.revertNamespaceToSnapshot(namespaceId);
+		}
+
+		bool Driver::setNamespaceDeduplicatedMedia(UINT_32 namespaceId, bool compress)
+		{
+			return this->TheController.setNamespaceDeduplicatedMedia(namespaceId, compress);
+		}
+
+		bool Driver::getNamespaceDedupStatistics(UINT_32 namespaceId, ns::DEDUP_STATISTICS &statistics)
+		{
+			return this->TheController.getNamespaceDedupStatistics(namespaceId, statistics);
+		}
+
+		bool Driver::setNamespaceFtl(UINT_32 namespaceId, const ns::FTL_PARAMETERS &parameters)
+		{
+			return this->TheController.setNamespaceFtl(namespaceId, parameters);
+		}
+
+		bool Driver::removeNamespaceFtl(UINT_32 namespaceId)
+		{
+			return this->TheController.removeNamespaceFtl(namespaceId);
+		}
+
+		bool Driver::getNamespaceFtlStatistics(UINT_32 namespaceId, ns::FTL_STATISTICS &statistics)
+		{
+			return this->TheController.getNamespaceFtlStatistics(namespaceId, statistics);
+		}
+
+		bool Driver::saveNamespaceImage(UINT_32 namespaceId, std::string filePath)
+		{
+			return this->TheController.saveNamespaceImage(namespaceId, filePath);
+		}
+
+		bool Driver::loadNamespaceImage(UINT_32 namespaceId, std::string filePath)
+		{
+			return this->TheController.loadNamespaceImage(namespaceId, filePath);
+		}
+
+		bool Driver::saveControllerImage(std::string filePath)
+		{
+			return this->TheController.saveControllerImage(filePath);
+		}
+
+		bool Driver::loadControllerImage(std::string filePath)
+		{
+			return this->TheController.loadControllerImage(filePath);
+		}
+
+		memory::MEMORY_STATISTICS Driver::getMemoryStatistics()
+		{
+			return memory::getMemoryStatistics();
+		}
+
+		void Driver::setTimingModel(std::shared_ptr<controller::TimingModel> timingModel)
+		{
+			this->TheController.setTimingModel(timingModel);
+		}
+
 		UINT_16 Driver::getCommandIdForSubmissionQueueIdViaIncrementIfNeeded(UINT_16 submissionQueueId)
 		{
 			auto entry = this->SubmissionQueueIdToCurrentCommandIdentifiers.find(submissionQueueId);
@@ -548,7 +793,7 @@ namespace cnvme
 				{
 					if (i.second->getMemoryAddress())
 					{
-						delete[]MEMORY_ADDRESS_TO_8POINTER(i.second->getMemoryAddress());
+						memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(i.second->getMemoryAddress()), i.second->getQueueSize() * sizeof(NVME_COMMAND), memory::SUBSYSTEM_QUEUE);
 						i.second->setMemoryAddress(0);
 					}
 					delete i.second;
@@ -562,7 +807,7 @@ namespace cnvme
 				{
 					if (i.second->getMemoryAddress())
 					{
-						delete[]MEMORY_ADDRESS_TO_8POINTER(i.second->getMemoryAddress());
+						memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(i.second->getMemoryAddress()), i.second->getQueueMemorySize(), memory::SUBSYSTEM_QUEUE);
 						i.second->setMemoryAddress(0);
 					}
 					delete i.second;
@@ -665,6 +910,68 @@ namespace cnvme
 			return this->readCommand(nvmeCommand, ADMIN_QUEUE_ID, constants::commands::identify::sizes::IDENTIFY_SIZE);
 		}
 
+		TEST_DRIVER_OUTPUT TestDriver::namespaceCreate(UINT_64 NSZE, UINT_64 NCAP, UINT_8 lbaFormat, UINT_8 commandSet)
+		{
+			NVME_COMMAND nvmeCommand = { 0 };
+			nvmeCommand.DWord0Breakdown.OPC = cnvme::constants::opcodes::admin::NAMESPACE_MANAGEMENT;
+			nvmeCommand.DW10_NamespaceManagement.SEL = constants::commands::ns_management::sel::CREATE_NAMESPACE;
+			nvmeCommand.DW11_NamespaceManagement.CSI = commandSet;
+
+			Payload data(sizeof(identify::structures::IDENTIFY_NAMESPACE));
+			auto pIdentifyNamespace = (identify::structures::IDENTIFY_NAMESPACE*)data.getBuffer();
+			pIdentifyNamespace->NSZE = NSZE;
+			pIdentifyNamespace->NCAP = NCAP;
+			pIdentifyNamespace->FLBAS.CurrentLBAFormat = lbaFormat;
+
+			return this->writeCommand(nvmeCommand, ADMIN_QUEUE_ID, data);
+		}
+
+		TEST_DRIVER_OUTPUT TestDriver::namespaceDelete(UINT_32 NSID)
+		{
+			NVME_COMMAND nvmeCommand = { 0 };
+			nvmeCommand.DWord0Breakdown.OPC = cnvme::constants::opcodes::admin::NAMESPACE_MANAGEMENT;
+			nvmeCommand.DW10_NamespaceManagement.SEL = constants::commands::ns_management::sel::DELETE_NAMESPACE;
+			nvmeCommand.NSID = NSID;
+
+			return this->nonDataCommand(nvmeCommand, ADMIN_QUEUE_ID);
+		}
+
+		TEST_DRIVER_OUTPUT TestDriver::namespaceAttachment(UINT_8 select, UINT_32 NSID, UINT_16 controllerId)
+		{
+			NVME_COMMAND nvmeCommand = { 0 };
+			nvmeCommand.DWord0Breakdown.OPC = cnvme::constants::opcodes::admin::NAMESPACE_ATTACHMENT;
+			nvmeCommand.DW10_NamespaceAttachment.SEL = select;
+			nvmeCommand.NSID = NSID;
+
+			Payload data(sizeof(identify::structures::CONTROLLER_LIST));
+			auto pControllerList = (identify::structures::CONTROLLER_LIST*)data.getBuffer();
+			pControllerList->NumberOfIdentifiers = 1;
+			pControllerList->ControllerIdentifiers[0] = controllerId;
+
+			return this->writeCommand(nvmeCommand, ADMIN_QUEUE_ID, data);
+		}
+
+		TEST_DRIVER_OUTPUT TestDriver::setFeatures(UINT_8 featureId, UINT_32 DWord11, bool save)
+		{
+			NVME_COMMAND nvmeCommand = { 0 };
+			nvmeCommand.DWord0Breakdown.OPC = cnvme::constants::opcodes::admin::SET_FEATURES;
+			nvmeCommand.DW10_Features.FID = featureId;
+			nvmeCommand.DW10_Features.SV = save;
+			nvmeCommand.DWord11 = DWord11;
+
+			return this->nonDataCommand(nvmeCommand, ADMIN_QUEUE_ID);
+		}
+
+		TEST_DRIVER_OUTPUT TestDriver::getFeatures(UINT_8 featureId, UINT_8 select)
+		{
+			NVME_COMMAND nvmeCommand = { 0 };
+			nvmeCommand.DWord0Breakdown.OPC = cnvme::constants::opcodes::admin::GET_FEATURES;
+			nvmeCommand.DW10_Features.FID = featureId;
+			nvmeCommand.DW10_Features.SEL = select;
+
+			return this->nonDataCommand(nvmeCommand, ADMIN_QUEUE_ID);
+		}
+
 		std::string TestDriver::getFirmwareString()
 		{
 			auto result = this->identify(constants::commands::identify::cns::CONTROLLER, 0);
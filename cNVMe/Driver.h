@@ -26,6 +26,7 @@ Driver.h - A header file for the cNVMe 'Driver'
 #pragma once
 
 #include "Controller.h"
+#include "Memory.h"
 #include "Queue.h"
 #include "Types.h"
 
@@ -48,6 +49,7 @@ namespace cnvme
 			INVALID_DATA_LENGTH_FOR_MANUAL_PRPS,
 			INVALID_IO_QUEUE_MANAGEMENT_PC,
 			INVALID_IO_QUEUE_MANAGEMENT_IEN,
+			SUBMISSION_QUEUE_FULL,
 		};
 
 		/// <summary>
@@ -108,6 +110,12 @@ namespace cnvme
 			/// </summary>
 			Driver();
 
+			/// <summary>
+			/// Constructor for a driver whose controller uses the given doorbell stride
+			/// </summary>
+			/// <param name="doorbellStride">CAP.DSTRD for the controller. Doorbells are (4 << doorbellStride) bytes apart.</param>
+			Driver(UINT_8 doorbellStride);
+
 			/// <summary>
 			/// Destructor for a driver
 			/// </summary>
@@ -120,6 +128,16 @@ namespace cnvme
 			/// <param name="driverCommandBufferSize">Size of the data pointed to in driverCommandBuffer</param>
 			void sendCommand(UINT_8* driverCommandBuffer, size_t driverCommandBufferSize);
 
+			/// <summary>
+			/// Used to send a fused operation (like Compare and Write) to the underlying controller.
+			/// Both commands go to the same IO queue with one doorbell ring. The driver fills in the FUSE fields.
+			/// </summary>
+			/// <param name="firstDriverCommandBuffer">Pointer to the filled out DRIVER_COMMAND structure for the first command</param>
+			/// <param name="firstDriverCommandBufferSize">Size of the data pointed to in firstDriverCommandBuffer</param>
+			/// <param name="secondDriverCommandBuffer">Pointer to the filled out DRIVER_COMMAND structure for the second command</param>
+			/// <param name="secondDriverCommandBufferSize">Size of the data pointed to in secondDriverCommandBuffer</param>
+			void sendFusedCommands(UINT_8* firstDriverCommandBuffer, size_t firstDriverCommandBufferSize, UINT_8* secondDriverCommandBuffer, size_t secondDriverCommandBufferSize);
+
 			/// <summary>
 			/// Issues a controller reset (CC.EN->0) and will wait for CC.EN->1.
 			/// </summary>
@@ -132,6 +150,114 @@ namespace cnvme
 			/// <param name="filePath">path to the file</param>
 			void setControllerCommandResponseProcessingFile(std::string filePath);
 
+			/// <summary>
+			/// Backs an active namespace on the controller with a file, so its data persists across runs
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="filePath">path to the file (or block device for direct I/O). Created if it doesn't exist.</param>
+			/// <param name="sizeInBytes">Namespace size. 0 means use the size of the existing file.</param>
+			/// <param name="directIo">false to memory map the file. true to do direct I/O on it, with commands completing asynchronously.</param>
+			/// <returns>true on success, False on failure</returns>
+			bool setNamespaceMediaFile(UINT_32 namespaceId, std::string filePath, UINT_64 sizeInBytes, bool directIo);
+
+			/// <summary>
+			/// Snapshots the data in an active namespace on the controller (replacing its older snapshot).
+			/// Takes the same time no matter how big the namespace is, for namespaces that aren't backed by a file.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <returns>true on success, False on failure</returns>
+			bool snapshotNamespace(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Puts the data in an active namespace back to its snapshot. Can be done any number of times per snapshot.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <returns>true on success, False on failure</returns>
+			bool revertNamespaceToSnapshot(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Backs an active namespace on the controller with empty deduplicated media of the same size.
+			/// Blocks with the same data are stored once, and all zero blocks not at all. NUSE reports what is actually stored.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="compress">true to also compress the stored blocks</param>
+			/// <returns>true on success, False on failure</returns>
+			bool setNamespaceDeduplicatedMedia(UINT_32 namespaceId, bool compress);
+
+			/// <summary>
+			/// Gets the deduplication statistics for an active namespace backed by deduplicated media
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="statistics">Filled in with the statistics</param>
+			/// <returns>true on success, False on failure</returns>
+			bool getNamespaceDedupStatistics(UINT_32 namespaceId, ns::DEDUP_STATISTICS &statistics);
+
+			/// <summary>
+			/// Puts a new FTL model (mapping, erase blocks, over-provisioning and garbage collection) in front of an active namespace on the controller.
+			/// The data is kept. Garbage collection work slows down later commands through the timing model, if there is one.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="parameters">Settings for the model</param>
+			/// <returns>true on success, False on failure</returns>
+			bool setNamespaceFtl(UINT_32 namespaceId, const ns::FTL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Takes the FTL model away from an active namespace on the controller. The data is kept.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <returns>true on success, False on failure</returns>
+			bool removeNamespaceFtl(UINT_32 namespaceId);
+
+			/// <summary>
+			/// Gets the FTL statistics for an active namespace with an FTL model
+			/// </summary>
+			/// <param name="namespaceId">NSID of the active namespace</param>
+			/// <param name="statistics">Filled in with the statistics</param>
+			/// <returns>true on success, False on failure</returns>
+			bool getNamespaceFtlStatistics(UINT_32 namespaceId, ns::FTL_STATISTICS &statistics);
+
+			/// <summary>
+			/// Saves an allocated namespace on the controller to an image file. Only what has been written takes up space.
+			/// </summary>
+			/// <param name="namespaceId">NSID of the allocated namespace</param>
+			/// <param name="filePath">path to the image file. Overwritten if it exists.</param>
+			/// <returns>true on success, False on failure</returns>
+			bool saveNamespaceImage(UINT_32 namespaceId, std::string filePath);
+
+			/// <summary>
+			/// Replaces an allocated namespace on the controller with one from saveNamespaceImage(), streaming its data into memory
+			/// </summary>
+			/// <param name="namespaceId">NSID of the allocated namespace</param>
+			/// <param name="filePath">path to the image file</param>
+			/// <returns>true on success, False on failure</returns>
+			bool loadNamespaceImage(UINT_32 namespaceId, std::string filePath);
+
+			/// <summary>
+			/// Saves the controller (Identify Controller, firmware slots and every allocated namespace) to an image file
+			/// </summary>
+			/// <param name="filePath">path to the image file. Overwritten if it exists.</param>
+			/// <returns>true on success, False on failure</returns>
+			bool saveControllerImage(std::string filePath);
+
+			/// <summary>
+			/// Replaces the controller's Identify Controller, firmware slots and namespaces with those from saveControllerImage()
+			/// </summary>
+			/// <param name="filePath">path to the image file</param>
+			/// <returns>true on success, False on failure</returns>
+			bool loadControllerImage(std::string filePath);
+
+			/// <summary>
+			/// Gets the allocator statistics along with the memory accounted to each simulator subsystem
+			/// </summary>
+			/// <returns>MEMORY_STATISTICS</returns>
+			memory::MEMORY_STATISTICS getMemoryStatistics();
+
+			/// <summary>
+			/// Sets the model of how long the controller's device takes for each command. Completions are held until then.
+			/// </summary>
+			/// <param name="timingModel">The model (like a controller::LatencyModel). nullptr to complete commands as fast as possible.</param>
+			void setTimingModel(std::shared_ptr<controller::TimingModel> timingModel);
+
 		private:
 			/// <summary>
 			/// The controller that this driver is connected to
@@ -153,6 +279,12 @@ namespace cnvme
 			/// </summary>
 			std::map<UINT_16, UINT_16> SubmissionQueueIdToCurrentCommandIdentifiers;
 
+			/// <summary>
+			/// Address/size of queue memory from IO queue creations that timed out.
+			/// The controller may still be using it, so it is only freed when the driver is destroyed.
+			/// </summary>
+			std::vector<std::pair<UINT_64, size_t>> TimedOutQueueMemory;
+
 			/// <summary>
 			/// Will update SubmissionQueueIdToCurrentCommandIdentifiers and return the next CID.
 			/// </summary>
@@ -237,6 +369,49 @@ namespace cnvme
 			/// <returns>TEST_DRIVER_OUTPUT</returns>
 			TEST_DRIVER_OUTPUT identify(UINT_8 CNS, UINT_32 NSID);
 
+			/// <summary>
+			/// Used to test Namespace Management (create)
+			/// </summary>
+			/// <param name="NSZE">Namespace size in sectors</param>
+			/// <param name="NCAP">Namespace capacity in sectors</param>
+			/// <param name="lbaFormat">Index of the LBA format to use</param>
+			/// <param name="commandSet">I/O Command Set (constants::commands::identify::csi) for the namespace</param>
+			/// <returns>TEST_DRIVER_OUTPUT (DW0 of the completion has the new NSID)</returns>
+			TEST_DRIVER_OUTPUT namespaceCreate(UINT_64 NSZE, UINT_64 NCAP, UINT_8 lbaFormat, UINT_8 commandSet);
+
+			/// <summary>
+			/// Used to test Namespace Management (delete)
+			/// </summary>
+			/// <param name="NSID">Namespace to delete</param>
+			/// <returns>TEST_DRIVER_OUTPUT</returns>
+			TEST_DRIVER_OUTPUT namespaceDelete(UINT_32 NSID);
+
+			/// <summary>
+			/// Used to test Namespace Attachment
+			/// </summary>
+			/// <param name="select">attach or detach</param>
+			/// <param name="NSID">Namespace to attach/detach</param>
+			/// <param name="controllerId">Only controller to put in the controller list</param>
+			/// <returns>TEST_DRIVER_OUTPUT</returns>
+			TEST_DRIVER_OUTPUT namespaceAttachment(UINT_8 select, UINT_32 NSID, UINT_16 controllerId);
+
+			/// <summary>
+			/// Used to test Set Features (for features without a data buffer)
+			/// </summary>
+			/// <param name="featureId">Feature to set</param>
+			/// <param name="DWord11">Value to set it to</param>
+			/// <param name="save">true to ask for the value to be saved across resets</param>
+			/// <returns>TEST_DRIVER_OUTPUT</returns>
+			TEST_DRIVER_OUTPUT setFeatures(UINT_8 featureId, UINT_32 DWord11, bool save);
+
+			/// <summary>
+			/// Used to test Get Features (for features without a data buffer)
+			/// </summary>
+			/// <param name="featureId">Feature to get</param>
+			/// <param name="select">Which value to get (current, default, saved or supported capabilities)</param>
+			/// <returns>TEST_DRIVER_OUTPUT (DW0 of the completion has the value)</returns>
+			TEST_DRIVER_OUTPUT getFeatures(UINT_8 featureId, UINT_8 select);
+
 			/// <summary>
 			/// Returns the FW string obtained by identify controller
 			/// </summary>
@@ -0,0 +1,287 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+FlashTranslationLayer.cpp - An implementation file for a model of a NAND flash translation layer
+*/
+
+#include "Constants.h"
+#include "FlashTranslationLayer.h"
+
+namespace cnvme
+{
+	namespace ns
+	{
+		FlashTranslationLayer::FlashTranslationLayer(UINT_64 byteSize, const FTL_PARAMETERS &parameters)
+		{
+			ASSERT_IF(!isValid(byteSize, parameters), "The flash translation layer was given settings it can't model");
+
+			this->Parameters = parameters;
+			UINT_64 logicalPages = (byteSize + parameters.PageSize - 1) / parameters.PageSize;
+			UINT_64 userBlocks = (logicalPages + parameters.PagesPerBlock - 1) / parameters.PagesPerBlock;
+			UINT_64 totalBlocks = userBlocks + (userBlocks * parameters.OverProvisioning + 99) / 100;
+
+			this->LogicalToPhysical.assign((size_t)logicalPages, FTL_UNMAPPED);
+			this->PhysicalToLogical.assign((size_t)(totalBlocks * parameters.PagesPerBlock), FTL_UNMAPPED);
+			this->Blocks.resize((size_t)totalBlocks); // Every block starts out free
+
+			this->Statistics = { 0 };
+			this->BackgroundWork = { 0 };
+			this->BlocksClosed = 0;
+			this->Collecting = false;
+			this->deallocateAll();
+		}
+
+		FTL_PARAMETERS FlashTranslationLayer::getDefaultParameters()
+		{
+			FTL_PARAMETERS parameters = { 0 };
+			parameters.PageSize = 4096;
+			parameters.PagesPerBlock = 256;
+			parameters.OverProvisioning = 7;
+			parameters.GcPolicy = constants::ftl::gc_policy::GREEDY;
+			parameters.GcLowWatermark = 2;
+			parameters.GcHighWatermark = 4;
+			return parameters;
+		}
+
+		bool FlashTranslationLayer::isValid(UINT_64 byteSize, const FTL_PARAMETERS &parameters)
+		{
+			if (byteSize == 0 || parameters.PageSize == 0 || parameters.PagesPerBlock == 0 || parameters.GcLowWatermark == 0 ||
+				parameters.GcHighWatermark < parameters.GcLowWatermark || parameters.GcPolicy > constants::ftl::gc_policy::COST_BENEFIT)
+			{
+				return false;
+			}
+
+			// Physical pages are numbered with 32 bits
+			UINT_64 logicalPages = (byteSize + parameters.PageSize - 1) / parameters.PageSize;
+			UINT_64 userBlocks = (logicalPages + parameters.PagesPerBlock - 1) / parameters.PagesPerBlock;
+			UINT_64 spareBlocks = (userBlocks * parameters.OverProvisioning + 99) / 100;
+			return spareBlocks > parameters.GcHighWatermark && (userBlocks + spareBlocks) * parameters.PagesPerBlock < FTL_UNMAPPED;
+		}
+
+		void FlashTranslationLayer::write(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			if (byteSize == 0)
+			{
+				return;
+			}
+
+			UINT_64 lastPage = (byteOffset + byteSize - 1) / this->Parameters.PageSize;
+			for (UINT_64 page = byteOffset / this->Parameters.PageSize; page <= lastPage; page++)
+			{
+				this->programPage((UINT_32)page);
+				this->Statistics.HostPagesWritten++;
+			}
+		}
+
+		void FlashTranslationLayer::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			UINT_64 firstPage = (byteOffset + this->Parameters.PageSize - 1) / this->Parameters.PageSize;
+			UINT_64 endPage = (byteOffset + byteSize) / this->Parameters.PageSize;
+			for (UINT_64 page = firstPage; page < endPage; page++)
+			{
+				this->unmapPage((UINT_32)page);
+			}
+		}
+
+		void FlashTranslationLayer::deallocateAll()
+		{
+			std::fill(this->LogicalToPhysical.begin(), this->LogicalToPhysical.end(), FTL_UNMAPPED);
+			std::fill(this->PhysicalToLogical.begin(), this->PhysicalToLogical.end(), FTL_UNMAPPED);
+
+			this->FreeBlocks.clear();
+			for (UINT_32 i = 0; i < this->Blocks.size(); i++)
+			{
+				if (this->Blocks[i].State != BLOCK_FREE || this->Blocks[i].WrittenPages)
+				{
+					this->Blocks[i].ValidPages = 0;
+					this->eraseBlock(i);
+				}
+				else
+				{
+					this->FreeBlocks.push_back(i);
+				}
+			}
+
+			this->OpenBlock = FTL_UNMAPPED;
+			this->Statistics.ValidPages = 0;
+		}
+
+		FTL_STATISTICS FlashTranslationLayer::getStatistics() const
+		{
+			FTL_STATISTICS statistics = this->Statistics;
+			statistics.FreeBlocks = this->FreeBlocks.size();
+			statistics.TotalBlocks = this->Blocks.size();
+			return statistics;
+		}
+
+		FTL_PARAMETERS FlashTranslationLayer::getParameters() const
+		{
+			return this->Parameters;
+		}
+
+		FTL_WORK FlashTranslationLayer::takeBackgroundWork()
+		{
+			FTL_WORK work = this->BackgroundWork;
+			this->BackgroundWork = { 0 };
+			return work;
+		}
+
+		void FlashTranslationLayer::programPage(UINT_32 logicalPage)
+		{
+			// Garbage collection triggered by opening a block may fill that block with relocated pages
+			while (this->OpenBlock == FTL_UNMAPPED || this->Blocks[this->OpenBlock].WrittenPages == this->Parameters.PagesPerBlock)
+			{
+				this->openNewBlock();
+			}
+
+			// Unmap after opening, since garbage collection may have just moved this page
+			this->unmapPage(logicalPage);
+
+			BLOCK &block = this->Blocks[this->OpenBlock];
+			UINT_32 physicalPage = this->OpenBlock * this->Parameters.PagesPerBlock + block.WrittenPages;
+			block.WrittenPages++;
+			block.ValidPages++;
+
+			this->LogicalToPhysical[logicalPage] = physicalPage;
+			this->PhysicalToLogical[physicalPage] = logicalPage;
+			this->Statistics.MediaPagesWritten++;
+			this->Statistics.ValidPages++;
+		}
+
+		void FlashTranslationLayer::unmapPage(UINT_32 logicalPage)
+		{
+			UINT_32 physicalPage = this->LogicalToPhysical[logicalPage];
+			if (physicalPage == FTL_UNMAPPED)
+			{
+				return;
+			}
+
+			this->Blocks[physicalPage / this->Parameters.PagesPerBlock].ValidPages--;
+			this->PhysicalToLogical[physicalPage] = FTL_UNMAPPED;
+			this->LogicalToPhysical[logicalPage] = FTL_UNMAPPED;
+			this->Statistics.ValidPages--;
+		}
+
+		void FlashTranslationLayer::openNewBlock()
+		{
+			if (this->OpenBlock != FTL_UNMAPPED)
+			{
+				this->Blocks[this->OpenBlock].State = BLOCK_CLOSED;
+				this->Blocks[this->OpenBlock].ClosedSequence = this->BlocksClosed++;
+			}
+
+			// isValid() leaves enough spare blocks that garbage collection always keeps one free
+			ASSERT_IF(this->FreeBlocks.empty(), "The flash translation layer ran out of free blocks");
+			this->OpenBlock = this->FreeBlocks.front();
+			this->FreeBlocks.pop_front();
+			this->Blocks[this->OpenBlock].State = BLOCK_OPEN;
+
+			if (!this->Collecting && this->FreeBlocks.size() < this->Parameters.GcLowWatermark)
+			{
+				this->collectGarbage();
+			}
+		}
+
+		void FlashTranslationLayer::collectGarbage()
+		{
+			this->Collecting = true;
+			this->Statistics.GarbageCollections++;
+
+			while (this->FreeBlocks.size() < this->Parameters.GcHighWatermark)
+			{
+				UINT_32 victim = this->pickVictim();
+				if (victim == FTL_UNMAPPED)
+				{
+					break; // Every closed block is full of valid data. Nothing to gain.
+				}
+
+				// Each victim has an invalid page, so moving its valid pages never needs more than the block it frees
+				UINT_32 firstPhysicalPage = victim * this->Parameters.PagesPerBlock;
+				for (UINT_32 physicalPage = firstPhysicalPage; physicalPage < firstPhysicalPage + this->Blocks[victim].WrittenPages; physicalPage++)
+				{
+					UINT_32 logicalPage = this->PhysicalToLogical[physicalPage];
+					if (logicalPage != FTL_UNMAPPED)
+					{
+						this->programPage(logicalPage);
+						this->Statistics.PagesRelocated++;
+						this->BackgroundWork.RelocatedBytes += this->Parameters.PageSize;
+					}
+				}
+
+				this->eraseBlock(victim);
+			}
+
+			this->Collecting = false;
+		}
+
+		UINT_32 FlashTranslationLayer::pickVictim() const
+		{
+			UINT_32 victim = FTL_UNMAPPED;
+			double bestScore = 0;
+
+			for (UINT_32 i = 0; i < this->Blocks.size(); i++)
+			{
+				const BLOCK &block = this->Blocks[i];
+				if (block.State != BLOCK_CLOSED || block.ValidPages == this->Parameters.PagesPerBlock)
+				{
+					continue;
+				}
+
+				// Higher is better
+				double score = 0;
+				double utilization = (double)block.ValidPages / this->Parameters.PagesPerBlock;
+				if (this->Parameters.GcPolicy == constants::ftl::gc_policy::GREEDY)
+				{
+					score = 1 - utilization;
+				}
+				else if (this->Parameters.GcPolicy == constants::ftl::gc_policy::FIFO)
+				{
+					score = (double)(this->BlocksClosed - block.ClosedSequence);
+				}
+				else // COST_BENEFIT: space gained per page moved, weighted by how long the data has stayed put
+				{
+					score = (1 - utilization) / (1 + utilization) * (double)(this->BlocksClosed - block.ClosedSequence);
+				}
+
+				if (victim == FTL_UNMAPPED || score > bestScore)
+				{
+					victim = i;
+					bestScore = score;
+				}
+			}
+
+			return victim;
+		}
+
+		void FlashTranslationLayer::eraseBlock(UINT_32 block)
+		{
+			ASSERT_IF(this->Blocks[block].ValidPages != 0, "Erasing a block that still has valid pages");
+
+			this->Blocks[block].WrittenPages = 0;
+			this->Blocks[block].EraseCount++;
+			this->Blocks[block].State = BLOCK_FREE;
+			this->FreeBlocks.push_back(block);
+			this->Statistics.BlocksErased++;
+			this->BackgroundWork.BlocksErased++;
+		}
+	}
+}
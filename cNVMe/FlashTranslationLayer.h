@@ -0,0 +1,251 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+FlashTranslationLayer.h - A header file for a model of a NAND flash translation layer
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#define FTL_UNMAPPED 0xFFFFFFFF // Page map entry for a page that doesn't map anywhere
+
+namespace cnvme
+{
+	namespace ns
+	{
+		/// <summary>
+		/// Settings for a FlashTranslationLayer
+		/// </summary>
+		typedef struct FTL_PARAMETERS
+		{
+			UINT_32 PageSize;           // Bytes each map entry covers. Writes program whole pages, so smaller writes still program a page.
+			UINT_32 PagesPerBlock;      // Pages in each erase block
+			UINT_32 OverProvisioning;   // Blocks beyond the logical capacity, as a percent of it
+			UINT_32 GcPolicy;           // constants::ftl::gc_policy
+			UINT_32 GcLowWatermark;     // Garbage collection starts once fewer than this many blocks are free
+			UINT_32 GcHighWatermark;    // and runs until this many are free
+		} FTL_PARAMETERS, *PFTL_PARAMETERS;
+
+		/// <summary>
+		/// Statistics for a FlashTranslationLayer. MediaPagesWritten / HostPagesWritten is the write amplification.
+		/// </summary>
+		typedef struct FTL_STATISTICS
+		{
+			UINT_64 HostPagesWritten;   // Pages programmed for host writes
+			UINT_64 MediaPagesWritten;  // Pages programmed in all: the host's plus the ones garbage collection moved
+			UINT_64 PagesRelocated;     // Valid pages garbage collection moved out of blocks it was about to erase
+			UINT_64 BlocksErased;
+			UINT_64 GarbageCollections; // Times garbage collection started
+			UINT_64 FreeBlocks;         // Erased blocks waiting to be written
+			UINT_64 TotalBlocks;
+			UINT_64 ValidPages;         // Logical pages that map somewhere
+		} FTL_STATISTICS, *PFTL_STATISTICS;
+
+		/// <summary>
+		/// Work garbage collection did on the media
+		/// </summary>
+		typedef struct FTL_WORK
+		{
+			UINT_64 RelocatedBytes; // Valid pages moved. Each one was read and programmed again.
+			UINT_64 BlocksErased;
+		} FTL_WORK, *PFTL_WORK;
+
+		/// <summary>
+		/// Models what a NAND flash translation layer does with writes, without holding any data.
+		/// Logical pages map to physical pages in erase blocks. Writes go to the next page of the open block, leaving the
+		///   page they replace invalid. Blocks can only be written again once erased, so when free blocks run low, garbage collection
+		///   picks victims by its policy, moves their valid pages to the open block and erases them. What it moves is the write amplification,
+		///   which grows as the drive fills up and over-provisioning is all that is left to collect from.
+		/// Not thread safe. The owner serializes access.
+		/// </summary>
+		class FlashTranslationLayer
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts out like a new drive: nothing mapped and every block free.
+			/// </summary>
+			/// <param name="byteSize">Logical capacity in bytes</param>
+			/// <param name="parameters">Settings. Must pass isValid().</param>
+			FlashTranslationLayer(UINT_64 byteSize, const FTL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Gets the default settings: 4KB pages, 1MB blocks, 7% over-provisioning and greedy garbage collection
+			/// </summary>
+			/// <returns>FTL_PARAMETERS</returns>
+			static FTL_PARAMETERS getDefaultParameters();
+
+			/// <summary>
+			/// Checks that settings can be modeled for a capacity.
+			/// Over-provisioning needs to leave more spare blocks than the high watermark, so garbage collection can always get there.
+			/// </summary>
+			/// <param name="byteSize">Logical capacity in bytes</param>
+			/// <param name="parameters">Settings to check</param>
+			/// <returns>true if they are usable</returns>
+			static bool isValid(UINT_64 byteSize, const FTL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Programs every page the range touches
+			/// </summary>
+			/// <param name="byteOffset">Offset into the logical capacity to start at</param>
+			/// <param name="byteSize">Number of bytes written</param>
+			void write(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Unmaps the pages the range fully covers, leaving them invalid for garbage collection
+			/// </summary>
+			/// <param name="byteOffset">Offset into the logical capacity to start at</param>
+			/// <param name="byteSize">Number of bytes thrown away</param>
+			void deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Unmaps everything and erases every block that was written
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Gets statistics on what the model has done
+			/// </summary>
+			/// <returns>FTL_STATISTICS</returns>
+			FTL_STATISTICS getStatistics() const;
+
+			/// <summary>
+			/// Gets the settings the model was made with
+			/// </summary>
+			/// <returns>FTL_PARAMETERS</returns>
+			FTL_PARAMETERS getParameters() const;
+
+			/// <summary>
+			/// Gets the garbage collection work done since the last call, so it can be charged to the media in a timing model
+			/// </summary>
+			/// <returns>FTL_WORK</returns>
+			FTL_WORK takeBackgroundWork();
+
+		private:
+			/// <summary>
+			/// Where a block is in its life
+			/// </summary>
+			enum BlockState : UINT_8
+			{
+				BLOCK_FREE,
+				BLOCK_OPEN,
+				BLOCK_CLOSED
+			};
+
+			/// <summary>
+			/// An erase block
+			/// </summary>
+			typedef struct BLOCK
+			{
+				UINT_32 ValidPages;     // Written pages that are still mapped
+				UINT_32 WrittenPages;   // Pages programmed since the last erase
+				UINT_64 ClosedSequence; // BlocksClosed when this block filled up. Tells the age of its data.
+				UINT_32 EraseCount;
+				BlockState State;
+			} BLOCK, *PBLOCK;
+
+			/// <summary>
+			/// Programs a logical page into the next page of the open block, invalidating where it was before
+			/// </summary>
+			/// <param name="logicalPage">The logical page</param>
+			void programPage(UINT_32 logicalPage);
+
+			/// <summary>
+			/// Invalidates where a logical page is mapped, if anywhere, and unmaps it
+			/// </summary>
+			/// <param name="logicalPage">The logical page</param>
+			void unmapPage(UINT_32 logicalPage);
+
+			/// <summary>
+			/// Closes the open block and opens a free one. Starts garbage collection if that leaves too few free blocks.
+			/// </summary>
+			void openNewBlock();
+
+			/// <summary>
+			/// Moves the valid pages out of victims and erases them until GcHighWatermark blocks are free
+			/// </summary>
+			void collectGarbage();
+
+			/// <summary>
+			/// Picks the closed block with the best score under the garbage collection policy. Only blocks with an invalid page are picked.
+			/// </summary>
+			/// <returns>Index of the block, or FTL_UNMAPPED if no closed block has an invalid page</returns>
+			UINT_32 pickVictim() const;
+
+			/// <summary>
+			/// Erases a block with no valid pages and puts it on the free list
+			/// </summary>
+			/// <param name="block">Index of the block</param>
+			void eraseBlock(UINT_32 block);
+
+			/// <summary>
+			/// Settings for the model
+			/// </summary>
+			FTL_PARAMETERS Parameters;
+
+			/// <summary>
+			/// Physical page each logical page is in. FTL_UNMAPPED if it isn't anywhere.
+			/// </summary>
+			std::vector<UINT_32> LogicalToPhysical;
+
+			/// <summary>
+			/// Logical page each physical page holds. FTL_UNMAPPED if it is free or invalid.
+			/// </summary>
+			std::vector<UINT_32> PhysicalToLogical;
+
+			/// <summary>
+			/// Every erase block
+			/// </summary>
+			std::vector<BLOCK> Blocks;
+
+			/// <summary>
+			/// Erased blocks, oldest erase first so wear is spread out
+			/// </summary>
+			std::deque<UINT_32> FreeBlocks;
+
+			/// <summary>
+			/// Block writes go to. FTL_UNMAPPED until the first write.
+			/// </summary>
+			UINT_32 OpenBlock;
+
+			/// <summary>
+			/// Number of blocks that have filled up so far
+			/// </summary>
+			UINT_64 BlocksClosed;
+
+			/// <summary>
+			/// true while garbage collection runs, so the blocks it opens don't start it again
+			/// </summary>
+			bool Collecting;
+
+			/// <summary>
+			/// Statistics so far. FreeBlocks and TotalBlocks are filled in by getStatistics().
+			/// </summary>
+			FTL_STATISTICS Statistics;
+
+			/// <summary>
+			/// Garbage collection work not yet handed out by takeBackgroundWork()
+			/// </summary>
+			FTL_WORK BackgroundWork;
+		};
+	}
+}
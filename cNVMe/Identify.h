@@ -293,6 +293,46 @@ namespace cnvme
 				NGUID NGUID;
 			} NAMESPACE_IDENTIFICATION_DESCRIPTOR_NGUID, *PNAMESPACE_IDENTIFICATION_DESCRIPTOR_NGUID;
 			static_assert(sizeof(NAMESPACE_IDENTIFICATION_DESCRIPTOR_NGUID) == 20, "A namespace identification descriptor for NGUID is 20 bytes in size");
+
+			typedef struct NAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI {
+				UINT_8 NIDT;
+				UINT_8 NIDL;
+				UINT_8 RSVD[2];
+				UINT_8 CSI;
+			} NAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI, *PNAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI;
+			static_assert(sizeof(NAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI) == 5, "A namespace identification descriptor for the command set is 5 bytes in size");
+
+			typedef struct ZONED_LBA_FORMAT_EXTENSION {
+				UINT_64 ZSZE; // Zone Size (in LBAs)
+				UINT_8 ZDES; // Zone Descriptor Extension Size (in 64 byte units)
+				UINT_8 RSVD[7];
+			} ZONED_LBA_FORMAT_EXTENSION, *PZONED_LBA_FORMAT_EXTENSION;
+			static_assert(sizeof(ZONED_LBA_FORMAT_EXTENSION) == 16, "Zoned LBA Format Extensions are 16 bytes in size");
+
+			typedef struct IDENTIFY_NAMESPACE_ZONED {
+				UINT_16 ZOC; // Zone Operation Characteristics
+				UINT_16 OZCS; // Optional Zoned Command Support
+				UINT_32 MAR; // Maximum Active Resources (0-based)
+				UINT_32 MOR; // Maximum Open Resources (0-based)
+				UINT_32 RRL; // Reset Recommended Limit
+				UINT_32 FRL; // Finish Recommended Limit
+				UINT_8 RSVD_20_2815[2796];
+				ZONED_LBA_FORMAT_EXTENSION LBAFE[16];
+				UINT_8 VendorSpecific[1024];
+			} IDENTIFY_NAMESPACE_ZONED, *PIDENTIFY_NAMESPACE_ZONED;
+			static_assert(sizeof(IDENTIFY_NAMESPACE_ZONED) == 4096, "Identify Namespace for the Zoned Namespace Command Set should be 4096 bytes in size");
+
+			typedef struct IDENTIFY_CONTROLLER_ZONED {
+				UINT_8 ZASL; // Zone Append Size Limit (0 means MDTS)
+				UINT_8 RSVD_1_4095[4095];
+			} IDENTIFY_CONTROLLER_ZONED, *PIDENTIFY_CONTROLLER_ZONED;
+			static_assert(sizeof(IDENTIFY_CONTROLLER_ZONED) == 4096, "Identify Controller for the Zoned Namespace Command Set should be 4096 bytes in size");
+
+			typedef struct CONTROLLER_LIST {
+				UINT_16 NumberOfIdentifiers;
+				UINT_16 ControllerIdentifiers[2047];
+			} CONTROLLER_LIST, *PCONTROLLER_LIST;
+			static_assert(sizeof(CONTROLLER_LIST) == 4096, "A controller list is 4096 bytes in size");
 		}
 	}
 }
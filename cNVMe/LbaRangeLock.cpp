@@ -0,0 +1,111 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+LbaRangeLock.cpp - An implementation file for locking ranges of LBAs in a namespace
+*/
+
+#include "LbaRangeLock.h"
+
+namespace cnvme
+{
+	namespace ns
+	{
+		LbaRangeLock::Range::Range(LbaRangeLock &owner, UINT_64 ticket) : Owner(owner)
+		{
+			this->Ticket = ticket;
+			this->Reserved = true;
+		}
+
+		LbaRangeLock::Range::~Range()
+		{
+			if (this->Reserved)
+			{
+				this->unlock();
+			}
+		}
+
+		void LbaRangeLock::Range::lock()
+		{
+			std::unique_lock<std::mutex> lock(this->Owner.RangeMutex);
+			this->Owner.RangeReleased.wait(lock, [this]() { return !this->Owner.hasEarlierConflict(this->Ticket); });
+		}
+
+		void LbaRangeLock::Range::unlock()
+		{
+			this->Owner.release(this->Ticket);
+			this->Reserved = false;
+		}
+
+		LbaRangeLock::LbaRangeLock()
+		{
+			this->NextTicket = 0;
+		}
+
+		std::shared_ptr<LbaRangeLock::Range> LbaRangeLock::reserve(UINT_64 firstLba, UINT_64 numberOfLbas, bool exclusive)
+		{
+			RESERVED_RANGE range = { firstLba, firstLba + numberOfLbas - 1, exclusive };
+			if (numberOfLbas == 0 || range.LastLba < firstLba)
+			{
+				range.LastLba = UINT64_MAX; // Runs off the end, so it's to the end
+			}
+
+			std::unique_lock<std::mutex> lock(this->RangeMutex);
+			UINT_64 ticket = this->NextTicket++;
+			this->ReservedRanges[ticket] = range;
+			return std::shared_ptr<Range>(new Range(*this, ticket));
+		}
+
+		size_t LbaRangeLock::getNumberOfReservedRanges()
+		{
+			std::unique_lock<std::mutex> lock(this->RangeMutex);
+			return this->ReservedRanges.size();
+		}
+
+		bool LbaRangeLock::hasEarlierConflict(UINT_64 ticket) const
+		{
+			auto rangeItr = this->ReservedRanges.find(ticket);
+			ASSERT_IF(rangeItr == this->ReservedRanges.end(), "Tried to lock a range that isn't reserved");
+
+			const RESERVED_RANGE &range = rangeItr->second;
+			for (auto itr = this->ReservedRanges.begin(); itr != rangeItr; itr++)
+			{
+				bool overlaps = itr->second.FirstLba <= range.LastLba && range.FirstLba <= itr->second.LastLba;
+				if (overlaps && (itr->second.Exclusive || range.Exclusive))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void LbaRangeLock::release(UINT_64 ticket)
+		{
+			{
+				std::unique_lock<std::mutex> lock(this->RangeMutex);
+				this->ReservedRanges.erase(ticket);
+			}
+
+			this->RangeReleased.notify_all();
+		}
+	}
+}
@@ -0,0 +1,168 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+LbaRangeLock.h - A header file for locking ranges of LBAs in a namespace
+*/
+
+#pragma once
+
+#include "Types.h"
+
+#include <memory>
+
+namespace cnvme
+{
+	namespace ns
+	{
+		/// <summary>
+		/// Locks ranges of LBAs so commands to one namespace can run on several I/O workers at once.
+		/// Ranges are reserved in the order commands were submitted, then locked by whichever worker runs the command.
+		///   A range can be locked once no earlier reserved range overlaps it, unless both are shared (reads).
+		///   So commands to different LBAs run in parallel, while overlapping writes happen in the order they were submitted.
+		/// </summary>
+		class LbaRangeLock
+		{
+		public:
+			/// <summary>
+			/// A reserved range. Meets BasicLockable so it works with std::lock_guard.
+			/// Released when unlocked, or when destroyed if it never was.
+			/// </summary>
+			class Range
+			{
+			public:
+				/// <summary>
+				/// Destructor. Releases the range if it is still reserved or locked.
+				/// </summary>
+				~Range();
+
+				/// <summary>
+				/// Blocks until no earlier range that conflicts with this one is still reserved
+				/// </summary>
+				void lock();
+
+				/// <summary>
+				/// Releases the range, letting later ranges that overlap it go
+				/// </summary>
+				void unlock();
+
+			private:
+				friend class LbaRangeLock;
+
+				/// <summary>
+				/// Constructor. Only LbaRangeLock::reserve() makes these.
+				/// </summary>
+				/// <param name="owner">The lock the range was reserved in</param>
+				/// <param name="ticket">Order the range was reserved in</param>
+				Range(LbaRangeLock &owner, UINT_64 ticket);
+
+				/// <summary>
+				/// Ranges can't be copied. Share them through a std::shared_ptr instead.
+				/// </summary>
+				Range(const Range&);
+
+				/// <summary>
+				/// Ranges can't be copied. Share them through a std::shared_ptr instead.
+				/// </summary>
+				Range& operator=(const Range&);
+
+				/// <summary>
+				/// The lock the range was reserved in
+				/// </summary>
+				LbaRangeLock &Owner;
+
+				/// <summary>
+				/// Order the range was reserved in
+				/// </summary>
+				UINT_64 Ticket;
+
+				/// <summary>
+				/// true until the range is released
+				/// </summary>
+				bool Reserved;
+			};
+
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			LbaRangeLock();
+
+			/// <summary>
+			/// Reserves a range, after every range reserved before it. Call this in submission order.
+			/// </summary>
+			/// <param name="firstLba">First LBA in the range</param>
+			/// <param name="numberOfLbas">Number of LBAs in the range (one based). 0 means through the last LBA.</param>
+			/// <param name="exclusive">true if the range will be written to. false if it will only be read.</param>
+			/// <returns>The range. lock() it before touching the LBAs.</returns>
+			std::shared_ptr<Range> reserve(UINT_64 firstLba, UINT_64 numberOfLbas, bool exclusive);
+
+			/// <summary>
+			/// Gets the number of ranges reserved (or locked) right now
+			/// </summary>
+			/// <returns>Number of ranges</returns>
+			size_t getNumberOfReservedRanges();
+
+		private:
+			/// <summary>
+			/// A reserved range
+			/// </summary>
+			typedef struct RESERVED_RANGE
+			{
+				UINT_64 FirstLba;
+				UINT_64 LastLba;    // Inclusive
+				bool Exclusive;
+			}RESERVED_RANGE, *PRESERVED_RANGE;
+
+			/// <summary>
+			/// Returns true if a range reserved before the given ticket overlaps it, and either of them is exclusive
+			/// </summary>
+			/// <param name="ticket">Ticket of the range to check</param>
+			/// <returns>bool</returns>
+			bool hasEarlierConflict(UINT_64 ticket) const;
+
+			/// <summary>
+			/// Drops a range and wakes up anything waiting on it
+			/// </summary>
+			/// <param name="ticket">Ticket of the range to drop</param>
+			void release(UINT_64 ticket);
+
+			/// <summary>
+			/// Reserved ranges, ordered by ticket (so by the order they were reserved in)
+			/// </summary>
+			std::map<UINT_64, RESERVED_RANGE> ReservedRanges;
+
+			/// <summary>
+			/// Ticket for the next range reserved
+			/// </summary>
+			UINT_64 NextTicket;
+
+			/// <summary>
+			/// Guards everything above
+			/// </summary>
+			std::mutex RangeMutex;
+
+			/// <summary>
+			/// Signaled whenever a range is released
+			/// </summary>
+			std::condition_variable RangeReleased;
+		};
+	}
+}
@@ -0,0 +1,1823 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Media.cpp - An implementation file for the storage behind a cNVMe Namespace
+*/
+
+#include "Media.h"
+#include "Memory.h"
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else // Linux
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace cnvme
+{
+	namespace ns
+	{
+		Media::~Media()
+		{
+		}
+
+		bool Media::isAsynchronous() const
+		{
+			return false;
+		}
+
+		bool Media::isPersistent() const
+		{
+			return false;
+		}
+
+		std::shared_ptr<Media> Media::clone()
+		{
+			return nullptr;
+		}
+
+		std::vector<std::pair<UINT_64, UINT_64>> Media::getAllocatedRanges() const
+		{
+			std::vector<std::pair<UINT_64, UINT_64>> ranges;
+			if (this->getSize() != 0)
+			{
+				ranges.push_back(std::make_pair(0, this->getSize()));
+			}
+			return ranges;
+		}
+
+		/// <summary>
+		/// Turns the indexes of allocated units (chunks, blocks) into byte ranges, joining up neighbouring units
+		/// </summary>
+		/// <param name="indexes">Index of each allocated unit, in any order</param>
+		/// <param name="unitSize">Size of each unit in bytes</param>
+		/// <param name="mediaSize">Size of the media in bytes. The last unit can go past it.</param>
+		/// <returns>(byte offset, byte size) of each run of units, in order</returns>
+		static std::vector<std::pair<UINT_64, UINT_64>> getRangesOfUnits(std::vector<UINT_64> &indexes, UINT_64 unitSize, UINT_64 mediaSize)
+		{
+			std::sort(indexes.begin(), indexes.end());
+
+			std::vector<std::pair<UINT_64, UINT_64>> ranges;
+			for (UINT_64 index : indexes)
+			{
+				UINT_64 byteOffset = index * unitSize;
+				UINT_64 byteSize = (std::min)(unitSize, mediaSize - byteOffset);
+				if (!ranges.empty() && ranges.back().first + ranges.back().second == byteOffset)
+				{
+					ranges.back().second += byteSize;
+				}
+				else
+				{
+					ranges.push_back(std::make_pair(byteOffset, byteSize));
+				}
+			}
+			return ranges;
+		}
+
+		bool Media::saveImage(std::ostream &image)
+		{
+			UINT_8* buffer = memory::allocate(MEDIA_CHUNK_SIZE, false, memory::SUBSYSTEM_NAMESPACE);
+			bool succeeded = true;
+
+			for (auto &range : this->getAllocatedRanges())
+			{
+				for (UINT_64 byteOffset = range.first; succeeded && byteOffset < range.first + range.second; byteOffset += MEDIA_CHUNK_SIZE)
+				{
+					MEDIA_IMAGE_EXTENT extent = { byteOffset, (std::min)((UINT_64)MEDIA_CHUNK_SIZE, range.first + range.second - byteOffset) };
+					if (!this->read(extent.ByteOffset, buffer, (size_t)extent.ByteSize))
+					{
+						LOG_ERROR("Failed to read " + std::to_string(extent.ByteSize) + " bytes at " + std::to_string(extent.ByteOffset) + " for the image");
+						succeeded = false;
+						break;
+					}
+
+					// Written the same way as DedupMedia finds all zero blocks. Loading leaves these as they are.
+					if (buffer[0] == 0 && memcmp(buffer, buffer + 1, (size_t)extent.ByteSize - 1) == 0)
+					{
+						continue;
+					}
+
+					image.write((const char*)&extent, sizeof(extent));
+					image.write((const char*)buffer, (std::streamsize)extent.ByteSize);
+					succeeded = image.good();
+				}
+			}
+
+			memory::deallocate(buffer, MEDIA_CHUNK_SIZE, memory::SUBSYSTEM_NAMESPACE);
+
+			MEDIA_IMAGE_EXTENT end = { 0 };
+			image.write((const char*)&end, sizeof(end));
+			return succeeded && image.good();
+		}
+
+		bool Media::loadImage(std::istream &image)
+		{
+			UINT_8* buffer = memory::allocate(MEDIA_CHUNK_SIZE, false, memory::SUBSYSTEM_NAMESPACE);
+			bool succeeded = true;
+
+			while (succeeded)
+			{
+				MEDIA_IMAGE_EXTENT extent = { 0 };
+				if (!image.read((char*)&extent, sizeof(extent)))
+				{
+					LOG_ERROR("The image ended before the last extent");
+					succeeded = false;
+					break;
+				}
+
+				if (extent.ByteSize == 0)
+				{
+					break;
+				}
+
+				if (extent.ByteOffset > this->getSize() || extent.ByteSize > this->getSize() - extent.ByteOffset)
+				{
+					LOG_ERROR("The image has " + std::to_string(extent.ByteSize) + " bytes at " + std::to_string(extent.ByteOffset) + ", which is past the end of the media");
+					succeeded = false;
+					break;
+				}
+
+				// A piece at a time, so a big extent never needs a big buffer
+				for (UINT_64 done = 0; done < extent.ByteSize; done += MEDIA_CHUNK_SIZE)
+				{
+					size_t byteSize = (size_t)(std::min)((UINT_64)MEDIA_CHUNK_SIZE, extent.ByteSize - done);
+					if (!image.read((char*)buffer, (std::streamsize)byteSize) || !this->write(extent.ByteOffset + done, buffer, byteSize))
+					{
+						LOG_ERROR("Failed to load " + std::to_string(byteSize) + " bytes at " + std::to_string(extent.ByteOffset + done) + " from the image");
+						succeeded = false;
+						break;
+					}
+				}
+			}
+
+			memory::deallocate(buffer, MEDIA_CHUNK_SIZE, memory::SUBSYSTEM_NAMESPACE);
+			return succeeded;
+		}
+
+		/// <summary>
+		/// Gets the thread that frees data given to Media::reclaimInBackground()
+		/// </summary>
+		/// <returns>ThreadPool</returns>
+		static ThreadPool& getReclaimer()
+		{
+			static ThreadPool reclaimer(1);
+			return reclaimer;
+		}
+
+		void Media::waitForBackgroundReclamation()
+		{
+			getReclaimer().waitForIdle();
+		}
+
+		void Media::reclaimInBackground(std::shared_ptr<void> garbage)
+		{
+			// Moved all the way in, so the last reference is dropped on the reclaimer and not here
+			std::function<void()> work = std::bind([](std::shared_ptr<void> &g) { g.reset(); }, std::move(garbage));
+			getReclaimer().submit(std::move(work));
+		}
+
+		SparseMedia::SparseMedia(UINT_64 byteSize)
+		{
+			this->ByteSize = byteSize;
+			this->AllocatedChunks = 0;
+			this->ChunkTables = std::make_shared<ChunkDirectory>();
+		}
+
+		SparseMedia::~SparseMedia()
+		{
+			this->deallocateAll();
+		}
+
+		UINT_64 SparseMedia::getSize() const
+		{
+			return this->ByteSize;
+		}
+
+		bool SparseMedia::read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to read past the end of the media");
+
+			while (byteSize > 0)
+			{
+				size_t offsetInChunk = (size_t)(byteOffset % MEDIA_CHUNK_SIZE);
+				size_t bytesThisChunk = (std::min)(byteSize, (size_t)MEDIA_CHUNK_SIZE - offsetInChunk);
+
+				const UINT_8* chunk = this->getChunk(byteOffset / MEDIA_CHUNK_SIZE);
+				if (chunk)
+				{
+					memcpy_s(buffer, bytesThisChunk, chunk + offsetInChunk, bytesThisChunk);
+				}
+				else
+				{
+					memset(buffer, 0, bytesThisChunk); // Never written
+				}
+
+				buffer += bytesThisChunk;
+				byteOffset += bytesThisChunk;
+				byteSize -= bytesThisChunk;
+			}
+
+			return true;
+		}
+
+		bool SparseMedia::write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to write past the end of the media");
+
+			while (byteSize > 0)
+			{
+				size_t offsetInChunk = (size_t)(byteOffset % MEDIA_CHUNK_SIZE);
+				size_t bytesThisChunk = (std::min)(byteSize, (size_t)MEDIA_CHUNK_SIZE - offsetInChunk);
+
+				UINT_8* chunk = this->getWritableChunk(byteOffset / MEDIA_CHUNK_SIZE);
+				memcpy_s(chunk + offsetInChunk, MEDIA_CHUNK_SIZE - offsetInChunk, buffer, bytesThisChunk);
+
+				buffer += bytesThisChunk;
+				byteOffset += bytesThisChunk;
+				byteSize -= bytesThisChunk;
+			}
+
+			return true;
+		}
+
+		void SparseMedia::deallocateAll()
+		{
+			// Everything under the old directory is freed in the background, once no clone is using it either
+			reclaimInBackground(std::move(this->ChunkTables));
+			this->ChunkTables = std::make_shared<ChunkDirectory>();
+			this->AllocatedChunks = 0;
+		}
+
+		bool SparseMedia::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to deallocate past the end of the media");
+
+			UINT_64 endOffset = byteOffset + byteSize;
+			while (byteOffset < endOffset)
+			{
+				UINT_64 chunkIndex = byteOffset / MEDIA_CHUNK_SIZE;
+				UINT_64 tableIndex = chunkIndex / MEDIA_CHUNKS_PER_TABLE;
+
+				if (this->ChunkTables->find(tableIndex) == this->ChunkTables->end())
+				{
+					// Nothing under this table was written, skip all of it
+					byteOffset = (std::min)(endOffset, (tableIndex + 1) * MEDIA_CHUNKS_PER_TABLE * MEDIA_CHUNK_SIZE);
+					continue;
+				}
+
+				size_t offsetInChunk = (size_t)(byteOffset % MEDIA_CHUNK_SIZE);
+				size_t bytesThisChunk = (size_t)(std::min)(endOffset - byteOffset, (UINT_64)(MEDIA_CHUNK_SIZE - offsetInChunk));
+
+				if (this->getChunk(chunkIndex) && bytesThisChunk == MEDIA_CHUNK_SIZE)
+				{
+					// A clone may still have the chunk. It is freed once nobody does.
+					ChunkTable* table = this->getWritableTable(tableIndex, false);
+					(*table)[chunkIndex % MEDIA_CHUNKS_PER_TABLE].reset();
+					this->AllocatedChunks--;
+
+					// Drop the table too once nothing is left under it
+					if (std::all_of(table->begin(), table->end(), [](const Chunk &c) { return c == nullptr; }))
+					{
+						this->ChunkTables->erase(tableIndex);
+					}
+				}
+				else if (this->getChunk(chunkIndex))
+				{
+					memset(this->getWritableChunk(chunkIndex) + offsetInChunk, 0, bytesThisChunk);
+				}
+
+				byteOffset += bytesThisChunk;
+			}
+
+			return true;
+		}
+
+		UINT_64 SparseMedia::getAllocatedSize() const
+		{
+			return this->AllocatedChunks * MEDIA_CHUNK_SIZE;
+		}
+
+		bool SparseMedia::isThinProvisioned() const
+		{
+			return true;
+		}
+
+		bool SparseMedia::flush()
+		{
+			return true;
+		}
+
+		std::shared_ptr<Media> SparseMedia::clone()
+		{
+			std::shared_ptr<SparseMedia> theClone = std::make_shared<SparseMedia>(this->ByteSize);
+			theClone->ChunkTables = this->ChunkTables; // Everything under the directory comes along with it
+			theClone->AllocatedChunks = this->AllocatedChunks;
+			return theClone;
+		}
+
+		std::vector<std::pair<UINT_64, UINT_64>> SparseMedia::getAllocatedRanges() const
+		{
+			std::vector<UINT_64> chunkIndexes;
+			chunkIndexes.reserve((size_t)this->AllocatedChunks);
+			for (auto &table : *this->ChunkTables)
+			{
+				for (size_t i = 0; i < MEDIA_CHUNKS_PER_TABLE; i++)
+				{
+					if ((*table.second)[i])
+					{
+						chunkIndexes.push_back(table.first * MEDIA_CHUNKS_PER_TABLE + i);
+					}
+				}
+			}
+
+			return getRangesOfUnits(chunkIndexes, MEDIA_CHUNK_SIZE, this->ByteSize);
+		}
+
+		const UINT_8* SparseMedia::getChunk(UINT_64 chunkIndex) const
+		{
+			auto tableItr = this->ChunkTables->find(chunkIndex / MEDIA_CHUNKS_PER_TABLE);
+			if (tableItr == this->ChunkTables->end())
+			{
+				return nullptr;
+			}
+
+			return (*tableItr->second)[chunkIndex % MEDIA_CHUNKS_PER_TABLE].get();
+		}
+
+		UINT_8* SparseMedia::getWritableChunk(UINT_64 chunkIndex)
+		{
+			ChunkTable* table = this->getWritableTable(chunkIndex / MEDIA_CHUNKS_PER_TABLE, true);
+
+			Chunk &chunk = (*table)[chunkIndex % MEDIA_CHUNKS_PER_TABLE];
+			if (!chunk || chunk.use_count() > 1)
+			{
+				// Either the first write to the chunk, or a clone still needs the old data
+				bool firstWrite = !chunk;
+				UINT_8* newChunk = memory::allocate(MEDIA_CHUNK_SIZE, firstWrite, memory::SUBSYSTEM_NAMESPACE);
+				if (!firstWrite)
+				{
+					memcpy_s(newChunk, MEDIA_CHUNK_SIZE, chunk.get(), MEDIA_CHUNK_SIZE);
+				}
+				else
+				{
+					this->AllocatedChunks++;
+				}
+
+				chunk = Chunk(newChunk, [](UINT_8* c) { memory::deallocate(c, MEDIA_CHUNK_SIZE, memory::SUBSYSTEM_NAMESPACE); });
+			}
+
+			return chunk.get();
+		}
+
+		SparseMedia::ChunkTable* SparseMedia::getWritableTable(UINT_64 tableIndex, bool allocate)
+		{
+			// Clones only ever read a shared directory, so ours is only changed once nobody else has it
+			if (this->ChunkTables.use_count() > 1)
+			{
+				this->ChunkTables = std::make_shared<ChunkDirectory>(*this->ChunkTables);
+			}
+
+			auto tableItr = this->ChunkTables->find(tableIndex);
+			if (tableItr == this->ChunkTables->end() && !allocate)
+			{
+				return nullptr;
+			}
+
+			if (tableItr == this->ChunkTables->end() || tableItr->second.use_count() > 1)
+			{
+				ChunkTable* newTable = (tableItr == this->ChunkTables->end()) ? new ChunkTable(MEDIA_CHUNKS_PER_TABLE) : new ChunkTable(*tableItr->second);
+				memory::trackAllocation(memory::SUBSYSTEM_NAMESPACE, newTable->capacity() * sizeof(Chunk));
+				std::shared_ptr<ChunkTable> table(newTable, [](ChunkTable* t) {
+					memory::trackDeallocation(memory::SUBSYSTEM_NAMESPACE, t->capacity() * sizeof(Chunk));
+					delete t;
+				});
+
+				(*this->ChunkTables)[tableIndex] = table;
+				return table.get();
+			}
+
+			return tableItr->second.get();
+		}
+
+		DedupMedia::STORED_BLOCK::~STORED_BLOCK()
+		{
+			memory::deallocate(this->Data, this->DataSize, memory::SUBSYSTEM_NAMESPACE);
+		}
+
+		DedupMedia::DedupMedia(UINT_64 byteSize, bool compress)
+		{
+			this->ByteSize = byteSize;
+			this->Compress = compress;
+			this->Blocks = std::make_shared<BLOCK_INDEX>();
+		}
+
+		DedupMedia::~DedupMedia()
+		{
+			this->deallocateAll();
+		}
+
+		UINT_64 DedupMedia::getSize() const
+		{
+			return this->ByteSize;
+		}
+
+		bool DedupMedia::read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to read past the end of the media");
+
+			UINT_8 block[DEDUP_BLOCK_SIZE];
+			while (byteSize > 0)
+			{
+				size_t offsetInBlock = (size_t)(byteOffset % DEDUP_BLOCK_SIZE);
+				size_t bytesThisBlock = (std::min)(byteSize, (size_t)DEDUP_BLOCK_SIZE - offsetInBlock);
+
+				auto blockItr = this->Blocks->BlockMap.find(byteOffset / DEDUP_BLOCK_SIZE);
+				if (blockItr == this->Blocks->BlockMap.end())
+				{
+					memset(buffer, 0, bytesThisBlock); // All zeros
+				}
+				else if (!blockItr->second->Compressed)
+				{
+					memcpy_s(buffer, bytesThisBlock, blockItr->second->Data + offsetInBlock, bytesThisBlock);
+				}
+				else
+				{
+					decompressBlock(blockItr->second->Data, blockItr->second->DataSize, block);
+					memcpy_s(buffer, bytesThisBlock, block + offsetInBlock, bytesThisBlock);
+				}
+
+				buffer += bytesThisBlock;
+				byteOffset += bytesThisBlock;
+				byteSize -= bytesThisBlock;
+			}
+
+			return true;
+		}
+
+		bool DedupMedia::write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to write past the end of the media");
+
+			UINT_8 block[DEDUP_BLOCK_SIZE];
+			while (byteSize > 0)
+			{
+				UINT_64 blockIndex = byteOffset / DEDUP_BLOCK_SIZE;
+				size_t offsetInBlock = (size_t)(byteOffset % DEDUP_BLOCK_SIZE);
+				size_t bytesThisBlock = (std::min)(byteSize, (size_t)DEDUP_BLOCK_SIZE - offsetInBlock);
+
+				if (bytesThisBlock == DEDUP_BLOCK_SIZE)
+				{
+					this->writeBlock(blockIndex, buffer);
+				}
+				else
+				{
+					this->readBlock(blockIndex, block);
+					memcpy_s(block + offsetInBlock, DEDUP_BLOCK_SIZE - offsetInBlock, buffer, bytesThisBlock);
+					this->writeBlock(blockIndex, block);
+				}
+
+				buffer += bytesThisBlock;
+				byteOffset += bytesThisBlock;
+				byteSize -= bytesThisBlock;
+			}
+
+			return true;
+		}
+
+		void DedupMedia::deallocateAll()
+		{
+			// The old index is freed in the background. Stored blocks go once no clone is using them either.
+			reclaimInBackground(std::move(this->Blocks));
+			this->Blocks = std::make_shared<BLOCK_INDEX>();
+		}
+
+		bool DedupMedia::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to deallocate past the end of the media");
+
+			UINT_8 block[DEDUP_BLOCK_SIZE];
+			UINT_64 endOffset = byteOffset + byteSize;
+			while (byteOffset < endOffset)
+			{
+				UINT_64 blockIndex = byteOffset / DEDUP_BLOCK_SIZE;
+				size_t offsetInBlock = (size_t)(byteOffset % DEDUP_BLOCK_SIZE);
+				size_t bytesThisBlock = (size_t)(std::min)(endOffset - byteOffset, (UINT_64)(DEDUP_BLOCK_SIZE - offsetInBlock));
+
+				if (bytesThisBlock == DEDUP_BLOCK_SIZE)
+				{
+					this->unmapBlock(blockIndex);
+				}
+				else if (this->Blocks->BlockMap.find(blockIndex) != this->Blocks->BlockMap.end())
+				{
+					this->readBlock(blockIndex, block);
+					memset(block + offsetInBlock, 0, bytesThisBlock);
+					this->writeBlock(blockIndex, block); // Unmaps it if that made it all zeros
+				}
+
+				byteOffset += bytesThisBlock;
+			}
+
+			return true;
+		}
+
+		UINT_64 DedupMedia::getAllocatedSize() const
+		{
+			// Rounded up so a little compressed data still counts towards NUSE
+			return (this->Blocks->StoredBytes + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+		}
+
+		bool DedupMedia::isThinProvisioned() const
+		{
+			return true;
+		}
+
+		bool DedupMedia::flush()
+		{
+			return true;
+		}
+
+		std::shared_ptr<Media> DedupMedia::clone()
+		{
+			std::shared_ptr<DedupMedia> theClone = std::make_shared<DedupMedia>(this->ByteSize, this->Compress);
+			theClone->Blocks = this->Blocks; // Whoever changes it first makes their own copy
+			return theClone;
+		}
+
+		std::vector<std::pair<UINT_64, UINT_64>> DedupMedia::getAllocatedRanges() const
+		{
+			std::vector<UINT_64> blockIndexes;
+			blockIndexes.reserve(this->Blocks->BlockMap.size());
+			for (auto &block : this->Blocks->BlockMap)
+			{
+				blockIndexes.push_back(block.first);
+			}
+
+			return getRangesOfUnits(blockIndexes, DEDUP_BLOCK_SIZE, this->ByteSize);
+		}
+
+		DEDUP_STATISTICS DedupMedia::getStatistics() const
+		{
+			DEDUP_STATISTICS statistics = { 0 };
+			statistics.MappedBlocks = this->Blocks->BlockMap.size();
+			statistics.UniqueBlocks = this->Blocks->BlockStore.size();
+			statistics.CompressedBlocks = this->Blocks->CompressedBlocks;
+			statistics.StoredBytes = this->Blocks->StoredBytes;
+			return statistics;
+		}
+
+		void DedupMedia::readBlock(UINT_64 blockIndex, UINT_8* block) const
+		{
+			auto blockItr = this->Blocks->BlockMap.find(blockIndex);
+			if (blockItr == this->Blocks->BlockMap.end())
+			{
+				memset(block, 0, DEDUP_BLOCK_SIZE);
+			}
+			else if (!blockItr->second->Compressed)
+			{
+				memcpy_s(block, DEDUP_BLOCK_SIZE, blockItr->second->Data, DEDUP_BLOCK_SIZE);
+			}
+			else
+			{
+				decompressBlock(blockItr->second->Data, blockItr->second->DataSize, block);
+			}
+		}
+
+		void DedupMedia::writeBlock(UINT_64 blockIndex, const UINT_8* block)
+		{
+			// All zeros if every byte matches the one after it, and the first one is zero
+			if (block[0] == 0 && memcmp(block, block + 1, DEDUP_BLOCK_SIZE - 1) == 0)
+			{
+				this->unmapBlock(blockIndex);
+				return;
+			}
+
+			UINT_64 hash = hashBlock(block);
+			auto range = this->Blocks->BlockStore.equal_range(hash);
+			auto storeItr = std::find_if(range.first, range.second, [&](const std::pair<const UINT_64, STORE_ENTRY> &entry) { return blockMatches(*entry.second.Block, block); });
+
+			auto blockItr = this->Blocks->BlockMap.find(blockIndex);
+			if (storeItr != range.second && blockItr != this->Blocks->BlockMap.end() && blockItr->second == storeItr->second.Block)
+			{
+				return; // Already holds this data
+			}
+
+			if (this->Blocks.use_count() > 1)
+			{
+				// The iterators point into the shared index, so look the data up again in our own copy
+				range = this->getWritableBlocks().BlockStore.equal_range(hash);
+				storeItr = std::find_if(range.first, range.second, [&](const std::pair<const UINT_64, STORE_ENTRY> &entry) { return blockMatches(*entry.second.Block, block); });
+			}
+
+			BLOCK_INDEX &blocks = *this->Blocks;
+
+			if (storeItr == range.second)
+			{
+				// New data. Keep it compressed if that makes it smaller.
+				UINT_8 compressed[DEDUP_BLOCK_SIZE];
+				UINT_32 compressedSize = this->Compress ? compressBlock(block, compressed) : 0;
+
+				STORED_BLOCK* storedBlock = new STORED_BLOCK();
+				storedBlock->Hash = hash;
+				storedBlock->Compressed = compressedSize != 0;
+				storedBlock->DataSize = storedBlock->Compressed ? compressedSize : DEDUP_BLOCK_SIZE;
+				storedBlock->Data = memory::allocate(storedBlock->DataSize, false, memory::SUBSYSTEM_NAMESPACE);
+				memcpy_s(storedBlock->Data, storedBlock->DataSize, storedBlock->Compressed ? compressed : block, storedBlock->DataSize);
+
+				STORE_ENTRY entry = { std::shared_ptr<const STORED_BLOCK>(storedBlock), 0 };
+				storeItr = blocks.BlockStore.insert(std::make_pair(hash, entry));
+				blocks.StoredBytes += storedBlock->DataSize;
+				if (storedBlock->Compressed)
+				{
+					blocks.CompressedBlocks++;
+				}
+			}
+
+			// Take the new reference before dropping the old one
+			storeItr->second.References++;
+			std::shared_ptr<const STORED_BLOCK> newBlock = storeItr->second.Block;
+			this->unmapBlock(blockIndex);
+			blocks.BlockMap[blockIndex] = newBlock;
+		}
+
+		DedupMedia::BLOCK_INDEX& DedupMedia::getWritableBlocks()
+		{
+			// Clones only ever read a shared index, so ours is only changed once nobody else has it
+			if (this->Blocks.use_count() > 1)
+			{
+				this->Blocks = std::make_shared<BLOCK_INDEX>(*this->Blocks);
+			}
+
+			return *this->Blocks;
+		}
+
+		void DedupMedia::unmapBlock(UINT_64 blockIndex)
+		{
+			// Nothing to change (or copy) if it isn't mapped
+			if (this->Blocks->BlockMap.find(blockIndex) == this->Blocks->BlockMap.end())
+			{
+				return;
+			}
+
+			BLOCK_INDEX &blocks = this->getWritableBlocks();
+			auto blockItr = blocks.BlockMap.find(blockIndex);
+			auto range = blocks.BlockStore.equal_range(blockItr->second->Hash);
+			auto storeItr = std::find_if(range.first, range.second, [&](const std::pair<const UINT_64, STORE_ENTRY> &entry) { return entry.second.Block == blockItr->second; });
+			ASSERT_IF(storeItr == range.second, "A mapped block wasn't in the block store");
+
+			if (--storeItr->second.References == 0)
+			{
+				// A clone may still have the stored block. It is freed once nobody does.
+				blocks.StoredBytes -= storeItr->second.Block->DataSize;
+				if (storeItr->second.Block->Compressed)
+				{
+					blocks.CompressedBlocks--;
+				}
+
+				blocks.BlockStore.erase(storeItr);
+			}
+
+			blocks.BlockMap.erase(blockItr);
+		}
+
+		bool DedupMedia::blockMatches(const STORED_BLOCK &storedBlock, const UINT_8* block)
+		{
+			if (!storedBlock.Compressed)
+			{
+				return memcmp(storedBlock.Data, block, DEDUP_BLOCK_SIZE) == 0;
+			}
+
+			UINT_8 decompressed[DEDUP_BLOCK_SIZE];
+			decompressBlock(storedBlock.Data, storedBlock.DataSize, decompressed);
+			return memcmp(decompressed, block, DEDUP_BLOCK_SIZE) == 0;
+		}
+
+		UINT_64 DedupMedia::hashBlock(const UINT_8* block)
+		{
+			UINT_64 hash = 0xCBF29CE484222325; // FNV offset basis
+			for (size_t i = 0; i < DEDUP_BLOCK_SIZE; i += sizeof(UINT_64))
+			{
+				UINT_64 word;
+				memcpy_s(&word, sizeof(word), block + i, sizeof(word));
+				hash = (hash ^ word) * 0x100000001B3; // FNV prime
+			}
+
+			return hash;
+		}
+
+		UINT_32 DedupMedia::compressBlock(const UINT_8* block, UINT_8* output)
+		{
+			// PackBits: a header byte of 0 to 127 is followed by that many + 1 literal bytes.
+			//   129 to 255 is followed by one byte that repeats 257 - header times (2 to 128).
+			size_t in = 0;
+			size_t out = 0;
+			while (in < DEDUP_BLOCK_SIZE)
+			{
+				size_t run = 1;
+				while (in + run < DEDUP_BLOCK_SIZE && run < 128 && block[in + run] == block[in])
+				{
+					run++;
+				}
+
+				if (run > 1)
+				{
+					if (out + 2 >= DEDUP_BLOCK_SIZE)
+					{
+						return 0;
+					}
+
+					output[out++] = (UINT_8)(257 - run);
+					output[out++] = block[in];
+					in += run;
+				}
+				else
+				{
+					// Literals up to the next run
+					size_t literalStart = in;
+					while (in < DEDUP_BLOCK_SIZE && in - literalStart < 128 && !(in + 1 < DEDUP_BLOCK_SIZE && block[in] == block[in + 1]))
+					{
+						in++;
+					}
+
+					size_t literals = in - literalStart;
+					if (out + 1 + literals >= DEDUP_BLOCK_SIZE)
+					{
+						return 0;
+					}
+
+					output[out++] = (UINT_8)(literals - 1);
+					memcpy_s(output + out, DEDUP_BLOCK_SIZE - out, block + literalStart, literals);
+					out += literals;
+				}
+			}
+
+			return (UINT_32)out;
+		}
+
+		void DedupMedia::decompressBlock(const UINT_8* data, UINT_32 dataSize, UINT_8* block)
+		{
+			size_t in = 0;
+			size_t out = 0;
+			while (in < dataSize)
+			{
+				UINT_8 header = data[in++];
+				if (header < 128)
+				{
+					size_t literals = (size_t)header + 1;
+					memcpy_s(block + out, DEDUP_BLOCK_SIZE - out, data + in, literals);
+					in += literals;
+					out += literals;
+				}
+				else if (header > 128)
+				{
+					size_t run = 257 - (size_t)header;
+					memset(block + out, data[in++], run);
+					out += run;
+				}
+			}
+
+			ASSERT_IF(out != DEDUP_BLOCK_SIZE, "A compressed block didn't decompress to a whole block");
+		}
+
+		MappedFileMedia::MappedFileMedia(std::string filePath, UINT_64 byteSize)
+		{
+			this->FilePath = filePath;
+			this->ByteSize = 0;
+			this->MappedBuffer = nullptr;
+
+#ifdef _WIN32
+			this->MappingHandle = NULL;
+			this->FileHandle = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (this->FileHandle == INVALID_HANDLE_VALUE)
+			{
+				LOG_ERROR("Failed to open media file " + filePath + ". Error: " + std::to_string(GetLastError()));
+				return;
+			}
+
+			LARGE_INTEGER fileSize = { 0 };
+			GetFileSizeEx(this->FileHandle, &fileSize);
+			this->ByteSize = (std::max)(byteSize, (UINT_64)fileSize.QuadPart); // CreateFileMapping grows the file for us
+#else
+			this->FileDescriptor = open(filePath.c_str(), O_RDWR | O_CREAT, 0644);
+			if (this->FileDescriptor < 0)
+			{
+				LOG_ERROR("Failed to open media file " + filePath + ". Error: " + std::string(strerror(errno)));
+				return;
+			}
+
+			struct stat fileStat = { 0 };
+			fstat(this->FileDescriptor, &fileStat);
+			this->ByteSize = (std::max)(byteSize, (UINT_64)fileStat.st_size);
+			if ((UINT_64)fileStat.st_size < this->ByteSize && ftruncate(this->FileDescriptor, (off_t)this->ByteSize) != 0) // Grows it sparsely
+			{
+				LOG_ERROR("Failed to grow media file " + filePath + " to " + std::to_string(this->ByteSize) + " bytes. Error: " + std::string(strerror(errno)));
+				return;
+			}
+#endif // _WIN32
+
+			this->map();
+		}
+
+		MappedFileMedia::~MappedFileMedia()
+		{
+			if (this->MappedBuffer)
+			{
+				this->flush();
+			}
+			this->unmap();
+
+#ifdef _WIN32
+			if (this->FileHandle != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(this->FileHandle);
+			}
+#else
+			if (this->FileDescriptor >= 0)
+			{
+				close(this->FileDescriptor);
+			}
+#endif // _WIN32
+		}
+
+		bool MappedFileMedia::isMapped() const
+		{
+			return this->MappedBuffer != nullptr;
+		}
+
+		UINT_64 MappedFileMedia::getSize() const
+		{
+			return this->ByteSize;
+		}
+
+		bool MappedFileMedia::read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to read past the end of the media");
+			memcpy_s(buffer, byteSize, this->MappedBuffer + byteOffset, byteSize);
+
+			return true;
+		}
+
+		bool MappedFileMedia::write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to write past the end of the media");
+			memcpy_s(this->MappedBuffer + byteOffset, (size_t)(this->ByteSize - byteOffset), buffer, byteSize);
+
+			return true;
+		}
+
+		void MappedFileMedia::deallocateAll()
+		{
+#ifdef _WIN32
+			memset(this->MappedBuffer, 0, (size_t)this->ByteSize); // Can't truncate a file that is mapped
+#else
+			// The mapping stays valid, and pages read back as zero once the file has been grown again
+			if (ftruncate(this->FileDescriptor, 0) != 0 || ftruncate(this->FileDescriptor, (off_t)this->ByteSize) != 0)
+			{
+				LOG_ERROR("Failed to truncate media file " + this->FilePath + ". Zeroing it instead. Error: " + std::string(strerror(errno)));
+				memset(this->MappedBuffer, 0, (size_t)this->ByteSize);
+			}
+#endif // _WIN32
+		}
+
+		bool MappedFileMedia::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to deallocate past the end of the media");
+
+#ifndef _WIN32
+			// The mapping sees the hole right away. The file system zeros any partial blocks at the edges.
+			if (fallocate(this->FileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)byteOffset, (off_t)byteSize) == 0)
+			{
+				return true;
+			}
+			LOG_INFO("Couldn't punch a hole in media file " + this->FilePath + ". Zeroing the range instead. Error: " + std::string(strerror(errno)));
+#endif // _WIN32
+
+			memset(this->MappedBuffer + byteOffset, 0, (size_t)byteSize);
+			return true;
+		}
+
+		UINT_64 MappedFileMedia::getAllocatedSize() const
+		{
+			return this->ByteSize;
+		}
+
+		bool MappedFileMedia::isThinProvisioned() const
+		{
+			return false;
+		}
+
+		bool MappedFileMedia::flush()
+		{
+#ifdef _WIN32
+			return FlushViewOfFile(this->MappedBuffer, 0) && FlushFileBuffers(this->FileHandle);
+#else
+			return msync(this->MappedBuffer, (size_t)this->ByteSize, MS_SYNC) == 0 && fdatasync(this->FileDescriptor) == 0;
+#endif // _WIN32
+		}
+
+		bool MappedFileMedia::isPersistent() const
+		{
+			return true;
+		}
+
+		bool MappedFileMedia::map()
+		{
+			if (this->ByteSize == 0 || this->ByteSize > (UINT_64)SIZE_MAX)
+			{
+				LOG_ERROR("Media file " + this->FilePath + " can't be mapped with a size of " + std::to_string(this->ByteSize) + " bytes");
+				return false;
+			}
+
+#ifdef _WIN32
+			this->MappingHandle = CreateFileMappingA(this->FileHandle, NULL, PAGE_READWRITE, (DWORD)(this->ByteSize >> 32), (DWORD)this->ByteSize, NULL);
+			if (this->MappingHandle == NULL)
+			{
+				LOG_ERROR("Failed to create a mapping for media file " + this->FilePath + ". Error: " + std::to_string(GetLastError()));
+				return false;
+			}
+
+			this->MappedBuffer = (UINT_8*)MapViewOfFile(this->MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+			if (this->MappedBuffer == NULL)
+			{
+				LOG_ERROR("Failed to map media file " + this->FilePath + ". Error: " + std::to_string(GetLastError()));
+				this->MappedBuffer = nullptr;
+				return false;
+			}
+#else
+			void* mapping = mmap(NULL, (size_t)this->ByteSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->FileDescriptor, 0);
+			if (mapping == MAP_FAILED)
+			{
+				LOG_ERROR("Failed to map media file " + this->FilePath + ". Error: " + std::string(strerror(errno)));
+				return false;
+			}
+			this->MappedBuffer = (UINT_8*)mapping;
+#endif // _WIN32
+
+			return true;
+		}
+
+		void MappedFileMedia::unmap()
+		{
+#ifdef _WIN32
+			if (this->MappedBuffer)
+			{
+				UnmapViewOfFile(this->MappedBuffer);
+			}
+			if (this->MappingHandle)
+			{
+				CloseHandle(this->MappingHandle);
+				this->MappingHandle = NULL;
+			}
+#else
+			if (this->MappedBuffer)
+			{
+				munmap(this->MappedBuffer, (size_t)this->ByteSize);
+			}
+#endif // _WIN32
+			this->MappedBuffer = nullptr;
+		}
+
+		DirectFileMedia::DirectFileMedia(std::string filePath, UINT_64 byteSize)
+		{
+			this->FilePath = filePath;
+			this->ByteSize = 0;
+			this->IsRegularFile = false;
+			UINT_64 currentSize = 0;
+
+#ifdef _WIN32
+			this->FileHandle = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, NULL);
+			if (this->FileHandle == INVALID_HANDLE_VALUE)
+			{
+				LOG_ERROR("Failed to open media file " + filePath + ". Error: " + std::to_string(GetLastError()));
+				return;
+			}
+
+			LARGE_INTEGER fileSize = { 0 };
+			this->IsRegularFile = GetFileSizeEx(this->FileHandle, &fileSize) != 0; // Fails for raw devices
+			currentSize = (UINT_64)fileSize.QuadPart;
+#else
+			this->UsingDirectIo = true;
+			this->FileDescriptor = open(filePath.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+			if (this->FileDescriptor < 0 && errno == EINVAL)
+			{
+				LOG_INFO("Media file " + filePath + " doesn't support O_DIRECT. Using buffered I/O instead.");
+				this->UsingDirectIo = false;
+				this->FileDescriptor = open(filePath.c_str(), O_RDWR | O_CREAT, 0644);
+			}
+
+			if (this->FileDescriptor < 0)
+			{
+				LOG_ERROR("Failed to open media file " + filePath + ". Error: " + std::string(strerror(errno)));
+				return;
+			}
+
+			struct stat fileStat = { 0 };
+			fstat(this->FileDescriptor, &fileStat);
+			this->IsRegularFile = S_ISREG(fileStat.st_mode);
+			currentSize = this->IsRegularFile ? (UINT_64)fileStat.st_size : (UINT_64)lseek(this->FileDescriptor, 0, SEEK_END); // st_size is 0 for block devices
+#endif // _WIN32
+
+			this->ByteSize = byteSize ? byteSize : currentSize;
+			if (this->ByteSize == 0 || this->ByteSize % DIRECT_IO_ALIGNMENT != 0)
+			{
+				LOG_ERROR("Media file " + filePath + " needs a non-zero size that is a multiple of " + std::to_string(DIRECT_IO_ALIGNMENT) + " bytes");
+				this->ByteSize = 0;
+				return;
+			}
+
+			if (currentSize < this->ByteSize)
+			{
+				bool grown = false;
+				if (this->IsRegularFile)
+				{
+#ifdef _WIN32
+					LARGE_INTEGER newSize;
+					newSize.QuadPart = (LONGLONG)this->ByteSize;
+					grown = SetFilePointerEx(this->FileHandle, newSize, NULL, FILE_BEGIN) && SetEndOfFile(this->FileHandle);
+#else
+					grown = ftruncate(this->FileDescriptor, (off_t)this->ByteSize) == 0;
+#endif // _WIN32
+				}
+
+				if (!grown)
+				{
+					LOG_ERROR("Media file " + filePath + " is only " + std::to_string(currentSize) + " bytes and couldn't be grown to " + std::to_string(this->ByteSize));
+					this->ByteSize = 0;
+				}
+			}
+		}
+
+		DirectFileMedia::~DirectFileMedia()
+		{
+#ifdef _WIN32
+			if (this->FileHandle != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(this->FileHandle);
+			}
+#else
+			if (this->FileDescriptor >= 0)
+			{
+				close(this->FileDescriptor);
+			}
+#endif // _WIN32
+		}
+
+		bool DirectFileMedia::isOpen() const
+		{
+			return this->ByteSize != 0; // Only set once the file is open and big enough
+		}
+
+		UINT_64 DirectFileMedia::getSize() const
+		{
+			return this->ByteSize;
+		}
+
+		bool DirectFileMedia::read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to read past the end of the media");
+
+			// Whole aligned blocks can go straight into the caller's buffer
+			if (byteOffset % DIRECT_IO_ALIGNMENT == 0 && byteSize % DIRECT_IO_ALIGNMENT == 0 && (uintptr_t)buffer % DIRECT_IO_ALIGNMENT == 0)
+			{
+				return this->transferAligned(byteOffset, buffer, byteSize, false);
+			}
+
+			UINT_64 alignedOffset = byteOffset - (byteOffset % DIRECT_IO_ALIGNMENT);
+			size_t alignedSize = (size_t)(((byteOffset + byteSize + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT) - alignedOffset);
+
+			UINT_8* bounceBuffer = memory::allocate(alignedSize, false, memory::SUBSYSTEM_NAMESPACE); // Aligned to at least DIRECT_IO_ALIGNMENT
+			bool succeeded = this->transferAligned(alignedOffset, bounceBuffer, alignedSize, false);
+			if (succeeded)
+			{
+				memcpy_s(buffer, byteSize, bounceBuffer + (byteOffset - alignedOffset), byteSize);
+			}
+			memory::deallocate(bounceBuffer, alignedSize, memory::SUBSYSTEM_NAMESPACE);
+
+			return succeeded;
+		}
+
+		bool DirectFileMedia::write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to write past the end of the media");
+
+			bool wholeBlocks = byteOffset % DIRECT_IO_ALIGNMENT == 0 && byteSize % DIRECT_IO_ALIGNMENT == 0;
+			if (wholeBlocks && (uintptr_t)buffer % DIRECT_IO_ALIGNMENT == 0)
+			{
+				return this->transferAligned(byteOffset, (UINT_8*)buffer, byteSize, true); // Only read from
+			}
+
+			UINT_64 alignedOffset = byteOffset - (byteOffset % DIRECT_IO_ALIGNMENT);
+			size_t alignedSize = (size_t)(((byteOffset + byteSize + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT) - alignedOffset);
+			UINT_8* bounceBuffer = memory::allocate(alignedSize, false, memory::SUBSYSTEM_NAMESPACE); // Aligned to at least DIRECT_IO_ALIGNMENT
+			bool succeeded = true;
+
+			std::unique_lock<std::mutex> lock(this->PartialBlockMutex, std::defer_lock);
+			if (!wholeBlocks)
+			{
+				// Keep the parts of the first and last blocks we aren't writing
+				lock.lock();
+				succeeded = this->transferAligned(alignedOffset, bounceBuffer, alignedSize, false);
+			}
+
+			if (succeeded)
+			{
+				memcpy_s(bounceBuffer + (byteOffset - alignedOffset), alignedSize - (size_t)(byteOffset - alignedOffset), buffer, byteSize);
+				succeeded = this->transferAligned(alignedOffset, bounceBuffer, alignedSize, true);
+			}
+			memory::deallocate(bounceBuffer, alignedSize, memory::SUBSYSTEM_NAMESPACE);
+
+			return succeeded;
+		}
+
+		void DirectFileMedia::deallocateAll()
+		{
+			bool truncated = false;
+			if (this->IsRegularFile)
+			{
+#ifdef _WIN32
+				LARGE_INTEGER zero = { 0 };
+				LARGE_INTEGER fullSize;
+				fullSize.QuadPart = (LONGLONG)this->ByteSize;
+				truncated = SetFilePointerEx(this->FileHandle, zero, NULL, FILE_BEGIN) && SetEndOfFile(this->FileHandle) &&
+					SetFilePointerEx(this->FileHandle, fullSize, NULL, FILE_BEGIN) && SetEndOfFile(this->FileHandle);
+#else
+				truncated = ftruncate(this->FileDescriptor, 0) == 0 && ftruncate(this->FileDescriptor, (off_t)this->ByteSize) == 0;
+#endif // _WIN32
+			}
+
+			if (!truncated)
+			{
+				// Block devices (or a failed truncate) get zeros written over them
+				this->writeZeros(0, this->ByteSize);
+			}
+		}
+
+		bool DirectFileMedia::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->ByteSize, "Attempted to deallocate past the end of the media");
+			ASSERT_IF(byteOffset % DIRECT_IO_ALIGNMENT != 0 || byteSize % DIRECT_IO_ALIGNMENT != 0, "Direct I/O media can only deallocate whole blocks");
+
+#ifdef _WIN32
+			if (this->IsRegularFile)
+			{
+				FILE_ZERO_DATA_INFORMATION zeroDataInformation;
+				zeroDataInformation.FileOffset.QuadPart = (LONGLONG)byteOffset;
+				zeroDataInformation.BeyondFinalZero.QuadPart = (LONGLONG)(byteOffset + byteSize);
+				DWORD bytesReturned = 0;
+				if (DeviceIoControl(this->FileHandle, FSCTL_SET_ZERO_DATA, &zeroDataInformation, sizeof(zeroDataInformation), NULL, 0, &bytesReturned, NULL))
+				{
+					return true;
+				}
+			}
+#else
+			// Works on regular files and (with a new enough kernel) block devices
+			if (fallocate(this->FileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)byteOffset, (off_t)byteSize) == 0)
+			{
+				return true;
+			}
+#endif // _WIN32
+
+			return this->writeZeros(byteOffset, byteSize);
+		}
+
+		UINT_64 DirectFileMedia::getAllocatedSize() const
+		{
+			return this->ByteSize;
+		}
+
+		bool DirectFileMedia::isThinProvisioned() const
+		{
+			return false;
+		}
+
+		bool DirectFileMedia::flush()
+		{
+#ifdef _WIN32
+			return FlushFileBuffers(this->FileHandle) != 0;
+#else
+			return fdatasync(this->FileDescriptor) == 0;
+#endif // _WIN32
+		}
+
+		bool DirectFileMedia::isAsynchronous() const
+		{
+			return true;
+		}
+
+		bool DirectFileMedia::isPersistent() const
+		{
+			return true;
+		}
+
+		bool DirectFileMedia::writeZeros(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			const size_t zeroSize = 1024 * 1024;
+			UINT_8* zeros = memory::allocate(zeroSize, true, memory::SUBSYSTEM_NAMESPACE);
+			bool succeeded = true;
+			for (UINT_64 offset = byteOffset; offset < byteOffset + byteSize; offset += zeroSize)
+			{
+				if (!this->transferAligned(offset, zeros, (size_t)(std::min)((UINT_64)zeroSize, byteOffset + byteSize - offset), true))
+				{
+					LOG_ERROR("Failed to zero media file " + this->FilePath);
+					succeeded = false;
+					break;
+				}
+			}
+			memory::deallocate(zeros, zeroSize, memory::SUBSYSTEM_NAMESPACE);
+
+			return succeeded;
+		}
+
+		bool DirectFileMedia::transferAligned(UINT_64 byteOffset, UINT_8* alignedBuffer, size_t byteSize, bool isWrite)
+		{
+			while (byteSize > 0)
+			{
+#ifdef _WIN32
+				OVERLAPPED overlapped = { 0 }; // Only used for the offset. The handle isn't opened for overlapped I/O.
+				overlapped.Offset = (DWORD)byteOffset;
+				overlapped.OffsetHigh = (DWORD)(byteOffset >> 32);
+				DWORD bytesThisTime = (DWORD)(std::min)(byteSize, (size_t)(1024 * 1024 * 1024)); // Stay an aligned amount under DWORD max
+				DWORD bytesTransferred = 0;
+				BOOL succeeded = isWrite ? WriteFile(this->FileHandle, alignedBuffer, bytesThisTime, &bytesTransferred, &overlapped) :
+					ReadFile(this->FileHandle, alignedBuffer, bytesThisTime, &bytesTransferred, &overlapped);
+				if (!succeeded && GetLastError() != ERROR_HANDLE_EOF)
+				{
+					LOG_ERROR("Failed to " + std::string(isWrite ? "write" : "read") + " media file " + this->FilePath + ". Error: " + std::to_string(GetLastError()));
+					return false;
+				}
+#else
+				ssize_t bytesTransferred = isWrite ? pwrite(this->FileDescriptor, alignedBuffer, byteSize, (off_t)byteOffset) :
+					pread(this->FileDescriptor, alignedBuffer, byteSize, (off_t)byteOffset);
+				if (bytesTransferred < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					if (errno == EINVAL && this->UsingDirectIo.exchange(false))
+					{
+						// The storage wants bigger alignment than DIRECT_IO_ALIGNMENT. Let the page cache deal with it.
+						LOG_INFO("Media file " + this->FilePath + " rejected direct I/O alignment. Using buffered I/O instead.");
+						fcntl(this->FileDescriptor, F_SETFL, fcntl(this->FileDescriptor, F_GETFL) & ~O_DIRECT);
+						continue;
+					}
+
+					LOG_ERROR("Failed to " + std::string(isWrite ? "write" : "read") + " media file " + this->FilePath + ". Error: " + std::string(strerror(errno)));
+					return false;
+				}
+#endif // _WIN32
+
+				if (bytesTransferred == 0)
+				{
+					if (isWrite)
+					{
+						LOG_ERROR("Media file " + this->FilePath + " stopped taking writes");
+						return false;
+					}
+
+					memset(alignedBuffer, 0, byteSize); // Past the end of the file
+					return true;
+				}
+
+				alignedBuffer += bytesTransferred;
+				byteOffset += bytesTransferred;
+				byteSize -= (size_t)bytesTransferred;
+			}
+
+			return true;
+		}
+
+		WriteCacheMedia::WriteCacheMedia(std::shared_ptr<Media> backingMedia, UINT_64 cacheSize)
+		{
+			this->BackingMedia = backingMedia;
+			this->CacheSize = (std::max)(cacheSize, (UINT_64)WRITE_CACHE_LINE_SIZE);
+			this->WrittenSinceLastLook = false;
+
+			this->Destager = LoopingThread([&] {WriteCacheMedia::destageInBackground(); }, WRITE_CACHE_DESTAGE_SLEEP_MS);
+			this->Destager.start();
+		}
+
+		WriteCacheMedia::~WriteCacheMedia()
+		{
+			this->Destager.end();
+
+			if (!this->destage())
+			{
+				LOG_ERROR("Cached writes were lost since they couldn't be destaged");
+			}
+		}
+
+		std::shared_ptr<Media> WriteCacheMedia::getBackingMedia() const
+		{
+			return this->BackingMedia;
+		}
+
+		UINT_64 WriteCacheMedia::getDirtySize() const
+		{
+			std::unique_lock<std::mutex> lock(this->CacheMutex);
+
+			UINT_64 dirtyLines = this->DirtyLines.size();
+			for (auto &i : this->DestagingLines)
+			{
+				dirtyLines += this->DirtyLines.count(i.first) ? 0 : 1; // Written again since the destage started
+			}
+			return dirtyLines * WRITE_CACHE_LINE_SIZE;
+		}
+
+		UINT_64 WriteCacheMedia::getSize() const
+		{
+			return this->BackingMedia->getSize();
+		}
+
+		bool WriteCacheMedia::read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->getSize(), "Attempted to read past the end of the media");
+
+			// Cached sectors are copied under the lock. The rest is read from the backing media after. Nothing destages those
+			//   sectors in the meantime, since only sectors that are in the cache get destaged.
+			std::vector<std::pair<UINT_64, size_t>> uncachedRanges;
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+
+				UINT_64 offset = byteOffset;
+				UINT_64 endOffset = byteOffset + byteSize;
+				while (offset < endOffset)
+				{
+					UINT_64 lineIndex = offset / WRITE_CACHE_LINE_SIZE;
+					size_t sector = (size_t)(offset % WRITE_CACHE_LINE_SIZE) / DIRECT_IO_ALIGNMENT;
+					UINT_64 pieceEnd = lineIndex * WRITE_CACHE_LINE_SIZE + (sector + 1) * DIRECT_IO_ALIGNMENT;
+
+					const UINT_8* cachedSector = nullptr;
+					if (!this->DirtyLines.count(lineIndex) && !this->DestagingLines.count(lineIndex))
+					{
+						pieceEnd = (lineIndex + 1) * WRITE_CACHE_LINE_SIZE; // Nothing in this line is cached
+					}
+					else
+					{
+						cachedSector = this->getCachedSector(lineIndex, sector);
+					}
+					pieceEnd = (std::min)(pieceEnd, endOffset);
+
+					if (cachedSector)
+					{
+						size_t offsetInSector = (size_t)(offset % DIRECT_IO_ALIGNMENT);
+						memcpy_s(buffer + (offset - byteOffset), (size_t)(endOffset - offset), cachedSector + offsetInSector, (size_t)(pieceEnd - offset));
+					}
+					else if (!uncachedRanges.empty() && uncachedRanges.back().first + uncachedRanges.back().second == offset)
+					{
+						uncachedRanges.back().second += (size_t)(pieceEnd - offset);
+					}
+					else
+					{
+						uncachedRanges.push_back(std::make_pair(offset, (size_t)(pieceEnd - offset)));
+					}
+
+					offset = pieceEnd;
+				}
+			}
+
+			for (auto &range : uncachedRanges)
+			{
+				if (!this->BackingMedia->read(range.first, buffer + (range.first - byteOffset), range.second))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool WriteCacheMedia::write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->getSize(), "Attempted to write past the end of the media");
+
+			bool cacheFull = false;
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+
+				while (byteSize > 0)
+				{
+					UINT_64 lineIndex = byteOffset / WRITE_CACHE_LINE_SIZE;
+					size_t offsetInLine = (size_t)(byteOffset % WRITE_CACHE_LINE_SIZE);
+					size_t bytesThisLine = (std::min)(byteSize, (size_t)WRITE_CACHE_LINE_SIZE - offsetInLine);
+
+					CacheLine &line = this->DirtyLines[lineIndex];
+					if (!line.Data)
+					{
+						UINT_8* newLine = memory::allocate(WRITE_CACHE_LINE_SIZE, false, memory::SUBSYSTEM_NAMESPACE);
+						line.Data = std::shared_ptr<UINT_8>(newLine, [](UINT_8* l) { memory::deallocate(l, WRITE_CACHE_LINE_SIZE, memory::SUBSYSTEM_NAMESPACE); });
+						line.ValidSectors = 0;
+					}
+
+					// A sector only partly written needs the rest of its data from wherever it is now
+					size_t firstSector = offsetInLine / DIRECT_IO_ALIGNMENT;
+					size_t lastSector = (offsetInLine + bytesThisLine - 1) / DIRECT_IO_ALIGNMENT;
+					for (size_t sector = firstSector; sector <= lastSector; sector++)
+					{
+						size_t sectorOffset = sector * DIRECT_IO_ALIGNMENT;
+						UINT_64 sectorByteOffset = lineIndex * WRITE_CACHE_LINE_SIZE + sectorOffset;
+						size_t sectorSize = (size_t)(std::min)((UINT_64)DIRECT_IO_ALIGNMENT, this->getSize() - sectorByteOffset);
+						bool fullyWritten = offsetInLine <= sectorOffset && offsetInLine + bytesThisLine >= sectorOffset + sectorSize;
+						if (fullyWritten || (line.ValidSectors & (1 << sector)))
+						{
+							continue;
+						}
+
+						auto destagingLine = this->DestagingLines.find(lineIndex);
+						if (destagingLine != this->DestagingLines.end() && (destagingLine->second.ValidSectors & (1 << sector)))
+						{
+							memcpy_s(line.Data.get() + sectorOffset, sectorSize, destagingLine->second.Data.get() + sectorOffset, sectorSize);
+						}
+						else if (!this->BackingMedia->read(sectorByteOffset, line.Data.get() + sectorOffset, sectorSize))
+						{
+							if (line.ValidSectors == 0)
+							{
+								this->DirtyLines.erase(lineIndex);
+							}
+							return false;
+						}
+					}
+
+					memcpy_s(line.Data.get() + offsetInLine, WRITE_CACHE_LINE_SIZE - offsetInLine, buffer, bytesThisLine);
+					for (size_t sector = firstSector; sector <= lastSector; sector++)
+					{
+						line.ValidSectors |= (UINT_8)(1 << sector);
+					}
+
+					buffer += bytesThisLine;
+					byteOffset += bytesThisLine;
+					byteSize -= bytesThisLine;
+				}
+
+				this->WrittenSinceLastLook = true;
+				cacheFull = this->DirtyLines.size() * WRITE_CACHE_LINE_SIZE >= this->CacheSize;
+			}
+
+			if (cacheFull)
+			{
+				// Out of cache. This write waits for room, like it would on a drive.
+				this->destage();
+			}
+
+			return true;
+		}
+
+		void WriteCacheMedia::deallocateAll()
+		{
+			std::unique_lock<std::mutex> destageLock(this->DestageMutex);
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+				this->DirtyLines.clear();
+			}
+
+			this->BackingMedia->deallocateAll();
+		}
+
+		bool WriteCacheMedia::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			ASSERT_IF(byteOffset + byteSize > this->getSize(), "Attempted to deallocate past the end of the media");
+
+			std::unique_lock<std::mutex> destageLock(this->DestageMutex);
+			if (byteSize != 0)
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+
+				UINT_64 endOffset = byteOffset + byteSize;
+				auto line = this->DirtyLines.lower_bound(byteOffset / WRITE_CACHE_LINE_SIZE);
+				while (line != this->DirtyLines.end() && line->first * WRITE_CACHE_LINE_SIZE < endOffset)
+				{
+					for (size_t sector = 0; sector < WRITE_CACHE_SECTORS_PER_LINE; sector++)
+					{
+						UINT_64 sectorByteOffset = line->first * WRITE_CACHE_LINE_SIZE + sector * DIRECT_IO_ALIGNMENT;
+						UINT_64 start = (std::max)(sectorByteOffset, byteOffset);
+						UINT_64 end = (std::min)(sectorByteOffset + DIRECT_IO_ALIGNMENT, endOffset);
+						if (start >= end || !(line->second.ValidSectors & (1 << sector)))
+						{
+							continue;
+						}
+
+						if (start == sectorByteOffset && end == sectorByteOffset + DIRECT_IO_ALIGNMENT)
+						{
+							line->second.ValidSectors &= (UINT_8)~(1 << sector);
+						}
+						else
+						{
+							// The rest of the sector is still written data. The backing media zeros the same part.
+							memset(line->second.Data.get() + (start - line->first * WRITE_CACHE_LINE_SIZE), 0, (size_t)(end - start));
+						}
+					}
+
+					line = line->second.ValidSectors == 0 ? this->DirtyLines.erase(line) : std::next(line);
+				}
+			}
+
+			return this->BackingMedia->deallocate(byteOffset, byteSize);
+		}
+
+		UINT_64 WriteCacheMedia::getAllocatedSize() const
+		{
+			return this->BackingMedia->getAllocatedSize();
+		}
+
+		bool WriteCacheMedia::isThinProvisioned() const
+		{
+			return this->BackingMedia->isThinProvisioned();
+		}
+
+		bool WriteCacheMedia::flush()
+		{
+			return this->destage() && this->BackingMedia->flush();
+		}
+
+		bool WriteCacheMedia::isAsynchronous() const
+		{
+			return this->BackingMedia->isAsynchronous();
+		}
+
+		bool WriteCacheMedia::isPersistent() const
+		{
+			return this->BackingMedia->isPersistent();
+		}
+
+		std::vector<std::pair<UINT_64, UINT_64>> WriteCacheMedia::getAllocatedRanges() const
+		{
+			std::vector<std::pair<UINT_64, UINT_64>> ranges = this->BackingMedia->getAllocatedRanges();
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+				for (const CacheLineMap* lines : { &this->DestagingLines, &this->DirtyLines })
+				{
+					for (auto &i : *lines)
+					{
+						UINT_64 lineByteOffset = i.first * WRITE_CACHE_LINE_SIZE;
+						ranges.push_back(std::make_pair(lineByteOffset, (std::min)((UINT_64)WRITE_CACHE_LINE_SIZE, this->getSize() - lineByteOffset)));
+					}
+				}
+			}
+
+			// Sort and join the ones that touch or overlap
+			std::sort(ranges.begin(), ranges.end());
+			std::vector<std::pair<UINT_64, UINT_64>> joinedRanges;
+			for (auto &range : ranges)
+			{
+				if (!joinedRanges.empty() && range.first <= joinedRanges.back().first + joinedRanges.back().second)
+				{
+					UINT_64 end = (std::max)(joinedRanges.back().first + joinedRanges.back().second, range.first + range.second);
+					joinedRanges.back().second = end - joinedRanges.back().first;
+				}
+				else
+				{
+					joinedRanges.push_back(range);
+				}
+			}
+			return joinedRanges;
+		}
+
+		bool WriteCacheMedia::destage()
+		{
+			std::unique_lock<std::mutex> destageLock(this->DestageMutex);
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+				if (this->DirtyLines.empty())
+				{
+					return true;
+				}
+				this->DestagingLines.swap(this->DirtyLines); // Writes from here on start new dirty lines
+			}
+
+			// Nothing changes DestagingLines but us, so it can be walked without the lock.
+			// Sectors next to each other go out together, up to MEDIA_CHUNK_SIZE at a time.
+			UINT_8* runBuffer = memory::allocate(MEDIA_CHUNK_SIZE, false, memory::SUBSYSTEM_NAMESPACE);
+			UINT_64 runByteOffset = 0;
+			size_t runByteSize = 0;
+			bool success = true;
+			for (auto &line : this->DestagingLines)
+			{
+				for (size_t sector = 0; sector < WRITE_CACHE_SECTORS_PER_LINE && success; sector++)
+				{
+					if (!(line.second.ValidSectors & (1 << sector)))
+					{
+						continue;
+					}
+
+					UINT_64 sectorByteOffset = line.first * WRITE_CACHE_LINE_SIZE + sector * DIRECT_IO_ALIGNMENT;
+					size_t sectorSize = (size_t)(std::min)((UINT_64)DIRECT_IO_ALIGNMENT, this->getSize() - sectorByteOffset);
+					if (runByteSize != 0 && (runByteOffset + runByteSize != sectorByteOffset || runByteSize + sectorSize > MEDIA_CHUNK_SIZE))
+					{
+						success = this->BackingMedia->write(runByteOffset, runBuffer, runByteSize);
+						runByteSize = 0;
+					}
+
+					if (runByteSize == 0)
+					{
+						runByteOffset = sectorByteOffset;
+					}
+					memcpy_s(runBuffer + runByteSize, MEDIA_CHUNK_SIZE - runByteSize, line.second.Data.get() + sector * DIRECT_IO_ALIGNMENT, sectorSize);
+					runByteSize += sectorSize;
+				}
+			}
+
+			if (success && runByteSize != 0)
+			{
+				success = this->BackingMedia->write(runByteOffset, runBuffer, runByteSize);
+			}
+			memory::deallocate(runBuffer, MEDIA_CHUNK_SIZE, memory::SUBSYSTEM_NAMESPACE);
+
+			std::unique_lock<std::mutex> lock(this->CacheMutex);
+			if (!success)
+			{
+				// Keep them dirty (under anything written since) so they go out next time
+				LOG_ERROR("Failed to destage " + std::to_string(this->DestagingLines.size()) + " cache line(s) to the backing media");
+				for (auto &line : this->DestagingLines)
+				{
+					auto dirtyLine = this->DirtyLines.find(line.first);
+					if (dirtyLine == this->DirtyLines.end())
+					{
+						this->DirtyLines.insert(line);
+						continue;
+					}
+
+					for (size_t sector = 0; sector < WRITE_CACHE_SECTORS_PER_LINE; sector++)
+					{
+						if ((line.second.ValidSectors & (1 << sector)) && !(dirtyLine->second.ValidSectors & (1 << sector)))
+						{
+							memcpy_s(dirtyLine->second.Data.get() + sector * DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT, line.second.Data.get() + sector * DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT);
+							dirtyLine->second.ValidSectors |= (UINT_8)(1 << sector);
+						}
+					}
+				}
+			}
+
+			this->DestagingLines.clear();
+			return success;
+		}
+
+		void WriteCacheMedia::destageInBackground()
+		{
+			bool shouldDestage = false;
+			{
+				std::unique_lock<std::mutex> lock(this->CacheMutex);
+				shouldDestage = !this->DirtyLines.empty() && (!this->WrittenSinceLastLook || this->DirtyLines.size() * WRITE_CACHE_LINE_SIZE >= this->CacheSize / 2);
+				this->WrittenSinceLastLook = false;
+			}
+
+			if (shouldDestage)
+			{
+				this->destage();
+			}
+		}
+
+		const UINT_8* WriteCacheMedia::getCachedSector(UINT_64 lineIndex, size_t sector) const
+		{
+			for (const CacheLineMap* lines : { &this->DirtyLines, &this->DestagingLines }) // Dirty lines are newer
+			{
+				auto line = lines->find(lineIndex);
+				if (line != lines->end() && (line->second.ValidSectors & (1 << sector)))
+				{
+					return line->second.Data.get() + sector * DIRECT_IO_ALIGNMENT;
+				}
+			}
+			return nullptr;
+		}
+
+		FtlMedia::FtlMedia(std::shared_ptr<Media> backingMedia, const FTL_PARAMETERS &parameters) : Model(backingMedia->getSize(), parameters)
+		{
+			this->BackingMedia = backingMedia;
+		}
+
+		FtlMedia::FtlMedia(std::shared_ptr<Media> backingMedia, const FlashTranslationLayer &model) : Model(model)
+		{
+			this->BackingMedia = backingMedia;
+		}
+
+		std::shared_ptr<Media> FtlMedia::getBackingMedia() const
+		{
+			return this->BackingMedia;
+		}
+
+		FTL_STATISTICS FtlMedia::getStatistics() const
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			return this->Model.getStatistics();
+		}
+
+		FTL_PARAMETERS FtlMedia::getParameters() const
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			return this->Model.getParameters();
+		}
+
+		FTL_WORK FtlMedia::takeBackgroundWork()
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			return this->Model.takeBackgroundWork();
+		}
+
+		UINT_64 FtlMedia::getSize() const
+		{
+			return this->BackingMedia->getSize();
+		}
+
+		bool FtlMedia::read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize)
+		{
+			return this->BackingMedia->read(byteOffset, buffer, byteSize);
+		}
+
+		bool FtlMedia::write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize)
+		{
+			if (!this->BackingMedia->write(byteOffset, buffer, byteSize))
+			{
+				return false;
+			}
+
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->Model.write(byteOffset, byteSize);
+			return true;
+		}
+
+		void FtlMedia::deallocateAll()
+		{
+			this->BackingMedia->deallocateAll();
+
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->Model.deallocateAll();
+		}
+
+		bool FtlMedia::deallocate(UINT_64 byteOffset, UINT_64 byteSize)
+		{
+			if (!this->BackingMedia->deallocate(byteOffset, byteSize))
+			{
+				return false;
+			}
+
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->Model.deallocate(byteOffset, byteSize);
+			return true;
+		}
+
+		UINT_64 FtlMedia::getAllocatedSize() const
+		{
+			return this->BackingMedia->getAllocatedSize();
+		}
+
+		bool FtlMedia::isThinProvisioned() const
+		{
+			return this->BackingMedia->isThinProvisioned();
+		}
+
+		bool FtlMedia::flush()
+		{
+			return this->BackingMedia->flush();
+		}
+
+		bool FtlMedia::isAsynchronous() const
+		{
+			return this->BackingMedia->isAsynchronous();
+		}
+
+		bool FtlMedia::isPersistent() const
+		{
+			return this->BackingMedia->isPersistent();
+		}
+
+		std::shared_ptr<Media> FtlMedia::clone()
+		{
+			std::shared_ptr<Media> backingClone = this->BackingMedia->clone();
+			if (!backingClone)
+			{
+				return nullptr;
+			}
+
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			return std::make_shared<FtlMedia>(backingClone, this->Model);
+		}
+
+		std::vector<std::pair<UINT_64, UINT_64>> FtlMedia::getAllocatedRanges() const
+		{
+			return this->BackingMedia->getAllocatedRanges();
+		}
+	}
+}
@@ -0,0 +1,1220 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Media.h - A header file for the storage behind a cNVMe Namespace
+*/
+
+#pragma once
+
+#include "FlashTranslationLayer.h"
+#include "LoopingThread.h"
+#include "Types.h"
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#define MEDIA_CHUNK_SIZE 65536          // Sparse media is allocated in chunks of this many bytes
+#define MEDIA_CHUNKS_PER_TABLE 512      // Number of chunks covered by each second-level table
+#define DIRECT_IO_ALIGNMENT 512         // Offset, size and buffer alignment for direct I/O. The smallest sector size we support.
+#define DEDUP_BLOCK_SIZE 4096           // Deduplicated media stores data in blocks of this many bytes
+#define WRITE_CACHE_LINE_SIZE 4096      // A volatile write cache holds written data in lines of this many bytes
+#define WRITE_CACHE_SECTORS_PER_LINE (WRITE_CACHE_LINE_SIZE / DIRECT_IO_ALIGNMENT) // Each line tracks which of its DIRECT_IO_ALIGNMENT sectors it holds
+#define WRITE_CACHE_SIZE (64ULL * 1024 * 1024) // Bytes a volatile write cache holds before writes have to wait for it to destage
+#define WRITE_CACHE_DESTAGE_SLEEP_MS 10 // How often the destager looks at the cache. Dirty lines go out once writes go quiet (or the cache fills up).
+
+namespace cnvme
+{
+	namespace ns
+	{
+		/// <summary>
+		/// Starts each run of data in a media image. The data follows it. The image ends with an extent with a ByteSize of 0.
+		/// </summary>
+		typedef struct MEDIA_IMAGE_EXTENT
+		{
+			UINT_64 ByteOffset;
+			UINT_64 ByteSize;
+		} MEDIA_IMAGE_EXTENT, *PMEDIA_IMAGE_EXTENT;
+		static_assert(sizeof(MEDIA_IMAGE_EXTENT) == 16, "MEDIA_IMAGE_EXTENT should be 16 byte(s) in size.");
+
+		/// <summary>
+		/// Interface for the storage behind a Namespace.
+		/// Offsets and sizes are in bytes and 64-bit so media can be larger than the address space.
+		/// </summary>
+		class Media
+		{
+		public:
+			/// <summary>
+			/// Destructor
+			/// </summary>
+			virtual ~Media();
+
+			/// <summary>
+			/// Gets the size of the media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			virtual UINT_64 getSize() const = 0;
+
+			/// <summary>
+			/// Copies bytes out of the media
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			virtual bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize) = 0;
+
+			/// <summary>
+			/// Copies bytes into the media
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			virtual bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize) = 0;
+
+			/// <summary>
+			/// Throws away all data. Every byte reads back as zero afterwards.
+			/// </summary>
+			virtual void deallocateAll() = 0;
+
+			/// <summary>
+			/// Throws away the data in a range. It reads back as zero afterwards, and whatever backed it is given back where the media can.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="byteSize">Number of bytes to throw away</param>
+			/// <returns>true on success</returns>
+			virtual bool deallocate(UINT_64 byteOffset, UINT_64 byteSize) = 0;
+
+			/// <summary>
+			/// Gets the number of bytes actually backed by memory (or disk)
+			/// </summary>
+			/// <returns>Allocated size in bytes</returns>
+			virtual UINT_64 getAllocatedSize() const = 0;
+
+			/// <summary>
+			/// Returns true if the media only allocates what has been written
+			/// </summary>
+			/// <returns>bool</returns>
+			virtual bool isThinProvisioned() const = 0;
+
+			/// <summary>
+			/// Makes everything written so far durable
+			/// </summary>
+			/// <returns>true on success</returns>
+			virtual bool flush() = 0;
+
+			/// <summary>
+			/// Returns true if I/O to this media blocks long enough that the controller should run it on its I/O threads
+			///   and post the completion once it finishes, rather than inline on the doorbell watcher.
+			/// </summary>
+			/// <returns>false unless overridden</returns>
+			virtual bool isAsynchronous() const;
+
+			/// <summary>
+			/// Returns true if the data outlives the simulator (it lands in a file), so putting a volatile write cache in front of it means something
+			/// </summary>
+			/// <returns>false unless overridden</returns>
+			virtual bool isPersistent() const;
+
+			/// <summary>
+			/// Makes new media holding the same data as this media does right now.
+			/// Writes to either one afterwards aren't seen by the other.
+			/// </summary>
+			/// <returns>The clone, or nullptr if this media can't be cloned (the default)</returns>
+			virtual std::shared_ptr<Media> clone();
+
+			/// <summary>
+			/// Gets the parts of the media that can hold data, in order. Everything else reads as zeros.
+			/// </summary>
+			/// <returns>(byte offset, byte size) of each part. The whole media unless overridden.</returns>
+			virtual std::vector<std::pair<UINT_64, UINT_64>> getAllocatedRanges() const;
+
+			/// <summary>
+			/// Writes the data in the media to an image, as MEDIA_IMAGE_EXTENTs each followed by their data.
+			/// Only the allocated ranges are read, and MEDIA_CHUNK_SIZE pieces of them that are all zeros are left out.
+			/// </summary>
+			/// <param name="image">Stream to write the image to</param>
+			/// <returns>true on success</returns>
+			bool saveImage(std::ostream &image);
+
+			/// <summary>
+			/// Streams an image from saveImage() into the media, a MEDIA_CHUNK_SIZE piece at a time.
+			/// Only the extents in the image are written, so the rest of the media is left as it was.
+			/// </summary>
+			/// <param name="image">Stream to read the image from</param>
+			/// <returns>true on success. false if the image is cut short or doesn't fit the media.</returns>
+			bool loadImage(std::istream &image);
+
+			/// <summary>
+			/// Blocks until everything handed to reclaimInBackground() has been freed
+			/// </summary>
+			static void waitForBackgroundReclamation();
+
+		protected:
+			/// <summary>
+			/// Drops the given data on a background thread. Media throws away its data structures in O(1) by swapping in empty ones,
+			///   then frees the old ones through here, so erasing (like a format) doesn't wait on freeing every chunk.
+			/// </summary>
+			/// <param name="garbage">Data to drop. Anything still sharing it (like a clone) keeps it alive.</param>
+			static void reclaimInBackground(std::shared_ptr<void> garbage);
+		};
+
+		/// <summary>
+		/// Media that allocates MEDIA_CHUNK_SIZE chunks on first write.
+		/// Chunks are found through a two-level table: a directory of second-level tables, each holding MEDIA_CHUNKS_PER_TABLE chunk pointers.
+		///   The directory only holds tables that have a written chunk under them, so creating media of any size costs nothing up front.
+		/// Reads of unwritten chunks give zeros without allocating anything.
+		/// Every level is reference counted so clones share it, which makes clone() O(1) and writes copy-on-write.
+		/// </summary>
+		class SparseMedia : public Media
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="byteSize">Size of the media in bytes</param>
+			SparseMedia(UINT_64 byteSize);
+
+			/// <summary>
+			/// Destructor. Frees all chunks and tables.
+			/// </summary>
+			~SparseMedia();
+
+			/// <summary>
+			/// Gets the size of the media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getSize() const;
+
+			/// <summary>
+			/// Copies bytes out of the media. Unwritten chunks read as zeros.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true</returns>
+			bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Copies bytes into the media, allocating chunks (and their tables) as needed
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true</returns>
+			bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Swaps in an empty directory in O(1). The chunks and tables under the old one are freed in the background.
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Frees the chunks (and tables) the range fully covers. Partially covered chunks have that part zeroed.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="byteSize">Number of bytes to throw away</param>
+			/// <returns>true</returns>
+			bool deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Gets the number of bytes in allocated chunks
+			/// </summary>
+			/// <returns>Allocated size in bytes</returns>
+			UINT_64 getAllocatedSize() const;
+
+			/// <summary>
+			/// Sparse media is always thin provisioned
+			/// </summary>
+			/// <returns>true</returns>
+			bool isThinProvisioned() const;
+
+			/// <summary>
+			/// Nothing to do. Sparse media lives in memory, so it is as durable as it will ever be.
+			/// </summary>
+			/// <returns>true</returns>
+			bool flush();
+
+			/// <summary>
+			/// Clones the media in O(1). The clone shares the directory, tables and chunks with this media,
+			///   and whichever one writes first copies just the parts it writes to.
+			/// </summary>
+			/// <returns>The clone</returns>
+			std::shared_ptr<Media> clone();
+
+			/// <summary>
+			/// Gets the allocated chunks, with neighbouring ones joined up
+			/// </summary>
+			/// <returns>(byte offset, byte size) of each run of chunks</returns>
+			std::vector<std::pair<UINT_64, UINT_64>> getAllocatedRanges() const;
+
+		private:
+			/// <summary>
+			/// A MEDIA_CHUNK_SIZE chunk of data. Shared between clones until one of them writes to it.
+			/// </summary>
+			typedef std::shared_ptr<UINT_8> Chunk;
+
+			/// <summary>
+			/// A second-level table of MEDIA_CHUNKS_PER_TABLE chunks. Shared between clones until one of them changes it.
+			/// </summary>
+			typedef std::vector<Chunk> ChunkTable;
+
+			/// <summary>
+			/// Goes from table index (chunk index / MEDIA_CHUNKS_PER_TABLE) to table. Missing tables have nothing written under them.
+			/// </summary>
+			typedef std::unordered_map<UINT_64, std::shared_ptr<ChunkTable>> ChunkDirectory;
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it (or clone() it) instead.
+			/// </summary>
+			SparseMedia(const SparseMedia&);
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it (or clone() it) instead.
+			/// </summary>
+			SparseMedia& operator=(const SparseMedia&);
+
+			/// <summary>
+			/// Gets the chunk with the given index, to read from
+			/// </summary>
+			/// <param name="chunkIndex">Index of the chunk (byte offset / MEDIA_CHUNK_SIZE)</param>
+			/// <returns>Pointer to the chunk, or nullptr if it isn't allocated</returns>
+			const UINT_8* getChunk(UINT_64 chunkIndex) const;
+
+			/// <summary>
+			/// Gets the chunk with the given index, to write to. Allocates it (and its table) if it isn't there.
+			/// Anything on the way to it that is shared with a clone gets copied first.
+			/// </summary>
+			/// <param name="chunkIndex">Index of the chunk (byte offset / MEDIA_CHUNK_SIZE)</param>
+			/// <returns>Pointer to the chunk</returns>
+			UINT_8* getWritableChunk(UINT_64 chunkIndex);
+
+			/// <summary>
+			/// Gets the table with the given index, to change. Copies the directory and table first if they are shared with a clone.
+			/// </summary>
+			/// <param name="tableIndex">Index of the table (chunk index / MEDIA_CHUNKS_PER_TABLE)</param>
+			/// <param name="allocate">If true, allocates the table if it isn't there</param>
+			/// <returns>Pointer to the table, or nullptr if it isn't there (and allocate is false)</returns>
+			ChunkTable* getWritableTable(UINT_64 tableIndex, bool allocate);
+
+			/// <summary>
+			/// Size of the media in bytes
+			/// </summary>
+			UINT_64 ByteSize;
+
+			/// <summary>
+			/// Number of chunks this media has allocated (some may be shared with clones)
+			/// </summary>
+			UINT_64 AllocatedChunks;
+
+			/// <summary>
+			/// The directory. Shared between clones until one of them changes it.
+			/// </summary>
+			std::shared_ptr<ChunkDirectory> ChunkTables;
+		};
+
+		/// <summary>
+		/// Statistics for deduplicated media, to see how much space it is saving
+		/// </summary>
+		typedef struct DEDUP_STATISTICS
+		{
+			UINT_64 MappedBlocks;       // Blocks holding data (anything but all zeros)
+			UINT_64 UniqueBlocks;       // Distinct blocks actually stored. Mapped blocks with the same data share one.
+			UINT_64 CompressedBlocks;   // Stored blocks that are kept compressed
+			UINT_64 StoredBytes;        // Bytes taken by the stored blocks
+		}DEDUP_STATISTICS, *PDEDUP_STATISTICS;
+
+		/// <summary>
+		/// Media that stores DEDUP_BLOCK_SIZE blocks by their content. Each block is hashed, and blocks with the same data
+		///   share one stored copy. All zero blocks aren't stored at all.
+		/// Stored blocks can also be compressed with a run-length encoding (PackBits), which is kept only if it makes the block smaller.
+		/// Meant for images that are mostly zeros and repeated patterns, so far larger namespaces fit in RAM.
+		/// </summary>
+		class DedupMedia : public Media
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="byteSize">Size of the media in bytes</param>
+			/// <param name="compress">If true, stored blocks are compressed when that makes them smaller</param>
+			DedupMedia(UINT_64 byteSize, bool compress);
+
+			/// <summary>
+			/// Destructor. Frees all stored blocks.
+			/// </summary>
+			~DedupMedia();
+
+			/// <summary>
+			/// Gets the size of the media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getSize() const;
+
+			/// <summary>
+			/// Copies bytes out of the media. Unmapped blocks read as zeros.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true</returns>
+			bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Copies bytes into the media. Writes that don't cover whole blocks are read-modify-write.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true</returns>
+			bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Swaps in an empty block map and store in O(1). The old ones (and their stored blocks) are freed in the background.
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Unmaps the blocks the range fully covers. Partially covered blocks have that part zeroed.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="byteSize">Number of bytes to throw away</param>
+			/// <returns>true</returns>
+			bool deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Gets the number of bytes taken by stored blocks (after deduplication and compression), rounded up to DIRECT_IO_ALIGNMENT
+			/// </summary>
+			/// <returns>Allocated size in bytes</returns>
+			UINT_64 getAllocatedSize() const;
+
+			/// <summary>
+			/// Deduplicated media is always thin provisioned
+			/// </summary>
+			/// <returns>true</returns>
+			bool isThinProvisioned() const;
+
+			/// <summary>
+			/// Nothing to do. Deduplicated media lives in memory.
+			/// </summary>
+			/// <returns>true</returns>
+			bool flush();
+
+			/// <summary>
+			/// Clones the media. The clone shares the block map until one side changes it, and shares the stored blocks, which are never changed once stored.
+			/// </summary>
+			/// <returns>The clone</returns>
+			std::shared_ptr<Media> clone();
+
+			/// <summary>
+			/// Gets the mapped blocks, with neighbouring ones joined up
+			/// </summary>
+			/// <returns>(byte offset, byte size) of each run of blocks</returns>
+			std::vector<std::pair<UINT_64, UINT_64>> getAllocatedRanges() const;
+
+			/// <summary>
+			/// Gets statistics on how the media is stored
+			/// </summary>
+			/// <returns>DEDUP_STATISTICS</returns>
+			DEDUP_STATISTICS getStatistics() const;
+
+		private:
+			/// <summary>
+			/// A stored block. Never changed once stored, so clones can share it.
+			/// </summary>
+			struct STORED_BLOCK
+			{
+				/// <summary>
+				/// Destructor. Frees the data.
+				/// </summary>
+				~STORED_BLOCK();
+
+				UINT_64 Hash;       // hashBlock() of the uncompressed data
+				UINT_8* Data;       // The data, compressed if Compressed is true
+				UINT_32 DataSize;   // Size of Data in bytes
+				bool Compressed;    // true if Data needs decompressBlock()
+			};
+
+			/// <summary>
+			/// A stored block this media uses, along with how many of its blocks map to it
+			/// </summary>
+			struct STORE_ENTRY
+			{
+				std::shared_ptr<const STORED_BLOCK> Block;
+				UINT_64 References;
+			};
+
+			/// <summary>
+			/// The block map and store, along with what they add up to. Shared between clones until one of them changes it.
+			/// </summary>
+			struct BLOCK_INDEX
+			{
+				std::unordered_map<UINT_64, std::shared_ptr<const STORED_BLOCK>> BlockMap;   // Block index to its stored block. Missing blocks are all zeros.
+				std::unordered_multimap<UINT_64, STORE_ENTRY> BlockStore;                     // Hash to the stored blocks with that hash. More than one only on a collision.
+				UINT_64 CompressedBlocks;                                                     // Number of stored blocks in BlockStore that are compressed
+				UINT_64 StoredBytes;                                                          // Bytes taken by the stored blocks in BlockStore
+			};
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it (or clone() it) instead.
+			/// </summary>
+			DedupMedia(const DedupMedia&);
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it (or clone() it) instead.
+			/// </summary>
+			DedupMedia& operator=(const DedupMedia&);
+
+			/// <summary>
+			/// Copies a whole block out of the media
+			/// </summary>
+			/// <param name="blockIndex">Index of the block (byte offset / DEDUP_BLOCK_SIZE)</param>
+			/// <param name="block">DEDUP_BLOCK_SIZE buffer to copy into</param>
+			void readBlock(UINT_64 blockIndex, UINT_8* block) const;
+
+			/// <summary>
+			/// Maps a block to the given data. The data is found in the store by its hash, or stored if it isn't there yet.
+			/// All zero data just unmaps the block.
+			/// </summary>
+			/// <param name="blockIndex">Index of the block (byte offset / DEDUP_BLOCK_SIZE)</param>
+			/// <param name="block">DEDUP_BLOCK_SIZE buffer to copy from</param>
+			void writeBlock(UINT_64 blockIndex, const UINT_8* block);
+
+			/// <summary>
+			/// Gets the block index, to change. Copies it first if it is shared with a clone.
+			/// </summary>
+			/// <returns>The block index</returns>
+			BLOCK_INDEX& getWritableBlocks();
+
+			/// <summary>
+			/// Unmaps a block, dropping its stored block from the store once no other block maps to it
+			/// </summary>
+			/// <param name="blockIndex">Index of the block (byte offset / DEDUP_BLOCK_SIZE)</param>
+			void unmapBlock(UINT_64 blockIndex);
+
+			/// <summary>
+			/// Returns true if the stored block holds the given data
+			/// </summary>
+			/// <param name="storedBlock">Stored block to check</param>
+			/// <param name="block">DEDUP_BLOCK_SIZE buffer to compare against</param>
+			/// <returns>bool</returns>
+			static bool blockMatches(const STORED_BLOCK &storedBlock, const UINT_8* block);
+
+			/// <summary>
+			/// Hashes a block (FNV-1a over 64-bit words). Matches are checked byte for byte, so collisions only cost time.
+			/// </summary>
+			/// <param name="block">DEDUP_BLOCK_SIZE buffer</param>
+			/// <returns>The hash</returns>
+			static UINT_64 hashBlock(const UINT_8* block);
+
+			/// <summary>
+			/// PackBits compresses a block. Gives up as soon as the output wouldn't be smaller than the block.
+			/// </summary>
+			/// <param name="block">DEDUP_BLOCK_SIZE buffer to compress</param>
+			/// <param name="output">DEDUP_BLOCK_SIZE buffer to compress into</param>
+			/// <returns>Compressed size in bytes. 0 if it wouldn't be smaller.</returns>
+			static UINT_32 compressBlock(const UINT_8* block, UINT_8* output);
+
+			/// <summary>
+			/// Decompresses what compressBlock() made
+			/// </summary>
+			/// <param name="data">Compressed data</param>
+			/// <param name="dataSize">Size of the compressed data in bytes</param>
+			/// <param name="block">DEDUP_BLOCK_SIZE buffer to decompress into</param>
+			static void decompressBlock(const UINT_8* data, UINT_32 dataSize, UINT_8* block);
+
+			/// <summary>
+			/// Size of the media in bytes
+			/// </summary>
+			UINT_64 ByteSize;
+
+			/// <summary>
+			/// If true, new stored blocks are compressed when that makes them smaller
+			/// </summary>
+			bool Compress;
+
+			/// <summary>
+			/// The block index. Copied on the first change while a clone has it, so cloning doesn't walk the map.
+			/// </summary>
+			std::shared_ptr<BLOCK_INDEX> Blocks;
+		};
+
+		/// <summary>
+		/// Media that maps a file into memory. Reads and writes go straight to the mapping,
+		///   so the data persists across runs and the OS page cache decides what is actually in RAM.
+		/// </summary>
+		class MappedFileMedia : public Media
+		{
+		public:
+			/// <summary>
+			/// Constructor. Opens (or creates) the file and maps it. Check isMapped() afterwards.
+			/// </summary>
+			/// <param name="filePath">Path to the backing file</param>
+			/// <param name="byteSize">Size of the media in bytes. The file is grown to this size if needed. 0 means use the file's current size.</param>
+			MappedFileMedia(std::string filePath, UINT_64 byteSize);
+
+			/// <summary>
+			/// Destructor. Flushes, unmaps and closes the file.
+			/// </summary>
+			~MappedFileMedia();
+
+			/// <summary>
+			/// Returns true if the file was opened and mapped
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isMapped() const;
+
+			/// <summary>
+			/// Gets the size of the media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getSize() const;
+
+			/// <summary>
+			/// Copies bytes out of the mapping
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true</returns>
+			bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Copies bytes into the mapping
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true</returns>
+			bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Zeros the file. On Linux this truncates it and grows it back so the file system can free the blocks.
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Zeros a range of the file. On Linux a hole is punched so the file system can free the blocks.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="byteSize">Number of bytes to throw away</param>
+			/// <returns>true</returns>
+			bool deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Gets the media size. The file is treated as fully provisioned.
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getAllocatedSize() const;
+
+			/// <summary>
+			/// File backed media is fully provisioned
+			/// </summary>
+			/// <returns>false</returns>
+			bool isThinProvisioned() const;
+
+			/// <summary>
+			/// Writes dirty pages of the mapping back to the file and waits for the file's data to reach the disk
+			/// </summary>
+			/// <returns>true on success</returns>
+			bool flush();
+
+			/// <summary>
+			/// The data is in a file
+			/// </summary>
+			/// <returns>true</returns>
+			bool isPersistent() const;
+
+		private:
+			/// <summary>
+			/// Media can't be copied. Namespaces share it instead.
+			/// </summary>
+			MappedFileMedia(const MappedFileMedia&);
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it instead.
+			/// </summary>
+			MappedFileMedia& operator=(const MappedFileMedia&);
+
+			/// <summary>
+			/// Maps the whole (already sized) file
+			/// </summary>
+			/// <returns>true on success</returns>
+			bool map();
+
+			/// <summary>
+			/// Unmaps the file if it is mapped
+			/// </summary>
+			void unmap();
+
+			/// <summary>
+			/// Path to the backing file
+			/// </summary>
+			std::string FilePath;
+
+			/// <summary>
+			/// Size of the media in bytes
+			/// </summary>
+			UINT_64 ByteSize;
+
+			/// <summary>
+			/// Start of the mapping. nullptr if not mapped.
+			/// </summary>
+			UINT_8* MappedBuffer;
+
+#ifdef _WIN32
+			/// <summary>
+			/// Handle to the backing file (HANDLE)
+			/// </summary>
+			void* FileHandle;
+
+			/// <summary>
+			/// Handle to the file mapping object (HANDLE)
+			/// </summary>
+			void* MappingHandle;
+#else
+			/// <summary>
+			/// File descriptor for the backing file
+			/// </summary>
+			int FileDescriptor;
+#endif // _WIN32
+		};
+
+		/// <summary>
+		/// Media that forwards reads and writes to a file or block device, bypassing the OS page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING).
+		/// Every access actually hits the storage, so the controller runs it on its I/O threads and completes commands asynchronously.
+		/// I/O is done through bounce buffers aligned to DIRECT_IO_ALIGNMENT. If the storage refuses direct I/O, it falls back to buffered I/O.
+		/// </summary>
+		class DirectFileMedia : public Media
+		{
+		public:
+			/// <summary>
+			/// Constructor. Opens (or creates) the file. Check isOpen() afterwards.
+			/// </summary>
+			/// <param name="filePath">Path to the backing file or block device</param>
+			/// <param name="byteSize">Size of the media in bytes. A regular file is grown to this size if needed. 0 means use the current size.</param>
+			DirectFileMedia(std::string filePath, UINT_64 byteSize);
+
+			/// <summary>
+			/// Destructor. Closes the file.
+			/// </summary>
+			~DirectFileMedia();
+
+			/// <summary>
+			/// Returns true if the file was opened
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isOpen() const;
+
+			/// <summary>
+			/// Gets the size of the media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getSize() const;
+
+			/// <summary>
+			/// Reads from the file. Safe to call from multiple threads at once.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Writes to the file. Safe to call from multiple threads at once.
+			/// Writes that don't cover whole DIRECT_IO_ALIGNMENT blocks are read-modify-write, and are serialized with each other.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Zeros the media. A regular file is truncated and grown back so the file system can free the blocks.
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Zeros a range of the media. A hole is punched (or the range is zeroed by the file system) when possible,
+			///   otherwise zeros are written over it.
+			/// </summary>
+			/// <param name="byteOffset">Aligned offset into the media to start at</param>
+			/// <param name="byteSize">Aligned number of bytes to throw away</param>
+			/// <returns>true on success</returns>
+			bool deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Gets the media size. The file is treated as fully provisioned.
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getAllocatedSize() const;
+
+			/// <summary>
+			/// File backed media is fully provisioned
+			/// </summary>
+			/// <returns>false</returns>
+			bool isThinProvisioned() const;
+
+			/// <summary>
+			/// Waits for written data to reach the disk (fdatasync / FlushFileBuffers)
+			/// </summary>
+			/// <returns>true on success</returns>
+			bool flush();
+
+			/// <summary>
+			/// Direct I/O blocks, so commands to this media complete asynchronously
+			/// </summary>
+			/// <returns>true</returns>
+			bool isAsynchronous() const;
+
+			/// <summary>
+			/// The data is in a file (or on a device)
+			/// </summary>
+			/// <returns>true</returns>
+			bool isPersistent() const;
+
+		private:
+			/// <summary>
+			/// Media can't be copied. Namespaces share it instead.
+			/// </summary>
+			DirectFileMedia(const DirectFileMedia&);
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it instead.
+			/// </summary>
+			DirectFileMedia& operator=(const DirectFileMedia&);
+
+			/// <summary>
+			/// Reads or writes whole aligned blocks between the file and an aligned buffer
+			/// </summary>
+			/// <param name="byteOffset">Aligned offset into the file</param>
+			/// <param name="alignedBuffer">Aligned buffer</param>
+			/// <param name="byteSize">Aligned number of bytes</param>
+			/// <param name="isWrite">true to write the buffer to the file, false to read the file into the buffer</param>
+			/// <returns>true on success</returns>
+			bool transferAligned(UINT_64 byteOffset, UINT_8* alignedBuffer, size_t byteSize, bool isWrite);
+
+			/// <summary>
+			/// Writes zeros over whole aligned blocks of the file
+			/// </summary>
+			/// <param name="byteOffset">Aligned offset into the file</param>
+			/// <param name="byteSize">Aligned number of bytes</param>
+			/// <returns>true on success</returns>
+			bool writeZeros(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Path to the backing file
+			/// </summary>
+			std::string FilePath;
+
+			/// <summary>
+			/// Size of the media in bytes
+			/// </summary>
+			UINT_64 ByteSize;
+
+			/// <summary>
+			/// true if this is a regular file (as opposed to a block device)
+			/// </summary>
+			bool IsRegularFile;
+
+			/// <summary>
+			/// Serializes read-modify-write of partial blocks so two of them can't undo each other
+			/// </summary>
+			std::mutex PartialBlockMutex;
+
+#ifdef _WIN32
+			/// <summary>
+			/// Handle to the backing file (HANDLE)
+			/// </summary>
+			void* FileHandle;
+#else
+			/// <summary>
+			/// File descriptor for the backing file
+			/// </summary>
+			int FileDescriptor;
+
+			/// <summary>
+			/// true while the file is open with O_DIRECT. Cleared if the storage won't take our alignment.
+			/// </summary>
+			std::atomic<bool> UsingDirectIo;
+#endif // _WIN32
+		};
+
+		/// <summary>
+		/// A volatile write cache in front of other (persistent) media.
+		/// Writes land in WRITE_CACHE_LINE_SIZE lines in memory and complete right away. Lines remember which sectors were written,
+		///   so sector sized writes never have to read the rest of the line from the media first. A background destager writes dirty sectors
+		///   back to the media, in order and a run of lines at a time, once writes go quiet or the cache is half full.
+		///   A write that finds the cache full destages inline first, like a drive that has run out of cache.
+		/// Reads see the cached lines over the media. flush() destages everything, then flushes the media.
+		/// Anything not yet destaged is lost if the process dies, just like a power loss with the cache on.
+		/// </summary>
+		class WriteCacheMedia : public Media
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts the destager.
+			/// </summary>
+			/// <param name="backingMedia">Media to cache writes for</param>
+			/// <param name="cacheSize">Bytes of dirty data to hold before writes wait</param>
+			WriteCacheMedia(std::shared_ptr<Media> backingMedia, UINT_64 cacheSize);
+
+			/// <summary>
+			/// Destructor. Stops the destager and destages whatever is left, so a clean shutdown loses nothing.
+			/// </summary>
+			~WriteCacheMedia();
+
+			/// <summary>
+			/// Gets the media writes are cached for
+			/// </summary>
+			/// <returns>The backing media</returns>
+			std::shared_ptr<Media> getBackingMedia() const;
+
+			/// <summary>
+			/// Gets the number of bytes written to the cache but not yet to the backing media
+			/// </summary>
+			/// <returns>Dirty bytes</returns>
+			UINT_64 getDirtySize() const;
+
+			/// <summary>
+			/// Gets the size of the backing media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getSize() const;
+
+			/// <summary>
+			/// Reads cached sectors from the cache and only the rest from the backing media
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Copies into cache lines. Only a sector that is partly written (and not already cached) is read from the backing media first.
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Drops every cached line, then zeros the backing media
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Drops (or zeros the covered part of) the cached lines in a range, then deallocates it from the backing media
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="byteSize">Number of bytes to throw away</param>
+			/// <returns>true on success</returns>
+			bool deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Gets the allocated size of the backing media
+			/// </summary>
+			/// <returns>Allocated size in bytes</returns>
+			UINT_64 getAllocatedSize() const;
+
+			/// <summary>
+			/// Same as the backing media
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isThinProvisioned() const;
+
+			/// <summary>
+			/// Destages every dirty line, then flushes the backing media
+			/// </summary>
+			/// <returns>true on success</returns>
+			bool flush();
+
+			/// <summary>
+			/// Same as the backing media, since reads that miss the cache (and flushes) go to it
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isAsynchronous() const;
+
+			/// <summary>
+			/// Same as the backing media
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isPersistent() const;
+
+			/// <summary>
+			/// Gets the backing media's allocated ranges along with those of the cached lines
+			/// </summary>
+			/// <returns>(byte offset, byte size) of each part</returns>
+			std::vector<std::pair<UINT_64, UINT_64>> getAllocatedRanges() const;
+
+		private:
+			/// <summary>
+			/// Media can't be copied. Namespaces share it instead.
+			/// </summary>
+			WriteCacheMedia(const WriteCacheMedia&);
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it instead.
+			/// </summary>
+			WriteCacheMedia& operator=(const WriteCacheMedia&);
+
+			/// <summary>
+			/// A line of cached data
+			/// </summary>
+			typedef struct CacheLine
+			{
+				/// <summary>
+				/// WRITE_CACHE_LINE_SIZE bytes
+				/// </summary>
+				std::shared_ptr<UINT_8> Data;
+
+				/// <summary>
+				/// Bit n is set if sector n of the line holds written data. Only those sectors are read from or destaged.
+				/// </summary>
+				UINT_8 ValidSectors;
+			} CacheLine;
+			static_assert(WRITE_CACHE_SECTORS_PER_LINE <= 8, "CacheLine::ValidSectors needs a bit for each sector in a line");
+
+			/// <summary>
+			/// Cache lines by line index. Ordered so destaging walks the media front to back.
+			/// </summary>
+			typedef std::map<UINT_64, CacheLine> CacheLineMap;
+
+			/// <summary>
+			/// Writes every dirty line to the backing media. Lines written while this runs wait for the next destage.
+			/// </summary>
+			/// <returns>true on success. On failure the lines stay dirty.</returns>
+			bool destage();
+
+			/// <summary>
+			/// Run by the destager. Destages once the cache is half full or nothing was written since the last look.
+			/// </summary>
+			void destageInBackground();
+
+			/// <summary>
+			/// Finds the newest cached copy of a sector. Call with CacheMutex held.
+			/// </summary>
+			/// <param name="lineIndex">Index of the line the sector is in</param>
+			/// <param name="sector">Index of the sector in the line</param>
+			/// <returns>The sector's data, or nullptr if it isn't cached</returns>
+			const UINT_8* getCachedSector(UINT_64 lineIndex, size_t sector) const;
+
+			/// <summary>
+			/// Media writes are cached for
+			/// </summary>
+			std::shared_ptr<Media> BackingMedia;
+
+			/// <summary>
+			/// Bytes of dirty data to hold before writes wait
+			/// </summary>
+			UINT_64 CacheSize;
+
+			/// <summary>
+			/// Lines written but not yet destaged
+			/// </summary>
+			CacheLineMap DirtyLines;
+
+			/// <summary>
+			/// Lines being written to the backing media right now. Reads still come from here until they are on it.
+			/// </summary>
+			CacheLineMap DestagingLines;
+
+			/// <summary>
+			/// true if something was written since the destager last looked
+			/// </summary>
+			bool WrittenSinceLastLook;
+
+			/// <summary>
+			/// Protects the line maps and everything above
+			/// </summary>
+			mutable std::mutex CacheMutex;
+
+			/// <summary>
+			/// Held while destaging (or while deallocating, so a destage can't put back data that was just thrown away)
+			/// </summary>
+			std::mutex DestageMutex;
+
+			/// <summary>
+			/// Destages in the background
+			/// </summary>
+			LoopingThread Destager;
+		};
+
+		/// <summary>
+		/// A FlashTranslationLayer model in front of other media. The data goes straight to the backing media,
+		///   while the model follows every write and deallocate to tell what a NAND drive would be doing underneath:
+		///   which blocks it would be collecting, how much it would be moving, and how that grows as the drive fills up.
+		/// </summary>
+		class FtlMedia : public Media
+		{
+		public:
+			/// <summary>
+			/// Constructor. The model starts out like a new drive, whatever the backing media already holds.
+			/// </summary>
+			/// <param name="backingMedia">Media holding the data</param>
+			/// <param name="parameters">Settings for the model. Must pass FlashTranslationLayer::isValid() for the media's size.</param>
+			FtlMedia(std::shared_ptr<Media> backingMedia, const FTL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Constructor that carries on from an existing model
+			/// </summary>
+			/// <param name="backingMedia">Media holding the data</param>
+			/// <param name="model">Model to copy. Must be for the media's size.</param>
+			FtlMedia(std::shared_ptr<Media> backingMedia, const FlashTranslationLayer &model);
+
+			/// <summary>
+			/// Gets the media holding the data
+			/// </summary>
+			/// <returns>The backing media</returns>
+			std::shared_ptr<Media> getBackingMedia() const;
+
+			/// <summary>
+			/// Gets the model's statistics
+			/// </summary>
+			/// <returns>FTL_STATISTICS</returns>
+			FTL_STATISTICS getStatistics() const;
+
+			/// <summary>
+			/// Gets the model's settings
+			/// </summary>
+			/// <returns>FTL_PARAMETERS</returns>
+			FTL_PARAMETERS getParameters() const;
+
+			/// <summary>
+			/// Gets the garbage collection work done since the last call
+			/// </summary>
+			/// <returns>FTL_WORK</returns>
+			FTL_WORK takeBackgroundWork();
+
+			/// <summary>
+			/// Gets the size of the backing media
+			/// </summary>
+			/// <returns>Size in bytes</returns>
+			UINT_64 getSize() const;
+
+			/// <summary>
+			/// Reads from the backing media
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy into</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			bool read(UINT_64 byteOffset, BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Writes to the backing media, then programs the pages in the model
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="buffer">Buffer to copy from</param>
+			/// <param name="byteSize">Number of bytes to copy</param>
+			/// <returns>true on success</returns>
+			bool write(UINT_64 byteOffset, const BYTE* buffer, size_t byteSize);
+
+			/// <summary>
+			/// Zeros the backing media and erases everything in the model
+			/// </summary>
+			void deallocateAll();
+
+			/// <summary>
+			/// Deallocates the range from the backing media, then unmaps the pages it fully covers in the model
+			/// </summary>
+			/// <param name="byteOffset">Offset into the media to start at</param>
+			/// <param name="byteSize">Number of bytes to throw away</param>
+			/// <returns>true on success</returns>
+			bool deallocate(UINT_64 byteOffset, UINT_64 byteSize);
+
+			/// <summary>
+			/// Gets the allocated size of the backing media
+			/// </summary>
+			/// <returns>Allocated size in bytes</returns>
+			UINT_64 getAllocatedSize() const;
+
+			/// <summary>
+			/// Same as the backing media
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isThinProvisioned() const;
+
+			/// <summary>
+			/// Flushes the backing media
+			/// </summary>
+			/// <returns>true on success</returns>
+			bool flush();
+
+			/// <summary>
+			/// Same as the backing media
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isAsynchronous() const;
+
+			/// <summary>
+			/// Same as the backing media
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isPersistent() const;
+
+			/// <summary>
+			/// Clones the backing media along with a copy of the model, so a reverted snapshot is back to the drive's state then too
+			/// </summary>
+			/// <returns>The clone, or nullptr if the backing media can't be cloned</returns>
+			std::shared_ptr<Media> clone();
+
+			/// <summary>
+			/// Same as the backing media
+			/// </summary>
+			/// <returns>(byte offset, byte size) of each part</returns>
+			std::vector<std::pair<UINT_64, UINT_64>> getAllocatedRanges() const;
+
+		private:
+			/// <summary>
+			/// Media can't be copied. Namespaces share it (or clone() it) instead.
+			/// </summary>
+			FtlMedia(const FtlMedia&);
+
+			/// <summary>
+			/// Media can't be copied. Namespaces share it (or clone() it) instead.
+			/// </summary>
+			FtlMedia& operator=(const FtlMedia&);
+
+			/// <summary>
+			/// Media holding the data
+			/// </summary>
+			std::shared_ptr<Media> BackingMedia;
+
+			/// <summary>
+			/// What the drive would be doing underneath
+			/// </summary>
+			FlashTranslationLayer Model;
+
+			/// <summary>
+			/// Guards Model. Writes can come from several I/O workers at once.
+			/// </summary>
+			mutable std::mutex ModelMutex;
+		};
+	}
+}
@@ -0,0 +1,444 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Memory.cpp - An implementation file for the size-class pooled memory allocator
+*/
+
+#include "Memory.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif // _WIN32
+
+// Size classes are powers of 2 from MIN_POOLED_ALLOCATION_SIZE (64B) to MAX_POOLED_ALLOCATION_SIZE (1MB)
+#define NUMBER_OF_SIZE_CLASSES 15
+
+// Number of bytes a single thread keeps cached per size class before handing some back to the shared pool
+#define MAX_THREAD_CACHE_BYTES_PER_SIZE_CLASS (1024 * 1024)
+
+// Number of bytes the shared pool keeps per size class before giving memory back to the heap
+#define MAX_SHARED_POOL_BYTES_PER_SIZE_CLASS (16 * 1024 * 1024)
+
+namespace cnvme
+{
+	namespace memory
+	{
+		namespace
+		{
+			std::atomic<UINT_64> Allocations(0);
+			std::atomic<UINT_64> Deallocations(0);
+			std::atomic<UINT_64> PoolHits(0);
+			std::atomic<UINT_64> PoolMisses(0);
+			std::atomic<UINT_64> LargeAllocations(0);
+			std::atomic<UINT_64> BytesInUse(0);
+			std::atomic<UINT_64> BytesCached(0);
+
+			/// <summary>
+			/// Accounting counters for a subsystem. Each gets its own cache line so subsystems don't slow each other down.
+			/// </summary>
+			struct alignas(64) SubsystemCounters
+			{
+				std::atomic<UINT_64> Allocations;
+				std::atomic<UINT_64> Deallocations;
+				std::atomic<UINT_64> BytesInUse;
+				std::atomic<UINT_64> HighWaterBytes;
+			};
+
+			SubsystemCounters SubsystemAccounting[NUMBER_OF_SUBSYSTEMS]; // Static storage, so starts at 0
+
+			void addBytes(Subsystem subsystem, size_t byteSize)
+			{
+				SubsystemCounters &counters = SubsystemAccounting[subsystem];
+				UINT_64 bytesInUse = counters.BytesInUse.fetch_add(byteSize, std::memory_order_relaxed) + byteSize;
+				UINT_64 highWaterBytes = counters.HighWaterBytes.load(std::memory_order_relaxed);
+				while (bytesInUse > highWaterBytes && !counters.HighWaterBytes.compare_exchange_weak(highWaterBytes, bytesInUse, std::memory_order_relaxed))
+				{
+					// compare_exchange_weak reloaded highWaterBytes, try again
+				}
+			}
+
+			void removeBytes(Subsystem subsystem, size_t byteSize)
+			{
+				SubsystemAccounting[subsystem].BytesInUse.fetch_sub(byteSize, std::memory_order_relaxed);
+			}
+
+			/// <summary>
+			/// Free blocks shared between all threads, one list per size class
+			/// </summary>
+			struct SharedPool
+			{
+				std::mutex Mutexes[NUMBER_OF_SIZE_CLASSES];
+				std::vector<UINT_8*> FreeBlocks[NUMBER_OF_SIZE_CLASSES];
+			};
+
+			/// <summary>
+			/// Gets the shared pool. It is intentionally never destroyed so that memory freed during
+			///   static destruction (after thread caches are gone) still has somewhere to go.
+			/// </summary>
+			SharedPool& getSharedPool()
+			{
+				static SharedPool* sharedPool = new SharedPool();
+				return *sharedPool;
+			}
+
+			size_t getSizeClass(size_t byteSize)
+			{
+				size_t sizeClass = 0;
+				while ((MIN_POOLED_ALLOCATION_SIZE << sizeClass) < byteSize)
+				{
+					sizeClass++;
+				}
+				return sizeClass;
+			}
+
+			size_t getSizeClassBytes(size_t sizeClass)
+			{
+				return MIN_POOLED_ALLOCATION_SIZE << sizeClass;
+			}
+
+			size_t getMaxBlocks(size_t sizeClass, size_t maxBytes)
+			{
+				return std::max((size_t)2, maxBytes / getSizeClassBytes(sizeClass));
+			}
+
+			/// <summary>
+			/// Gets a block from the heap aligned to its size, up to MAX_ALLOCATION_ALIGNMENT
+			/// </summary>
+			UINT_8* allocateBlock(size_t byteSize)
+			{
+				size_t alignment = std::min(getUsableSize(byteSize), MAX_ALLOCATION_ALIGNMENT);
+				void* block = nullptr;
+#ifdef _WIN32
+				block = _aligned_malloc(byteSize, alignment);
+#else
+				if (posix_memalign(&block, alignment, byteSize) != 0)
+				{
+					block = nullptr;
+				}
+#endif // _WIN32
+				if (!block)
+				{
+					throw std::bad_alloc();
+				}
+				return (UINT_8*)block;
+			}
+
+			/// <summary>
+			/// Gives a block from allocateBlock() back to the heap
+			/// </summary>
+			void freeBlock(UINT_8* block)
+			{
+#ifdef _WIN32
+				_aligned_free(block);
+#else
+				free(block);
+#endif // _WIN32
+			}
+
+			/// <summary>
+			/// Moves the last count blocks of the given vector to the shared pool.
+			/// If the shared pool is over its limit, the extra blocks go back to the heap.
+			/// </summary>
+			void returnToSharedPool(size_t sizeClass, std::vector<UINT_8*> &blocks, size_t count)
+			{
+				SharedPool& sharedPool = getSharedPool();
+				size_t maxSharedBlocks = getMaxBlocks(sizeClass, MAX_SHARED_POOL_BYTES_PER_SIZE_CLASS);
+
+				std::unique_lock<std::mutex> lock(sharedPool.Mutexes[sizeClass]);
+				std::vector<UINT_8*> &sharedBlocks = sharedPool.FreeBlocks[sizeClass];
+				for (size_t i = 0; i < count && !blocks.empty(); i++)
+				{
+					if (sharedBlocks.size() < maxSharedBlocks)
+					{
+						sharedBlocks.push_back(blocks.back());
+					}
+					else
+					{
+						freeBlock(blocks.back());
+						BytesCached.fetch_sub(getSizeClassBytes(sizeClass), std::memory_order_relaxed);
+					}
+					blocks.pop_back();
+				}
+			}
+
+			/// <summary>
+			/// Free blocks only used by the owning thread, so the common path takes no lock
+			/// </summary>
+			struct ThreadCache
+			{
+				std::vector<UINT_8*> FreeBlocks[NUMBER_OF_SIZE_CLASSES];
+
+				~ThreadCache();
+			};
+
+			thread_local bool ThreadCacheDestroyed = false;
+			thread_local ThreadCache TheThreadCache;
+
+			ThreadCache::~ThreadCache()
+			{
+				for (size_t sizeClass = 0; sizeClass < NUMBER_OF_SIZE_CLASSES; sizeClass++)
+				{
+					returnToSharedPool(sizeClass, FreeBlocks[sizeClass], FreeBlocks[sizeClass].size());
+				}
+				ThreadCacheDestroyed = true;
+			}
+		}
+
+		std::string subsystemToString(Subsystem subsystem)
+		{
+			if (subsystem == SUBSYSTEM_PAYLOAD)
+			{
+				return "Payload";
+			}
+			else if (subsystem == SUBSYSTEM_PRP)
+			{
+				return "PRP";
+			}
+			else if (subsystem == SUBSYSTEM_QUEUE)
+			{
+				return "Queue";
+			}
+			else if (subsystem == SUBSYSTEM_NAMESPACE)
+			{
+				return "Namespace";
+			}
+			else if (subsystem == SUBSYSTEM_FIRMWARE_CACHE)
+			{
+				return "Firmware Cache";
+			}
+
+			ASSERT("Subsystem not found in subsystemToString()");
+			return "Unknown";
+		}
+
+		UINT_8* allocate(size_t byteSize, bool zeroMemory, Subsystem subsystem)
+		{
+			if (byteSize == 0)
+			{
+				return nullptr;
+			}
+
+			trackAllocation(subsystem, byteSize);
+
+			UINT_8* pointer = nullptr;
+			if (byteSize > MAX_POOLED_ALLOCATION_SIZE)
+			{
+				pointer = allocateBlock(byteSize);
+				LargeAllocations.fetch_add(1, std::memory_order_relaxed);
+				BytesInUse.fetch_add(byteSize, std::memory_order_relaxed);
+			}
+			else
+			{
+				size_t sizeClass = getSizeClass(byteSize);
+				size_t sizeClassBytes = getSizeClassBytes(sizeClass);
+
+				if (!ThreadCacheDestroyed)
+				{
+					std::vector<UINT_8*> &freeBlocks = TheThreadCache.FreeBlocks[sizeClass];
+					if (freeBlocks.empty())
+					{
+						// Grab a batch from the shared pool so the next few allocations don't need the lock
+						SharedPool& sharedPool = getSharedPool();
+						size_t batchSize = getMaxBlocks(sizeClass, MAX_THREAD_CACHE_BYTES_PER_SIZE_CLASS) / 2;
+
+						std::unique_lock<std::mutex> lock(sharedPool.Mutexes[sizeClass]);
+						std::vector<UINT_8*> &sharedBlocks = sharedPool.FreeBlocks[sizeClass];
+						while (!sharedBlocks.empty() && freeBlocks.size() < batchSize)
+						{
+							freeBlocks.push_back(sharedBlocks.back());
+							sharedBlocks.pop_back();
+						}
+					}
+
+					if (!freeBlocks.empty())
+					{
+						pointer = freeBlocks.back();
+						freeBlocks.pop_back();
+					}
+				}
+				else
+				{
+					SharedPool& sharedPool = getSharedPool();
+					std::unique_lock<std::mutex> lock(sharedPool.Mutexes[sizeClass]);
+					std::vector<UINT_8*> &sharedBlocks = sharedPool.FreeBlocks[sizeClass];
+					if (!sharedBlocks.empty())
+					{
+						pointer = sharedBlocks.back();
+						sharedBlocks.pop_back();
+					}
+				}
+
+				if (pointer)
+				{
+					PoolHits.fetch_add(1, std::memory_order_relaxed);
+					BytesCached.fetch_sub(sizeClassBytes, std::memory_order_relaxed);
+				}
+				else
+				{
+					pointer = allocateBlock(sizeClassBytes);
+					PoolMisses.fetch_add(1, std::memory_order_relaxed);
+				}
+				BytesInUse.fetch_add(sizeClassBytes, std::memory_order_relaxed);
+			}
+
+			Allocations.fetch_add(1, std::memory_order_relaxed);
+
+			if (zeroMemory)
+			{
+				memset(pointer, 0, byteSize);
+			}
+
+			return pointer;
+		}
+
+		void deallocate(UINT_8* pointer, size_t byteSize, Subsystem subsystem)
+		{
+			if (!pointer)
+			{
+				return;
+			}
+
+			trackDeallocation(subsystem, byteSize);
+
+			Deallocations.fetch_add(1, std::memory_order_relaxed);
+
+			if (byteSize > MAX_POOLED_ALLOCATION_SIZE)
+			{
+				freeBlock(pointer);
+				BytesInUse.fetch_sub(byteSize, std::memory_order_relaxed);
+				return;
+			}
+
+			size_t sizeClass = getSizeClass(byteSize);
+			size_t sizeClassBytes = getSizeClassBytes(sizeClass);
+			BytesInUse.fetch_sub(sizeClassBytes, std::memory_order_relaxed);
+			BytesCached.fetch_add(sizeClassBytes, std::memory_order_relaxed);
+
+			if (!ThreadCacheDestroyed)
+			{
+				std::vector<UINT_8*> &freeBlocks = TheThreadCache.FreeBlocks[sizeClass];
+				freeBlocks.push_back(pointer);
+
+				// Too much cached on this thread, give half of it to the other threads
+				size_t maxThreadBlocks = getMaxBlocks(sizeClass, MAX_THREAD_CACHE_BYTES_PER_SIZE_CLASS);
+				if (freeBlocks.size() > maxThreadBlocks)
+				{
+					returnToSharedPool(sizeClass, freeBlocks, freeBlocks.size() / 2);
+				}
+			}
+			else
+			{
+				std::vector<UINT_8*> blocks(1, pointer);
+				returnToSharedPool(sizeClass, blocks, 1);
+			}
+		}
+
+		void trackAllocation(Subsystem subsystem, size_t byteSize)
+		{
+			SubsystemAccounting[subsystem].Allocations.fetch_add(1, std::memory_order_relaxed);
+			addBytes(subsystem, byteSize);
+		}
+
+		void trackDeallocation(Subsystem subsystem, size_t byteSize)
+		{
+			SubsystemAccounting[subsystem].Deallocations.fetch_add(1, std::memory_order_relaxed);
+			removeBytes(subsystem, byteSize);
+		}
+
+		void trackResize(Subsystem subsystem, size_t oldByteSize, size_t newByteSize)
+		{
+			if (newByteSize > oldByteSize)
+			{
+				addBytes(subsystem, newByteSize - oldByteSize);
+			}
+			else
+			{
+				removeBytes(subsystem, oldByteSize - newByteSize);
+			}
+		}
+
+		void transferAccounting(Subsystem from, Subsystem to, size_t byteSize)
+		{
+			if (from != to)
+			{
+				trackDeallocation(from, byteSize);
+				trackAllocation(to, byteSize);
+			}
+		}
+
+		size_t getUsableSize(size_t byteSize)
+		{
+			if (byteSize == 0 || byteSize > MAX_POOLED_ALLOCATION_SIZE)
+			{
+				return byteSize;
+			}
+			return getSizeClassBytes(getSizeClass(byteSize));
+		}
+
+		ALLOCATION_STATISTICS getAllocationStatistics()
+		{
+			ALLOCATION_STATISTICS statistics = { 0 };
+			statistics.Allocations = Allocations.load(std::memory_order_relaxed);
+			statistics.Deallocations = Deallocations.load(std::memory_order_relaxed);
+			statistics.PoolHits = PoolHits.load(std::memory_order_relaxed);
+			statistics.PoolMisses = PoolMisses.load(std::memory_order_relaxed);
+			statistics.LargeAllocations = LargeAllocations.load(std::memory_order_relaxed);
+			statistics.BytesInUse = BytesInUse.load(std::memory_order_relaxed);
+			statistics.BytesCached = BytesCached.load(std::memory_order_relaxed);
+			return statistics;
+		}
+
+		MEMORY_STATISTICS getMemoryStatistics()
+		{
+			MEMORY_STATISTICS statistics = { 0 };
+			statistics.Allocator = getAllocationStatistics();
+			for (size_t i = 0; i < NUMBER_OF_SUBSYSTEMS; i++)
+			{
+				statistics.Subsystems[i].Allocations = SubsystemAccounting[i].Allocations.load(std::memory_order_relaxed);
+				statistics.Subsystems[i].Deallocations = SubsystemAccounting[i].Deallocations.load(std::memory_order_relaxed);
+				statistics.Subsystems[i].BytesInUse = SubsystemAccounting[i].BytesInUse.load(std::memory_order_relaxed);
+				statistics.Subsystems[i].HighWaterBytes = SubsystemAccounting[i].HighWaterBytes.load(std::memory_order_relaxed);
+			}
+			return statistics;
+		}
+
+		std::string getLeakReport()
+		{
+			MEMORY_STATISTICS statistics = getMemoryStatistics();
+
+			std::string report;
+			for (size_t i = 0; i < NUMBER_OF_SUBSYSTEMS; i++)
+			{
+				SUBSYSTEM_STATISTICS &subsystemStatistics = statistics.Subsystems[i];
+				if (subsystemStatistics.BytesInUse != 0 || subsystemStatistics.Allocations != subsystemStatistics.Deallocations)
+				{
+					report += subsystemToString((Subsystem)i) + ": " + std::to_string(subsystemStatistics.BytesInUse) + " bytes in " + \
+						std::to_string(subsystemStatistics.Allocations - subsystemStatistics.Deallocations) + " outstanding allocation(s), high-water mark of " + \
+						std::to_string(subsystemStatistics.HighWaterBytes) + " bytes\n";
+				}
+			}
+			return report;
+		}
+	}
+}
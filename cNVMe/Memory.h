@@ -0,0 +1,182 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Memory.h - A header file for the size-class pooled memory allocator
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	namespace memory
+	{
+		/// <summary>
+		/// Allocations of up to this many bytes come from the size-class pools.
+		/// Anything larger goes straight to the heap.
+		/// </summary>
+		const size_t MAX_POOLED_ALLOCATION_SIZE = 1024 * 1024;
+
+		/// <summary>
+		/// Smallest size class. Every pooled allocation is at least this large.
+		/// </summary>
+		const size_t MIN_POOLED_ALLOCATION_SIZE = 64;
+
+		/// <summary>
+		/// Allocations are aligned to their size class, up to this many bytes (a page).
+		/// So nothing from allocate() shares a cache line with another allocation, and queues of a page or more start on a page.
+		/// </summary>
+		const size_t MAX_ALLOCATION_ALIGNMENT = 4096;
+
+		/// <summary>
+		/// Snapshot of the allocator statistics
+		/// </summary>
+		typedef struct ALLOCATION_STATISTICS
+		{
+			UINT_64 Allocations;        // Number of calls to allocate() that returned memory
+			UINT_64 Deallocations;      // Number of calls to deallocate() that freed memory
+			UINT_64 PoolHits;           // Pooled allocations served from a cache without touching the heap
+			UINT_64 PoolMisses;         // Pooled allocations that had to go to the heap
+			UINT_64 LargeAllocations;   // Allocations too large to be pooled
+			UINT_64 BytesInUse;         // Bytes currently handed out (rounded up to the size class)
+			UINT_64 BytesCached;        // Bytes sitting in the pools waiting to be reused
+		}ALLOCATION_STATISTICS, *PALLOCATION_STATISTICS;
+
+		/// <summary>
+		/// Parts of the simulator that memory is accounted to
+		/// </summary>
+		enum Subsystem : UINT_8
+		{
+			SUBSYSTEM_PAYLOAD,          // Payloads not claimed by anything more specific
+			SUBSYSTEM_PRP,              // PRP pages and PRP lists
+			SUBSYSTEM_QUEUE,            // Submission/completion queue memory
+			SUBSYSTEM_NAMESPACE,        // Namespace media
+			SUBSYSTEM_FIRMWARE_CACHE,   // Firmware image pieces waiting for a commit
+			NUMBER_OF_SUBSYSTEMS,
+		};
+
+		/// <summary>
+		/// Converts a Subsystem to a string
+		/// </summary>
+		/// <param name="subsystem">Subsystem to convert</param>
+		/// <returns>string</returns>
+		std::string subsystemToString(Subsystem subsystem);
+
+		/// <summary>
+		/// Snapshot of the accounting for one subsystem
+		/// </summary>
+		typedef struct SUBSYSTEM_STATISTICS
+		{
+			UINT_64 Allocations;        // Number of allocations accounted to this subsystem
+			UINT_64 Deallocations;      // Number of deallocations accounted to this subsystem
+			UINT_64 BytesInUse;         // Bytes currently accounted to this subsystem
+			UINT_64 HighWaterBytes;     // Most bytes ever accounted to this subsystem at once
+		}SUBSYSTEM_STATISTICS, *PSUBSYSTEM_STATISTICS;
+
+		/// <summary>
+		/// Snapshot of the allocator and every subsystem. This is also the layout handed out by the DLL.
+		/// </summary>
+		typedef struct MEMORY_STATISTICS
+		{
+			ALLOCATION_STATISTICS Allocator;
+			SUBSYSTEM_STATISTICS Subsystems[NUMBER_OF_SUBSYSTEMS];
+		}MEMORY_STATISTICS, *PMEMORY_STATISTICS;
+
+		/// <summary>
+		/// Allocates byteSize bytes. Pooled sizes are served from a per-thread cache first,
+		/// then from a shared pool, and only then from the heap.
+		/// The memory is aligned to the smaller of getUsableSize(byteSize) and MAX_ALLOCATION_ALIGNMENT.
+		/// </summary>
+		/// <param name="byteSize">Number of bytes to allocate</param>
+		/// <param name="zeroMemory">If true, the returned memory is set to 0. If false, contents are undefined.</param>
+		/// <param name="subsystem">Subsystem to account the memory to</param>
+		/// <returns>Pointer to the memory, nullptr if byteSize is 0</returns>
+		UINT_8* allocate(size_t byteSize, bool zeroMemory = true, Subsystem subsystem = SUBSYSTEM_PAYLOAD);
+
+		/// <summary>
+		/// Gives back memory from allocate(). byteSize must be the size it was allocated with
+		/// (or any size with the same getUsableSize()).
+		/// </summary>
+		/// <param name="pointer">Pointer from allocate()</param>
+		/// <param name="byteSize">Size given to allocate()</param>
+		/// <param name="subsystem">Subsystem the memory is accounted to</param>
+		void deallocate(UINT_8* pointer, size_t byteSize, Subsystem subsystem = SUBSYSTEM_PAYLOAD);
+
+		/// <summary>
+		/// Accounts memory that didn't come from allocate() to a subsystem
+		/// </summary>
+		/// <param name="subsystem">Subsystem to account to</param>
+		/// <param name="byteSize">Number of bytes</param>
+		void trackAllocation(Subsystem subsystem, size_t byteSize);
+
+		/// <summary>
+		/// Removes memory accounted via trackAllocation() from a subsystem
+		/// </summary>
+		/// <param name="subsystem">Subsystem it was accounted to</param>
+		/// <param name="byteSize">Number of bytes</param>
+		void trackDeallocation(Subsystem subsystem, size_t byteSize);
+
+		/// <summary>
+		/// Accounts for an allocation changing size in place
+		/// </summary>
+		/// <param name="subsystem">Subsystem it is accounted to</param>
+		/// <param name="oldByteSize">Previous size in bytes</param>
+		/// <param name="newByteSize">New size in bytes</param>
+		void trackResize(Subsystem subsystem, size_t oldByteSize, size_t newByteSize);
+
+		/// <summary>
+		/// Moves accounting for an allocation from one subsystem to another
+		/// </summary>
+		/// <param name="from">Subsystem it is accounted to now</param>
+		/// <param name="to">Subsystem it should be accounted to</param>
+		/// <param name="byteSize">Number of bytes</param>
+		void transferAccounting(Subsystem from, Subsystem to, size_t byteSize);
+
+		/// <summary>
+		/// Returns how many bytes are really reserved for an allocation of byteSize bytes.
+		/// A buffer may grow up to this size without being reallocated.
+		/// </summary>
+		/// <param name="byteSize">Number of bytes requested</param>
+		/// <returns>Usable size in bytes</returns>
+		size_t getUsableSize(size_t byteSize);
+
+		/// <summary>
+		/// Gets a snapshot of the allocator statistics
+		/// </summary>
+		/// <returns>ALLOCATION_STATISTICS</returns>
+		ALLOCATION_STATISTICS getAllocationStatistics();
+
+		/// <summary>
+		/// Gets a snapshot of the allocator statistics and the accounting for every subsystem
+		/// </summary>
+		/// <returns>MEMORY_STATISTICS</returns>
+		MEMORY_STATISTICS getMemoryStatistics();
+
+		/// <summary>
+		/// Builds a report of every subsystem that still has memory accounted to it.
+		/// Meant to be called once everything should have been freed.
+		/// </summary>
+		/// <returns>The report, empty if nothing is outstanding</returns>
+		std::string getLeakReport();
+	}
+}
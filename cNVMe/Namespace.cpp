@@ -24,28 +24,65 @@ Namespace.cpp - An implementation file for a cNVMe Namespace
 */
 
 #include "Constants.h"
+#include "Crc.h"
+#include "Memory.h"
 #include "Namespace.h"
 #include "PRP.h"
 #include "Tests.h"
 
-#define DEFAULT_NUMBER_OF_LBA_FORMAT 2; // 0-based!
+#define DEFAULT_NUMBER_OF_LBA_FORMAT 5; // 0-based!
 #define IEEE_OUI 0xCCAACC
 #define LBA_IN_BYTES_TO_LBADS(lbaSizeInBytes) ((UINT_8)(log2(lbaSizeInBytes)))
-#define GET_RANDOM_BYTE() (UINT_8)(rand() % ((UINT_8)-1)) // lol not really random. Make sure to call srand above this somewhere.
+#define GET_RANDOM_BYTE(randomDevice) (UINT_8)(randomDevice() & 0xFF) // Namespaces created in the same second still get different NGUIDs
 
 namespace cnvme
 {
 	namespace ns
 	{
+		/// <summary>
+		/// Reads a big endian field (like those in protection information)
+		/// </summary>
+		/// <param name="bytes">The field</param>
+		/// <param name="byteSize">Size of the field</param>
+		/// <returns>The value</returns>
+		static UINT_64 fromBigEndian(const UINT_8* bytes, size_t byteSize)
+		{
+			UINT_64 value = 0;
+			for (size_t i = 0; i < byteSize; i++)
+			{
+				value = (value << 8) | bytes[i];
+			}
+			return value;
+		}
+
+		/// <summary>
+		/// Writes a big endian field (like those in protection information)
+		/// </summary>
+		/// <param name="bytes">The field</param>
+		/// <param name="byteSize">Size of the field</param>
+		/// <param name="value">The value</param>
+		static void toBigEndian(UINT_8* bytes, size_t byteSize, UINT_64 value)
+		{
+			for (size_t i = byteSize; i > 0; i--)
+			{
+				bytes[i - 1] = (UINT_8)(value & 0xFF);
+				value >>= 8;
+			}
+		}
+
 		Namespace::Namespace()
 		{
 			memset(&this->IdentifyNamespace, 0, sizeof(this->IdentifyNamespace));
-			this->getIdentifyNamespaceStructure(); // make sure we are setup.
+			this->Media = std::make_shared<SparseMedia>(0);
+			this->updateIdentifyNamespaceStructure(); // make sure we are setup.
+			this->resetMetadata();
 		}
 
-		Namespace::Namespace(size_t SizeInBytes) : Namespace()
+		Namespace::Namespace(UINT_64 SizeInBytes) : Namespace()
 		{
-			Media = Payload(SizeInBytes);
+			Media = std::make_shared<SparseMedia>(SizeInBytes);
+			this->updateIdentifyNamespaceStructure(); // Size the structure to the new media
+			this->resetMetadata();
 		}
 
 		Namespace::~Namespace()
@@ -54,50 +91,78 @@ namespace cnvme
 		}
 
 		identify::structures::IDENTIFY_NAMESPACE& Namespace::getIdentifyNamespaceStructure()
+		{
+			// Only written chunks are backed, so that's what is in use. Chunks can be bigger than the last few sectors.
+			// This is the only field that changes with I/O, so it's the only one refreshed here.
+			this->IdentifyNamespace.NUSE = std::min(this->IdentifyNamespace.NSZE, this->Media->getAllocatedSize() / this->getSectorSize());
+
+			return this->IdentifyNamespace;
+		}
+
+		void Namespace::updateIdentifyNamespaceStructure()
 		{
 			// Assume this is the first call if NLBAF is 0.
 			// That way we generate the NGUID once.
 			if (this->IdentifyNamespace.NLBAF == 0)
 			{
-				srand((unsigned int)time(NULL)); // 'random' seed
+				std::random_device randomDevice;
 
 				for (size_t i = 0; i < sizeof(this->IdentifyNamespace.NGUID.VSEI); i++)
 				{
 					if (i < sizeof(this->IdentifyNamespace.NGUID.EI))
 					{
-						this->IdentifyNamespace.NGUID.EI[i] = GET_RANDOM_BYTE();
+						this->IdentifyNamespace.NGUID.EI[i] = GET_RANDOM_BYTE(randomDevice);
 					}
 					if (i < sizeof(this->IdentifyNamespace.NGUID.OUI))
 					{
 						this->IdentifyNamespace.NGUID.OUI[i] = (IEEE_OUI >> (i * 8)) & 0xFF;
 					}
-					this->IdentifyNamespace.NGUID.VSEI[i] = GET_RANDOM_BYTE();
+					this->IdentifyNamespace.NGUID.VSEI[i] = GET_RANDOM_BYTE(randomDevice);
 				}
 			}
 			this->IdentifyNamespace.NamespaceGUIDAndEUI64AreNotRepeated = 1;     // Will try hard not to repeat NGUID
+			this->IdentifyNamespace.NamespaceSupportsThinProvisioning = this->Media->isThinProvisioned();
 
-			this->IdentifyNamespace.NLBAF = DEFAULT_NUMBER_OF_LBA_FORMAT;        // support 512/4096/8192 byte sectors
+			this->IdentifyNamespace.NLBAF = DEFAULT_NUMBER_OF_LBA_FORMAT;        // support 512/4096/8192 byte sectors, then 512/4096 byte sectors with metadata
 			this->IdentifyNamespace.LBAF[0].LBADS = LBA_IN_BYTES_TO_LBADS(512);
 			this->IdentifyNamespace.LBAF[1].LBADS = LBA_IN_BYTES_TO_LBADS(4096);
 			this->IdentifyNamespace.LBAF[2].LBADS = LBA_IN_BYTES_TO_LBADS(8192);
+			this->IdentifyNamespace.LBAF[3].LBADS = LBA_IN_BYTES_TO_LBADS(512);
+			this->IdentifyNamespace.LBAF[3].MS = sizeof(command::PROTECTION_INFORMATION);
+			this->IdentifyNamespace.LBAF[4].LBADS = LBA_IN_BYTES_TO_LBADS(4096);
+			this->IdentifyNamespace.LBAF[4].MS = sizeof(command::PROTECTION_INFORMATION);
+			this->IdentifyNamespace.LBAF[5].LBADS = LBA_IN_BYTES_TO_LBADS(4096);
+			this->IdentifyNamespace.LBAF[5].MS = 16; // Room for the host's own metadata next to the protection information
+
+			// Metadata can be at the end of each LBA or in its own buffer, with any type of protection information at either end of it
+			this->IdentifyNamespace.MC = constants::commands::identify::mc::EXTENDED_LBA | constants::commands::identify::mc::SEPARATE_BUFFER;
+			this->IdentifyNamespace.DPC = constants::commands::identify::dpc::TYPE_1 | constants::commands::identify::dpc::TYPE_2 | constants::commands::identify::dpc::TYPE_3 |
+				constants::commands::identify::dpc::FIRST_EIGHT_BYTES | constants::commands::identify::dpc::LAST_EIGHT_BYTES;
 
 			auto currentLbaFormat = this->IdentifyNamespace.LBAF[this->IdentifyNamespace.FLBAS.CurrentLBAFormat];
 			ASSERT_IF(currentLbaFormat.LBADS < 9, "Minimum posssible selected LBADS should be 9. 2^9 = 512.");
 
 			this->IdentifyNamespace.NSZE = this->getNamespaceSizeInSectors();
 			this->IdentifyNamespace.NCAP = this->IdentifyNamespace.NSZE; // todo: dealloacted lbas should subtract from this one day.
-			this->IdentifyNamespace.NUSE = this->IdentifyNamespace.NSZE;
 
 			this->IdentifyNamespace.NMIC.NamespaceMayBeAttachedToMoreThanOneController = 1;
 
-			this->IdentifyNamespace.NVMCAP.NVMCAP_64[0] = this->Media.getSize(); // When we need more terabytes... let me know.
+			this->IdentifyNamespace.DLFEAT = constants::commands::identify::dlfeat::DEALLOCATED_READS_ZEROES; // Every kind of media gives back zeros
 
-			return this->IdentifyNamespace;
+			this->IdentifyNamespace.NVMCAP.NVMCAP_64[0] = this->Media->getSize(); // When we need more terabytes... let me know.
+
+			this->getIdentifyNamespaceStructure(); // NUSE
 		}
 
 		Payload Namespace::getIdentifyNamespaceDescriptorList()
 		{
-			Payload payload(sizeof(identify::structures::NAMESPACE_IDENTIFICATION_DESCRIPTOR_NGUID));
+			// Namespaces that aren't in the NVM Command Set say which one they are in
+			size_t payloadSize = sizeof(identify::structures::NAMESPACE_IDENTIFICATION_DESCRIPTOR_NGUID);
+			if (this->isZoned())
+			{
+				payloadSize += sizeof(identify::structures::NAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI);
+			}
+			Payload payload(payloadSize);
 
 			ASSERT_IF(payload.getSize() > 4096, "Per NVMe spec this cannot ever be larger than 4096 bytes");
 
@@ -107,15 +172,48 @@ namespace cnvme
 			pList->NIDL = constants::commands::identify::sizes::NGUID_SIZE;
 			pList->NGUID = this->getIdentifyNamespaceStructure().NGUID;
 
+			if (this->isZoned())
+			{
+				auto pCommandSet = (identify::structures::NAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI*)(pList + 1);
+				pCommandSet->NIDT = constants::commands::identify::ns_identifiers::COMMAND_SET_IDENTIFIER;
+				pCommandSet->NIDL = sizeof(pCommandSet->CSI);
+				pCommandSet->CSI = constants::commands::identify::csi::ZONED_NAMESPACE;
+			}
+
 			return payload;
 		}
 
+		identify::structures::IDENTIFY_NAMESPACE_ZONED Namespace::getIdentifyNamespaceZonedStructure()
+		{
+			identify::structures::IDENTIFY_NAMESPACE_ZONED identifyNamespaceZoned;
+			memset(&identifyNamespaceZoned, 0, sizeof(identifyNamespaceZoned));
+
+			// Any number of zones can be open or active at once
+			identifyNamespaceZoned.OZCS = constants::commands::identify::ozcs::READ_ACROSS_ZONE_BOUNDARIES;
+			identifyNamespaceZoned.MAR = constants::commands::identify::NO_ZONE_RESOURCE_LIMIT;
+			identifyNamespaceZoned.MOR = constants::commands::identify::NO_ZONE_RESOURCE_LIMIT;
+
+			// Zones hold the same amount of data in every LBA format
+			for (UINT_8 i = 0; i <= this->IdentifyNamespace.NLBAF; i++)
+			{
+				identifyNamespaceZoned.LBAFE[i].ZSZE = DEFAULT_ZONE_SIZE >> this->IdentifyNamespace.LBAF[i].LBADS;
+			}
+
+			return identifyNamespaceZoned;
+		}
+
 		command::COMPLETION_QUEUE_ENTRY Namespace::formatNVM(command::NVME_COMMAND nvmeCommand)
 		{
 			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
 
-			// we don't support metadata. We also should block invalid lba formats
-			if (nvmeCommand.DW10_Format.MSET || nvmeCommand.DW10_Format.PI || nvmeCommand.DW10_Format.PIL || nvmeCommand.DW10_Format.LBAF > this->IdentifyNamespace.NLBAF)
+			// Block invalid lba formats, and protection information without metadata to keep it in
+			bool invalidFormat = nvmeCommand.DW10_Format.LBAF > this->IdentifyNamespace.NLBAF || nvmeCommand.DW10_Format.PI > constants::commands::format::pi::TYPE_3;
+			if (!invalidFormat && nvmeCommand.DW10_Format.PI != constants::commands::format::pi::DISABLED)
+			{
+				invalidFormat = this->IdentifyNamespace.LBAF[nvmeCommand.DW10_Format.LBAF].MS < sizeof(command::PROTECTION_INFORMATION);
+			}
+
+			if (invalidFormat)
 			{
 				completionQueueEntry.DNR = true;
 				completionQueueEntry.SCT = constants::status::types::COMMAND_SPECIFIC;
@@ -125,27 +223,27 @@ namespace cnvme
 
 			// update or current lba format
 			this->IdentifyNamespace.FLBAS.CurrentLBAFormat = nvmeCommand.DW10_Format.LBAF;
+			this->IdentifyNamespace.FLBAS.MetadataAtEndOfData = nvmeCommand.DW10_Format.MSET;
+			this->IdentifyNamespace.DPS = (UINT_8)(nvmeCommand.DW10_Format.PI | (nvmeCommand.DW10_Format.PIL ? constants::commands::identify::dps::FIRST_EIGHT_BYTES : 0));
+			this->updateIdentifyNamespaceStructure(); // NSZE is in sectors of the new format
 
-			// delete the 'key'... in our case delete the Media and recreate it.
+			// delete the 'key'... in our case throw away every written chunk. In-memory media does that in O(1) and frees them in the background.
+			// Per NVMe spec the controller can do whatever for a user data erase as long as the data is gone, so all of these just deallocate.
 			if (nvmeCommand.DW10_Format.SES == constants::commands::format::ses::CRYPTOGRAPHIC_ERASE)
 			{
 				LOG_INFO("Performing a crypto erase");
-				this->Media = Payload(Media.getSize());
 			}
 			else if (nvmeCommand.DW10_Format.SES == constants::commands::format::ses::USER_DATA_ERASE)
 			{
 				LOG_INFO("Performing a user data erase");
-				// Per NVMe spec the controller can do whatever here as long as the data is gone... so we shall do some randomization.
-				for (size_t i = 0; i < 8; i++) // 8 is a number i picked without much reason.
-				{
-					tests::helpers::randomizePayload(this->Media);
-				}
 			}
 			else
 			{
 				LOG_INFO("Performing a non-secure erase");
-				memset(this->Media.getBuffer(), 0x00, this->Media.getSize());
 			}
+			this->Media->deallocateAll();
+			this->resetMetadata(); // Sized for the new format
+			this->resetZones();
 
 			return completionQueueEntry;
 		}
@@ -167,11 +265,28 @@ namespace cnvme
 				return completionQueueEntry;
 			}
 
+			if (this->getMetadataSize() != 0)
+			{
+				Payload hostMetadata;
+				completionQueueEntry = this->readWithMetadata(nvmeCommand, outputPayload, hostMetadata);
+				if (completionQueueEntry.succeeded() && hostMetadata.getSize() != 0)
+				{
+					memcpy((void*)nvmeCommand.CompleteMPTR, hostMetadata.getBuffer(), hostMetadata.getSize());
+				}
+				return completionQueueEntry;
+			}
+
 			UINT_64 transferSize = this->getSectorSize() * ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
 			UINT_64 byteOffset = this->getSectorSize() * nvmeCommand.SLBA;
 
 			// Give data back
-			outputPayload = Payload(this->Media.getBuffer() + byteOffset, (size_t)transferSize);
+			outputPayload = Payload((size_t)transferSize, false); // read() fills every byte
+			if (!this->Media->read(byteOffset, outputPayload.getBuffer(), (size_t)transferSize))
+			{
+				completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+				completionQueueEntry.SC = constants::status::codes::integrity::UNRECOVERED_READ_ERROR;
+				outputPayload = Payload();
+			}
 
 			return completionQueueEntry;
 		}
@@ -193,25 +308,605 @@ namespace cnvme
 				return completionQueueEntry;
 			}
 
+			if (this->getMetadataSize() != 0)
+			{
+				return this->writeWithMetadata(nvmeCommand, memoryPageSize);
+			}
+
 			UINT_64 transferSize = this->getSectorSize() * ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
 			UINT_64 byteOffset = this->getSectorSize() * nvmeCommand.SLBA;
 
 			// Get data from PRPs
 			PRP prps(nvmeCommand.DPTR.DPTR1, nvmeCommand.DPTR.DPTR2, (size_t)transferSize, memoryPageSize);
-			auto inputPayload = prps.getPayloadCopy();
+			auto inputPayload = prps.getSegmentedPayload();
 
-			// Give data back
-			memcpy_s(this->Media.getBuffer() + byteOffset, (size_t)(this->Media.getSize() - byteOffset), inputPayload.getBuffer(), (size_t)transferSize);
+			// Copy each PRP page straight to the media, no need for an intermediate contiguous copy
+			for (auto &segment : inputPayload.getSegments())
+			{
+				if (!this->Media->write(byteOffset, segment.first, segment.second))
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::WRITE_FAULT;
+					break;
+				}
+				byteOffset += segment.second;
+			}
+
+			return completionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::compare(command::NVME_COMMAND nvmeCommand, UINT_32 memoryPageSize)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			UINT_64 namespaceSizeInSectors = this->getNamespaceSizeInSectors();
+
+			// Make sure the LBA is in range
+			if (nvmeCommand.SLBA > namespaceSizeInSectors || nvmeCommand.SLBA + ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB) > namespaceSizeInSectors)
+			{
+				completionQueueEntry.DNR = true;
+				completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntry.SC = constants::status::codes::generic::LBA_OUT_OF_RANGE;
+				return completionQueueEntry;
+			}
+
+			if (this->getMetadataSize() != 0)
+			{
+				// Compare against what the host would read back, which checks the protection information on the way
+				Payload mediaData;
+				Payload mediaMetadata;
+				completionQueueEntry = this->readWithMetadata(nvmeCommand, mediaData, mediaMetadata);
+				if (!completionQueueEntry.succeeded())
+				{
+					return completionQueueEntry;
+				}
+
+				PRP prps(nvmeCommand.DPTR.DPTR1, nvmeCommand.DPTR.DPTR2, mediaData.getSize(), memoryPageSize);
+				Payload hostData = prps.getPayloadCopy();
+				if (memcmp(mediaData.getBuffer(), hostData.getBuffer(), mediaData.getSize()) != 0 ||
+					(mediaMetadata.getSize() != 0 && memcmp(mediaMetadata.getBuffer(), (const void*)nvmeCommand.CompleteMPTR, mediaMetadata.getSize()) != 0))
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::COMPARE_FAILURE;
+				}
+				return completionQueueEntry;
+			}
+
+			UINT_64 transferSize = this->getSectorSize() * ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			UINT_64 byteOffset = this->getSectorSize() * nvmeCommand.SLBA;
+
+			// Look at the host data where it is, a PRP page at a time
+			PRP prps(nvmeCommand.DPTR.DPTR1, nvmeCommand.DPTR.DPTR2, (size_t)transferSize, memoryPageSize);
+			auto hostPayload = prps.getSegmentedPayload();
+
+			size_t largestSegmentSize = 0;
+			for (auto &segment : hostPayload.getSegments())
+			{
+				largestSegmentSize = (std::max)(largestSegmentSize, segment.second);
+			}
+			Payload mediaData(largestSegmentSize, false); // read() fills every byte we compare
+
+			for (auto &segment : hostPayload.getSegments())
+			{
+				if (!this->Media->read(byteOffset, mediaData.getBuffer(), segment.second))
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::UNRECOVERED_READ_ERROR;
+					break;
+				}
+
+				// The C library's memcmp is vectorized and stops at the first differing word, so a miscompare ends the command early
+				if (memcmp(mediaData.getBuffer(), segment.first, segment.second) != 0)
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::COMPARE_FAILURE;
+					break;
+				}
+				byteOffset += segment.second;
+			}
+
+			return completionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::compareAndWrite(command::NVME_COMMAND compareCommand, command::NVME_COMMAND writeCommand, UINT_32 memoryPageSize, command::COMPLETION_QUEUE_ENTRY &writeCompletionQueueEntry)
+		{
+			writeCompletionQueueEntry = { 0 };
+
+			// Both halves have to be for the same LBAs
+			if (compareCommand.SLBA != writeCommand.SLBA || compareCommand.DW12_IO.NLB != writeCommand.DW12_IO.NLB)
+			{
+				writeCompletionQueueEntry.DNR = true;
+				writeCompletionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				writeCompletionQueueEntry.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return writeCompletionQueueEntry;
+			}
+
+			command::COMPLETION_QUEUE_ENTRY compareCompletionQueueEntry = this->compare(compareCommand, memoryPageSize);
+			if (!compareCompletionQueueEntry.succeeded())
+			{
+				writeCompletionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				writeCompletionQueueEntry.SC = constants::status::codes::generic::COMMAND_ABORTED_DUE_TO_FAILED_FUSED_COMMAND;
+				return compareCompletionQueueEntry;
+			}
+
+			writeCompletionQueueEntry = this->write(writeCommand, memoryPageSize);
+			return compareCompletionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::writeZeroes(command::NVME_COMMAND nvmeCommand)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			UINT_64 namespaceSizeInSectors = this->getNamespaceSizeInSectors();
+
+			// Make sure the LBA is in range
+			if (nvmeCommand.SLBA > namespaceSizeInSectors || nvmeCommand.SLBA + ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB) > namespaceSizeInSectors)
+			{
+				completionQueueEntry.DNR = true;
+				completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntry.SC = constants::status::codes::generic::LBA_OUT_OF_RANGE;
+				return completionQueueEntry;
+			}
+
+			UINT_64 byteSize = this->getSectorSize() * ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			UINT_64 byteOffset = this->getSectorSize() * nvmeCommand.SLBA;
+
+			// Every media reads zeros once deallocated, so there is nothing to write
+			if (!this->Media->deallocate(byteOffset, byteSize) || !this->deallocateMetadata(nvmeCommand.SLBA, ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB)))
+			{
+				completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+				completionQueueEntry.SC = constants::status::codes::integrity::WRITE_FAULT;
+			}
 
 			return completionQueueEntry;
 		}
 
+		command::COMPLETION_QUEUE_ENTRY Namespace::datasetManagement(command::NVME_COMMAND nvmeCommand, UINT_32 memoryPageSize)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			// The other attributes are only hints about how the ranges will be used
+			if (!nvmeCommand.DW11_DatasetManagement.AD)
+			{
+				return completionQueueEntry;
+			}
+
+			size_t numberOfRanges = ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW10_DatasetManagement.NR);
+			PRP prps(nvmeCommand.DPTR.DPTR1, nvmeCommand.DPTR.DPTR2, numberOfRanges * sizeof(command::DATASET_MANAGEMENT_RANGE), memoryPageSize);
+			Payload rangePayload = prps.getPayloadCopy();
+			auto pRanges = (command::DATASET_MANAGEMENT_RANGE*)rangePayload.getBuffer();
+
+			UINT_64 namespaceSizeInSectors = this->getNamespaceSizeInSectors();
+
+			// Make sure every range is in the namespace before throwing anything away
+			for (size_t i = 0; i < numberOfRanges; i++)
+			{
+				if (pRanges[i].StartingLBA > namespaceSizeInSectors || pRanges[i].LengthInLogicalBlocks > namespaceSizeInSectors - pRanges[i].StartingLBA)
+				{
+					completionQueueEntry.DNR = true;
+					completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntry.SC = constants::status::codes::generic::LBA_OUT_OF_RANGE;
+					return completionQueueEntry;
+				}
+			}
+
+			UINT_64 sectorSize = this->getSectorSize();
+			for (size_t i = 0; i < numberOfRanges; i++)
+			{
+				if (pRanges[i].LengthInLogicalBlocks == 0)
+				{
+					continue;
+				}
+
+				if (!this->Media->deallocate(pRanges[i].StartingLBA * sectorSize, pRanges[i].LengthInLogicalBlocks * sectorSize) ||
+					!this->deallocateMetadata(pRanges[i].StartingLBA, pRanges[i].LengthInLogicalBlocks))
+				{
+					LOG_ERROR("Failed to deallocate " + std::to_string(pRanges[i].LengthInLogicalBlocks) + " sectors at LBA " + std::to_string(pRanges[i].StartingLBA));
+					completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntry.SC = constants::status::codes::generic::INTERNAL_ERROR;
+					break;
+				}
+			}
+
+			return completionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::flush()
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			if (!this->Media->flush())
+			{
+				LOG_ERROR("Failed to flush the namespace media");
+				completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntry.SC = constants::status::codes::generic::INTERNAL_ERROR;
+			}
+
+			return completionQueueEntry;
+		}
+
+		bool Namespace::isZoned() const
+		{
+			return this->ZoneStates != nullptr;
+		}
+
+		bool Namespace::setZoned(bool zoned)
+		{
+			if (zoned && this->Media->getSize() % DEFAULT_ZONE_SIZE != 0)
+			{
+				LOG_ERROR("Zoned namespaces need to be a multiple of the zone size (" + std::to_string(DEFAULT_ZONE_SIZE) + " bytes)");
+				return false;
+			}
+
+			// Empty zones read as zeros, so nothing written before can stay
+			this->Media->deallocateAll();
+			this->resetMetadata();
+			this->deleteSnapshot();
+
+			this->ZoneStates = zoned ? std::make_shared<Zones>(0, 1) : nullptr; // Just marks the namespace as zoned for resetZones()
+			this->resetZones();
+			return true;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::reserveZoneWrite(command::NVME_COMMAND &nvmeCommand, ZONE_WRITE_RESERVATION &reservation)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+			memset(&reservation, 0, sizeof(reservation));
+			if (!this->ZoneStates)
+			{
+				return completionQueueEntry;
+			}
+
+			// Write Zeroes takes up LBAs in the zone like any other write
+			UINT_64 numberOfLbas = ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			if (nvmeCommand.DWord0Breakdown.OPC == constants::opcodes::nvm::ZONE_APPEND)
+			{
+				completionQueueEntry = this->ZoneStates->reserveAppend(nvmeCommand.SLBA, numberOfLbas, reservation);
+				if (completionQueueEntry.succeeded())
+				{
+					nvmeCommand.SLBA = reservation.FirstLba;
+				}
+				return completionQueueEntry;
+			}
+
+			return this->ZoneStates->reserveWrite(nvmeCommand.SLBA, numberOfLbas, reservation);
+		}
+
+		void Namespace::releaseZoneWrite(const ZONE_WRITE_RESERVATION &reservation)
+		{
+			if (this->ZoneStates)
+			{
+				this->ZoneStates->releaseWrite(reservation);
+			}
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::zoneManagementSend(command::NVME_COMMAND nvmeCommand, std::vector<UINT_64> &resetZoneStartLbas)
+		{
+			ASSERT_IF(!this->ZoneStates, "Zone management is only for zoned namespaces");
+
+			return this->ZoneStates->manage(nvmeCommand.SLBA, (UINT_8)nvmeCommand.DW13_ZoneManagementSend.ZSA, nvmeCommand.DW13_ZoneManagementSend.SELECT_ALL == 1, resetZoneStartLbas);
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::resetZoneData(const std::vector<UINT_64> &zoneStartLbas)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			UINT_64 sectorSize = this->getSectorSize();
+			UINT_64 zoneSize = this->ZoneStates->getZoneSize();
+			for (auto &zoneStartLba : zoneStartLbas)
+			{
+				if (!this->Media->deallocate(zoneStartLba * sectorSize, zoneSize * sectorSize) || !this->deallocateMetadata(zoneStartLba, zoneSize))
+				{
+					LOG_ERROR("Failed to throw away the data of the zone at LBA " + std::to_string(zoneStartLba));
+					completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+					completionQueueEntry.SC = constants::status::codes::generic::INTERNAL_ERROR;
+					break;
+				}
+			}
+
+			return completionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::zoneManagementReceive(command::NVME_COMMAND nvmeCommand, Payload &report)
+		{
+			ASSERT_IF(!this->ZoneStates, "Zone management is only for zoned namespaces");
+
+			// We don't have zone descriptor extensions, so there is nothing extended to report
+			if (nvmeCommand.DW13_ZoneManagementReceive.ZRA != constants::commands::zones::zra::REPORT_ZONES)
+			{
+				command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+				completionQueueEntry.DNR = true;
+				completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntry.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return completionQueueEntry;
+			}
+
+			// Nothing past the last descriptor is ever filled in, so don't make room for it however much the host asked for
+			UINT_64 reportSize = ONE_BASED_FROM_ZERO_BASED((UINT_64)nvmeCommand.NUMD) * sizeof(UINT_32);
+			UINT_64 largestReportSize = sizeof(command::ZONE_REPORT_HEADER) + this->ZoneStates->getNumberOfZones() * sizeof(command::ZONE_DESCRIPTOR);
+			report = Payload((size_t)(std::min)(reportSize, largestReportSize));
+
+			return this->ZoneStates->report(nvmeCommand.SLBA, (UINT_8)nvmeCommand.DW13_ZoneManagementReceive.ZRASF, nvmeCommand.DW13_ZoneManagementReceive.PARTIAL == 1, report);
+		}
+
+		bool Namespace::isAsynchronous() const
+		{
+			return this->Media->isAsynchronous();
+		}
+
+		bool Namespace::setVolatileWriteCache(bool enabled)
+		{
+			std::shared_ptr<WriteCacheMedia> writeCache = std::dynamic_pointer_cast<WriteCacheMedia>(this->Media);
+			if (enabled && !writeCache && this->Media->isPersistent())
+			{
+				this->Media = std::make_shared<WriteCacheMedia>(this->Media, WRITE_CACHE_SIZE);
+			}
+			else if (!enabled && writeCache)
+			{
+				if (!writeCache->flush())
+				{
+					LOG_ERROR("Failed to destage the write cache, so it is staying in front of the media");
+					return false;
+				}
+				this->Media = writeCache->getBackingMedia();
+			}
+
+			return true;
+		}
+
+		bool Namespace::hasVolatileWriteCache() const
+		{
+			return std::dynamic_pointer_cast<WriteCacheMedia>(this->Media) != nullptr;
+		}
+
+		bool Namespace::setFtl(const FTL_PARAMETERS &parameters)
+		{
+			if (this->hasVolatileWriteCache())
+			{
+				LOG_ERROR("The FTL model goes under the write cache, so the cache needs to be off to change it");
+				return false;
+			}
+
+			if (!FlashTranslationLayer::isValid(this->Media->getSize(), parameters))
+			{
+				LOG_ERROR("The FTL settings don't work for " + std::to_string(this->Media->getSize()) + " bytes of media. Over-provisioning needs more spare blocks than the high watermark.");
+				return false;
+			}
+
+			std::shared_ptr<FtlMedia> ftl = this->getFtl();
+			this->Media = std::make_shared<FtlMedia>(ftl ? ftl->getBackingMedia() : this->Media, parameters);
+			return true;
+		}
+
+		bool Namespace::removeFtl()
+		{
+			if (this->hasVolatileWriteCache())
+			{
+				LOG_ERROR("The FTL model goes under the write cache, so the cache needs to be off to change it");
+				return false;
+			}
+
+			std::shared_ptr<FtlMedia> ftl = this->getFtl();
+			if (ftl)
+			{
+				this->Media = ftl->getBackingMedia();
+			}
+			return true;
+		}
+
+		std::shared_ptr<FtlMedia> Namespace::getFtl() const
+		{
+			std::shared_ptr<WriteCacheMedia> writeCache = std::dynamic_pointer_cast<WriteCacheMedia>(this->Media);
+			return std::dynamic_pointer_cast<FtlMedia>(writeCache ? writeCache->getBackingMedia() : this->Media);
+		}
+
+		bool Namespace::setMedia(std::shared_ptr<ns::Media> media)
+		{
+			if (!media || media->getSize() == 0 || media->getSize() % this->getSectorSize() != 0)
+			{
+				LOG_ERROR("Media needs to be a non-zero multiple of the sector size (" + std::to_string(this->getSectorSize()) + " bytes)");
+				return false;
+			}
+
+			if (this->ZoneStates && media->getSize() % DEFAULT_ZONE_SIZE != 0)
+			{
+				LOG_ERROR("Media for a zoned namespace needs to be a multiple of the zone size (" + std::to_string(DEFAULT_ZONE_SIZE) + " bytes)");
+				return false;
+			}
+
+			this->Media = media;
+			this->updateIdentifyNamespaceStructure(); // Size the structure to the new media
+			this->resetMetadata();
+			this->resetZones();
+			return true;
+		}
+
+		std::shared_ptr<ns::Media> Namespace::getMedia() const
+		{
+			return this->Media;
+		}
+
+		std::shared_ptr<LbaRangeLock::Range> Namespace::reserveLbaRange(UINT_64 firstLba, UINT_64 numberOfLbas, bool exclusive)
+		{
+			return this->RangeLock.reserve(firstLba, numberOfLbas, exclusive);
+		}
+
+		bool Namespace::takeSnapshot()
+		{
+			std::shared_ptr<ns::Media> snapshot = this->Media->clone();
+			if (!snapshot)
+			{
+				LOG_ERROR("The namespace media can't be cloned, so it can't be snapshotted");
+				return false;
+			}
+
+			this->Snapshot = snapshot;
+			this->SnapshotZones = this->ZoneStates ? this->ZoneStates->clone() : nullptr;
+
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			this->SnapshotMetadata = this->Metadata->clone();
+			return true;
+		}
+
+		bool Namespace::revertToSnapshot()
+		{
+			if (!this->Snapshot)
+			{
+				LOG_ERROR("There is no snapshot to revert to");
+				return false;
+			}
+
+			// Clone the snapshot again so it stays as it is for next time
+			if (!this->setMedia(this->Snapshot->clone()))
+			{
+				return false;
+			}
+
+			// Like the metadata, zones only come back if they are still the same zones
+			if (this->ZoneStates && this->SnapshotZones && this->SnapshotZones->getZoneSize() == this->ZoneStates->getZoneSize())
+			{
+				this->ZoneStates = this->SnapshotZones->clone();
+			}
+
+			// The metadata only comes back if the namespace is still formatted the way it was
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			if (this->SnapshotMetadata && this->SnapshotMetadata->getSize() == this->Metadata->getSize())
+			{
+				this->Metadata = this->SnapshotMetadata->clone();
+			}
+			return true;
+		}
+
+		void Namespace::deleteSnapshot()
+		{
+			this->Snapshot = nullptr;
+			this->SnapshotZones = nullptr;
+
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			this->SnapshotMetadata = nullptr;
+		}
+
+		bool Namespace::saveImage(std::ostream &image)
+		{
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+
+			NAMESPACE_IMAGE_HEADER header = { 0 };
+			header.IdentifyNamespace = this->getIdentifyNamespaceStructure();
+			header.MediaSize = this->Media->getSize();
+			header.MetadataSize = this->Metadata->getSize();
+			header.NumberOfZones = this->ZoneStates ? this->ZoneStates->getNumberOfZones() : 0;
+			image.write((const char*)&header, sizeof(header));
+
+			if (!this->Media->saveImage(image) || !this->Metadata->saveImage(image))
+			{
+				return false;
+			}
+
+			if (this->ZoneStates)
+			{
+				std::vector<command::ZONE_DESCRIPTOR> zoneDescriptors = this->ZoneStates->getDescriptors();
+				image.write((const char*)zoneDescriptors.data(), zoneDescriptors.size() * sizeof(command::ZONE_DESCRIPTOR));
+			}
+			return image.good();
+		}
+
+		bool Namespace::loadImage(std::istream &image)
+		{
+			NAMESPACE_IMAGE_HEADER header = { 0 };
+			if (!image.read((char*)&header, sizeof(header)))
+			{
+				LOG_ERROR("The image ended before the namespace header");
+				return false;
+			}
+
+			// Every namespace has the same LBA formats, so the image's has to be one of ours
+			UINT_8 lbaFormat = header.IdentifyNamespace.FLBAS.CurrentLBAFormat;
+			if (lbaFormat > this->IdentifyNamespace.NLBAF ||
+				header.IdentifyNamespace.LBAF[lbaFormat].LBADS != this->IdentifyNamespace.LBAF[lbaFormat].LBADS ||
+				header.IdentifyNamespace.LBAF[lbaFormat].MS != this->IdentifyNamespace.LBAF[lbaFormat].MS)
+			{
+				LOG_ERROR("The image's LBA format (" + std::to_string(lbaFormat) + ") isn't one this namespace supports");
+				return false;
+			}
+
+			UINT_64 sectorSize = (UINT_64)1 << header.IdentifyNamespace.LBAF[lbaFormat].LBADS;
+			if (header.MediaSize == 0 || header.MediaSize % sectorSize != 0 ||
+				header.MetadataSize != header.MediaSize / sectorSize * header.IdentifyNamespace.LBAF[lbaFormat].MS)
+			{
+				LOG_ERROR("The image's media size (" + std::to_string(header.MediaSize) + " bytes) doesn't fit its LBA format");
+				return false;
+			}
+
+			UINT_64 zoneSize = DEFAULT_ZONE_SIZE / sectorSize;
+			if (header.NumberOfZones != 0 && header.NumberOfZones * zoneSize * sectorSize != header.MediaSize)
+			{
+				LOG_ERROR("The image's " + std::to_string(header.NumberOfZones) + " zones don't cover its media");
+				return false;
+			}
+
+			// Images load into memory. Anything else (a file, deduplicated media, or the write cache that only goes on files) would be lost.
+			std::shared_ptr<FtlMedia> ftl = this->getFtl();
+			if (!std::dynamic_pointer_cast<SparseMedia>(ftl ? ftl->getBackingMedia() : this->Media))
+			{
+				LOG_ERROR("Images only load into namespaces on in-memory media. Put the namespace back on in-memory media first.");
+				return false;
+			}
+
+			if (ftl && !FlashTranslationLayer::isValid(header.MediaSize, ftl->getParameters()))
+			{
+				LOG_ERROR("The namespace's FTL settings don't work for the image's " + std::to_string(header.MediaSize) + " bytes of media");
+				return false;
+			}
+
+			// Load everything before changing anything, so a bad image leaves the namespace as it was
+			std::shared_ptr<ns::Media> media = std::make_shared<SparseMedia>(header.MediaSize);
+			std::shared_ptr<ns::Media> metadata = std::make_shared<SparseMedia>(header.MetadataSize);
+			if (!media->loadImage(image) || !metadata->loadImage(image))
+			{
+				return false;
+			}
+
+			if (ftl)
+			{
+				// The FTL model stays on, starting over like a new drive
+				LOG_INFO("The namespace's FTL model is reset for the loaded image");
+				media = std::make_shared<FtlMedia>(media, ftl->getParameters());
+			}
+
+			std::shared_ptr<Zones> zones;
+			if (header.NumberOfZones != 0)
+			{
+				std::vector<command::ZONE_DESCRIPTOR> zoneDescriptors((size_t)header.NumberOfZones);
+				if (!image.read((char*)zoneDescriptors.data(), zoneDescriptors.size() * sizeof(command::ZONE_DESCRIPTOR)))
+				{
+					LOG_ERROR("The image ended before its zone descriptors");
+					return false;
+				}
+
+				zones = std::make_shared<Zones>(header.NumberOfZones, zoneSize);
+				if (!zones->setDescriptors(zoneDescriptors))
+				{
+					return false;
+				}
+			}
+
+			this->deleteSnapshot();
+			this->IdentifyNamespace = header.IdentifyNamespace;
+			this->Media = media;
+			this->ZoneStates = zones;
+			this->updateIdentifyNamespaceStructure(); // Brings NUSE (and anything we report differently now) up to date
+
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			this->Metadata = metadata;
+			return true;
+		}
+
 		UINT_64 Namespace::getNamespaceSizeInSectors()
 		{
 			UINT_32 sectorSize = this->getSectorSize();
-			ASSERT_IF(this->Media.getSize() % sectorSize != 0, "The media's size needs to be divisible by the namespace sector size");
+			ASSERT_IF(this->Media->getSize() % sectorSize != 0, "The media's size needs to be divisible by the namespace sector size");
 
-			UINT_64 namespaceSizeInSectors = this->Media.getSize() / sectorSize;
+			UINT_64 namespaceSizeInSectors = this->Media->getSize() / sectorSize;
 			return namespaceSizeInSectors;
 		}
 
@@ -221,5 +916,333 @@ namespace cnvme
 			ASSERT_IF(sectorSize < 512, "Sector size shouldn't be less than 512!");
 			return sectorSize;
 		}
+
+		UINT_32 Namespace::getMetadataSize()
+		{
+			return this->IdentifyNamespace.LBAF[this->IdentifyNamespace.FLBAS.CurrentLBAFormat].MS;
+		}
+
+		UINT_32 Namespace::getHostMetadataSize(const command::NVME_COMMAND &nvmeCommand)
+		{
+			if ((nvmeCommand.DW12_IO.PRINFO & constants::commands::io::prinfo::PRACT) &&
+				this->getProtectionInformationType() != constants::commands::format::pi::DISABLED &&
+				this->getMetadataSize() == sizeof(command::PROTECTION_INFORMATION))
+			{
+				return 0;
+			}
+
+			return this->getMetadataSize();
+		}
+
+		UINT_32 Namespace::getProtectionInformationType()
+		{
+			return this->IdentifyNamespace.DPS & constants::commands::identify::dps::PI_TYPE_MASK;
+		}
+
+		void Namespace::resetMetadata()
+		{
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			if (this->Metadata)
+			{
+				this->Metadata->deallocateAll(); // Frees the old metadata in the background
+			}
+			this->Metadata = std::make_shared<SparseMedia>(this->getNamespaceSizeInSectors() * this->getMetadataSize());
+		}
+
+		void Namespace::resetZones()
+		{
+			if (this->ZoneStates)
+			{
+				UINT_64 zoneSize = DEFAULT_ZONE_SIZE / this->getSectorSize();
+				this->ZoneStates = std::make_shared<Zones>(this->getNamespaceSizeInSectors() / zoneSize, zoneSize);
+			}
+		}
+
+		bool Namespace::readMetadata(UINT_64 firstLba, UINT_64 numberOfLbas, UINT_8* buffer)
+		{
+			UINT_32 metadataSize = this->getMetadataSize();
+			size_t byteSize = (size_t)(numberOfLbas * metadataSize);
+
+			{
+				std::unique_lock<std::mutex> lock(this->MetadataMutex);
+				if (!this->Metadata->read(firstLba * metadataSize, buffer, byteSize))
+				{
+					return false;
+				}
+			}
+
+			for (size_t i = 0; i < byteSize; i++)
+			{
+				buffer[i] = ~buffer[i];
+			}
+			return true;
+		}
+
+		bool Namespace::writeMetadata(UINT_64 firstLba, UINT_64 numberOfLbas, const UINT_8* buffer)
+		{
+			UINT_32 metadataSize = this->getMetadataSize();
+			Payload inverted((size_t)(numberOfLbas * metadataSize), false); // Every byte is filled in below
+			UINT_8* pInverted = inverted.getBuffer();
+			for (size_t i = 0; i < inverted.getSize(); i++)
+			{
+				pInverted[i] = ~buffer[i];
+			}
+
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			return this->Metadata->write(firstLba * metadataSize, pInverted, inverted.getSize());
+		}
+
+		bool Namespace::deallocateMetadata(UINT_64 firstLba, UINT_64 numberOfLbas)
+		{
+			UINT_32 metadataSize = this->getMetadataSize();
+			if (metadataSize == 0)
+			{
+				return true;
+			}
+
+			std::unique_lock<std::mutex> lock(this->MetadataMutex);
+			return this->Metadata->deallocate(firstLba * metadataSize, numberOfLbas * metadataSize);
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::readWithMetadata(const command::NVME_COMMAND &nvmeCommand, Payload &hostData, Payload &hostMetadata)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			UINT_64 numberOfLbas = ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			UINT_32 sectorSize = this->getSectorSize();
+			UINT_32 metadataSize = this->getMetadataSize();
+			UINT_32 hostMetadataSize = this->getHostMetadataSize(nvmeCommand);
+			bool extendedLba = this->IdentifyNamespace.FLBAS.MetadataAtEndOfData;
+
+			if (!extendedLba && hostMetadataSize != 0 && nvmeCommand.CompleteMPTR == 0)
+			{
+				LOG_ERROR("The namespace has metadata in a separate buffer, but the command has no metadata pointer");
+				completionQueueEntry.DNR = true;
+				completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntry.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return completionQueueEntry;
+			}
+
+			Payload data((size_t)(sectorSize * numberOfLbas), false); // read() fills every byte
+			Payload metadata((size_t)(metadataSize * numberOfLbas), false); // So does readMetadata()
+			if (!this->Media->read(sectorSize * nvmeCommand.SLBA, data.getBuffer(), data.getSize()) ||
+				!this->readMetadata(nvmeCommand.SLBA, numberOfLbas, metadata.getBuffer()))
+			{
+				completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+				completionQueueEntry.SC = constants::status::codes::integrity::UNRECOVERED_READ_ERROR;
+				return completionQueueEntry;
+			}
+
+			if (!this->checkProtectionInformation(nvmeCommand, data.getBuffer(), metadata.getBuffer(), completionQueueEntry))
+			{
+				return completionQueueEntry;
+			}
+
+			if (hostMetadataSize == 0)
+			{
+				// The controller strips the protection information, which was all of the metadata
+				hostData = std::move(data);
+			}
+			else if (extendedLba)
+			{
+				hostData = Payload((size_t)((sectorSize + metadataSize) * numberOfLbas), false); // Every byte is filled in below
+				UINT_8* pHostData = hostData.getBuffer();
+				for (UINT_64 i = 0; i < numberOfLbas; i++)
+				{
+					memcpy(pHostData, data.getBuffer() + i * sectorSize, sectorSize);
+					pHostData += sectorSize;
+					memcpy(pHostData, metadata.getBuffer() + i * metadataSize, metadataSize);
+					pHostData += metadataSize;
+				}
+			}
+			else
+			{
+				hostData = std::move(data);
+				hostMetadata = std::move(metadata);
+			}
+
+			return completionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Namespace::writeWithMetadata(const command::NVME_COMMAND &nvmeCommand, UINT_32 memoryPageSize)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+
+			UINT_64 numberOfLbas = ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			UINT_32 sectorSize = this->getSectorSize();
+			UINT_32 metadataSize = this->getMetadataSize();
+			UINT_32 hostMetadataSize = this->getHostMetadataSize(nvmeCommand);
+			bool extendedLba = this->IdentifyNamespace.FLBAS.MetadataAtEndOfData;
+
+			if (!extendedLba && hostMetadataSize != 0 && nvmeCommand.CompleteMPTR == 0)
+			{
+				LOG_ERROR("The namespace has metadata in a separate buffer, but the command has no metadata pointer");
+				completionQueueEntry.DNR = true;
+				completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+				completionQueueEntry.SC = constants::status::codes::generic::INVALID_FIELD_IN_COMMAND;
+				return completionQueueEntry;
+			}
+
+			UINT_64 hostSectorSize = sectorSize + (extendedLba ? hostMetadataSize : 0);
+			PRP prps(nvmeCommand.DPTR.DPTR1, nvmeCommand.DPTR.DPTR2, (size_t)(hostSectorSize * numberOfLbas), memoryPageSize);
+			Payload hostData = prps.getPayloadCopy();
+
+			Payload data;
+			Payload metadata((size_t)(metadataSize * numberOfLbas)); // Zeros where the controller inserts protection information
+			if (hostSectorSize == sectorSize)
+			{
+				data = std::move(hostData);
+				if (hostMetadataSize != 0)
+				{
+					memcpy(metadata.getBuffer(), (const void*)nvmeCommand.CompleteMPTR, metadata.getSize());
+				}
+			}
+			else
+			{
+				data = Payload((size_t)(sectorSize * numberOfLbas), false); // Every byte is filled in below
+				const UINT_8* pHostData = hostData.getBuffer();
+				for (UINT_64 i = 0; i < numberOfLbas; i++)
+				{
+					memcpy(data.getBuffer() + i * sectorSize, pHostData, sectorSize);
+					pHostData += sectorSize;
+					memcpy(metadata.getBuffer() + i * metadataSize, pHostData, metadataSize);
+					pHostData += metadataSize;
+				}
+			}
+
+			// Nothing is written unless the whole command's protection information is good
+			if ((nvmeCommand.DW12_IO.PRINFO & constants::commands::io::prinfo::PRACT) && this->getProtectionInformationType() != constants::commands::format::pi::DISABLED)
+			{
+				this->generateProtectionInformation(nvmeCommand, data.getBuffer(), metadata.getBuffer());
+			}
+			else if (!this->checkProtectionInformation(nvmeCommand, data.getBuffer(), metadata.getBuffer(), completionQueueEntry))
+			{
+				return completionQueueEntry;
+			}
+
+			if (!this->Media->write(sectorSize * nvmeCommand.SLBA, data.getBuffer(), data.getSize()) ||
+				!this->writeMetadata(nvmeCommand.SLBA, numberOfLbas, metadata.getBuffer()))
+			{
+				completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+				completionQueueEntry.SC = constants::status::codes::integrity::WRITE_FAULT;
+			}
+
+			return completionQueueEntry;
+		}
+
+		bool Namespace::checkProtectionInformation(const command::NVME_COMMAND &nvmeCommand, const UINT_8* data, const UINT_8* metadata, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			UINT_32 protectionInformationType = this->getProtectionInformationType();
+			UINT_8 checks = nvmeCommand.DW12_IO.PRINFO & (constants::commands::io::prinfo::CHECK_GUARD | constants::commands::io::prinfo::CHECK_APPLICATION_TAG | constants::commands::io::prinfo::CHECK_REFERENCE_TAG);
+			if (protectionInformationType == constants::commands::format::pi::DISABLED || checks == 0)
+			{
+				return true;
+			}
+
+			// Type 1 reference tags are the low 32 bits of the LBA, so the command has to start from that one
+			if ((checks & constants::commands::io::prinfo::CHECK_REFERENCE_TAG) && protectionInformationType == constants::commands::format::pi::TYPE_1 &&
+				nvmeCommand.EILBRT != (UINT_32)nvmeCommand.SLBA)
+			{
+				completionQueueEntry.DNR = true;
+				completionQueueEntry.SCT = constants::status::types::COMMAND_SPECIFIC;
+				completionQueueEntry.SC = constants::status::codes::specific::INVALID_PROTECTION_INFORMATION;
+				return false;
+			}
+
+			UINT_64 numberOfLbas = ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			UINT_32 sectorSize = this->getSectorSize();
+			UINT_32 metadataSize = this->getMetadataSize();
+			UINT_32 protectionInformationOffset = this->getProtectionInformationOffset();
+
+			for (UINT_64 i = 0; i < numberOfLbas; i++)
+			{
+				const UINT_8* lbaData = data + i * sectorSize;
+				const UINT_8* lbaMetadata = metadata + i * metadataSize;
+				auto pProtectionInformation = (const command::PROTECTION_INFORMATION*)(lbaMetadata + protectionInformationOffset);
+				UINT_16 applicationTag = (UINT_16)fromBigEndian(pProtectionInformation->ApplicationTag, sizeof(pProtectionInformation->ApplicationTag));
+				UINT_32 referenceTag = (UINT_32)fromBigEndian(pProtectionInformation->ReferenceTag, sizeof(pProtectionInformation->ReferenceTag));
+
+				// Escaped LBAs (like deallocated ones, which read as all FFh) aren't checked
+				if (applicationTag == constants::commands::io::tags::ESCAPE_APPLICATION_TAG &&
+					(protectionInformationType != constants::commands::format::pi::TYPE_3 || referenceTag == constants::commands::io::tags::ESCAPE_REFERENCE_TAG))
+				{
+					continue;
+				}
+
+				if ((checks & constants::commands::io::prinfo::CHECK_GUARD) &&
+					fromBigEndian(pProtectionInformation->Guard, sizeof(pProtectionInformation->Guard)) != this->getGuard(lbaData, lbaMetadata))
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::END_TO_END_GUARD_CHECK_ERROR;
+					return false;
+				}
+
+				if ((checks & constants::commands::io::prinfo::CHECK_APPLICATION_TAG) && ((applicationTag ^ nvmeCommand.DW15_IO.ELBAT) & nvmeCommand.DW15_IO.ELBATM) != 0)
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::END_TO_END_APPLICATION_TAG_CHECK_ERROR;
+					return false;
+				}
+
+				if ((checks & constants::commands::io::prinfo::CHECK_REFERENCE_TAG) && referenceTag != this->getExpectedReferenceTag(nvmeCommand, i))
+				{
+					completionQueueEntry.SCT = constants::status::types::MEDIA_AND_DATA_INTEGRITY;
+					completionQueueEntry.SC = constants::status::codes::integrity::END_TO_END_REFERENCE_TAG_CHECK_ERROR;
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		void Namespace::generateProtectionInformation(const command::NVME_COMMAND &nvmeCommand, const UINT_8* data, UINT_8* metadata)
+		{
+			UINT_64 numberOfLbas = ONE_BASED_FROM_ZERO_BASED(nvmeCommand.DW12_IO.NLB);
+			UINT_32 sectorSize = this->getSectorSize();
+			UINT_32 metadataSize = this->getMetadataSize();
+			UINT_32 protectionInformationOffset = this->getProtectionInformationOffset();
+
+			for (UINT_64 i = 0; i < numberOfLbas; i++)
+			{
+				const UINT_8* lbaData = data + i * sectorSize;
+				UINT_8* lbaMetadata = metadata + i * metadataSize;
+				auto pProtectionInformation = (command::PROTECTION_INFORMATION*)(lbaMetadata + protectionInformationOffset);
+
+				toBigEndian(pProtectionInformation->Guard, sizeof(pProtectionInformation->Guard), this->getGuard(lbaData, lbaMetadata));
+				toBigEndian(pProtectionInformation->ApplicationTag, sizeof(pProtectionInformation->ApplicationTag), nvmeCommand.DW15_IO.ELBAT);
+				toBigEndian(pProtectionInformation->ReferenceTag, sizeof(pProtectionInformation->ReferenceTag), this->getExpectedReferenceTag(nvmeCommand, i));
+			}
+		}
+
+		UINT_16 Namespace::getGuard(const UINT_8* data, const UINT_8* metadata)
+		{
+			UINT_16 guard = crc::crc16T10Dif(data, this->getSectorSize());
+
+			// Protection information in the last 8 bytes also covers the metadata in front of it
+			UINT_32 protectionInformationOffset = this->getProtectionInformationOffset();
+			if (protectionInformationOffset != 0)
+			{
+				guard = crc::crc16T10Dif(metadata, protectionInformationOffset, guard);
+			}
+			return guard;
+		}
+
+		UINT_32 Namespace::getProtectionInformationOffset()
+		{
+			if (this->IdentifyNamespace.DPS & constants::commands::identify::dps::FIRST_EIGHT_BYTES)
+			{
+				return 0;
+			}
+			return this->getMetadataSize() - sizeof(command::PROTECTION_INFORMATION);
+		}
+
+		UINT_32 Namespace::getExpectedReferenceTag(const command::NVME_COMMAND &nvmeCommand, UINT_64 lbaIndex)
+		{
+			if (this->getProtectionInformationType() == constants::commands::format::pi::TYPE_3)
+			{
+				return nvmeCommand.EILBRT;
+			}
+			return (UINT_32)(nvmeCommand.EILBRT + lbaIndex);
+		}
 	}
 }
\ No newline at end of file
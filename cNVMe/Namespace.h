@@ -27,6 +27,12 @@ Namespace.h - A header file for a cNVMe Namespace
 
 #include "Command.h"
 #include "Identify.h"
+#include "LbaRangeLock.h"
+#include "Media.h"
+#include "Zones.h"
+
+#include <memory>
+#include <mutex>
 
 #define DEFAULT_SECTOR_SIZE 512
 
@@ -34,6 +40,18 @@ namespace cnvme
 {
 	namespace ns
 	{
+		/// <summary>
+		/// Starts a namespace in an image. The media's image (see Media::saveImage()) follows, then the metadata's,
+		///   then a command::ZONE_DESCRIPTOR for each zone.
+		/// </summary>
+		typedef struct NAMESPACE_IMAGE_HEADER
+		{
+			identify::structures::IDENTIFY_NAMESPACE IdentifyNamespace; // LBA format, protection information settings and NGUID
+			UINT_64 MediaSize;
+			UINT_64 MetadataSize;
+			UINT_64 NumberOfZones; // 0 if the namespace isn't zoned
+		} NAMESPACE_IMAGE_HEADER, *PNAMESPACE_IMAGE_HEADER;
+
 		class Namespace
 		{
 		public:
@@ -43,9 +61,10 @@ namespace cnvme
 			Namespace();
 
 			/// <summary>
-			/// Constructor for namespace that takes in a size
+			/// Constructor for namespace that takes in a size.
+			/// The media is sparse, so nothing is allocated until it is written.
 			/// </summary>
-			Namespace(size_t SizeInBytes);
+			Namespace(UINT_64 SizeInBytes);
 
 			/// <summary>
 			/// Destructor for namespace
@@ -53,7 +72,7 @@ namespace cnvme
 			~Namespace();
 
 			/// <summary>
-			/// Returns the Identify Namespace structure
+			/// Returns the Identify Namespace structure (with NUSE brought up to date)
 			/// </summary>
 			/// <returns>IDENTIFY_NAMESPACE</returns>
 			identify::structures::IDENTIFY_NAMESPACE& getIdentifyNamespaceStructure();
@@ -64,6 +83,12 @@ namespace cnvme
 			/// <returns>Payload</returns>
 			Payload getIdentifyNamespaceDescriptorList();
 
+			/// <summary>
+			/// Returns the Identify Namespace structure for the Zoned Namespace Command Set. Only meaningful if isZoned().
+			/// </summary>
+			/// <returns>IDENTIFY_NAMESPACE_ZONED</returns>
+			identify::structures::IDENTIFY_NAMESPACE_ZONED getIdentifyNamespaceZonedStructure();
+
 			/// <summary>
 			/// Perform a format NVM command on the given namespace.
 			/// </summary>
@@ -87,7 +112,223 @@ namespace cnvme
 			/// <returns>Completion queue entry for command</returns>
 			command::COMPLETION_QUEUE_ENTRY write(command::NVME_COMMAND nvmeCommand, UINT_32 memoryPageSize);
 
+			/// <summary>
+			/// Performs an NVM Compare command on the given namespace.
+			/// The host data is checked against the media a PRP page at a time, stopping at the first difference.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command for the compare</param>
+			/// <param name="memoryPageSize">size of the memory page</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY compare(command::NVME_COMMAND nvmeCommand, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Performs a fused Compare and Write on the given namespace.
+			/// The write only happens if the compare passes. Nothing else may touch the LBAs in between:
+			///   on asynchronous media the caller holds an exclusive reserveLbaRange() over them for the whole call.
+			/// </summary>
+			/// <param name="compareCommand">Complete NVMe command for the compare (the first fused command)</param>
+			/// <param name="writeCommand">Complete NVMe command for the write (the second fused command)</param>
+			/// <param name="memoryPageSize">size of the memory page</param>
+			/// <param name="writeCompletionQueueEntry">Filled in with the completion queue entry for the write</param>
+			/// <returns>Completion queue entry for the compare</returns>
+			command::COMPLETION_QUEUE_ENTRY compareAndWrite(command::NVME_COMMAND compareCommand, command::NVME_COMMAND writeCommand, UINT_32 memoryPageSize, command::COMPLETION_QUEUE_ENTRY &writeCompletionQueueEntry);
+
+			/// <summary>
+			/// Performs an NVM Write Zeroes command on the given namespace.
+			/// No data comes from the host. The range is deallocated from the media, which then reads as zeros.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command for the write zeroes</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY writeZeroes(command::NVME_COMMAND nvmeCommand);
+
+			/// <summary>
+			/// Performs an NVM Dataset Management command on the given namespace.
+			/// Only the deallocate attribute does anything. The ranges give their space back to the media and read as zeros afterwards.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command for the dataset management</param>
+			/// <param name="memoryPageSize">size of the memory page</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY datasetManagement(command::NVME_COMMAND nvmeCommand, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Returns true if the namespace uses the Zoned Namespace Command Set
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isZoned() const;
+
+			/// <summary>
+			/// Moves the namespace to the Zoned Namespace Command Set, or back to the NVM Command Set.
+			/// Every zone starts empty, so whatever was written is thrown away.
+			/// </summary>
+			/// <param name="zoned">true for zones</param>
+			/// <returns>true on success. false if the media isn't a whole number of zones (DEFAULT_ZONE_SIZE bytes each).</returns>
+			bool setZoned(bool zoned);
+
+			/// <summary>
+			/// Checks a Write, Write Zeroes or Zone Append against its zone and moves the zone's write pointer past it.
+			/// A Zone Append's SLBA is changed to where the data lands. Call in submission order, before the data is written.
+			/// Does nothing for namespaces that aren't zoned.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command for the write</param>
+			/// <param name="reservation">Filled in with what the write took up in its zone, for releaseZoneWrite()</param>
+			/// <returns>Completion queue entry with the error if the write isn't allowed</returns>
+			command::COMPLETION_QUEUE_ENTRY reserveZoneWrite(command::NVME_COMMAND &nvmeCommand, ZONE_WRITE_RESERVATION &reservation);
+
+			/// <summary>
+			/// Gives back what reserveZoneWrite() took up for a write that failed, if no later write or zone management built on it
+			/// </summary>
+			/// <param name="reservation">From reserveZoneWrite()</param>
+			void releaseZoneWrite(const ZONE_WRITE_RESERVATION &reservation);
+
+			/// <summary>
+			/// Performs the zone state change of a Zone Management Send command. Call in submission order.
+			/// The data of reset zones is left for resetZoneData(), so it can wait for writes to them that are still running.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command for the zone management send</param>
+			/// <param name="resetZoneStartLbas">Filled in with the first LBA of each zone that was reset</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY zoneManagementSend(command::NVME_COMMAND nvmeCommand, std::vector<UINT_64> &resetZoneStartLbas);
+
+			/// <summary>
+			/// Throws away the data of zones that were reset. They read as zeros afterwards.
+			/// </summary>
+			/// <param name="zoneStartLbas">First LBA of each zone</param>
+			/// <returns>Completion queue entry for the Zone Management Send that reset them</returns>
+			command::COMPLETION_QUEUE_ENTRY resetZoneData(const std::vector<UINT_64> &zoneStartLbas);
+
+			/// <summary>
+			/// Performs a Zone Management Receive command (Report Zones) on the given namespace
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command for the zone management receive</param>
+			/// <param name="report">Filled in with the report for the host</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY zoneManagementReceive(command::NVME_COMMAND nvmeCommand, Payload &report);
+
+			/// <summary>
+			/// Performs an NVM Flush command on the given namespace
+			/// </summary>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY flush();
+
+			/// <summary>
+			/// Returns true if I/O to this namespace should run on the controller's I/O threads and complete asynchronously
+			/// </summary>
+			/// <returns>bool</returns>
+			bool isAsynchronous() const;
+
+			/// <summary>
+			/// Gets the sector size for this namespace (in bytes).
+			/// </summary>
+			/// <returns>sector size</returns>
+			UINT_32 getSectorSize();
+
+			/// <summary>
+			/// Puts a volatile write cache in front of the media, or takes it away (destaging everything first).
+			/// In-memory media isn't persistent, so there is nothing to cache for and it is left alone.
+			/// </summary>
+			/// <param name="enabled">true to cache writes</param>
+			/// <returns>true unless the cache couldn't be destaged</returns>
+			bool setVolatileWriteCache(bool enabled);
+
+			/// <summary>
+			/// Returns true if writes to this namespace land in a volatile write cache
+			/// </summary>
+			/// <returns>bool</returns>
+			bool hasVolatileWriteCache() const;
+
+			/// <summary>
+			/// Puts a new FlashTranslationLayer model in front of the media (replacing any older one). The data is left as it is.
+			/// The model goes under the write cache, so it can't be added or removed while the cache is on.
+			/// </summary>
+			/// <param name="parameters">Settings for the model</param>
+			/// <returns>true if the model is in place. false if the settings don't fit the media or the write cache is on.</returns>
+			bool setFtl(const FTL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Takes the FlashTranslationLayer model away from in front of the media. The data is left as it is.
+			/// </summary>
+			/// <returns>true unless the write cache is on</returns>
+			bool removeFtl();
+
+			/// <summary>
+			/// Gets the FlashTranslationLayer model in front of the media, if there is one (under the write cache, if that is on)
+			/// </summary>
+			/// <returns>The model's media, or nullptr</returns>
+			std::shared_ptr<FtlMedia> getFtl() const;
+
+			/// <summary>
+			/// Replaces the media behind this namespace. The old media is dropped once nothing else is using it.
+			/// </summary>
+			/// <param name="media">New media. Must be a whole number of sectors.</param>
+			/// <returns>true if the media was swapped in</returns>
+			bool setMedia(std::shared_ptr<ns::Media> media);
+
+			/// <summary>
+			/// Gets the media behind this namespace
+			/// </summary>
+			/// <returns>The media</returns>
+			std::shared_ptr<ns::Media> getMedia() const;
+
+			/// <summary>
+			/// Reserves a range of LBAs for a command about to run on an I/O worker. Call in submission order, then lock() the range
+			///   on the worker around the I/O. Commands to other LBAs run in parallel, while overlapping ones run in submission order.
+			/// </summary>
+			/// <param name="firstLba">First LBA the command touches</param>
+			/// <param name="numberOfLbas">Number of LBAs the command touches (one based). 0 means through the last LBA.</param>
+			/// <param name="exclusive">true if the command writes the LBAs. false if it only reads them.</param>
+			/// <returns>The reserved range</returns>
+			std::shared_ptr<LbaRangeLock::Range> reserveLbaRange(UINT_64 firstLba, UINT_64 numberOfLbas, bool exclusive);
+
+			/// <summary>
+			/// Remembers the data in the namespace right now, replacing any older snapshot.
+			/// O(1) for media that can be cloned. Only the chunks written afterwards get copied.
+			/// </summary>
+			/// <returns>true if the snapshot was taken. false if the media can't be cloned.</returns>
+			bool takeSnapshot();
+
+			/// <summary>
+			/// Puts the data back to what it was when the snapshot was taken. The snapshot stays, so it can be reverted to again.
+			/// </summary>
+			/// <returns>true if reverted. false if there is no snapshot.</returns>
+			bool revertToSnapshot();
+
+			/// <summary>
+			/// Drops the snapshot, freeing the chunks only it was holding onto
+			/// </summary>
+			void deleteSnapshot();
+
+			/// <summary>
+			/// Writes the namespace to an image: its Identify Namespace structure, then the written parts of its data and metadata
+			/// </summary>
+			/// <param name="image">Stream to write the image to</param>
+			/// <returns>true on success</returns>
+			bool saveImage(std::ostream &image);
+
+			/// <summary>
+			/// Replaces the namespace with one from saveImage(), streaming the data into new in-memory media.
+			/// The LBA format, protection information settings and NGUID come from the image. Any snapshot is dropped.
+			/// Only loads into in-memory media, so a file or deduplicated media is never dropped. An FTL model stays on, starting over.
+			/// </summary>
+			/// <param name="image">Stream to read the image from</param>
+			/// <returns>true on success. false (leaving the namespace as it was) if the image is bad.</returns>
+			bool loadImage(std::istream &image);
+
 		private:
+			/// <summary>
+			/// Namespaces are owned once by the controller. Share them through a std::shared_ptr instead.
+			/// </summary>
+			Namespace(const Namespace&);
+
+			/// <summary>
+			/// Namespaces are owned once by the controller. Share them through a std::shared_ptr instead.
+			/// </summary>
+			Namespace& operator=(const Namespace&);
+
+			/// <summary>
+			/// Fills in the Identify Namespace structure from the media and current LBA format.
+			/// Called whenever either of those change.
+			/// </summary>
+			void updateIdentifyNamespaceStructure();
 
 			/// <summary>
 			/// Gets this namespace's size in sectors. The sector size is variable and should be grabbed from the ID namespace structure
@@ -96,10 +337,121 @@ namespace cnvme
 			UINT_64 getNamespaceSizeInSectors();
 
 			/// <summary>
-			/// Gets the sector size for this namespace (in bytes).
+			/// Gets the number of metadata bytes kept with each sector in the current LBA format
 			/// </summary>
-			/// <returns>sector size</returns>
-			UINT_32 getSectorSize();
+			/// <returns>metadata size</returns>
+			UINT_32 getMetadataSize();
+
+			/// <summary>
+			/// Gets the number of metadata bytes per sector the host transfers for the given command.
+			/// That is 0 if the controller inserts/strips the protection information (PRACT) and it is all of the metadata.
+			/// </summary>
+			/// <param name="nvmeCommand">The I/O command</param>
+			/// <returns>metadata size</returns>
+			UINT_32 getHostMetadataSize(const command::NVME_COMMAND &nvmeCommand);
+
+			/// <summary>
+			/// Gets the end-to-end protection information type the namespace is formatted with
+			/// </summary>
+			/// <returns>constants::commands::format::pi value</returns>
+			UINT_32 getProtectionInformationType();
+
+			/// <summary>
+			/// Throws away any metadata and starts an empty store sized to the media and current LBA format
+			/// </summary>
+			void resetMetadata();
+
+			/// <summary>
+			/// Starts every zone over as empty, sized to the media and current LBA format. Does nothing if the namespace isn't zoned.
+			/// </summary>
+			void resetZones();
+
+			/// <summary>
+			/// Copies metadata for a range of LBAs out of the metadata store
+			/// </summary>
+			/// <param name="firstLba">First LBA</param>
+			/// <param name="numberOfLbas">Number of LBAs (one based)</param>
+			/// <param name="buffer">Buffer to copy into. numberOfLbas * getMetadataSize() bytes.</param>
+			/// <returns>true on success</returns>
+			bool readMetadata(UINT_64 firstLba, UINT_64 numberOfLbas, UINT_8* buffer);
+
+			/// <summary>
+			/// Copies metadata for a range of LBAs into the metadata store
+			/// </summary>
+			/// <param name="firstLba">First LBA</param>
+			/// <param name="numberOfLbas">Number of LBAs (one based)</param>
+			/// <param name="buffer">Buffer to copy from. numberOfLbas * getMetadataSize() bytes.</param>
+			/// <returns>true on success</returns>
+			bool writeMetadata(UINT_64 firstLba, UINT_64 numberOfLbas, const UINT_8* buffer);
+
+			/// <summary>
+			/// Throws away the metadata for a range of LBAs. It reads as all FFh afterwards, so deallocated protection information is escaped.
+			/// </summary>
+			/// <param name="firstLba">First LBA</param>
+			/// <param name="numberOfLbas">Number of LBAs (one based)</param>
+			/// <returns>true on success</returns>
+			bool deallocateMetadata(UINT_64 firstLba, UINT_64 numberOfLbas);
+
+			/// <summary>
+			/// Reads the LBAs of a command as the host sees them: extended LBAs interleave the metadata into the data,
+			///   otherwise it goes in its own buffer. Protection information is checked and stripped as the command asks.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command. The LBAs must already be known to be in range.</param>
+			/// <param name="hostData">Data (and extended LBA metadata) for the host's PRPs</param>
+			/// <param name="hostMetadata">Metadata for the host's separate metadata buffer. Empty if there is none.</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY readWithMetadata(const command::NVME_COMMAND &nvmeCommand, Payload &hostData, Payload &hostMetadata);
+
+			/// <summary>
+			/// Writes the LBAs of a command from the host's PRPs and metadata buffer.
+			///   Protection information is checked, or inserted if the command asks the controller to (PRACT), before anything is written.
+			/// </summary>
+			/// <param name="nvmeCommand">Complete NVMe command. The LBAs must already be known to be in range.</param>
+			/// <param name="memoryPageSize">size of the memory page</param>
+			/// <returns>Completion queue entry for command</returns>
+			command::COMPLETION_QUEUE_ENTRY writeWithMetadata(const command::NVME_COMMAND &nvmeCommand, UINT_32 memoryPageSize);
+
+			/// <summary>
+			/// Checks the protection information of each LBA of a command against its data and the expected tags,
+			///   as far as the command's PRINFO asks for
+			/// </summary>
+			/// <param name="nvmeCommand">The I/O command</param>
+			/// <param name="data">Data for the command's LBAs</param>
+			/// <param name="metadata">Metadata (getMetadataSize() bytes per LBA) for the command's LBAs</param>
+			/// <param name="completionQueueEntry">Has the error filled in if a check fails</param>
+			/// <returns>true if every check passed</returns>
+			bool checkProtectionInformation(const command::NVME_COMMAND &nvmeCommand, const UINT_8* data, const UINT_8* metadata, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry);
+
+			/// <summary>
+			/// Fills in the protection information of each LBA of a command from its data and the command's tags
+			/// </summary>
+			/// <param name="nvmeCommand">The I/O command</param>
+			/// <param name="data">Data for the command's LBAs</param>
+			/// <param name="metadata">Metadata (getMetadataSize() bytes per LBA) for the command's LBAs. The protection information in it is overwritten.</param>
+			void generateProtectionInformation(const command::NVME_COMMAND &nvmeCommand, const UINT_8* data, UINT_8* metadata);
+
+			/// <summary>
+			/// Computes the guard for one LBA: the CRC of its data, and of any metadata in front of the protection information
+			/// </summary>
+			/// <param name="data">Data for the LBA</param>
+			/// <param name="metadata">Metadata for the LBA</param>
+			/// <returns>Guard</returns>
+			UINT_16 getGuard(const UINT_8* data, const UINT_8* metadata);
+
+			/// <summary>
+			/// Gets where the protection information is in each LBA's metadata: the first or last 8 bytes
+			/// </summary>
+			/// <returns>Byte offset into the metadata</returns>
+			UINT_32 getProtectionInformationOffset();
+
+			/// <summary>
+			/// Gets the reference tag an LBA of a command should have.
+			/// It counts up from the command's initial reference tag for Types 1 and 2. Type 3 doesn't count.
+			/// </summary>
+			/// <param name="nvmeCommand">The I/O command</param>
+			/// <param name="lbaIndex">Index of the LBA in the command</param>
+			/// <returns>Reference tag</returns>
+			UINT_32 getExpectedReferenceTag(const command::NVME_COMMAND &nvmeCommand, UINT_64 lbaIndex);
 
 			/// <summary>
 			/// Internal representation of the Identify Namespace structure
@@ -109,7 +461,43 @@ namespace cnvme
 			/// <summary>
 			/// Internal managed media
 			/// </summary>
-			Payload Media;
+			std::shared_ptr<ns::Media> Media;
+
+			/// <summary>
+			/// Clone of the media from takeSnapshot(). Never written to, so it keeps the data as it was.
+			/// </summary>
+			std::shared_ptr<ns::Media> Snapshot;
+
+			/// <summary>
+			/// Metadata for every sector, getMetadataSize() bytes each. Kept in memory whatever the media is.
+			/// Stored inverted, so metadata that was never written reads as all FFh.
+			/// </summary>
+			std::shared_ptr<ns::Media> Metadata;
+
+			/// <summary>
+			/// Clone of the metadata from takeSnapshot()
+			/// </summary>
+			std::shared_ptr<ns::Media> SnapshotMetadata;
+
+			/// <summary>
+			/// State and write pointer of each zone. nullptr if the namespace isn't zoned.
+			/// </summary>
+			std::shared_ptr<Zones> ZoneStates;
+
+			/// <summary>
+			/// Copy of the zones from takeSnapshot()
+			/// </summary>
+			std::shared_ptr<Zones> SnapshotZones;
+
+			/// <summary>
+			/// Held around each use of the metadata store. I/O workers can write the metadata of neighbouring LBAs at once.
+			/// </summary>
+			std::mutex MetadataMutex;
+
+			/// <summary>
+			/// Ranges of LBAs that commands running on I/O workers have reserved
+			/// </summary>
+			LbaRangeLock RangeLock;
 		};
 	}
 }
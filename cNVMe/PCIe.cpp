@@ -23,11 +23,12 @@
 PCIe.cpp - A implementation file for the PCIe Registers
 */
 
+#include "Atomic.h"
+#include "ControllerRegisters.h"
 #include "PCIe.h"
 #include "Strings.h"
 
-
-#define BAR_SIZE 4096          // 4K Bytes
+#define BAR_SIZE 4096          // 4K Bytes (BAR0/BAR1 use BAR0_SIZE to fit the doorbells)
 #define CAPABILITIES_SIZE 4096 // Much larger than probably needed
 
 // Cap Ids
@@ -915,7 +916,7 @@ namespace cnvme
 
 		void PCIExpressRegisters::allocateBars()
 		{
-			Bars = cnvme::Payload(BAR_SIZE * 6); // 6 bars
+			Bars = cnvme::Payload(BAR0_SIZE + (BAR_SIZE * 5)); // 6 bars, BAR0/BAR1 holding the controller registers and doorbells
 			PCI_HEADER* PciHeader = getPciHeader();
 
 			// BAR 0
@@ -933,17 +934,17 @@ namespace cnvme
 			// BAR0 = ((UINT_8*)addr);
 
 			// BAR 2 technically only would need 8 bytes of space...
-			PciHeader->IDBAR.BA = BAR_SIZE * 2;
+			PciHeader->IDBAR.BA = BAR0_SIZE + BAR_SIZE;
 			PciHeader->IDBAR.RTE = 1; // I/O Space
 
 			// Bar 3
-			PciHeader->BAR3.BAR = BAR_SIZE * 3;
+			PciHeader->BAR3.BAR = BAR0_SIZE + (BAR_SIZE * 2);
 
 			// Bar 4
-			PciHeader->BAR4.BAR = BAR_SIZE * 4;
+			PciHeader->BAR4.BAR = BAR0_SIZE + (BAR_SIZE * 3);
 
 			// Bar 5
-			PciHeader->BAR5.BAR = BAR_SIZE * 5;
+			PciHeader->BAR5.BAR = BAR0_SIZE + (BAR_SIZE * 4);
 		}
 
 		void PCIExpressRegisters::allocateCapabilities()
@@ -1081,12 +1082,35 @@ namespace cnvme
 			return Registers;
 		}
 
+		void PCIExpressRegisters::initiateFunctionLevelReset()
+		{
+			auto regs = getPciExpressRegisters();
+			ASSERT_IF(!regs.PXCAP, "Can't initiate a function level reset without PXCAP");
+
+			PCI_EXPRESS_DEVICE_CONTROL initiateReset;
+			memset(&initiateReset, 0, sizeof(initiateReset));
+			initiateReset.IFLR = 1;
+
+			UINT_16 rawValue = 0;
+			memcpy(&rawValue, &initiateReset, sizeof(rawValue));
+			atomic::orRelease((UINT_16*)&regs.PXCAP->PXDC, rawValue);
+		}
+
 		void PCIExpressRegisters::checkForChanges()
 		{
 			auto regs = getPciExpressRegisters();
 
+			// PXDC is written by the host while we poll it. See initiateFunctionLevelReset().
+			PCI_EXPRESS_DEVICE_CONTROL deviceControl;
+			memset(&deviceControl, 0, sizeof(deviceControl));
+			if (regs.PXCAP)
+			{
+				UINT_16 rawValue = atomic::loadAcquire((UINT_16*)&regs.PXCAP->PXDC);
+				memcpy(&deviceControl, &rawValue, sizeof(deviceControl));
+			}
+
 			// If we can't find PXCAP or IFLR was set to 1 do the function level reset
-			if ((!regs.PXCAP) || regs.PXCAP->PXDC.IFLR == 1)
+			if ((!regs.PXCAP) || deviceControl.IFLR == 1)
 			{
 				functionLevelReset(); // Function level reset
 			}
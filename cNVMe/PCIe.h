@@ -869,6 +869,12 @@ namespace cnvme
 			/// </summary>
 			void waitForChangeLoop();
 
+			/// <summary>
+			/// Sets PXDC.IFLR to start a function level reset.
+			/// PXDC is polled by the register watcher, so it is written atomically.
+			/// </summary>
+			void initiateFunctionLevelReset();
+
 		private:
 			/// <summary>
 			/// The private implementation of the BAR memory.
@@ -23,6 +23,7 @@
 PRP.cpp - An implementation file for the PRPs
 */
 
+#include "Memory.h"
 #include "PRP.h"
 
 namespace cnvme
@@ -68,28 +69,40 @@ namespace cnvme
 	}
 
 	PRP::~PRP()
+	{
+		this->freeOwnedMemory();
+	}
+
+	void PRP::freeOwnedMemory()
 	{
 		if (FreeOnScopeLoss)
 		{
 			if (PRP1)
 			{
-				delete[] MEMORY_ADDRESS_TO_8POINTER(PRP1);
+				memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(PRP1), std::min(NumberOfBytes, MemoryPageSize), memory::SUBSYSTEM_PRP);
 				PRP1 = 0;
 			}
 
 			if (usesPRPList())
 			{
 				// Go through all items in the PRP2 list and free memory
-				std::vector<std::pair<BYTE*, size_t>> prpList = getPRPListPointers();
+				std::vector<BYTE*> prpListPages;
+				std::vector<std::pair<BYTE*, size_t>> prpList = getPRPListPointers(&prpListPages);
 				for (std::pair<BYTE*, size_t> &prp : prpList)
 				{
-					delete[]prp.first;
+					memory::deallocate(prp.first, MemoryPageSize, memory::SUBSYSTEM_PRP);
+				}
+
+				// PRP2 itself is the first list page, the rest were chained off of it
+				for (size_t i = 1; i < prpListPages.size(); i++)
+				{
+					memory::deallocate(prpListPages[i], MemoryPageSize, memory::SUBSYSTEM_PRP);
 				}
 			}
 
 			if (PRP2)
 			{
-				delete[] MEMORY_ADDRESS_TO_8POINTER(PRP2);
+				memory::deallocate(MEMORY_ADDRESS_TO_8POINTER(PRP2), MemoryPageSize, memory::SUBSYSTEM_PRP);
 				PRP2 = 0;
 			}
 		}
@@ -97,13 +110,18 @@ namespace cnvme
 
 	Payload PRP::getPayloadCopy()
 	{
-		Payload payload;
+		return Payload(getSegmentedPayload());
+	}
+
+	SegmentedPayload PRP::getSegmentedPayload()
+	{
+		SegmentedPayload segmentedPayload;
 		if (NumberOfBytes > 0)
 		{
 			size_t bytesRemaining = NumberOfBytes;
 			// no matter what, prp 1 is used
 			BYTE* prp1Pointer = MEMORY_ADDRESS_TO_8POINTER(PRP1);
-			payload.append(Payload(prp1Pointer, std::min(bytesRemaining, MemoryPageSize)));
+			segmentedPayload.appendReference(prp1Pointer, std::min(bytesRemaining, MemoryPageSize));
 			bytesRemaining -= std::min(bytesRemaining, MemoryPageSize);
 			if (bytesRemaining > 0)
 			{
@@ -112,18 +130,18 @@ namespace cnvme
 					std::vector<std::pair<BYTE*, size_t>> prpList = getPRPListPointers();
 					for (std::pair<BYTE*, size_t> &prp : prpList)
 					{
-						payload.append(Payload(prp.first, prp.second));
+						segmentedPayload.appendReference(prp.first, prp.second);
 					}
 				}
 				else
 				{
 					BYTE* prp2Pointer = MEMORY_ADDRESS_TO_8POINTER(PRP2);
-					payload.append(Payload(prp2Pointer, std::min(bytesRemaining, MemoryPageSize)));
+					segmentedPayload.appendReference(prp2Pointer, std::min(bytesRemaining, MemoryPageSize));
 					bytesRemaining -= std::min(bytesRemaining, MemoryPageSize);
 				}
 			}
 		}
-		return payload;
+		return segmentedPayload;
 	}
 
 	size_t PRP::getNumBytes()
@@ -215,7 +233,7 @@ namespace cnvme
 		return (UINT_32)(MemoryPageSize / sizeof(UINT_64));
 	}
 
-	std::vector<std::pair<BYTE*, size_t>> PRP::getPRPListPointers()
+	std::vector<std::pair<BYTE*, size_t>> PRP::getPRPListPointers(std::vector<BYTE*>* prpListPages)
 	{
 		std::vector<std::pair<BYTE*, size_t>> prpListPointers;
 		if (usesPRPList())
@@ -227,6 +245,11 @@ namespace cnvme
 			UINT_64* singlePrp = MEMORY_ADDRESS_TO_64POINTER(PRP2);
 			for (UINT_32 i = 0; i < numberOfChainedPRPs; i++)
 			{
+				if (prpListPages)
+				{
+					prpListPages->push_back((BYTE*)singlePrp);
+				}
+
 				for (UINT_32 j = 0; j < getMaxItemsInSinglePRPList(); j++)
 				{
 					// Out of data or we need to follow the link to the next chain
@@ -264,6 +287,9 @@ namespace cnvme
 	{
 		LOG_INFO("Payload with a size of " + std::to_string(payload.getSize()) + " was passed to PRP()");
 
+		// Don't leak what we had before
+		this->freeOwnedMemory();
+
 		FreeOnScopeLoss = true;
 		NumberOfBytes = payload.getSize();
 		MemoryPageSize = memoryPageSize;
@@ -272,7 +298,7 @@ namespace cnvme
 
 		// PRP1 will be the first MPS (memory page size) of the data
 		size_t prp1DataSize = std::min(payload.getSize(), MemoryPageSize);
-		ALLOC_BYTE_ARRAY(prp1Pointer, prp1DataSize);
+		BYTE* prp1Pointer = memory::allocate(prp1DataSize, true, memory::SUBSYSTEM_PRP);
 		// This is sort of not how this works in NVMe. In NVMe, we would have an entire page allocated.
 		// Though for the simulation, this can be really slow. If we only need say 512 bytes instead of a full 128MB page
 		// We will only allocate the 512 as opposed finding a full page. While here, another oddity is the offset.
@@ -285,7 +311,7 @@ namespace cnvme
 		if (bytesRemaining > 0)
 		{
 			// PRP2 will be the next MPS or a pointer to a PRP list 
-			ALLOC_BYTE_ARRAY(prp2Pointer, MemoryPageSize);
+			BYTE* prp2Pointer = memory::allocate(MemoryPageSize, true, memory::SUBSYSTEM_PRP);
 
 			// If the remaining data size is less than a second memory page, just copy to that pointer
 			if (!usesPRPList())
@@ -314,7 +340,7 @@ namespace cnvme
 							break;
 						}
 
-						ALLOC_BYTE_ARRAY(listItem, MemoryPageSize);
+						BYTE* listItem = memory::allocate(MemoryPageSize, true, memory::SUBSYSTEM_PRP);
 
 						size_t bytesToCopy = std::min(MemoryPageSize, bytesRemaining);
 
@@ -333,7 +359,7 @@ namespace cnvme
 					}
 
 					// Create new chain
-					ALLOC_BYTE_ARRAY(newPrpList, MemoryPageSize);
+					BYTE* newPrpList = memory::allocate(MemoryPageSize, true, memory::SUBSYSTEM_PRP);
 
 					*pPrpList = POINTER_TO_MEMORY_ADDRESS(newPrpList);
 					pPrpList = &(*(UINT_64*)newPrpList);
@@ -25,6 +25,7 @@ PRP.h - A header file for the NVMe PRPs
 
 #pragma once
 
+#include "SegmentedPayload.h"
 #include "Types.h"
 
 namespace cnvme
@@ -79,6 +80,13 @@ namespace cnvme
 		/// <returns>A payload with data from the PRP</returns>
 		Payload getPayloadCopy();
 
+		/// <summary>
+		/// Get the linked PRP data as a chain of references to the PRP memory pages. No data is copied.
+		/// The PRP memory must stay valid for as long as the returned object is used.
+		/// </summary>
+		/// <returns>A SegmentedPayload referencing the data in the PRP</returns>
+		SegmentedPayload getSegmentedPayload();
+
 		/// <summary>
 		/// Returns the number of bytes represented by the PRP
 		/// </summary>
@@ -172,8 +180,14 @@ namespace cnvme
 		/// <summary>
 		/// Gets a vector of pointers from the PRP2 list
 		/// </summary>
+		/// <param name="prpListPages">If given, filled with the pointers to the PRP list pages themselves</param>
 		/// <returns>vector of byte pointers and the size of the data they point to</returns>
-		std::vector<std::pair<BYTE*, size_t>> getPRPListPointers();
+		std::vector<std::pair<BYTE*, size_t>> getPRPListPointers(std::vector<BYTE*>* prpListPages = nullptr);
+
+		/// <summary>
+		/// Frees the PRP memory if this object owns it
+		/// </summary>
+		void freeOwnedMemory();
 
 		/// <summary>
 		/// Returns the number of chained PRPs needed
@@ -23,20 +23,25 @@
 Payload.cpp - An implementation file for the Payload class
 */
 
+#include "Memory.h"
 #include "Payload.h"
+#include "SegmentedPayload.h"
 
 #include <algorithm>
 
 namespace cnvme
 {
-	Payload::Payload(size_t byteSize) : Payload()
+	Payload::Payload(size_t byteSize) : Payload(byteSize, true)
+	{
+	}
+
+	Payload::Payload(size_t byteSize, bool zeroMemory) : Payload()
 	{
 		ByteSize = byteSize;
-		BytePointer = new UINT_8[byteSize];
-		memset(BytePointer, 0x00, ByteSize);
+		BytePointer = memory::allocate(byteSize, zeroMemory, AccountingSubsystem);
 	}
 
-	Payload::Payload(BYTE * pointer, size_t byteSize) : Payload::Payload(byteSize)
+	Payload::Payload(BYTE * pointer, size_t byteSize) : Payload::Payload(byteSize, false) // Everything is about to be copied over, so don't zero it first
 	{
 		memcpy_s(BytePointer, ByteSize, pointer, byteSize);
 	}
@@ -46,13 +51,25 @@ namespace cnvme
 		ByteSize = 0;
 		BytePointer = nullptr;
 		DeleteOnScopeLoss = true;
+		AccountingSubsystem = memory::SUBSYSTEM_PAYLOAD;
 	}
 
 	Payload::Payload(const Payload& other) : Payload::Payload()
 	{
+		AccountingSubsystem = other.AccountingSubsystem;
 		*this = other;
 	}
 
+	Payload::Payload(Payload&& other) noexcept : Payload::Payload()
+	{
+		AccountingSubsystem = other.AccountingSubsystem;
+		*this = std::move(other);
+	}
+
+	Payload::Payload(SegmentedPayload&& segmentedPayload) : Payload::Payload(segmentedPayload.toPayload())
+	{
+	}
+
 	Payload& Payload::operator=(const Payload& other)
 	{
 		// check for self-assignment
@@ -61,13 +78,49 @@ namespace cnvme
 			return *this;
 		}
 
+		// Give back what we had before taking on a copy
+		if (BytePointer && DeleteOnScopeLoss)
+		{
+			memory::deallocate(BytePointer, ByteSize, AccountingSubsystem);
+		}
+
 		ByteSize = other.ByteSize;
-		BytePointer = new UINT_8[other.ByteSize];
+		BytePointer = memory::allocate(other.ByteSize, false, AccountingSubsystem);
+		DeleteOnScopeLoss = true; // This is our own new buffer
 
 		memcpy_s(BytePointer, ByteSize, other.BytePointer, other.ByteSize);
 		return *this;
 	}
 
+	Payload& Payload::operator=(Payload&& other) noexcept
+	{
+		// check for self-assignment
+		if (&other == this)
+		{
+			return *this;
+		}
+
+		if (BytePointer && DeleteOnScopeLoss)
+		{
+			memory::deallocate(BytePointer, ByteSize, AccountingSubsystem);
+		}
+
+		BytePointer = other.BytePointer;
+		ByteSize = other.ByteSize;
+		DeleteOnScopeLoss = other.DeleteOnScopeLoss;
+
+		// The buffer now belongs to our subsystem
+		if (BytePointer)
+		{
+			memory::transferAccounting(other.AccountingSubsystem, AccountingSubsystem, ByteSize);
+		}
+
+		other.BytePointer = nullptr;
+		other.ByteSize = 0;
+		other.DeleteOnScopeLoss = true;
+		return *this;
+	}
+
 	bool Payload::operator==(const Payload &other)
 	{
 		if (this->getSize() == other.getSize())
@@ -98,7 +151,7 @@ namespace cnvme
 	{
 		if (BytePointer && DeleteOnScopeLoss)
 		{
-			delete[] BytePointer;
+			memory::deallocate(BytePointer, ByteSize, AccountingSubsystem);
 			BytePointer = nullptr;
 			ByteSize = 0;
 		}
@@ -123,9 +176,25 @@ namespace cnvme
 	{
 		if (newSize != ByteSize)
 		{
-			UINT_8* tmp = new UINT_8[newSize];
+			if (BytePointer && newSize != 0 && memory::getUsableSize(newSize) == memory::getUsableSize(ByteSize))
+			{
+				// Same size class, the current buffer already has room
+				if (newSize > ByteSize)
+				{
+					memset(BytePointer + ByteSize, 0, newSize - ByteSize);
+				}
+				memory::trackResize(AccountingSubsystem, ByteSize, newSize);
+				ByteSize = newSize;
+				return;
+			}
+
+			UINT_8* tmp = memory::allocate(newSize, false, AccountingSubsystem);
 			memcpy_s(tmp, newSize, BytePointer, std::min(ByteSize, newSize)); // Only copy current size at most... don't overflow
-			delete[] BytePointer;
+			if (newSize > ByteSize)
+			{
+				memset(tmp + ByteSize, 0, newSize - ByteSize);
+			}
+			memory::deallocate(BytePointer, ByteSize, AccountingSubsystem);
 			BytePointer = tmp;
 			ByteSize = newSize;
 		}
@@ -153,6 +222,20 @@ namespace cnvme
 		DeleteOnScopeLoss = delOnScopeLoss;
 	}
 
+	void Payload::setAccountingSubsystem(memory::Subsystem subsystem)
+	{
+		if (BytePointer)
+		{
+			memory::transferAccounting(AccountingSubsystem, subsystem, ByteSize);
+		}
+		AccountingSubsystem = subsystem;
+	}
+
+	memory::Subsystem Payload::getAccountingSubsystem() const
+	{
+		return AccountingSubsystem;
+	}
+
 	void Payload::clear()
 	{
 		memset(this->getBuffer(), 0, this->getSize());
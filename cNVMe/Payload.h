@@ -29,6 +29,13 @@ Payload.h - A header file for the Payload class
 
 namespace cnvme
 {
+	class SegmentedPayload;
+
+	namespace memory
+	{
+		enum Subsystem : UINT_8; // Defined in Memory.h, which can't be included here since it includes Types.h
+	}
+
 	/// <summary>
 	/// Payload is a safe dynamic memory allocation class
 	/// </summary>
@@ -41,6 +48,13 @@ namespace cnvme
 		/// <param name="byteSize">Number of bytes for the payload</param>
 		Payload(size_t byteSize);
 
+		/// <summary>
+		/// Create a payload with byteSize bytes
+		/// </summary>
+		/// <param name="byteSize">Number of bytes for the payload</param>
+		/// <param name="zeroMemory">If false, the buffer is left uninitialized. Use when it will be fully overwritten.</param>
+		Payload(size_t byteSize, bool zeroMemory);
+
 		/// <summary>
 		/// Create a payload from a pointer/length. This copies the data.
 		/// </summary>
@@ -59,6 +73,18 @@ namespace cnvme
 		/// <param name="other">Another Payload to copy from</param>
 		Payload(const Payload &other);
 
+		/// <summary>
+		/// Move constructor. Takes the buffer of other without copying it.
+		/// </summary>
+		/// <param name="other">Another Payload to move from</param>
+		Payload(Payload &&other) noexcept;
+
+		/// <summary>
+		/// Create a payload from a SegmentedPayload. This materializes the segments into contiguous memory.
+		/// </summary>
+		/// <param name="segmentedPayload">SegmentedPayload to adopt. It is empty afterwards.</param>
+		Payload(SegmentedPayload &&segmentedPayload);
+
 		/// <summary>
 		/// Assignment operator
 		/// </summary>
@@ -66,6 +92,13 @@ namespace cnvme
 		/// <returns>Payload</returns>
 		Payload& operator=(const Payload& other);
 
+		/// <summary>
+		/// Move assignment operator. Takes the buffer of other without copying it.
+		/// </summary>
+		/// <param name="other">Another payload to move from</param>
+		/// <returns>Payload</returns>
+		Payload& operator=(Payload&& other) noexcept;
+
 		/// <summary>
 		/// Checks if the two payloads are equivalent
 		/// </summary>
@@ -127,6 +160,19 @@ namespace cnvme
 		/// <param name="delOnScopeLoss">If true, delete on scope loss. If false dont.</param>
 		void setDeleteOnScopeLoss(bool delOnScopeLoss);
 
+		/// <summary>
+		/// Sets which subsystem this payload's memory is accounted to. The current buffer moves over to it.
+		/// A payload keeps its subsystem when assigned to, so set this before assigning a new buffer.
+		/// </summary>
+		/// <param name="subsystem">Subsystem to account to</param>
+		void setAccountingSubsystem(memory::Subsystem subsystem);
+
+		/// <summary>
+		/// Gets which subsystem this payload's memory is accounted to
+		/// </summary>
+		/// <returns>Subsystem</returns>
+		memory::Subsystem getAccountingSubsystem() const;
+
 		/// <summary>
 		/// Clears the payload to all 0
 		/// </summary>
@@ -156,5 +202,10 @@ namespace cnvme
 		/// If True, delete memory on scope loss, otherwise don't.
 		/// </summary>
 		bool DeleteOnScopeLoss;
+
+		/// <summary>
+		/// The subsystem the memory is accounted to
+		/// </summary>
+		memory::Subsystem AccountingSubsystem;
 	};
 }
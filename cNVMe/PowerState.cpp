@@ -0,0 +1,207 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+PowerState.cpp - An implementation file for modeling power states and autonomous power state transitions
+*/
+
+#include "PowerState.h"
+
+namespace cnvme
+{
+	namespace controller
+	{
+		namespace
+		{
+			/// <summary>
+			/// A row of the power state table
+			/// </summary>
+			typedef struct POWER_STATE
+			{
+				UINT_16 MaxPower; // In 0.01 W, or 0.0001 W if ScaledMaxPower
+				bool ScaledMaxPower;
+				bool NonOperational;
+				UINT_32 EntryLatency; // Microseconds
+				UINT_32 ExitLatency; // Microseconds
+				UINT_8 RelativePerformance; // Reported for read/write throughput and latency alike. 0 is the best.
+				UINT_32 PerformancePercent; // How fast commands run compared to PS0. Nothing runs in a non-operational state.
+			} POWER_STATE, *PPOWER_STATE;
+
+			const POWER_STATE PowerStates[NUMBER_OF_POWER_STATES] = {
+				{ 900, false, false, 0, 0, 0, 100 }, // PS0: 9 W
+				{ 600, false, false, 0, 0, 1, 75 }, // PS1: 6 W
+				{ 400, false, false, 0, 0, 2, 50 }, // PS2: 4 W
+				{ 5, false, true, 2000, 2000, 3, 0 }, // PS3: 50 mW idle
+				{ 50, true, true, 6000, 8000, 4, 0 }, // PS4: 5 mW sleep
+			};
+		}
+
+		PowerStateModel::PowerStateModel()
+		{
+			this->reset(std::chrono::steady_clock::now());
+		}
+
+		identify::structures::IDENTIFY_POWER_STATE_DESCRIPTOR PowerStateModel::getPowerStateDescriptor(UINT_8 powerState)
+		{
+			ASSERT_IF(powerState >= NUMBER_OF_POWER_STATES, "There is no power state " + std::to_string(powerState));
+
+			const POWER_STATE &state = PowerStates[powerState];
+			identify::structures::IDENTIFY_POWER_STATE_DESCRIPTOR descriptor;
+			memset(&descriptor, 0, sizeof(descriptor));
+			descriptor.MP = state.MaxPower;
+			descriptor.MXPS = state.ScaledMaxPower ? 1 : 0;
+			descriptor.NOPS = state.NonOperational ? 1 : 0;
+			descriptor.ENLAT = state.EntryLatency;
+			descriptor.EXLAT = state.ExitLatency;
+			descriptor.RRT = state.RelativePerformance;
+			descriptor.RRL = state.RelativePerformance;
+			descriptor.RWT = state.RelativePerformance;
+			descriptor.RWL = state.RelativePerformance;
+			return descriptor;
+		}
+
+		void PowerStateModel::reset(std::chrono::steady_clock::time_point now)
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->PowerState = 0;
+			this->LastOperationalPowerState = 0;
+			this->BusyUntil = now;
+			this->IdleSince = now;
+			this->ApstEnabled = false;
+			memset(this->ApstTable, 0, sizeof(this->ApstTable));
+		}
+
+		UINT_8 PowerStateModel::getPowerState(std::chrono::steady_clock::time_point now)
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->transitionAutonomously(now);
+			return this->PowerState;
+		}
+
+		bool PowerStateModel::setPowerState(UINT_8 powerState, std::chrono::steady_clock::time_point now)
+		{
+			if (powerState >= NUMBER_OF_POWER_STATES)
+			{
+				return false;
+			}
+
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->transitionAutonomously(now);
+			this->transition(powerState, now);
+			return true;
+		}
+
+		bool PowerStateModel::setAutonomousPowerStateTransitions(bool enabled, const APST_ENTRY* apstTable, std::chrono::steady_clock::time_point now)
+		{
+			for (size_t i = 0; i < APST_ENTRIES; i++)
+			{
+				if (apstTable[i].ITPT != 0 && (apstTable[i].ITPS >= NUMBER_OF_POWER_STATES || !PowerStates[apstTable[i].ITPS].NonOperational))
+				{
+					return false;
+				}
+			}
+
+			// Whatever the old table did up to now stands
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->transitionAutonomously(now);
+			this->IdleSince = (std::max)(this->IdleSince, now);
+			this->ApstEnabled = enabled;
+			memcpy_s(this->ApstTable, sizeof(this->ApstTable), apstTable, sizeof(this->ApstTable));
+			return true;
+		}
+
+		bool PowerStateModel::isApstEnabled() const
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			return this->ApstEnabled;
+		}
+
+		void PowerStateModel::getApstTable(APST_ENTRY* apstTable) const
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			memcpy_s(apstTable, sizeof(this->ApstTable), this->ApstTable, sizeof(this->ApstTable));
+		}
+
+		std::chrono::steady_clock::time_point PowerStateModel::wake(std::chrono::steady_clock::time_point now)
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			this->transitionAutonomously(now);
+			if (PowerStates[this->PowerState].NonOperational)
+			{
+				this->transition(this->LastOperationalPowerState, now);
+			}
+
+			return (std::max)(this->BusyUntil, now);
+		}
+
+		std::chrono::steady_clock::time_point PowerStateModel::finish(std::chrono::steady_clock::time_point startTime, std::chrono::steady_clock::time_point completionTime)
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+			UINT_32 performancePercent = PowerStates[this->PowerState].PerformancePercent;
+			if (completionTime > startTime && performancePercent != 100)
+			{
+				completionTime = startTime + (completionTime - startTime) * 100 / performancePercent;
+			}
+
+			this->IdleSince = (std::max)(this->IdleSince, completionTime);
+			return completionTime;
+		}
+
+		void PowerStateModel::transition(UINT_8 powerState, std::chrono::steady_clock::time_point time)
+		{
+			if (powerState == this->PowerState)
+			{
+				return;
+			}
+
+			// Leaving waits for whatever transition is still going on
+			std::chrono::steady_clock::time_point startTime = (std::max)(this->BusyUntil, time);
+			this->BusyUntil = startTime + std::chrono::microseconds(PowerStates[this->PowerState].ExitLatency + PowerStates[powerState].EntryLatency);
+			this->IdleSince = (std::max)(this->IdleSince, time);
+			this->PowerState = powerState;
+			if (!PowerStates[powerState].NonOperational)
+			{
+				this->LastOperationalPowerState = powerState;
+			}
+		}
+
+		void PowerStateModel::transitionAutonomously(std::chrono::steady_clock::time_point now)
+		{
+			while (this->ApstEnabled)
+			{
+				// Only ever going to a deeper state means this ends
+				const APST_ENTRY &entry = this->ApstTable[this->PowerState];
+				if (entry.ITPT == 0 || entry.ITPS <= this->PowerState)
+				{
+					break;
+				}
+
+				std::chrono::steady_clock::time_point transitionTime = this->IdleSince + std::chrono::milliseconds(entry.ITPT);
+				if (transitionTime > now)
+				{
+					break;
+				}
+
+				this->transition((UINT_8)entry.ITPS, transitionTime);
+			}
+		}
+	}
+}
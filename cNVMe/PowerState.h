@@ -0,0 +1,182 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+PowerState.h - A header file for modeling power states and autonomous power state transitions
+*/
+
+#pragma once
+
+#include "Identify.h"
+#include "Types.h"
+
+#define NUMBER_OF_POWER_STATES 5
+#define APST_ENTRIES 32 // The APST data structure has an entry for every possible power state
+
+namespace cnvme
+{
+	namespace controller
+	{
+		/// <summary>
+		/// An entry of the Autonomous Power State Transition data structure. Entry i says what to do after idling in power state i.
+		/// </summary>
+		typedef struct APST_ENTRY
+		{
+			UINT_32 RSVD_0_2 : 3;
+			UINT_32 ITPS : 5; // Idle Transition Power State
+			UINT_32 ITPT : 24; // Idle Time Prior to Transition in milliseconds (0 never transitions)
+			UINT_32 RSVD_32_63;
+		} APST_ENTRY, *PAPST_ENTRY;
+		static_assert(sizeof(APST_ENTRY) == 8, "An APST data structure entry is 8 bytes.");
+
+		/// <summary>
+		/// Models the power states the controller reports in Identify Controller.
+		/// Moving from state A to state B keeps the device busy for A's exit latency plus B's entry latency.
+		/// An I/O command that finds the device in a non-operational state wakes it to the last operational state,
+		///   so the command waits for any transition still going on and then for the wake-up.
+		/// Operational states below PS0 run commands slower, in line with their relative performance.
+		/// With APST on, each time the device has idled for ITPT in a state it goes to that state's ITPS.
+		///   Idle time is only looked at when someone asks, which gives the same answer as a timer would have.
+		/// Thread safe: commands on I/O workers finish in it while the doorbell watcher wakes it for the next ones.
+		/// </summary>
+		class PowerStateModel
+		{
+		public:
+			/// <summary>
+			/// Constructor. Starts in PS0 with APST off.
+			/// </summary>
+			PowerStateModel();
+
+			/// <summary>
+			/// Gets the descriptor Identify Controller reports for a power state
+			/// </summary>
+			/// <param name="powerState">The power state. Must be less than NUMBER_OF_POWER_STATES.</param>
+			/// <returns>IDENTIFY_POWER_STATE_DESCRIPTOR</returns>
+			static identify::structures::IDENTIFY_POWER_STATE_DESCRIPTOR getPowerStateDescriptor(UINT_8 powerState);
+
+			/// <summary>
+			/// Goes back to PS0 with APST off and an empty APST table, as after a controller reset
+			/// </summary>
+			/// <param name="now">Time of the reset</param>
+			void reset(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Gets the power state the device is in, after any autonomous transitions up to now
+			/// </summary>
+			/// <param name="now">The time</param>
+			/// <returns>The power state</returns>
+			UINT_8 getPowerState(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Moves to a power state because the host asked to
+			/// </summary>
+			/// <param name="powerState">The power state</param>
+			/// <param name="now">Time the host asked</param>
+			/// <returns>false if there is no such power state</returns>
+			bool setPowerState(UINT_8 powerState, std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Sets up autonomous power state transitions
+			/// </summary>
+			/// <param name="enabled">true to turn them on</param>
+			/// <param name="apstTable">APST_ENTRIES entries</param>
+			/// <param name="now">Time the host asked. Idle time before this doesn't count towards the new table.</param>
+			/// <returns>false (changing nothing) if an entry transitions to a state that isn't non-operational</returns>
+			bool setAutonomousPowerStateTransitions(bool enabled, const APST_ENTRY* apstTable, std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Checks if autonomous power state transitions are on
+			/// </summary>
+			/// <returns>true if they are</returns>
+			bool isApstEnabled() const;
+
+			/// <summary>
+			/// Gets the APST table the host last set
+			/// </summary>
+			/// <param name="apstTable">Gets APST_ENTRIES entries</param>
+			void getApstTable(APST_ENTRY* apstTable) const;
+
+			/// <summary>
+			/// Starts an I/O command: wakes the device if it is in a non-operational state
+			/// </summary>
+			/// <param name="now">Time the controller fetched the command</param>
+			/// <returns>Time the device can start on the command</returns>
+			std::chrono::steady_clock::time_point wake(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// Finishes an I/O command: stretches its time on the device to the current power state's performance, and restarts the idle time from its end
+			/// </summary>
+			/// <param name="startTime">Time the device started on the command (from wake())</param>
+			/// <param name="completionTime">Time it would have finished in PS0</param>
+			/// <returns>Time it finishes in the current power state</returns>
+			std::chrono::steady_clock::time_point finish(std::chrono::steady_clock::time_point startTime, std::chrono::steady_clock::time_point completionTime);
+
+		private:
+			/// <summary>
+			/// Moves to a power state, keeping the device busy for the transition. Call with ModelMutex held.
+			/// </summary>
+			/// <param name="powerState">The power state</param>
+			/// <param name="time">Time the transition starts</param>
+			void transition(UINT_8 powerState, std::chrono::steady_clock::time_point time);
+
+			/// <summary>
+			/// Makes the autonomous transitions the idle time up to now calls for. Call with ModelMutex held.
+			/// </summary>
+			/// <param name="now">The time</param>
+			void transitionAutonomously(std::chrono::steady_clock::time_point now);
+
+			/// <summary>
+			/// The power state the device is in
+			/// </summary>
+			UINT_8 PowerState;
+
+			/// <summary>
+			/// The operational power state the device wakes to
+			/// </summary>
+			UINT_8 LastOperationalPowerState;
+
+			/// <summary>
+			/// Time the last transition is done. Commands can't start before this.
+			/// </summary>
+			std::chrono::steady_clock::time_point BusyUntil;
+
+			/// <summary>
+			/// Time idling in the current power state started: the later of the last command finishing and entering the state
+			/// </summary>
+			std::chrono::steady_clock::time_point IdleSince;
+
+			/// <summary>
+			/// true if autonomous power state transitions are on
+			/// </summary>
+			bool ApstEnabled;
+
+			/// <summary>
+			/// The APST table the host last set
+			/// </summary>
+			APST_ENTRY ApstTable[APST_ENTRIES];
+
+			/// <summary>
+			/// Guards everything above
+			/// </summary>
+			mutable std::mutex ModelMutex;
+		};
+	}
+}
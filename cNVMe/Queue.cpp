@@ -23,6 +23,7 @@
 Queue.cpp- A implementation file for the NVMe Queues
 */
 
+#include "Atomic.h"
 #include "Command.h"
 #include "Queue.h"
 
@@ -37,6 +38,7 @@ namespace cnvme
 			Doorbell = nullptr;
 			HeadPointer = 0; // Queue start at 0
 			TailPointer = 0; // Queue start at 0
+			PhaseTag = true; // First lap is posted with a phase tag of 1
 			LinkedMemoryAddress = 0;
 			MappedQueue = nullptr;
 		}
@@ -71,6 +73,16 @@ namespace cnvme
 			return Doorbell;
 		}
 
+		UINT_16 Queue::readDoorbell() const
+		{
+			return atomic::loadAcquire(Doorbell);
+		}
+
+		void Queue::ringDoorbell(UINT_16 value)
+		{
+			atomic::storeRelease(Doorbell, value);
+		}
+
 		UINT_32 Queue::getHeadPointer()
 		{
 			return HeadPointer;
@@ -81,6 +93,17 @@ namespace cnvme
 			return TailPointer;
 		}
 
+		bool Queue::setHeadPointer(UINT_32 newIndex)
+		{
+			if (newIndex < getQueueSize())
+			{
+				HeadPointer = newIndex;
+				return true;
+			}
+
+			return false;
+		}
+
 		bool Queue::setTailPointer(UINT_32 newIndex)
 		{
 			if (newIndex < getQueueSize())
@@ -115,7 +138,112 @@ namespace cnvme
 				TailPointer = 0;
 			}
 
-			*Doorbell = TailPointer;
+			ringDoorbell((UINT_16)TailPointer);
+		}
+
+		bool Queue::isFull() const
+		{
+			return ((TailPointer + 1) % QueueSize) == HeadPointer;
+		}
+
+		bool Queue::submitCommand(const command::NVME_COMMAND& command)
+		{
+			if (isFull())
+			{
+				return false;
+			}
+
+			command::NVME_COMMAND* submissionQueueEntry = (command::NVME_COMMAND*)MEMORY_ADDRESS_TO_8POINTER(LinkedMemoryAddress);
+			submissionQueueEntry += TailPointer;
+			memcpy_s(submissionQueueEntry, sizeof(command::NVME_COMMAND), &command, sizeof(command));
+
+			incrementTailPointerAndRingDoorbell(); // Publishes the entry
+			return true;
+		}
+
+		bool Queue::submitCommands(const command::NVME_COMMAND* commands, size_t count)
+		{
+			// One slot always stays empty so a full queue doesn't look empty
+			size_t freeEntries = (HeadPointer + QueueSize - TailPointer - 1) % QueueSize;
+			if (count > freeEntries)
+			{
+				return false;
+			}
+
+			command::NVME_COMMAND* submissionQueueEntries = (command::NVME_COMMAND*)MEMORY_ADDRESS_TO_8POINTER(LinkedMemoryAddress);
+			for (size_t i = 0; i < count; i++)
+			{
+				memcpy_s(submissionQueueEntries + TailPointer, sizeof(command::NVME_COMMAND), &commands[i], sizeof(command::NVME_COMMAND));
+				TailPointer = (TailPointer + 1) % QueueSize;
+			}
+
+			ringDoorbell((UINT_16)TailPointer); // Publishes every entry at once
+			return true;
+		}
+
+		bool Queue::postCompletionQueueEntry(command::COMPLETION_QUEUE_ENTRY completionQueueEntry)
+		{
+			if (isFull())
+			{
+				return false;
+			}
+
+			command::COMPLETION_QUEUE_ENTRY* slot = (command::COMPLETION_QUEUE_ENTRY*)MEMORY_ADDRESS_TO_8POINTER(LinkedMemoryAddress);
+			slot += TailPointer;
+
+			completionQueueEntry.P = (UINT_16)PhaseTag;
+
+			// DWord0-2 first. The host doesn't look at them until it sees the new phase tag in DWord3.
+			slot->DWord0 = completionQueueEntry.DWord0;
+			slot->DWord1 = completionQueueEntry.DWord1;
+			slot->DWord2 = completionQueueEntry.DWord2;
+			atomic::storeRelease(&slot->DWord3, completionQueueEntry.DWord3);
+
+			TailPointer++;
+			if (TailPointer == QueueSize)
+			{
+				TailPointer = 0;
+				PhaseTag = !PhaseTag; // Next lap
+			}
+			return true;
+		}
+
+		bool Queue::consumeCompletionQueueEntry(command::COMPLETION_QUEUE_ENTRY& completionQueueEntry)
+		{
+			command::COMPLETION_QUEUE_ENTRY* slot = (command::COMPLETION_QUEUE_ENTRY*)MEMORY_ADDRESS_TO_8POINTER(LinkedMemoryAddress);
+			slot += HeadPointer;
+
+			completionQueueEntry.DWord3 = atomic::loadAcquire(&slot->DWord3);
+			if (completionQueueEntry.P != (UINT_16)PhaseTag)
+			{
+				return false; // Still from the last lap
+			}
+
+			completionQueueEntry.DWord0 = slot->DWord0;
+			completionQueueEntry.DWord1 = slot->DWord1;
+			completionQueueEntry.DWord2 = slot->DWord2;
+
+			HeadPointer++;
+			if (HeadPointer == QueueSize)
+			{
+				HeadPointer = 0;
+				PhaseTag = !PhaseTag; // Next lap
+			}
+
+			ringDoorbell((UINT_16)HeadPointer); // Hands the entry back to the controller
+			return true;
+		}
+
+		bool Queue::getPhaseTag() const
+		{
+			return PhaseTag;
+		}
+
+		void Queue::reset()
+		{
+			HeadPointer = 0;
+			TailPointer = 0;
+			PhaseTag = true;
 		}
 
 		UINT_64 Queue::getMemoryAddress()
@@ -25,6 +25,7 @@ Queue.h - A header file for the NVMe Queues
 
 #pragma once
 
+#include "Command.h"
 #include "Types.h"
 
 namespace cnvme
@@ -32,7 +33,12 @@ namespace cnvme
 	namespace controller
 	{
 		/// <summary>
-		/// Represents either a submission or completion queue
+		/// Represents either a submission or completion queue.
+		/// Each queue is a single-producer/single-consumer ring shared between the host and the controller:
+		///   the producer fills entries at the tail, the consumer takes them from the head.
+		/// Submission queue entries are published by a release store to the tail doorbell (acquired by the controller).
+		/// Completion queue entries are published by a release store of DWord3, which holds the phase tag (acquired by the host).
+		///   The host hands entries back with a release store to the head doorbell.
 		/// </summary>
 		class Queue
 		{
@@ -74,6 +80,20 @@ namespace cnvme
 			/// <returns>pointer to doorbell</returns>
 			UINT_16* getDoorbell();
 
+			/// <summary>
+			/// Reads the doorbell with acquire ordering.
+			/// Everything the other side wrote to the queue before ringing the doorbell is visible after this.
+			/// </summary>
+			/// <returns>Doorbell value</returns>
+			UINT_16 readDoorbell() const;
+
+			/// <summary>
+			/// Writes the doorbell with release ordering.
+			/// Everything written to the queue before this is visible to whoever reads the doorbell.
+			/// </summary>
+			/// <param name="value">New doorbell value</param>
+			void ringDoorbell(UINT_16 value);
+
 			/// <summary>
 			/// Get the head pointer
 			/// </summary>
@@ -86,6 +106,13 @@ namespace cnvme
 			/// <returns>Gets the tail pointer</returns>
 			UINT_32 getTailPointer();
 
+			/// <summary>
+			/// Sets the head pointer index
+			/// </summary>
+			/// <param name="newIndex">the new index</param>	 
+			/// <returns>True if successful. False if the new index is out of bounds</returns>
+			bool setHeadPointer(UINT_32 newIndex);
+
 			/// <summary>
 			/// Sets the tail pointer index
 			/// </summary>
@@ -106,6 +133,55 @@ namespace cnvme
 			/// </summary>
 			void incrementTailPointerAndRingDoorbell();
 
+			/// <summary>
+			/// Returns true if adding an entry at the tail would make it catch up to the head
+			/// </summary>
+			/// <returns>true if full</returns>
+			bool isFull() const;
+
+			/// <summary>
+			/// Host side of a submission queue: copies the command in at the tail, then moves the tail and rings the doorbell.
+			/// </summary>
+			/// <param name="command">Command to submit</param>
+			/// <returns>true if submitted, false if the queue is full</returns>
+			bool submitCommand(const command::NVME_COMMAND& command);
+
+			/// <summary>
+			/// Host side of a submission queue: copies all of the commands in at the tail, then rings the doorbell once.
+			/// The controller sees either all of them or none of them (needed for fused operations).
+			/// </summary>
+			/// <param name="commands">Commands to submit, in order</param>
+			/// <param name="count">Number of commands</param>
+			/// <returns>true if submitted, false if they don't all fit in the queue</returns>
+			bool submitCommands(const command::NVME_COMMAND* commands, size_t count);
+
+			/// <summary>
+			/// Controller side of a completion queue: places the entry at the tail with the current phase tag.
+			/// DWord3 (holding the phase tag) is stored last, with release ordering, so the host never sees a partial entry.
+			/// </summary>
+			/// <param name="completionQueueEntry">Entry to post. The phase tag is filled in.</param>
+			/// <returns>true if posted, false if the queue is full</returns>
+			bool postCompletionQueueEntry(command::COMPLETION_QUEUE_ENTRY completionQueueEntry);
+
+			/// <summary>
+			/// Host side of a completion queue: takes the entry at the head if its phase tag says it is new,
+			///   then moves the head and rings the head doorbell to hand the entry back.
+			/// </summary>
+			/// <param name="completionQueueEntry">Filled in with the entry</param>
+			/// <returns>true if an entry was consumed, false if there is nothing new</returns>
+			bool consumeCompletionQueueEntry(command::COMPLETION_QUEUE_ENTRY& completionQueueEntry);
+
+			/// <summary>
+			/// Gets the phase tag for the current lap around the queue
+			/// </summary>
+			/// <returns>Phase tag</returns>
+			bool getPhaseTag() const;
+
+			/// <summary>
+			/// Puts the head and tail back to 0 and the phase tag back to 1, like a newly created queue
+			/// </summary>
+			void reset();
+
 			/// <summary>
 			/// Returns the address of the linked memory
 			/// </summary>
@@ -162,6 +238,12 @@ namespace cnvme
 			/// </summary>
 			UINT_32 TailPointer;
 
+			/// <summary>
+			/// Phase tag for entries of the current lap (completion queues only).
+			/// Starts at 1 and inverts each time the queue wraps.
+			/// </summary>
+			bool PhaseTag;
+
 			/// <summary>
 			/// The memory for this queue to use.
 			/// Submission queues will expect the 64 byte CDB here
@@ -0,0 +1,156 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+SegmentedPayload.cpp - An implementation file for the SegmentedPayload class
+*/
+
+#include "SegmentedPayload.h"
+
+namespace cnvme
+{
+	SegmentedPayload::SegmentedPayload()
+	{
+		ByteSize = 0;
+	}
+
+	SegmentedPayload::SegmentedPayload(SegmentedPayload&& other) : SegmentedPayload::SegmentedPayload()
+	{
+		*this = std::move(other);
+	}
+
+	SegmentedPayload& SegmentedPayload::operator=(SegmentedPayload&& other)
+	{
+		// check for self-assignment
+		if (&other == this)
+		{
+			return *this;
+		}
+
+		Segments = std::move(other.Segments);
+		OwnedPayloads = std::move(other.OwnedPayloads);
+		ByteSize = other.ByteSize;
+
+		other.clear();
+		return *this;
+	}
+
+	void SegmentedPayload::append(Payload&& payload)
+	{
+		if (payload.getSize() == 0)
+		{
+			return;
+		}
+
+		Segments.push_back(std::pair<BYTE*, size_t>(payload.getBuffer(), payload.getSize()));
+		ByteSize += payload.getSize();
+
+		// Moving a Payload keeps its buffer where it is, so the segment pointer above stays valid.
+		OwnedPayloads.push_back(std::move(payload));
+	}
+
+	void SegmentedPayload::append(const BYTE* pointer, size_t byteSize)
+	{
+		this->append(Payload((BYTE*)pointer, byteSize));
+	}
+
+	void SegmentedPayload::appendReference(BYTE* pointer, size_t byteSize)
+	{
+		if (byteSize == 0)
+		{
+			return;
+		}
+
+		Segments.push_back(std::pair<BYTE*, size_t>(pointer, byteSize));
+		ByteSize += byteSize;
+	}
+
+	size_t SegmentedPayload::getSize() const
+	{
+		return ByteSize;
+	}
+
+	const std::vector<std::pair<BYTE*, size_t>>& SegmentedPayload::getSegments() const
+	{
+		return Segments;
+	}
+
+	bool SegmentedPayload::copyTo(size_t offset, BYTE* destination, size_t byteSize) const
+	{
+		if (offset + byteSize > ByteSize || offset + byteSize < offset)
+		{
+			ASSERT("Attempted to copy a range outside of the SegmentedPayload");
+			return false;
+		}
+
+		for (auto &segment : Segments)
+		{
+			if (byteSize == 0)
+			{
+				break;
+			}
+
+			if (offset >= segment.second)
+			{
+				offset -= segment.second;
+				continue;
+			}
+
+			size_t bytesFromSegment = std::min(byteSize, segment.second - offset);
+			memcpy_s(destination, byteSize, segment.first + offset, bytesFromSegment);
+			destination += bytesFromSegment;
+			byteSize -= bytesFromSegment;
+			offset = 0;
+		}
+
+		return true;
+	}
+
+	Payload SegmentedPayload::toPayload()
+	{
+		Payload retPayload;
+
+		if (Segments.size() == 1 && OwnedPayloads.size() == 1 && OwnedPayloads[0].getBuffer() == Segments[0].first)
+		{
+			retPayload = std::move(OwnedPayloads[0]);
+		}
+		else if (ByteSize > 0)
+		{
+			retPayload = Payload(ByteSize, false); // Every byte is about to be copied over
+			size_t offset = 0;
+			for (auto &segment : Segments)
+			{
+				memcpy_s(retPayload.getBuffer() + offset, retPayload.getSize() - offset, segment.first, segment.second);
+				offset += segment.second;
+			}
+		}
+
+		this->clear();
+		return retPayload;
+	}
+
+	void SegmentedPayload::clear()
+	{
+		Segments.clear();
+		OwnedPayloads.clear();
+		ByteSize = 0;
+	}
+}
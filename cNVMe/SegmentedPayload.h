@@ -0,0 +1,141 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+SegmentedPayload.h - A header file for the SegmentedPayload class
+*/
+
+#pragma once
+
+#include "Payload.h"
+#include "Types.h"
+
+namespace cnvme
+{
+	/// <summary>
+	/// SegmentedPayload is a chain of byte segments that can be appended to without copying what is already there.
+	/// Contiguous memory is only created when the SegmentedPayload is materialized via toPayload().
+	/// </summary>
+	class SegmentedPayload
+	{
+	public:
+		/// <summary>
+		/// Default constructor, creates an empty chain
+		/// </summary>
+		SegmentedPayload();
+
+		/// <summary>
+		/// Move constructor. Segments are handed over without copying any bytes.
+		/// </summary>
+		/// <param name="other">Another SegmentedPayload to move from</param>
+		SegmentedPayload(SegmentedPayload &&other);
+
+		/// <summary>
+		/// Move assignment operator. Segments are handed over without copying any bytes.
+		/// </summary>
+		/// <param name="other">Another SegmentedPayload to move from</param>
+		/// <returns>SegmentedPayload</returns>
+		SegmentedPayload& operator=(SegmentedPayload&& other);
+
+		/// <summary>
+		/// Copying is not allowed since segments point into owned buffers
+		/// </summary>
+		SegmentedPayload(const SegmentedPayload &other) = delete;
+
+		/// <summary>
+		/// Copying is not allowed since segments point into owned buffers
+		/// </summary>
+		SegmentedPayload& operator=(const SegmentedPayload& other) = delete;
+
+		/// <summary>
+		/// Appends a segment by taking ownership of the given Payload's buffer. No bytes are copied.
+		/// </summary>
+		/// <param name="payload">Payload to adopt</param>
+		void append(Payload&& payload);
+
+		/// <summary>
+		/// Appends a segment by copying the given bytes into a newly owned segment.
+		/// </summary>
+		/// <param name="pointer">byte array</param>
+		/// <param name="byteSize">size of the array</param>
+		void append(const BYTE* pointer, size_t byteSize);
+
+		/// <summary>
+		/// Appends a segment that refers to memory owned by someone else. No bytes are copied.
+		/// The memory must stay valid for as long as this SegmentedPayload uses it.
+		/// </summary>
+		/// <param name="pointer">byte array</param>
+		/// <param name="byteSize">size of the array</param>
+		void appendReference(BYTE* pointer, size_t byteSize);
+
+		/// <summary>
+		/// Returns the total size of all segments
+		/// </summary>
+		/// <returns>Size in bytes</returns>
+		size_t getSize() const;
+
+		/// <summary>
+		/// Returns the segments in order as pointer/size pairs
+		/// </summary>
+		/// <returns>vector of pointer/size pairs</returns>
+		const std::vector<std::pair<BYTE*, size_t>>& getSegments() const;
+
+		/// <summary>
+		/// Copies byteSize bytes starting at offset (across segment boundaries) into destination
+		/// </summary>
+		/// <param name="offset">Offset into the chain to start copying from</param>
+		/// <param name="destination">Where to copy to</param>
+		/// <param name="byteSize">Number of bytes to copy</param>
+		/// <returns>true if the range was within the chain and was copied</returns>
+		bool copyTo(size_t offset, BYTE* destination, size_t byteSize) const;
+
+		/// <summary>
+		/// Materializes the chain into a single contiguous Payload.
+		/// If the chain is a single owned segment, its buffer is handed over without a copy.
+		/// Otherwise one allocation is made and every byte is copied exactly once.
+		/// The chain is empty afterwards.
+		/// </summary>
+		/// <returns>Payload</returns>
+		Payload toPayload();
+
+		/// <summary>
+		/// Removes all segments
+		/// </summary>
+		void clear();
+
+	private:
+
+		/// <summary>
+		/// Pointer/size of each segment, in order
+		/// </summary>
+		std::vector<std::pair<BYTE*, size_t>> Segments;
+
+		/// <summary>
+		/// Payloads whose buffers are owned by this chain
+		/// </summary>
+		std::vector<Payload> OwnedPayloads;
+
+		/// <summary>
+		/// Total number of bytes across all segments
+		/// </summary>
+		size_t ByteSize;
+	};
+}
@@ -57,14 +57,41 @@ namespace cnvme
 				{
 					results.push_back(std::async(pci::testPciHeaderId));
 					results.push_back(std::async(general::testLoopingThread));
+					results.push_back(std::async(general::testLbaRangeLock));
+					results.push_back(std::async(general::testCrc16T10Dif));
+					results.push_back(std::async(general::testTimerWheel));
+					results.push_back(std::async(general::testZoneWriteRelease));
 					results.push_back(std::async(controller_registers::testControllerReset));
+					results.push_back(std::async(controller_registers::testDoorbellStride));
 					results.push_back(std::async(commands::testNVMeCommandOpcodeInvalid));
 					results.push_back(std::async(commands::testNVMeCommandParsing));
 					results.push_back(std::async(commands::testNVMeFirmwareDownloadAndCommit));
 					results.push_back(std::async(commands::testNVMeIo));
+					results.push_back(std::async(commands::testNVMeWriteZeroes));
+					results.push_back(std::async(commands::testNVMeCompareAndWrite));
+					results.push_back(std::async(commands::testNVMeProtectionInformation));
+					results.push_back(std::async(commands::testNVMeNamespaceManagementAndAttachment));
+					results.push_back(std::async(commands::testNVMeZonedNamespace));
+					results.push_back(std::async(commands::testNVMeTimingModel));
+					results.push_back(std::async(commands::testNVMeQosLimits));
+					results.push_back(std::async(commands::testNVMePowerManagement));
 					results.push_back(std::async(commands::testNVMeQueueDeletionFailures));
 					results.push_back(std::async(driver::testNoDataCommandViaDriver));
 					results.push_back(std::async(driver::testReadCommandViaDriver));
+					results.push_back(std::async(media::testSparseNamespace));
+					results.push_back(std::async(media::testMappedFileNamespace));
+					results.push_back(std::async(media::testDirectFileNamespace));
+					results.push_back(std::async(media::testDatasetManagement));
+					results.push_back(std::async(media::testSnapshots));
+					results.push_back(std::async(media::testDedupMedia));
+					results.push_back(std::async(media::testInstantErase));
+					results.push_back(std::async(media::testImages));
+					results.push_back(std::async(media::testWriteCache));
+					results.push_back(std::async(media::testFlashTranslationLayer));
+					results.push_back(std::async(queue::testCompletionQueueRing));
+					results.push_back(std::async(payload::testSegmentedPayload));
+					results.push_back(std::async(payload::testPayloadPoolAllocation));
+					results.push_back(std::async(payload::testMemoryAccounting));
 					results.push_back(std::async(prp::testDifferentPRPSizes));
 					results.push_back(std::async(prp::testDataIntoExistingPRP));
 					results.push_back(std::async(logging::testAsserting));
@@ -102,6 +129,44 @@ namespace cnvme
 
 				return retPayload;
 			}
+
+			bool createIoQueuePair(cnvme::driver::Driver &driver, UINT_16 queueId, UINT_16 zeroBasedQueueSize)
+			{
+				Payload commandPayload(sizeof(cnvme::driver::DRIVER_COMMAND));
+				auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)commandPayload.getBuffer();
+				pDriverCommand->QueueId = ADMIN_QUEUE_ID;
+				pDriverCommand->Timeout = 5; // arbitrary
+				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE;
+				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = zeroBasedQueueSize;
+				pDriverCommand->Command.DW10_CreateIoQueue.QID = queueId;
+				pDriverCommand->Command.DW11_CreateIoCompletionQueue.IEN = 1;
+				pDriverCommand->Command.DW11_CreateIoCompletionQueue.PC = 1;
+				driver.sendCommand(commandPayload.getBuffer(), commandPayload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Controller failed creating io completion queue " + std::to_string(queueId));
+
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_SUBMISSION_QUEUE;
+				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = zeroBasedQueueSize;
+				pDriverCommand->Command.DW10_CreateIoQueue.QID = queueId;
+				pDriverCommand->Command.DW11_CreateIoSubmissionQueue.PC = 1;
+				pDriverCommand->Command.DW11_CreateIoSubmissionQueue.CQID = queueId;
+				driver.sendCommand(commandPayload.getBuffer(), commandPayload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Controller failed creating io submission queue " + std::to_string(queueId));
+
+				return true;
+			}
+
+			TemporaryFile::TemporaryFile(const std::string &prefix) : Path(prefix + std::to_string(randInt(0, UINT32_MAX)) + ".bin")
+			{
+				std::remove(this->Path.c_str());
+			}
+
+			TemporaryFile::~TemporaryFile()
+			{
+				std::remove(this->Path.c_str());
+			}
 		}
 
 		namespace general
@@ -122,6 +187,169 @@ namespace cnvme
 
 				return true;
 			}
+
+			bool testLbaRangeLock()
+			{
+				ns::LbaRangeLock rangeLock;
+				auto write0To9 = rangeLock.reserve(0, 10, true);
+				auto read20To29 = rangeLock.reserve(20, 10, false);
+				auto write5 = rangeLock.reserve(5, 1, true);
+				auto read5 = rangeLock.reserve(5, 1, false);
+				auto read25To26 = rangeLock.reserve(25, 2, false);
+				auto writeToEnd = rangeLock.reserve(UINT64_MAX - 1, 0, true);
+				FAIL_IF(rangeLock.getNumberOfReservedRanges() != 6, "Every range should be reserved");
+
+				// Nothing earlier conflicts with these, so they shouldn't block
+				write0To9->lock();
+				read20To29->lock();
+				read25To26->lock();
+				writeToEnd->lock();
+
+				auto lockWrite5 = std::async(std::launch::async, [&]() { write5->lock(); });
+				auto lockRead5 = std::async(std::launch::async, [&]() { read5->lock(); });
+				FAIL_IF(lockWrite5.wait_for(std::chrono::milliseconds(50)) != std::future_status::timeout, "A write locked a range an earlier write still has");
+				write0To9->unlock();
+				FAIL_IF(lockWrite5.wait_for(std::chrono::seconds(10)) != std::future_status::ready, "A write didn't get its range once the earlier write let go");
+				FAIL_IF(lockRead5.wait_for(std::chrono::milliseconds(50)) != std::future_status::timeout, "A read locked a range an earlier write still has");
+				write5->unlock();
+				FAIL_IF(lockRead5.wait_for(std::chrono::seconds(10)) != std::future_status::ready, "A read didn't get its range once the earlier write let go");
+				read5->unlock();
+
+				// Dropping a range without unlocking it releases it too
+				read20To29.reset();
+				read25To26.reset();
+				writeToEnd.reset();
+				FAIL_IF(rangeLock.getNumberOfReservedRanges() != 0, "Ranges should have been released");
+
+				// Overlapping writes reserved in order, locked in reverse order, still go in order
+				const UINT_32 numberOfWrites = 8;
+				std::vector<std::shared_ptr<ns::LbaRangeLock::Range>> writes;
+				for (UINT_32 i = 0; i < numberOfWrites; i++)
+				{
+					writes.push_back(rangeLock.reserve(i, numberOfWrites, true));
+				}
+
+				std::vector<UINT_32> order;
+				std::vector<std::future<void>> writers;
+				for (UINT_32 i = numberOfWrites; i > 0; i--)
+				{
+					std::shared_ptr<ns::LbaRangeLock::Range> write = writes[i - 1];
+					writers.push_back(std::async(std::launch::async, [write, i, &order]() {
+						std::lock_guard<ns::LbaRangeLock::Range> lock(*write);
+						order.push_back(i - 1);
+					}));
+				}
+
+				for (auto &i : writers)
+				{
+					i.get();
+				}
+
+				for (UINT_32 i = 0; i < numberOfWrites; i++)
+				{
+					FAIL_IF(order[i] != i, "Overlapping writes didn't get their ranges in the order they were reserved");
+				}
+
+				return true;
+			}
+
+			bool testCrc16T10Dif()
+			{
+				const std::string checkString = "123456789";
+				FAIL_IF(crc::crc16T10Dif((const UINT_8*)checkString.c_str(), checkString.size()) != 0xD0DB, "CRC16 T10-DIF of the check string wasn't 0xD0DB");
+				FAIL_IF(crc::crc16T10DifBytewise((const UINT_8*)checkString.c_str(), checkString.size()) != 0xD0DB, "Bytewise CRC16 T10-DIF of the check string wasn't 0xD0DB");
+
+				Payload data(4096 + 16, false);
+				for (size_t i = 0; i < data.getSize(); i++)
+				{
+					data.getBuffer()[i] = (UINT_8)helpers::randInt(0, 0xFF);
+				}
+
+				// Every length up to a few slices, and from every alignment
+				for (size_t start = 0; start < 8; start++)
+				{
+					for (size_t length = 0; length < 64; length++)
+					{
+						FAIL_IF(crc::crc16T10Dif(data.getBuffer() + start, length) != crc::crc16T10DifBytewise(data.getBuffer() + start, length),
+							"Sliced CRC didn't match the bytewise CRC over " + std::to_string(length) + " bytes");
+					}
+				}
+
+				// Continuing from a CRC gives the same as doing it all at once
+				UINT_16 wholeCrc = crc::crc16T10DifBytewise(data.getBuffer(), data.getSize());
+				FAIL_IF(crc::crc16T10Dif(data.getBuffer(), data.getSize()) != wholeCrc, "Sliced CRC didn't match the bytewise CRC over a whole sector with metadata");
+				for (size_t split : { (size_t)1, (size_t)7, (size_t)512, (size_t)4096 })
+				{
+					UINT_16 firstCrc = crc::crc16T10Dif(data.getBuffer(), split);
+					FAIL_IF(crc::crc16T10Dif(data.getBuffer() + split, data.getSize() - split, firstCrc) != wholeCrc, "Continuing a CRC didn't match doing it all at once");
+				}
+
+				return true;
+			}
+
+			bool testTimerWheel()
+			{
+				// 8 slots of 1 ms, so 20 ms is more than a turn away
+				TimerWheel timerWheel(std::chrono::milliseconds(1), 8);
+				auto base = std::chrono::steady_clock::now();
+
+				std::vector<int> order;
+				timerWheel.schedule(base + std::chrono::milliseconds(5), [&order]() { order.push_back(5); });
+				timerWheel.schedule(base + std::chrono::milliseconds(20), [&order]() { order.push_back(20); });
+				timerWheel.schedule(base + std::chrono::milliseconds(2), [&order]() { order.push_back(2); });
+				timerWheel.schedule(base - std::chrono::milliseconds(1), [&order]() { order.push_back(-1); });
+				FAIL_IF(timerWheel.size() != 4 || !order.empty(), "Scheduling shouldn't run anything");
+				FAIL_IF(timerWheel.getNextDeadline() > base + std::chrono::milliseconds(1), "The next deadline wasn't the callback that is already due");
+
+				FAIL_IF(timerWheel.advance(base + std::chrono::milliseconds(3)) != 2, "Didn't run exactly the callbacks that were due");
+				FAIL_IF(order != std::vector<int>({ -1, 2 }), "Due callbacks didn't run in deadline order");
+				FAIL_IF(timerWheel.advance(base + std::chrono::milliseconds(4)) != 0, "A callback ran early");
+				FAIL_IF(timerWheel.advance(base + std::chrono::milliseconds(12)) != 1 || order.back() != 5, "A callback didn't run once due");
+				FAIL_IF(timerWheel.size() != 1, "A callback more than a turn away ran early");
+				FAIL_IF(timerWheel.getNextDeadline() < base + std::chrono::milliseconds(20) || timerWheel.getNextDeadline() > base + std::chrono::milliseconds(21),
+					"The next deadline wasn't the callback more than a turn away");
+				FAIL_IF(timerWheel.advance(base + std::chrono::milliseconds(100)) != 1 || order.back() != 20, "A callback more than a turn away didn't run once due");
+
+				// Cleared callbacks never run
+				timerWheel.schedule(base, [&order]() { order.push_back(0); });
+				timerWheel.clear();
+				FAIL_IF(timerWheel.advance(base + std::chrono::seconds(1)) != 0 || timerWheel.size() != 0 || order.size() != 4, "A cleared callback ran");
+				FAIL_IF(timerWheel.getNextDeadline() != std::chrono::steady_clock::time_point::max(), "An empty wheel had a deadline");
+
+				return true;
+			}
+
+			bool testZoneWriteRelease()
+			{
+				using namespace constants::commands::zones;
+
+				ns::Zones zones(2, 64);
+				std::vector<UINT_64> resetZoneStartLbas;
+
+				// A write that fails with nothing after it gives back its LBAs and the state it opened the zone from
+				ns::ZONE_WRITE_RESERVATION first = { 0 };
+				FAIL_IF(!zones.reserveWrite(0, 8, first).succeeded(), "Couldn't reserve a write at the write pointer");
+				FAIL_IF(!zones.releaseWrite(first), "A failed write didn't give back its LBAs");
+				FAIL_IF(zones.getDescriptors()[0].WP != 0 || zones.getDescriptors()[0].ZS != zs::EMPTY, "Releasing a write didn't restore the write pointer and state");
+
+				// Reset the zone while a write is in flight, then write the same size again.
+				//  The write pointer is back where the first write would leave it, but those LBAs are the second write's.
+				FAIL_IF(!zones.reserveWrite(0, 8, first).succeeded(), "Couldn't reserve a write at the write pointer");
+				FAIL_IF(!zones.manage(0, zsa::RESET_ZONE, false, resetZoneStartLbas).succeeded(), "Zone Reset failed");
+				ns::ZONE_WRITE_RESERVATION second = { 0 };
+				FAIL_IF(!zones.reserveWrite(0, 8, second).succeeded(), "Couldn't reserve a write after a Zone Reset");
+				FAIL_IF(zones.releaseWrite(first), "A write from before a Zone Reset gave back LBAs of a write after it");
+				FAIL_IF(zones.getDescriptors()[0].WP != 8 || zones.getDescriptors()[0].ZS != zs::IMPLICITLY_OPENED, "A stale release moved the write pointer or state");
+				FAIL_IF(!zones.releaseWrite(second), "The write after the Zone Reset couldn't give back its LBAs");
+
+				// Finishing the zone also makes an earlier reservation stale
+				FAIL_IF(!zones.reserveWrite(64, 32, first).succeeded(), "Couldn't reserve a write in the second zone");
+				FAIL_IF(!zones.manage(64, zsa::FINISH_ZONE, false, resetZoneStartLbas).succeeded(), "Zone Finish failed");
+				FAIL_IF(zones.releaseWrite(first), "A write from before a Zone Finish gave back its LBAs");
+				FAIL_IF(zones.getDescriptors()[1].WP != 128 || zones.getDescriptors()[1].ZS != zs::FULL, "A stale release un-finished a zone");
+
+				return true;
+			}
 		}
 
 		namespace pci
@@ -150,7 +378,7 @@ namespace cnvme
 				FAIL_IF(p.getPciExpressRegisters().PciHeader->ID.VID != newVid, "VID did not update");
 				FAIL_IF(p.getPciExpressRegisters().PciHeader->ID.DID != newDid, "DID did not update");
 
-				p.getPciExpressRegisters().PXCAP->PXDC.IFLR = 1; // Issue reset
+				p.initiateFunctionLevelReset(); // Issue reset
 
 				// Wait for thread to catch this... also tests that the thread is working
 				p.waitForChangeLoop();
@@ -180,16 +408,16 @@ namespace cnvme
 				auto CR = controllerRegisters.getControllerRegisters();
 				auto timeoutMs = CR->CAP.TO * 500; // CAP.TO is in 500 millisecond intervals
 
-				FAIL_IF(CR->CC.EN == 1, "CC.EN should not automatically move to 1");
-				FAIL_IF(CR->CSTS.RDY != 0, "CSTS.RDY should be 0 after reset");
+				FAIL_IF(controller::registers::readRegister(CR->CC).EN == 1, "CC.EN should not automatically move to 1");
+				FAIL_IF(controller::registers::isControllerReady(CR), "CSTS.RDY should be 0 after reset");
 
-				CR->CC.EN = 1;
+				controller::registers::setControllerEnable(CR, true);
 
 				bool rdyTo1 = false;
 				UINT_64 deathTime = helpers::getTimeInMilliseconds() + timeoutMs;
 				while (helpers::getTimeInMilliseconds() < deathTime)
 				{
-					if (CR->CSTS.RDY == 1)
+					if (controller::registers::isControllerReady(CR))
 					{
 						rdyTo1 = true;
 						break;
@@ -197,17 +425,19 @@ namespace cnvme
 				}
 				FAIL_IF(rdyTo1 == false, "CSTS.RDY did not transition to 1 after CC.EN was set to 1");
 
-				UINT_32 savedAMS = CR->CC.AMS;
+				controller::registers::CONTROLLER_CONFIGURATION controllerConfiguration = controller::registers::readRegister(CR->CC);
+				UINT_32 savedAMS = controllerConfiguration.AMS;
 				UINT_32 savedACQB = (UINT_32)helpers::randInt(0, 0xFFFF);  // Make sure this does not get reset
-				CR->CC.AMS = helpers::randInt(0, 0b111);          // Make sure most things get reset
+				controllerConfiguration.AMS = helpers::randInt(0, 0b111);  // Make sure most things get reset
+				controller::registers::writeRegister(CR->CC, controllerConfiguration);
 				CR->ACQ.ACQB = savedACQB;
 
-				CR->CC.EN = 0; // Begin Reset
+				controller::registers::setControllerEnable(CR, false); // Begin Reset
 				deathTime = helpers::getTimeInMilliseconds() + timeoutMs;
 				bool rdyTo0 = false;
 				while (helpers::getTimeInMilliseconds() < deathTime)
 				{
-					if (CR->CSTS.RDY == 0)
+					if (!controller::registers::isControllerReady(CR))
 					{
 						rdyTo0 = true;
 						break;
@@ -215,12 +445,12 @@ namespace cnvme
 				}
 				FAIL_IF(rdyTo0 == false, "CSTS.RDY did not transition to 0 after CC.EN was set to 0");
 
-				CR->CC.EN = 1; // Enable controller and wait till ready
+				controller::registers::setControllerEnable(CR, true); // Enable controller and wait till ready
 				rdyTo1 = false;
 				deathTime = helpers::getTimeInMilliseconds() + timeoutMs;
 				while (helpers::getTimeInMilliseconds() < deathTime)
 				{
-					if (CR->CSTS.RDY == 1)
+					if (controller::registers::isControllerReady(CR))
 					{
 						rdyTo1 = true;
 						break;
@@ -229,11 +459,69 @@ namespace cnvme
 				FAIL_IF(rdyTo1 == false, "CSTS.RDY did not transition to 1 after CC.EN was set to 1");
 
 				// Check that proper things reset
-				FAIL_IF(CR->CC.AMS != savedAMS, "CC.AMS did not reset");
+				FAIL_IF(controller::registers::readRegister(CR->CC).AMS != savedAMS, "CC.AMS did not reset");
 				FAIL_IF(CR->ACQ.ACQB != savedACQB, "ACQ.ACQB reset when it should not have");
 
 				return true;
 			}
+
+			bool testDoorbellStride()
+			{
+				Payload payload(BAR0_SIZE);
+				UINT_8* bar0 = payload.getBuffer();
+
+				controller::registers::ControllerRegisters controllerRegisters(payload.getMemoryAddress());
+				auto CR = controllerRegisters.getControllerRegisters();
+				FAIL_IF(CR->CAP.DSTRD != DEFAULT_DOORBELL_STRIDE, "CAP.DSTRD did not default to DEFAULT_DOORBELL_STRIDE");
+
+				for (UINT_8 doorbellStride = 0; doorbellStride <= MAX_DOORBELL_STRIDE; doorbellStride++)
+				{
+					FAIL_IF(!controllerRegisters.setDoorbellStride(doorbellStride), "Unable to set the doorbell stride while the controller was disabled");
+					FAIL_IF(CR->CAP.DSTRD != doorbellStride, "CAP.DSTRD did not reflect the doorbell stride");
+
+					size_t strideBytes = (size_t)4 << doorbellStride;
+					for (UINT_16 queueId : { (UINT_16)0, (UINT_16)1, (UINT_16)(MAX_QUEUE_PAIRS - 1) })
+					{
+						FAIL_IF((UINT_8*)controllerRegisters.getSubmissionQueueTailDoorbell(queueId) != bar0 + 0x1000 + (2 * queueId * strideBytes), "SQ tail doorbell is not at 1000h + (2y * (4 << CAP.DSTRD))");
+						FAIL_IF((UINT_8*)controllerRegisters.getCompletionQueueHeadDoorbell(queueId) != bar0 + 0x1000 + ((2 * queueId + 1) * strideBytes), "CQ head doorbell is not at 1000h + ((2y + 1) * (4 << CAP.DSTRD))");
+					}
+				}
+
+				FAIL_IF(controllerRegisters.getSubmissionQueueTailDoorbell(MAX_QUEUE_PAIRS) != nullptr, "There should be no doorbell past MAX_QUEUE_PAIRS");
+				FAIL_IF(controllerRegisters.setDoorbellStride(MAX_DOORBELL_STRIDE + 1), "Doorbell stride past MAX_DOORBELL_STRIDE should be refused");
+
+				controller::registers::setControllerEnable(CR, true);
+				FAIL_IF(controllerRegisters.setDoorbellStride(0), "Doorbell stride should not change while the controller is enabled");
+				controller::registers::setControllerEnable(CR, false);
+
+				// Send a command through the last queue pair with the widest stride
+				cnvme::driver::Driver driver(MAX_DOORBELL_STRIDE);
+
+				Payload commandPayload(sizeof(cnvme::driver::DRIVER_COMMAND));
+				auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)commandPayload.getBuffer();
+				pDriverCommand->QueueId = ADMIN_QUEUE_ID;
+				pDriverCommand->Timeout = 5; // arbitrary
+				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE;
+				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = 0xF;
+				pDriverCommand->Command.DW10_CreateIoQueue.QID = MAX_QUEUE_PAIRS;
+				pDriverCommand->Command.DW11_CreateIoCompletionQueue.IEN = 1;
+				pDriverCommand->Command.DW11_CreateIoCompletionQueue.PC = 1;
+				driver.sendCommand(commandPayload.getBuffer(), commandPayload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::specific::INVALID_QUEUE_IDENTIFIER, "Controller created a queue without a doorbell");
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, MAX_QUEUE_PAIRS - 1, 0xF), "Controller failed creating the last io queue pair");
+
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->QueueId = MAX_QUEUE_PAIRS - 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::FLUSH;
+				pDriverCommand->Command.NSID = 1;
+				driver.sendCommand(commandPayload.getBuffer(), commandPayload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Flush through the last queue pair failed");
+
+				return true;
+			}
 		}
 
 		namespace commands
@@ -310,27 +598,8 @@ namespace cnvme
 				auto status = pDriverCommand->CompletionQueueEntry.SC;
 				FAIL_IF(status != constants::status::codes::specific::INVALID_QUEUE_IDENTIFIER, "Expected controller to fail IO queue deletion with admin queue ID, but did not receive INVALID_QUEUE_IDENTIFIER status");
 
-				// Create CQ 1
-				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = 0xF;
-				pDriverCommand->Command.DW10_CreateIoQueue.QID = 1;
-				pDriverCommand->Command.DW11_CreateIoCompletionQueue.IEN = 1;
-				pDriverCommand->Command.DW11_CreateIoCompletionQueue.PC = 1;
-				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE;
-				driver.sendCommand(buffer, BUF_SIZE);
-
-				status = pDriverCommand->CompletionQueueEntry.SC;
-				FAIL_IF(status != 0, "Controller failed creating an io completion queue");
-
-				// Create SQ 1
-				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = 0xF;
-				pDriverCommand->Command.DW10_CreateIoQueue.QID = 1;
-				pDriverCommand->Command.DW11_CreateIoSubmissionQueue.PC = 1;
-				pDriverCommand->Command.DW11_CreateIoSubmissionQueue.CQID = 1; // Link to CQ 1
-				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_SUBMISSION_QUEUE;
-				driver.sendCommand(buffer, BUF_SIZE);
-
-				status = pDriverCommand->CompletionQueueEntry.SC;
-				FAIL_IF(status != 0, "Controller failed creating an io completion queue");
+				// Create CQ 1 and SQ 1
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
 
 				// Deleting CQ 1 should fail since we need to delete SQ 1 first
 				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::DELETE_IO_COMPLETION_QUEUE;
@@ -363,31 +632,12 @@ namespace cnvme
 
 				Payload payload(8192); // generic large size
 				auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)payload.getBuffer();
-				pDriverCommand->QueueId = ADMIN_QUEUE_ID;
 
 				UINT_32 timeout = 5; // arbitrary
 				pDriverCommand->Timeout = timeout;
-				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
-				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_COMPLETION_QUEUE;
-
-				// Create CQ 1
-				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = 0xF;
-				pDriverCommand->Command.DW10_CreateIoQueue.QID = 1;
-				pDriverCommand->Command.DW11_CreateIoCompletionQueue.IEN = 1;
-				pDriverCommand->Command.DW11_CreateIoCompletionQueue.PC = 1;
-				driver.sendCommand(payload.getBuffer(), payload.getSize());
-
-				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Controller failed creating an io completion queue");
-
-				// Create SQ 1
-				pDriverCommand->Command.DW10_CreateIoQueue.QSIZE = 0xF;
-				pDriverCommand->Command.DW10_CreateIoQueue.QID = 1;
-				pDriverCommand->Command.DW11_CreateIoSubmissionQueue.PC = 1;
-				pDriverCommand->Command.DW11_CreateIoSubmissionQueue.CQID = 1; // Link to CQ 1
-				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::CREATE_IO_SUBMISSION_QUEUE;
-				driver.sendCommand(payload.getBuffer(), payload.getSize());
 
-				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Controller failed creating an io completion queue");
+				// Create CQ 1 and SQ 1
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
 
 				// Now we have IO Queue Pair 1
 				pDriverCommand->QueueId = 1;
@@ -474,6 +724,334 @@ namespace cnvme
 				return true;
 			}
 
+			bool testNVMeWriteZeroes()
+			{
+				cnvme::driver::Driver driver;
+
+				Payload payload(8192); // generic large size
+				auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)payload.getBuffer();
+				pDriverCommand->Timeout = 5; // arbitrary
+
+				// Create IO Queue Pair 1
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				// Fill the first 8 sectors with 0xAB
+				const UINT_32 numberOfSectors = 8;
+				pDriverCommand->QueueId = 1;
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+				pDriverCommand->Command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(numberOfSectors);
+				pDriverCommand->TransferDataDirection = cnvme::driver::WRITE;
+				pDriverCommand->TransferDataSize = numberOfSectors * DEFAULT_SECTOR_SIZE;
+				memset(pDriverCommand->TransferData, 0xAB, pDriverCommand->TransferDataSize);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write the sectors");
+
+				// Zero sectors 3 through 5, no data goes along with it
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE_ZEROES;
+				pDriverCommand->Command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(3);
+				pDriverCommand->Command.SLBA = 3;
+				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+				pDriverCommand->TransferDataSize = 0;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write zeroes");
+
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				pDriverCommand->Command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(numberOfSectors);
+				pDriverCommand->TransferDataDirection = cnvme::driver::READ;
+				pDriverCommand->TransferDataSize = numberOfSectors * DEFAULT_SECTOR_SIZE;
+				memset(pDriverCommand->TransferData, 0xFF, pDriverCommand->TransferDataSize);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read back the sectors");
+
+				for (size_t i = 0; i < numberOfSectors * DEFAULT_SECTOR_SIZE; i++)
+				{
+					UINT_8 expected = (i >= 3 * DEFAULT_SECTOR_SIZE && i < 6 * DEFAULT_SECTOR_SIZE) ? 0 : 0xAB;
+					FAIL_IF(pDriverCommand->TransferData[i] != expected, "Write Zeroes did not zero exactly the LBAs it was given");
+				}
+
+				// Running off the end of the namespace
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE_ZEROES;
+				pDriverCommand->Command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(2);
+				pDriverCommand->Command.SLBA = DEFAULT_NAMESPACE_SIZE / DEFAULT_SECTOR_SIZE - 1;
+				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+				pDriverCommand->TransferDataSize = 0;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::generic::LBA_OUT_OF_RANGE, "Write Zeroes past the end of the namespace should be out of range");
+
+				return true;
+			}
+
+			bool testNVMeCompareAndWrite()
+			{
+				const UINT_32 transferSize = DEFAULT_SECTOR_SIZE * 2;
+				helpers::TemporaryFile testFile("cNVMeCompareAndWriteTest");
+				const std::string &filePath = testFile.Path;
+
+				for (bool directIo : { false, true })
+				{
+					cnvme::driver::Driver driver;
+					if (directIo)
+					{
+						FAIL_IF(!driver.setNamespaceMediaFile(1, filePath, DEFAULT_NAMESPACE_SIZE, true), "Failed to back the default namespace with a direct I/O file");
+					}
+
+					Payload firstPayload(sizeof(cnvme::driver::DRIVER_COMMAND) + transferSize);
+					Payload secondPayload(sizeof(cnvme::driver::DRIVER_COMMAND) + transferSize);
+					auto pFirst = (cnvme::driver::PDRIVER_COMMAND)firstPayload.getBuffer();
+					auto pSecond = (cnvme::driver::PDRIVER_COMMAND)secondPayload.getBuffer();
+
+					// A small queue pair, so the fused pairs have to go around it
+					FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0x3), "Controller failed creating io queue pair 1");
+
+					auto setUpCommand = [transferSize](cnvme::driver::PDRIVER_COMMAND pDriverCommand, UINT_8 opcode, UINT_8 value) {
+						memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+						pDriverCommand->Timeout = 5;
+						pDriverCommand->QueueId = 1;
+						pDriverCommand->Command.NSID = 1;
+						pDriverCommand->Command.DWord0Breakdown.OPC = opcode;
+						pDriverCommand->Command.SLBA = 2;
+						pDriverCommand->Command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(transferSize / DEFAULT_SECTOR_SIZE);
+						pDriverCommand->TransferDataDirection = cnvme::driver::WRITE; // Compare sends data too
+						pDriverCommand->TransferDataSize = transferSize;
+						memset(pDriverCommand->TransferData, value, transferSize);
+					};
+
+					// Our 'lock word' starts at 0
+					setUpCommand(pFirst, constants::opcodes::nvm::WRITE, 0);
+					driver.sendCommand(firstPayload.getBuffer(), firstPayload.getSize());
+					FAIL_IF(!pFirst->CompletionQueueEntry.succeeded(), "Failed to write the starting data");
+
+					setUpCommand(pFirst, constants::opcodes::nvm::COMPARE, 0);
+					driver.sendCommand(firstPayload.getBuffer(), firstPayload.getSize());
+					FAIL_IF(!pFirst->CompletionQueueEntry.succeeded(), "Compare failed against matching data");
+
+					// Only the very last byte is different
+					pFirst->TransferData[transferSize - 1] = 1;
+					driver.sendCommand(firstPayload.getBuffer(), firstPayload.getSize());
+					FAIL_IF(pFirst->CompletionQueueEntry.SCT != constants::status::types::MEDIA_AND_DATA_INTEGRITY ||
+						pFirst->CompletionQueueEntry.SC != constants::status::codes::integrity::COMPARE_FAILURE, "Compare passed against different data");
+
+					// Move the lock word along, more times than there are queue entries
+					for (UINT_8 value = 0; value < 10; value++)
+					{
+						setUpCommand(pFirst, constants::opcodes::nvm::COMPARE, value);
+						setUpCommand(pSecond, constants::opcodes::nvm::WRITE, value + 1);
+						driver.sendFusedCommands(firstPayload.getBuffer(), firstPayload.getSize(), secondPayload.getBuffer(), secondPayload.getSize());
+						FAIL_IF(pFirst->DriverStatus != cnvme::driver::SENT_SUCCESSFULLY || pSecond->DriverStatus != cnvme::driver::SENT_SUCCESSFULLY, "Fused commands didn't both complete");
+						FAIL_IF(!pFirst->CompletionQueueEntry.succeeded() || !pSecond->CompletionQueueEntry.succeeded(), "Compare and Write failed with matching data");
+					}
+
+					// Someone else got there first, so the write can't happen
+					setUpCommand(pFirst, constants::opcodes::nvm::COMPARE, 0);
+					setUpCommand(pSecond, constants::opcodes::nvm::WRITE, 0xFF);
+					driver.sendFusedCommands(firstPayload.getBuffer(), firstPayload.getSize(), secondPayload.getBuffer(), secondPayload.getSize());
+					FAIL_IF(pFirst->CompletionQueueEntry.SC != constants::status::codes::integrity::COMPARE_FAILURE, "Compare and Write passed the compare with stale data");
+					FAIL_IF(pSecond->CompletionQueueEntry.SC != constants::status::codes::generic::COMMAND_ABORTED_DUE_TO_FAILED_FUSED_COMMAND, "The write of a failed Compare and Write wasn't aborted");
+
+					setUpCommand(pFirst, constants::opcodes::nvm::COMPARE, 10);
+					driver.sendCommand(firstPayload.getBuffer(), firstPayload.getSize());
+					FAIL_IF(!pFirst->CompletionQueueEntry.succeeded(), "The data wasn't what the last successful Compare and Write left");
+
+					// Both halves have to cover the same LBAs
+					setUpCommand(pFirst, constants::opcodes::nvm::COMPARE, 10);
+					setUpCommand(pSecond, constants::opcodes::nvm::WRITE, 0xFF);
+					pSecond->Command.SLBA = 0;
+					driver.sendFusedCommands(firstPayload.getBuffer(), firstPayload.getSize(), secondPayload.getBuffer(), secondPayload.getSize());
+					FAIL_IF(pFirst->CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND ||
+						pSecond->CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Compare and Write over different LBAs should fail both");
+
+					// Only Compare then Write can be fused
+					setUpCommand(pFirst, constants::opcodes::nvm::WRITE, 10);
+					setUpCommand(pSecond, constants::opcodes::nvm::WRITE, 0xFF);
+					driver.sendFusedCommands(firstPayload.getBuffer(), firstPayload.getSize(), secondPayload.getBuffer(), secondPayload.getSize());
+					FAIL_IF(pFirst->CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND ||
+						pSecond->CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Fusing two writes should fail both");
+
+					// A second fused command on its own
+					setUpCommand(pFirst, constants::opcodes::nvm::WRITE, 0xFF);
+					pFirst->Command.DWord0Breakdown.FUSE = constants::commands::fuse::SECOND_COMMAND;
+					driver.sendCommand(firstPayload.getBuffer(), firstPayload.getSize());
+					FAIL_IF(pFirst->CompletionQueueEntry.SC != constants::status::codes::generic::COMMAND_ABORTED_DUE_TO_MISSING_FUSED_COMMAND, "A lone second fused command should fail as missing the first");
+
+					setUpCommand(pFirst, constants::opcodes::nvm::COMPARE, 10);
+					driver.sendCommand(firstPayload.getBuffer(), firstPayload.getSize());
+					FAIL_IF(!pFirst->CompletionQueueEntry.succeeded(), "A failed fused operation changed the data");
+				}
+
+				return true;
+			}
+
+			bool testNVMeProtectionInformation()
+			{
+				cnvme::driver::Driver driver;
+
+				Payload payload(sizeof(cnvme::driver::DRIVER_COMMAND) + 8192);
+				auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)payload.getBuffer();
+				pDriverCommand->Timeout = 5;
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				auto format = [&](UINT_8 lbaFormat, bool extendedLba, UINT_8 protectionInformationType, bool protectionInformationFirst) {
+					memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+					pDriverCommand->QueueId = ADMIN_QUEUE_ID;
+					pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+					pDriverCommand->TransferDataSize = 0;
+					pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::FORMAT_NVM;
+					pDriverCommand->Command.NSID = 1;
+					pDriverCommand->Command.DW10_Format.LBAF = lbaFormat;
+					pDriverCommand->Command.DW10_Format.MSET = extendedLba;
+					pDriverCommand->Command.DW10_Format.PI = protectionInformationType;
+					pDriverCommand->Command.DW10_Format.PIL = protectionInformationFirst;
+					driver.sendCommand(payload.getBuffer(), payload.getSize());
+					return pDriverCommand->CompletionQueueEntry;
+				};
+
+				auto setUpIo = [&](UINT_8 opcode, UINT_64 slba, UINT_32 numberOfLbas, UINT_32 transferSize, UINT_8 prinfo, UINT_32 referenceTag, UINT_16 applicationTag) {
+					memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+					pDriverCommand->QueueId = 1;
+					pDriverCommand->TransferDataDirection = (opcode == constants::opcodes::nvm::READ) ? cnvme::driver::READ : cnvme::driver::WRITE;
+					pDriverCommand->TransferDataSize = transferSize;
+					pDriverCommand->Command.DWord0Breakdown.OPC = opcode;
+					pDriverCommand->Command.NSID = 1;
+					pDriverCommand->Command.SLBA = slba;
+					pDriverCommand->Command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(numberOfLbas);
+					pDriverCommand->Command.DW12_IO.PRINFO = prinfo;
+					pDriverCommand->Command.EILBRT = referenceTag;
+					pDriverCommand->Command.DW15_IO.ELBAT = applicationTag;
+					pDriverCommand->Command.DW15_IO.ELBATM = 0xFFFF;
+				};
+
+				const UINT_8 checkAll = constants::commands::io::prinfo::CHECK_GUARD | constants::commands::io::prinfo::CHECK_APPLICATION_TAG | constants::commands::io::prinfo::CHECK_REFERENCE_TAG;
+				const UINT_8 pract = constants::commands::io::prinfo::PRACT;
+
+				// Protection information needs metadata to go in
+				auto completionQueueEntry = format(0, true, constants::commands::format::pi::TYPE_1, false);
+				FAIL_IF(completionQueueEntry.SC != constants::status::codes::specific::INVALID_FORMAT, "Formatted with protection information but no metadata");
+
+				// 512 + 8 byte extended LBAs with Type 1 protection information
+				completionQueueEntry = format(3, true, constants::commands::format::pi::TYPE_1, false);
+				FAIL_IF(!completionQueueEntry.succeeded(), "Failed to format with Type 1 protection information");
+
+				// The controller inserts the protection information, so only data goes across
+				setUpIo(constants::opcodes::nvm::WRITE, 4, 2, 1024, pract | checkAll, 4, 0x1234);
+				memset(pDriverCommand->TransferData, 0xAB, 1024);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write with the controller inserting protection information");
+
+				// Reading the whole extended LBAs gives the protection information the controller made
+				setUpIo(constants::opcodes::nvm::READ, 4, 2, 1040, checkAll, 4, 0x1234);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read back extended LBAs with good protection information");
+				for (UINT_32 i = 0; i < 2; i++)
+				{
+					const UINT_8* lba = pDriverCommand->TransferData + i * 520;
+					auto pProtectionInformation = (const command::PROTECTION_INFORMATION*)(lba + 512);
+					UINT_16 guard = crc::crc16T10Dif(lba, 512);
+					FAIL_IF(lba[0] != 0xAB || lba[511] != 0xAB, "Data in the extended LBA didn't match what was written");
+					FAIL_IF(pProtectionInformation->Guard[0] != (guard >> 8) || pProtectionInformation->Guard[1] != (guard & 0xFF), "The guard wasn't the big endian CRC of the data");
+					FAIL_IF(pProtectionInformation->ApplicationTag[0] != 0x12 || pProtectionInformation->ApplicationTag[1] != 0x34, "The application tag wasn't the one given");
+					FAIL_IF(pProtectionInformation->ReferenceTag[0] != 0 || pProtectionInformation->ReferenceTag[3] != 4 + i, "The reference tag didn't count up from the initial one");
+				}
+
+				// Each check fails on its own, and nothing is read
+				setUpIo(constants::opcodes::nvm::READ, 4, 2, 1040, constants::commands::io::prinfo::CHECK_APPLICATION_TAG, 4, 0x4321);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::integrity::END_TO_END_APPLICATION_TAG_CHECK_ERROR, "Read passed with the wrong application tag");
+
+				setUpIo(constants::opcodes::nvm::READ, 4, 2, 1040, constants::commands::io::prinfo::CHECK_APPLICATION_TAG, 4, 0x12FF);
+				pDriverCommand->Command.DW15_IO.ELBATM = 0xFF00; // Only the tag bits that match
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Read failed the application tag check on masked off bits");
+
+				setUpIo(constants::opcodes::nvm::READ, 4, 2, 1040, constants::commands::io::prinfo::CHECK_REFERENCE_TAG, 5, 0x1234);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::specific::INVALID_PROTECTION_INFORMATION, "Type 1 read passed with an initial reference tag that isn't the LBA");
+
+				// The controller strips the protection information on the way back
+				setUpIo(constants::opcodes::nvm::READ, 4, 2, 1024, pract | checkAll, 4, 0x1234);
+				memset(pDriverCommand->TransferData, 0, 1040);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read with the controller stripping protection information");
+				FAIL_IF(pDriverCommand->TransferData[1023] != 0xAB || pDriverCommand->TransferData[1024] != 0, "Stripped read didn't give back just the data");
+
+				// A bad guard from the host fails the write before anything lands
+				setUpIo(constants::opcodes::nvm::READ, 4, 1, 520, 0, 0, 0);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				setUpIo(constants::opcodes::nvm::WRITE, 4, 1, 520, checkAll, 4, 0x1234);
+				memset(pDriverCommand->TransferData, 0xCD, 512);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::integrity::END_TO_END_GUARD_CHECK_ERROR, "Write passed with a guard that doesn't match the data");
+
+				setUpIo(constants::opcodes::nvm::COMPARE, 4, 2, 1024, pract | checkAll, 4, 0x1234);
+				memset(pDriverCommand->TransferData, 0xAB, 1024);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "A write with a bad guard changed the data");
+
+				pDriverCommand->TransferData[600] = 0xAC;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::integrity::COMPARE_FAILURE, "Compare passed against different data");
+
+				// LBAs that were never written read as escaped protection information, so they pass every check
+				setUpIo(constants::opcodes::nvm::READ, 0, 1, 520, checkAll, 0, 0x1234);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Reading an unwritten LBA failed its protection information checks");
+				FAIL_IF(pDriverCommand->TransferData[0] != 0 || pDriverCommand->TransferData[512] != 0xFF || pDriverCommand->TransferData[519] != 0xFF, "Unwritten LBA didn't read as zeros with all FFh protection information");
+
+				// 4096 + 16 byte LBAs with the metadata in its own buffer and Type 3 protection information first in it
+				completionQueueEntry = format(5, false, constants::commands::format::pi::TYPE_3, true);
+				FAIL_IF(!completionQueueEntry.succeeded(), "Failed to format with Type 3 protection information in separate metadata");
+
+				UINT_8 metadata[32] = { 0 };
+				memset(metadata, 0x5A, sizeof(metadata)); // The controller replaces the protection information part
+
+				setUpIo(constants::opcodes::nvm::WRITE, 1, 2, 8192, pract, 0xCAFE, 0xBEEF);
+				pDriverCommand->Command.CompleteMPTR = (UINT_64)metadata;
+				memset(pDriverCommand->TransferData, 0x77, 8192);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write with separate metadata");
+
+				memset(metadata, 0, sizeof(metadata));
+				setUpIo(constants::opcodes::nvm::READ, 1, 2, 8192, checkAll, 0xCAFE, 0xBEEF);
+				pDriverCommand->Command.CompleteMPTR = (UINT_64)metadata;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read back with separate metadata");
+				for (UINT_32 i = 0; i < 2; i++)
+				{
+					auto pProtectionInformation = (const command::PROTECTION_INFORMATION*)(metadata + i * 16);
+					UINT_16 guard = crc::crc16T10Dif(pDriverCommand->TransferData + i * 4096, 4096);
+					FAIL_IF(pProtectionInformation->Guard[0] != (guard >> 8) || pProtectionInformation->Guard[1] != (guard & 0xFF), "The guard at the front of the metadata wasn't just the CRC of the data");
+					FAIL_IF(pProtectionInformation->ReferenceTag[2] != 0xCA || pProtectionInformation->ReferenceTag[3] != 0xFE, "Type 3 reference tag shouldn't count up");
+					FAIL_IF(metadata[i * 16 + 8] != 0x5A || metadata[i * 16 + 15] != 0x5A, "The host's own metadata after the protection information didn't come back");
+				}
+
+				// Separate metadata needs somewhere to go
+				setUpIo(constants::opcodes::nvm::READ, 1, 2, 8192, checkAll, 0xCAFE, 0xBEEF);
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(pDriverCommand->CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Read with separate metadata passed without a metadata pointer");
+
+				// Deallocated LBAs are escaped
+				setUpIo(constants::opcodes::nvm::WRITE_ZEROES, 1, 2, 0, 0, 0, 0);
+				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write zeroes");
+
+				setUpIo(constants::opcodes::nvm::READ, 1, 2, 8192, checkAll, 0xCAFE, 0xBEEF);
+				pDriverCommand->Command.CompleteMPTR = (UINT_64)metadata;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Reading zeroed LBAs failed their protection information checks");
+				FAIL_IF(metadata[0] != 0xFF || metadata[31] != 0xFF, "Zeroed LBAs didn't have all FFh metadata");
+
+				return true;
+			}
+
 			bool testNVMeFirmwareDownloadAndCommit()
 			{
 				cnvme::driver::TestDriver driver;
@@ -513,6 +1091,526 @@ namespace cnvme
 
 				return true;
 			}
+
+			bool testNVMeNamespaceManagementAndAttachment()
+			{
+				cnvme::driver::TestDriver driver;
+				using namespace constants::commands::ns_attachment;
+
+				auto identifyController = driver.identify(constants::commands::identify::cns::CONTROLLER, 0);
+				auto pIdentifyController = (identify::structures::IDENTIFY_CONTROLLER*)identifyController.OutputData.getBuffer();
+				FAIL_IF(!pIdentifyController->NamespaceCommandsSupported, "Namespace management should be supported");
+				FAIL_IF(pIdentifyController->MAXCMD != MAX_COMMAND_IDENTIFIER, "Identify Controller should report that a queue runs as many commands at once as it has command identifiers");
+				UINT_16 controllerId = pIdentifyController->CNTLID;
+
+				// 1 TB each (in 512 byte sectors), but almost none of it has to be backed
+				const UINT_64 namespaceSizeInSectors = 1ULL << 31;
+				const UINT_32 numberOfNamespaces = 300;
+				std::set<UINT_32> createdNsids;
+				for (UINT_32 i = 0; i < numberOfNamespaces; i++)
+				{
+					auto result = driver.namespaceCreate(namespaceSizeInSectors, 16, 0, constants::commands::identify::csi::NVM);
+					FAIL_IF(!result.CompletionQueueEntry.succeeded(), "Failed to create a namespace");
+					createdNsids.insert(result.CompletionQueueEntry.DWord0);
+				}
+				FAIL_IF(createdNsids.size() != numberOfNamespaces || createdNsids.count(1), "Created namespaces did not get unique, unused NSIDs");
+
+				// All are allocated, none are active (besides the default one)
+				auto allocatedList = driver.identify(constants::commands::identify::cns::NAMESPACES_ALL, 0);
+				auto pAllocatedNsids = (UINT_32*)allocatedList.OutputData.getBuffer();
+				UINT_32 numberOfAllocatedNsids = 0;
+				while (numberOfAllocatedNsids < constants::commands::identify::sizes::MAX_NSID_IN_NAMESPACE_LIST && pAllocatedNsids[numberOfAllocatedNsids] != 0)
+				{
+					numberOfAllocatedNsids++;
+				}
+				FAIL_IF(numberOfAllocatedNsids != numberOfNamespaces + 1, "The allocated namespace list didn't have every namespace");
+
+				auto activeList = driver.identify(constants::commands::identify::cns::NAMESPACES_ACTIVE, 0);
+				FAIL_IF(((UINT_32*)activeList.OutputData.getBuffer())[1] != 0, "A created namespace was active before being attached");
+
+				UINT_32 nsid = *createdNsids.rbegin();
+				FAIL_IF(driver.namespaceAttachment(sel::ATTACH_CONTROLLERS, nsid, controllerId + 1).CompletionQueueEntry.SC != constants::status::codes::specific::CONTROLLER_LIST_INVALID, "Attaching to a controller that doesn't exist should fail");
+				FAIL_IF(!driver.namespaceAttachment(sel::ATTACH_CONTROLLERS, nsid, controllerId).CompletionQueueEntry.succeeded(), "Failed to attach a namespace");
+				FAIL_IF(driver.namespaceAttachment(sel::ATTACH_CONTROLLERS, nsid, controllerId).CompletionQueueEntry.SC != constants::status::codes::specific::NAMESPACE_ALREADY_ATTACHED, "Attaching twice should fail");
+
+				auto attachedControllers = driver.identify(constants::commands::identify::cns::CONTROLLERS_ATTACHED_TO_NAMESPACE, nsid);
+				FAIL_IF(((identify::structures::CONTROLLER_LIST*)attachedControllers.OutputData.getBuffer())->NumberOfIdentifiers != 1, "The attached namespace didn't list this controller");
+
+				auto identifyNamespace = driver.identify(constants::commands::identify::cns::NAMESPACE_ACTIVE, nsid);
+				FAIL_IF(((identify::structures::IDENTIFY_NAMESPACE*)identifyNamespace.OutputData.getBuffer())->NSZE != namespaceSizeInSectors, "The attached namespace has the wrong size");
+
+				// Do I/O at the end of the namespace
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				NVME_COMMAND command = { 0 };
+				command.NSID = nsid;
+				command.SLBA = namespaceSizeInSectors - 1;
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+				Payload writeData(DEFAULT_SECTOR_SIZE);
+				memset(writeData.getBuffer(), 0xAB, writeData.getSize());
+				FAIL_IF(!driver.writeCommand(command, 1, writeData).CompletionQueueEntry.succeeded(), "Failed to write to the last sector of a created namespace");
+
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				auto readResult = driver.readCommand(command, 1, DEFAULT_SECTOR_SIZE);
+				FAIL_IF(!readResult.CompletionQueueEntry.succeeded(), "Failed to read from the last sector of a created namespace");
+				FAIL_IF(readResult.OutputData != writeData, "Read back the wrong data from a created namespace");
+
+				// Detach
+				FAIL_IF(!driver.namespaceAttachment(sel::DETACH_CONTROLLERS, nsid, controllerId).CompletionQueueEntry.succeeded(), "Failed to detach a namespace");
+				FAIL_IF(driver.namespaceAttachment(sel::DETACH_CONTROLLERS, nsid, controllerId).CompletionQueueEntry.SC != constants::status::codes::specific::NAMESPACE_NOT_ATTACHED, "Detaching twice should fail");
+				FAIL_IF(driver.readCommand(command, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "Read from a detached namespace");
+				attachedControllers = driver.identify(constants::commands::identify::cns::CONTROLLERS_ATTACHED_TO_NAMESPACE, nsid);
+				FAIL_IF(((identify::structures::CONTROLLER_LIST*)attachedControllers.OutputData.getBuffer())->NumberOfIdentifiers != 0, "The detached namespace still listed this controller");
+
+				// Bad creates
+				FAIL_IF(driver.namespaceCreate(namespaceSizeInSectors, 16, 15, constants::commands::identify::csi::NVM).CompletionQueueEntry.SC != constants::status::codes::specific::INVALID_FORMAT, "Creating with an unsupported LBA format should fail");
+				FAIL_IF(driver.namespaceCreate(0, 0, 0, constants::commands::identify::csi::NVM).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Creating an empty namespace should fail");
+				FAIL_IF(driver.namespaceCreate(16, 32, 0, constants::commands::identify::csi::NVM).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Creating with more capacity than size should fail");
+
+				// Deletes
+				FAIL_IF(!driver.namespaceDelete(nsid).CompletionQueueEntry.succeeded(), "Failed to delete a namespace");
+				FAIL_IF(driver.namespaceDelete(nsid).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT, "Deleting a deleted namespace should fail as an invalid namespace");
+				FAIL_IF(driver.namespaceAttachment(sel::ATTACH_CONTROLLERS, nsid, controllerId).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT,
+					"Attaching a deleted namespace should fail as an invalid namespace");
+				FAIL_IF(driver.namespaceAttachment(sel::ATTACH_CONTROLLERS, ALL_NAMESPACES, controllerId).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND,
+					"Attaching all namespaces at once should fail");
+				FAIL_IF(!driver.namespaceDelete(ALL_NAMESPACES).CompletionQueueEntry.succeeded(), "Failed to delete all namespaces");
+				allocatedList = driver.identify(constants::commands::identify::cns::NAMESPACES_ALL, 0);
+				FAIL_IF(((UINT_32*)allocatedList.OutputData.getBuffer())[0] != 0, "Namespaces were left after deleting all of them");
+
+				// The lowest NSID gets reused
+				auto recreated = driver.namespaceCreate(8, 8, 1, constants::commands::identify::csi::NVM);
+				FAIL_IF(!recreated.CompletionQueueEntry.succeeded() || recreated.CompletionQueueEntry.DWord0 != 1, "A new namespace didn't get the lowest free NSID");
+
+				return true;
+			}
+
+			bool testNVMeZonedNamespace()
+			{
+				cnvme::driver::TestDriver driver;
+				using namespace constants::commands::zones;
+
+				auto identifyController = driver.identify(constants::commands::identify::cns::CONTROLLER, 0);
+				UINT_16 controllerId = ((identify::structures::IDENTIFY_CONTROLLER*)identifyController.OutputData.getBuffer())->CNTLID;
+
+				// 4 zones of 512 byte sectors
+				const UINT_64 zoneSize = DEFAULT_ZONE_SIZE / DEFAULT_SECTOR_SIZE;
+				const UINT_64 numberOfZones = 4;
+				FAIL_IF(driver.namespaceCreate(zoneSize + 1, 16, 0, constants::commands::identify::csi::ZONED_NAMESPACE).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Creating a zoned namespace that isn't a whole number of zones should fail");
+				FAIL_IF(driver.namespaceCreate(zoneSize, 16, 0, 1).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Creating a namespace in an unsupported command set should fail");
+
+				auto createResult = driver.namespaceCreate(zoneSize * numberOfZones, 16, 0, constants::commands::identify::csi::ZONED_NAMESPACE);
+				FAIL_IF(!createResult.CompletionQueueEntry.succeeded(), "Failed to create a zoned namespace");
+				UINT_32 nsid = createResult.CompletionQueueEntry.DWord0;
+				FAIL_IF(!driver.namespaceAttachment(constants::commands::ns_attachment::sel::ATTACH_CONTROLLERS, nsid, controllerId).CompletionQueueEntry.succeeded(), "Failed to attach the zoned namespace");
+
+				// Identify says what it is
+				auto descriptorList = driver.identify(constants::commands::identify::cns::NAMESPACE_DESCRIPTOR, nsid);
+				auto pCommandSet = (identify::structures::NAMESPACE_IDENTIFICATION_DESCRIPTOR_CSI*)(descriptorList.OutputData.getBuffer() + sizeof(identify::structures::NAMESPACE_IDENTIFICATION_DESCRIPTOR_NGUID));
+				FAIL_IF(pCommandSet->NIDT != constants::commands::identify::ns_identifiers::COMMAND_SET_IDENTIFIER || pCommandSet->CSI != constants::commands::identify::csi::ZONED_NAMESPACE, "The namespace descriptor list didn't have the Zoned Namespace Command Set");
+
+				NVME_COMMAND command = { 0 };
+				command.DWord0Breakdown.OPC = constants::opcodes::admin::IDENTIFY;
+				command.DW10_Identify.CNS = constants::commands::identify::cns::NAMESPACE_ACTIVE_COMMAND_SET_SPECIFIC;
+				command.DW11_Identify.CSI = constants::commands::identify::csi::ZONED_NAMESPACE;
+				command.NSID = nsid;
+				auto identifyNamespaceZoned = driver.readCommand(command, ADMIN_QUEUE_ID, constants::commands::identify::sizes::IDENTIFY_SIZE);
+				FAIL_IF(!identifyNamespaceZoned.CompletionQueueEntry.succeeded(), "Identify Namespace for the Zoned Namespace Command Set failed");
+				FAIL_IF(((identify::structures::IDENTIFY_NAMESPACE_ZONED*)identifyNamespaceZoned.OutputData.getBuffer())->LBAFE[0].ZSZE != zoneSize, "Identify Namespace (zoned) had the wrong zone size");
+				command.NSID = 1;
+				FAIL_IF(driver.readCommand(command, ADMIN_QUEUE_ID, constants::commands::identify::sizes::IDENTIFY_SIZE).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Identify Namespace (zoned) of a namespace without zones should fail");
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				// Writes go at the write pointer and nowhere else
+				const UINT_32 numberOfSectors = 8;
+				Payload writeData(numberOfSectors * DEFAULT_SECTOR_SIZE);
+				memset(writeData.getBuffer(), 0xAB, writeData.getSize());
+				memset(&command, 0, sizeof(command));
+				command.NSID = nsid;
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+				command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(numberOfSectors);
+				FAIL_IF(!driver.writeCommand(command, 1, writeData).CompletionQueueEntry.succeeded(), "Failed to write at the write pointer");
+				auto writeResult = driver.writeCommand(command, 1, writeData);
+				FAIL_IF(writeResult.CompletionQueueEntry.SCT != constants::status::types::COMMAND_SPECIFIC || writeResult.CompletionQueueEntry.SC != constants::status::codes::specific::ZONE_INVALID_WRITE, "Writing behind the write pointer should fail");
+				command.SLBA = zoneSize - 1;
+				FAIL_IF(driver.writeCommand(command, 1, writeData).CompletionQueueEntry.SC != constants::status::codes::specific::ZONE_BOUNDARY_ERROR, "Writing across a zone boundary should fail");
+
+				// Appends land one after another, and the completion says where
+				Payload appendData(numberOfSectors * DEFAULT_SECTOR_SIZE);
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::ZONE_APPEND;
+				for (UINT_64 i = 1; i <= 2; i++)
+				{
+					memset(appendData.getBuffer(), (int)i, appendData.getSize());
+					command.SLBA = 0;
+					auto appendResult = driver.writeCommand(command, 1, appendData);
+					FAIL_IF(!appendResult.CompletionQueueEntry.succeeded(), "Zone Append failed");
+					FAIL_IF(appendResult.CompletionQueueEntry.DWord0 != i * numberOfSectors || appendResult.CompletionQueueEntry.DWord1 != 0, "Zone Append returned the wrong LBA");
+				}
+				command.SLBA = 1;
+				FAIL_IF(driver.writeCommand(command, 1, appendData).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Zone Append to an LBA that doesn't start a zone should fail");
+
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				command.SLBA = 2 * numberOfSectors;
+				auto readResult = driver.readCommand(command, 1, (UINT_32)appendData.getSize());
+				FAIL_IF(!readResult.CompletionQueueEntry.succeeded() || readResult.OutputData != appendData, "Read back the wrong data from where Zone Append said it went");
+
+				// Finish zone 1, explicitly open then close zone 2 (nothing written, so it is empty again)
+				NVME_COMMAND sendCommand = { 0 };
+				sendCommand.NSID = nsid;
+				sendCommand.DWord0Breakdown.OPC = constants::opcodes::nvm::ZONE_MANAGEMENT_SEND;
+				sendCommand.SLBA = zoneSize;
+				sendCommand.DW13_ZoneManagementSend.ZSA = zsa::FINISH_ZONE;
+				FAIL_IF(!driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.succeeded(), "Failed to finish a zone");
+				sendCommand.DW13_ZoneManagementSend.ZSA = zsa::OPEN_ZONE;
+				FAIL_IF(driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.SC != constants::status::codes::specific::INVALID_ZONE_STATE_TRANSITION, "Opening a full zone should fail");
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+				command.SLBA = zoneSize;
+				FAIL_IF(driver.writeCommand(command, 1, writeData).CompletionQueueEntry.SC != constants::status::codes::specific::ZONE_IS_FULL, "Writing to a full zone should fail");
+
+				sendCommand.SLBA = 2 * zoneSize;
+				FAIL_IF(!driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.succeeded(), "Failed to open a zone");
+				sendCommand.DW13_ZoneManagementSend.ZSA = zsa::CLOSE_ZONE;
+				FAIL_IF(!driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.succeeded(), "Failed to close a zone");
+				sendCommand.SLBA = 1;
+				FAIL_IF(driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Zone Management Send to an LBA that doesn't start a zone should fail");
+
+				// Report every zone
+				NVME_COMMAND receiveCommand = { 0 };
+				receiveCommand.NSID = nsid;
+				receiveCommand.DWord0Breakdown.OPC = constants::opcodes::nvm::ZONE_MANAGEMENT_RECEIVE;
+				UINT_32 reportSize = (UINT_32)(sizeof(command::ZONE_REPORT_HEADER) + numberOfZones * sizeof(command::ZONE_DESCRIPTOR));
+				receiveCommand.NUMD = ZERO_BASED_FROM_ONE_BASED(reportSize / sizeof(UINT_32));
+				auto reportResult = driver.readCommand(receiveCommand, 1, reportSize);
+				FAIL_IF(!reportResult.CompletionQueueEntry.succeeded(), "Report Zones failed");
+				auto pHeader = (command::ZONE_REPORT_HEADER*)reportResult.OutputData.getBuffer();
+				auto pDescriptors = (command::ZONE_DESCRIPTOR*)(pHeader + 1);
+				FAIL_IF(pHeader->NumberOfZones != numberOfZones, "Report Zones had the wrong number of zones");
+				FAIL_IF(pDescriptors[0].ZS != zs::IMPLICITLY_OPENED || pDescriptors[0].WP != 3 * numberOfSectors || pDescriptors[0].ZSLBA != 0, "Zone 0 was reported wrong");
+				FAIL_IF(pDescriptors[1].ZS != zs::FULL || pDescriptors[1].WP != 2 * zoneSize, "Zone 1 was reported wrong");
+				FAIL_IF(pDescriptors[2].ZS != zs::EMPTY || pDescriptors[3].ZS != zs::EMPTY || pDescriptors[3].ZCAP != zoneSize, "Zones 2 and 3 were reported wrong");
+
+				// Only empty zones, and only as many as fit (partial)
+				receiveCommand.DW13_ZoneManagementReceive.ZRASF = zrasf::EMPTY;
+				reportResult = driver.readCommand(receiveCommand, 1, reportSize);
+				FAIL_IF(((command::ZONE_REPORT_HEADER*)reportResult.OutputData.getBuffer())->NumberOfZones != 2, "Report Zones didn't filter by state");
+				receiveCommand.DW13_ZoneManagementReceive.ZRASF = zrasf::ALL_ZONES;
+				receiveCommand.DW13_ZoneManagementReceive.PARTIAL = 1;
+				reportSize = (UINT_32)(sizeof(command::ZONE_REPORT_HEADER) + sizeof(command::ZONE_DESCRIPTOR));
+				receiveCommand.NUMD = ZERO_BASED_FROM_ONE_BASED(reportSize / sizeof(UINT_32));
+				reportResult = driver.readCommand(receiveCommand, 1, reportSize);
+				FAIL_IF(((command::ZONE_REPORT_HEADER*)reportResult.OutputData.getBuffer())->NumberOfZones != 1, "A partial Report Zones counted zones that weren't in it");
+
+				// Reset everything. Data that was written reads as zeros again.
+				sendCommand.SLBA = 0;
+				sendCommand.DW13_ZoneManagementSend.ZSA = zsa::RESET_ZONE;
+				sendCommand.DW13_ZoneManagementSend.SELECT_ALL = 1;
+				FAIL_IF(!driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.succeeded(), "Failed to reset every zone");
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				command.SLBA = 0;
+				readResult = driver.readCommand(command, 1, (UINT_32)writeData.getSize());
+				FAIL_IF(!readResult.CompletionQueueEntry.succeeded() || readResult.OutputData != Payload(writeData.getSize()), "A reset zone didn't read back as zeros");
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+				FAIL_IF(!driver.writeCommand(command, 1, writeData).CompletionQueueEntry.succeeded(), "Failed to write at the start of a reset zone");
+
+				// A write that fails after its zone took it leaves the write pointer where it was
+				NVME_COMMAND formatCommand = { 0 };
+				formatCommand.DWord0Breakdown.OPC = constants::opcodes::admin::FORMAT_NVM;
+				formatCommand.NSID = nsid;
+				formatCommand.DW10_Format.LBAF = 3; // 512 + 8 byte extended LBAs
+				formatCommand.DW10_Format.MSET = 1;
+				formatCommand.DW10_Format.PI = constants::commands::format::pi::TYPE_1;
+				FAIL_IF(!driver.nonDataCommand(formatCommand, ADMIN_QUEUE_ID).CompletionQueueEntry.succeeded(), "Failed to format the zoned namespace with protection information");
+				Payload protectedData(numberOfSectors * (DEFAULT_SECTOR_SIZE + 8));
+				command.SLBA = 0;
+				command.EILBRT = 1; // Type 1 reference tags have to start at the SLBA
+				command.DW12_IO.PRINFO = constants::commands::io::prinfo::CHECK_REFERENCE_TAG;
+				FAIL_IF(driver.writeCommand(command, 1, protectedData).CompletionQueueEntry.SC != constants::status::codes::specific::INVALID_PROTECTION_INFORMATION, "A write with the wrong reference tag should fail");
+				reportResult = driver.readCommand(receiveCommand, 1, reportSize);
+				pDescriptors = (command::ZONE_DESCRIPTOR*)(reportResult.OutputData.getBuffer() + sizeof(command::ZONE_REPORT_HEADER));
+				FAIL_IF(pDescriptors[0].WP != 0 || pDescriptors[0].ZS != zs::EMPTY, "A failed write moved the write pointer");
+				command.DW12_IO.PRINFO = 0;
+				FAIL_IF(!driver.writeCommand(command, 1, protectedData).CompletionQueueEntry.succeeded(), "Failed to write where a failed write was");
+				reportResult = driver.readCommand(receiveCommand, 1, reportSize);
+				pDescriptors = (command::ZONE_DESCRIPTOR*)(reportResult.OutputData.getBuffer() + sizeof(command::ZONE_REPORT_HEADER));
+				FAIL_IF(pDescriptors[0].WP != numberOfSectors || pDescriptors[0].ZS != zs::IMPLICITLY_OPENED, "A write after a failed one didn't move the write pointer");
+
+				// Zone commands are only for zoned namespaces
+				sendCommand.NSID = 1;
+				FAIL_IF(driver.nonDataCommand(sendCommand, 1).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_COMMAND_OPCODE, "Zone Management Send to a namespace without zones should fail");
+
+				return true;
+			}
+
+			bool testNVMeTimingModel()
+			{
+				// 2 channels with a die each. Reads take 100 us on the die, then 10 us to move a 4 KB stripe.
+				controller::LATENCY_MODEL_PARAMETERS parameters;
+				memset(&parameters, 0, sizeof(parameters));
+				parameters.NvmLatency[constants::opcodes::nvm::READ] = 100000;
+				parameters.NumberOfChannels = 2;
+				parameters.DiesPerChannel = 1;
+				parameters.StripeSize = 4096;
+				parameters.ChannelBandwidth = 409600000;
+				FAIL_IF(!controller::LatencyModel::isValid(parameters), "The latency model should take these settings");
+
+				controller::LatencyModel latencyModel(parameters);
+				auto now = std::chrono::steady_clock::now();
+				controller::TIMED_COMMAND read = { false, constants::opcodes::nvm::READ, 0, 4096 };
+				FAIL_IF(latencyModel.getCompletionTime(read, now) != now + std::chrono::microseconds(110), "A read on an idle die took the wrong time");
+				read.ByteOffset = 4096;
+				FAIL_IF(latencyModel.getCompletionTime(read, now) != now + std::chrono::microseconds(110), "A read on another die didn't overlap the first one");
+				read.ByteOffset = 8192;
+				FAIL_IF(latencyModel.getCompletionTime(read, now) != now + std::chrono::microseconds(220), "A read on a busy die didn't wait for it");
+
+				// Once idle, a read across both dies takes the same time as a read on one
+				now += std::chrono::seconds(1);
+				read.ByteOffset = 0;
+				read.ByteCount = 8192;
+				FAIL_IF(latencyModel.getCompletionTime(read, now) != now + std::chrono::microseconds(110), "A read across dies didn't split between them");
+				controller::TIMED_COMMAND flush = { false, constants::opcodes::nvm::FLUSH, 0, 0 };
+				FAIL_IF(latencyModel.getCompletionTime(flush, now) != now, "A command without data took time it wasn't given");
+
+				// Through the controller, completions wait for the model
+				const UINT_64 latencyInMilliseconds = 30;
+				parameters = controller::LatencyModel::getDefaultParameters();
+				parameters.AdminLatency[constants::opcodes::admin::IDENTIFY] = latencyInMilliseconds * 1000000;
+				parameters.NvmLatency[constants::opcodes::nvm::READ] = latencyInMilliseconds * 1000000;
+				cnvme::driver::TestDriver driver;
+				driver.setTimingModel(std::make_shared<controller::LatencyModel>(parameters));
+
+				UINT_64 startTime = helpers::getTimeInMilliseconds();
+				FAIL_IF(!driver.identify(constants::commands::identify::cns::CONTROLLER, 0).CompletionQueueEntry.succeeded(), "Identify failed with a timing model");
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < latencyInMilliseconds, "Identify completed before its modeled latency");
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				NVME_COMMAND command = { 0 };
+				command.NSID = 1;
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				startTime = helpers::getTimeInMilliseconds();
+				FAIL_IF(!driver.readCommand(command, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "Read failed with a timing model");
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < latencyInMilliseconds, "A read completed before its modeled latency");
+
+				// Latencies shorter than the doorbell watcher's sleep come out when they are due, not on its next pass
+				class SubMillisecondModel : public controller::TimingModel
+				{
+				public:
+					std::chrono::steady_clock::time_point getCompletionTime(const controller::TIMED_COMMAND &, std::chrono::steady_clock::time_point now)
+					{
+						std::chrono::steady_clock::time_point completionTime = now + std::chrono::microseconds(200);
+						this->LastCompletionTime = completionTime.time_since_epoch().count();
+						return completionTime;
+					}
+
+					std::atomic<std::chrono::steady_clock::rep> LastCompletionTime;
+				};
+
+				// Other tests compete for the CPU, which only ever makes us see completions later. So the earliest one says how late the controller posts.
+				auto subMillisecondModel = std::make_shared<SubMillisecondModel>();
+				driver.setTimingModel(subMillisecondModel);
+				std::chrono::steady_clock::duration earliestLateness = std::chrono::steady_clock::duration::max();
+				for (int i = 0; i < 100 && earliestLateness > std::chrono::microseconds(500); i++)
+				{
+					FAIL_IF(!driver.readCommand(command, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "Read failed with a sub-millisecond timing model");
+					std::chrono::steady_clock::duration lateness(std::chrono::steady_clock::now().time_since_epoch().count() - subMillisecondModel->LastCompletionTime);
+					FAIL_IF(lateness.count() < 0, "A read completed before its sub-millisecond modeled latency");
+					earliestLateness = (std::min)(earliestLateness, lateness);
+				}
+#ifndef __SANITIZE_THREAD__ // ThreadSanitizer alone slows a round trip past the bound
+				FAIL_IF(earliestLateness > std::chrono::microseconds(500), "Sub-millisecond modeled latencies were held for the doorbell watcher's next pass");
+#endif
+
+				// Without the model, it is back to as fast as we can go
+				driver.setTimingModel(nullptr);
+				FAIL_IF(!driver.readCommand(command, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "Read failed after removing the timing model");
+
+				return true;
+			}
+
+			bool testNVMeQosLimits()
+			{
+				using namespace constants::commands::features;
+				cnvme::driver::TestDriver driver;
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				NVME_COMMAND command = { 0 };
+				NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DW10_Features.FID = fid::QOS_LIMITS;
+				getFeatures.DW10_Features.SEL = sel::SUPPORTED_CAPABILITIES;
+				FAIL_IF(driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.DWord0 != (capabilities::NAMESPACE_SPECIFIC | capabilities::CHANGEABLE), "QoS limits should be changeable and namespace specific");
+
+				// 100 IOPS for NSID 1 lets a burst of 10 reads through, then one every 10 ms
+				const UINT_32 iopsLimit = 100;
+				NVME_COMMAND setFeatures = { 0 };
+				setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+				setFeatures.DW10_Features.FID = fid::QOS_LIMITS;
+				setFeatures.NSID = 1;
+				setFeatures.IOPSL = iopsLimit;
+				FAIL_IF(!driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.succeeded(), "Failed to set an IOPS limit for NSID 1");
+
+				getFeatures.NSID = 1;
+				getFeatures.DW10_Features.SEL = sel::CURRENT;
+				auto completionQueueEntry = driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry;
+				FAIL_IF(completionQueueEntry.DWord0 != iopsLimit || completionQueueEntry.DWord1 != 0, "Get Features didn't give back the limits that were set");
+
+				NVME_COMMAND read = { 0 };
+				read.NSID = 1;
+				read.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				UINT_64 startTime = helpers::getTimeInMilliseconds();
+				for (size_t i = 0; i < 20; i++)
+				{
+					FAIL_IF(!driver.readCommand(read, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "A read over the IOPS limit should wait, not fail");
+				}
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < 80, "Reads went faster than the IOPS limit");
+
+				// Taking the limit off
+				setFeatures.IOPSL = 0;
+				FAIL_IF(!driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.succeeded(), "Failed to remove the IOPS limit for NSID 1");
+				FAIL_IF(driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.DWord0 != 0, "The IOPS limit should be gone");
+
+				// 400 KiB/s for SQ 1 lets a 40 KiB burst through, then 16 KiB every 40 ms
+				setFeatures.NSID = 0;
+				setFeatures.DW11_QosLimits.SQ = 1;
+				setFeatures.DW11_QosLimits.SQID = 1;
+				setFeatures.BWL = 400;
+				FAIL_IF(!driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.succeeded(), "Failed to set a bandwidth limit for SQ 1");
+
+				read.DW12_IO.NLB = (DEFAULT_NAMESPACE_SIZE / DEFAULT_SECTOR_SIZE) - 1;
+				startTime = helpers::getTimeInMilliseconds();
+				for (size_t i = 0; i < 6; i++)
+				{
+					FAIL_IF(!driver.readCommand(read, 1, DEFAULT_NAMESPACE_SIZE).CompletionQueueEntry.succeeded(), "A read over the bandwidth limit should wait, not fail");
+				}
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < 80, "Reads went faster than the bandwidth limit");
+
+				// Limits are only for I/O submission queues and active namespaces
+				setFeatures.DW11_QosLimits.SQID = ADMIN_QUEUE_ID;
+				FAIL_IF(driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "The admin queue shouldn't take a QoS limit");
+				setFeatures.DW11_QosLimits.SQ = 0;
+				setFeatures.NSID = 2;
+				FAIL_IF(driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_NAMESPACE_OR_FORMAT, "A namespace that doesn't exist shouldn't take a QoS limit");
+
+				return true;
+			}
+
+			bool testNVMePowerManagement()
+			{
+				using namespace constants::commands::features;
+
+				// PS0 idles into PS3 after 10 ms, then PS3 into PS4 after 50 ms more
+				controller::APST_ENTRY apstTable[APST_ENTRIES];
+				memset(apstTable, 0, sizeof(apstTable));
+				apstTable[0].ITPS = 3;
+				apstTable[0].ITPT = 10;
+				apstTable[3].ITPS = 4;
+				apstTable[3].ITPT = 50;
+
+				controller::PowerStateModel powerStates;
+				auto base = std::chrono::steady_clock::now();
+				FAIL_IF(!powerStates.setAutonomousPowerStateTransitions(true, apstTable, base), "The power state model didn't take a valid APST table");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::milliseconds(9)) != 0, "APST went to PS3 before idling long enough");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::milliseconds(10)) != 3, "APST didn't go to PS3 after idling long enough");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::milliseconds(59)) != 3, "APST went to PS4 before idling long enough in PS3");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::milliseconds(60)) != 4, "APST didn't go to PS4 after idling long enough in PS3");
+
+				// Waking from PS4 takes its exit latency. Idling starts over from the end of the command.
+				auto wakeTime = powerStates.wake(base + std::chrono::milliseconds(100));
+				FAIL_IF(wakeTime != base + std::chrono::milliseconds(108) || powerStates.getPowerState(wakeTime) != 0, "Waking from PS4 didn't take its exit latency");
+				FAIL_IF(powerStates.finish(wakeTime, wakeTime + std::chrono::milliseconds(1)) != base + std::chrono::milliseconds(109), "A command in PS0 should take the time it was given");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::milliseconds(118)) != 0, "APST counted idle time from before the command finished");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::milliseconds(119)) != 3, "APST didn't go to PS3 after the command");
+
+				// Waking right after going to PS3 waits for the entry to finish first
+				FAIL_IF(powerStates.wake(base + std::chrono::milliseconds(120)) != base + std::chrono::milliseconds(123), "Waking in the middle of entering PS3 didn't wait for it");
+
+				// Lower operational states are slower, and the device wakes back to them
+				FAIL_IF(!powerStates.setAutonomousPowerStateTransitions(false, apstTable, base + std::chrono::milliseconds(200)), "Failed to turn APST off");
+				FAIL_IF(!powerStates.setPowerState(2, base + std::chrono::milliseconds(200)), "Failed to go to PS2");
+				FAIL_IF(powerStates.finish(base + std::chrono::milliseconds(200), base + std::chrono::milliseconds(201)) != base + std::chrono::milliseconds(202), "PS2 should run commands at half speed");
+				FAIL_IF(!powerStates.setPowerState(3, base + std::chrono::milliseconds(300)), "Failed to go to PS3");
+				FAIL_IF(powerStates.wake(base + std::chrono::milliseconds(400)) != base + std::chrono::milliseconds(402) || powerStates.getPowerState(base + std::chrono::milliseconds(400)) != 2,
+					"The device didn't wake to the last operational state");
+				FAIL_IF(powerStates.getPowerState(base + std::chrono::seconds(10)) != 2, "APST moved the device while it was off");
+
+				// Only supported non-operational states can be transitioned to
+				FAIL_IF(powerStates.setPowerState(NUMBER_OF_POWER_STATES, base), "Went to a power state that doesn't exist");
+				apstTable[0].ITPS = 1;
+				FAIL_IF(powerStates.setAutonomousPowerStateTransitions(true, apstTable, base), "APST took a transition to an operational state");
+				apstTable[0].ITPS = NUMBER_OF_POWER_STATES;
+				FAIL_IF(powerStates.setAutonomousPowerStateTransitions(true, apstTable, base), "APST took a transition to a power state that doesn't exist");
+				apstTable[0].ITPS = 3;
+
+				// Through the controller
+				cnvme::driver::TestDriver driver;
+				auto identifyController = driver.identify(constants::commands::identify::cns::CONTROLLER, 0);
+				auto pIdentifyController = (identify::structures::IDENTIFY_CONTROLLER*)identifyController.OutputData.getBuffer();
+				FAIL_IF(pIdentifyController->NPSS != NUMBER_OF_POWER_STATES - 1 || !pIdentifyController->APSTA, "Identify Controller didn't report the power states");
+				FAIL_IF(pIdentifyController->PSD[0].MP == 0 || pIdentifyController->PSD[0].NOPS || !pIdentifyController->PSD[4].NOPS || pIdentifyController->PSD[4].EXLAT == 0,
+					"Identify Controller's power state descriptors aren't filled in");
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				NVME_COMMAND command = { 0 };
+				NVME_COMMAND getFeatures = { 0 };
+				getFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::GET_FEATURES;
+				getFeatures.DW10_Features.FID = fid::POWER_MANAGEMENT;
+				FAIL_IF(driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.DWord0 != 0, "The device should start in PS0");
+
+				NVME_COMMAND setFeatures = { 0 };
+				setFeatures.DWord0Breakdown.OPC = constants::opcodes::admin::SET_FEATURES;
+				setFeatures.DW10_Features.FID = fid::POWER_MANAGEMENT;
+				setFeatures.DW11_PowerManagement.PS = NUMBER_OF_POWER_STATES;
+				FAIL_IF(driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Went to a power state that doesn't exist");
+				setFeatures.DW11_PowerManagement.PS = 2;
+				FAIL_IF(!driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.succeeded(), "Failed to go to PS2");
+				FAIL_IF(driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.DWord0 != 2, "Get Features didn't give back the power state that was set");
+
+				// The read after going to PS4 waits for entering it, then for leaving it
+				NVME_COMMAND read = { 0 };
+				read.NSID = 1;
+				read.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				setFeatures.DW11_PowerManagement.PS = 4;
+				UINT_64 startTime = helpers::getTimeInMilliseconds();
+				FAIL_IF(!driver.nonDataCommand(setFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.succeeded(), "Failed to go to PS4");
+				FAIL_IF(!driver.readCommand(read, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "A read in PS4 should wake the device, not fail");
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < 14, "A read in PS4 didn't wait for the device to wake up");
+				FAIL_IF(driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.DWord0 != 2, "The read didn't wake the device to PS2");
+
+				// APST takes the idle device to PS4 on its own
+				setFeatures.DW10_Features.FID = fid::AUTONOMOUS_POWER_STATE_TRANSITION;
+				setFeatures.DWord11 = 0;
+				setFeatures.DW11_AutonomousPowerStateTransition.APSTE = 1;
+				apstTable[2].ITPS = 1;
+				apstTable[2].ITPT = 5;
+				Payload apstPayload((BYTE*)apstTable, sizeof(apstTable));
+				FAIL_IF(driver.writeCommand(setFeatures, ADMIN_QUEUE_ID, apstPayload).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND,
+					"APST took a transition to an operational state");
+				apstTable[2].ITPS = 4;
+				apstPayload = Payload((BYTE*)apstTable, sizeof(apstTable));
+				FAIL_IF(!driver.writeCommand(setFeatures, ADMIN_QUEUE_ID, apstPayload).CompletionQueueEntry.succeeded(), "Failed to turn APST on");
+
+				getFeatures.DW10_Features.FID = fid::AUTONOMOUS_POWER_STATE_TRANSITION;
+				auto apstOutput = driver.readCommand(getFeatures, ADMIN_QUEUE_ID, sizeof(apstTable));
+				FAIL_IF(apstOutput.CompletionQueueEntry.DWord0 != 1 || apstOutput.OutputData != apstPayload, "Get Features didn't give back the APST table that was set");
+
+				// Admin commands don't keep the device from being idle, so Get Features can watch for the transition
+				getFeatures.DW10_Features.FID = fid::POWER_MANAGEMENT;
+				UINT_32 powerState = 0;
+				UINT_64 deathTime = helpers::getTimeInMilliseconds() + 5000;
+				while (powerState != 4 && helpers::getTimeInMilliseconds() < deathTime)
+				{
+					powerState = driver.nonDataCommand(getFeatures, ADMIN_QUEUE_ID).CompletionQueueEntry.DWord0;
+				}
+				FAIL_IF(powerState != 4, "APST didn't take the idle device to PS4");
+				startTime = helpers::getTimeInMilliseconds();
+				FAIL_IF(!driver.readCommand(read, 1, DEFAULT_SECTOR_SIZE).CompletionQueueEntry.succeeded(), "A read after APST should wake the device, not fail");
+				FAIL_IF(helpers::getTimeInMilliseconds() - startTime < 8, "A read after APST didn't wait for the device to wake up");
+
+				return true;
+			}
 		}
 
 		namespace driver
@@ -590,6 +1688,1117 @@ namespace cnvme
 			}
 		}
 
+		namespace media
+		{
+			bool testSparseNamespace()
+			{
+				// Chunk boundaries are handled by the media itself
+				ns::SparseMedia sparseMedia(MEDIA_CHUNK_SIZE * 3);
+				Payload pattern(MEDIA_CHUNK_SIZE);
+				helpers::randomizePayload(pattern);
+				sparseMedia.write(MEDIA_CHUNK_SIZE / 2, pattern.getBuffer(), pattern.getSize());
+				FAIL_IF(sparseMedia.getAllocatedSize() != MEDIA_CHUNK_SIZE * 2, "A write straddling two chunks should allocate exactly those two");
+				Payload readBack(MEDIA_CHUNK_SIZE);
+				sparseMedia.read(MEDIA_CHUNK_SIZE / 2, readBack.getBuffer(), readBack.getSize());
+				FAIL_IF(readBack != pattern, "Data written across a chunk boundary did not read back the same");
+
+				// 4 terabytes is way more than we could ever allocate up front
+				const UINT_64 namespaceSize = (UINT_64)4 * 1024 * 1024 * 1024 * 1024;
+				ns::Namespace bigNamespace(namespaceSize);
+				auto identifyNamespace = bigNamespace.getIdentifyNamespaceStructure();
+				FAIL_IF(identifyNamespace.NSZE != namespaceSize / DEFAULT_SECTOR_SIZE, "NSZE did not match the requested namespace size");
+				FAIL_IF(identifyNamespace.NUSE != 0, "NUSE should be 0 before anything is written");
+				FAIL_IF(!identifyNamespace.NamespaceSupportsThinProvisioning, "A sparse namespace should report thin provisioning");
+
+				Payload sector(DEFAULT_SECTOR_SIZE);
+				helpers::randomizePayload(sector);
+				NVME_COMMAND command = { 0 };
+				command.SLBA = identifyNamespace.NSZE - 1;
+				command.DPTR.DPTR1 = sector.getMemoryAddress();
+				FAIL_IF(!bigNamespace.write(command, 4096).succeeded(), "Failed to write the last LBA");
+				FAIL_IF(bigNamespace.getIdentifyNamespaceStructure().NUSE != MEDIA_CHUNK_SIZE / DEFAULT_SECTOR_SIZE, "NUSE should be one chunk after one write");
+
+				Payload dataRead;
+				FAIL_IF(!bigNamespace.read(command, dataRead).succeeded(), "Failed to read the last LBA");
+				FAIL_IF(dataRead != sector, "The last LBA did not read back what was written");
+
+				command.SLBA = identifyNamespace.NSZE / 2;
+				FAIL_IF(!bigNamespace.read(command, dataRead).succeeded(), "Failed to read an unwritten LBA");
+				FAIL_IF(dataRead != Payload(DEFAULT_SECTOR_SIZE), "An unwritten LBA should read as zeros");
+				FAIL_IF(bigNamespace.getIdentifyNamespaceStructure().NUSE != MEDIA_CHUNK_SIZE / DEFAULT_SECTOR_SIZE, "Reading an unwritten LBA should not allocate");
+
+				NVME_COMMAND formatCommand = { 0 };
+				FAIL_IF(!bigNamespace.formatNVM(formatCommand).succeeded(), "Failed to format the namespace");
+				FAIL_IF(bigNamespace.getIdentifyNamespaceStructure().NUSE != 0, "NUSE should be 0 after a format");
+
+				command.SLBA = identifyNamespace.NSZE - 1;
+				FAIL_IF(!bigNamespace.read(command, dataRead).succeeded(), "Failed to read the last LBA after a format");
+				FAIL_IF(dataRead != Payload(DEFAULT_SECTOR_SIZE), "Formatted LBAs should read as zeros");
+
+				return true;
+			}
+
+			bool testMappedFileNamespace()
+			{
+				helpers::TemporaryFile testFile("cNVMeMappedFileNamespaceTest");
+				const std::string &filePath = testFile.Path;
+				const UINT_64 namespaceSize = 1024 * 1024;
+
+				Payload sector(DEFAULT_SECTOR_SIZE);
+				helpers::randomizePayload(sector);
+				NVME_COMMAND command = { 0 };
+				command.SLBA = 5;
+				command.DPTR.DPTR1 = sector.getMemoryAddress();
+
+				{
+					ns::Namespace mappedNamespace;
+					FAIL_IF(!mappedNamespace.setMedia(std::make_shared<ns::MappedFileMedia>(filePath, namespaceSize)), "Failed to back a namespace with a new file");
+					FAIL_IF(mappedNamespace.getIdentifyNamespaceStructure().NSZE != namespaceSize / DEFAULT_SECTOR_SIZE, "NSZE did not match the file size");
+					FAIL_IF(!mappedNamespace.write(command, 4096).succeeded(), "Failed to write to the mapped namespace");
+					FAIL_IF(!mappedNamespace.flush().succeeded(), "Failed to flush the mapped namespace");
+
+					// The data should be in the file itself now
+					std::ifstream file(filePath, std::ios::binary);
+					Payload fileData(DEFAULT_SECTOR_SIZE);
+					file.seekg(command.SLBA * DEFAULT_SECTOR_SIZE);
+					file.read((char*)fileData.getBuffer(), fileData.getSize());
+					FAIL_IF(fileData != sector, "The flushed data was not in the backing file");
+				}
+
+				{
+					// Size 0 picks up the existing file
+					ns::Namespace mappedNamespace;
+					FAIL_IF(!mappedNamespace.setMedia(std::make_shared<ns::MappedFileMedia>(filePath, 0)), "Failed to back a namespace with an existing file");
+					FAIL_IF(mappedNamespace.getIdentifyNamespaceStructure().NSZE != namespaceSize / DEFAULT_SECTOR_SIZE, "NSZE did not match the existing file size");
+
+					Payload dataRead;
+					FAIL_IF(!mappedNamespace.read(command, dataRead).succeeded(), "Failed to read from the mapped namespace");
+					FAIL_IF(dataRead != sector, "Data did not persist across mappings of the file");
+
+					NVME_COMMAND formatCommand = { 0 };
+					FAIL_IF(!mappedNamespace.formatNVM(formatCommand).succeeded(), "Failed to format the mapped namespace");
+					FAIL_IF(!mappedNamespace.read(command, dataRead).succeeded(), "Failed to read from the mapped namespace after a format");
+					FAIL_IF(dataRead != Payload(DEFAULT_SECTOR_SIZE), "Formatted LBAs should read as zeros");
+					FAIL_IF(mappedNamespace.getIdentifyNamespaceStructure().NSZE != namespaceSize / DEFAULT_SECTOR_SIZE, "A format should not change the file size");
+				}
+
+				{
+					cnvme::driver::Driver driver;
+					FAIL_IF(driver.setNamespaceMediaFile(2, filePath, namespaceSize, false), "Was able to back an inactive namespace with a file");
+					FAIL_IF(!driver.setNamespaceMediaFile(1, filePath, 0, false), "Failed to back the default namespace with a file");
+				}
+
+				return true;
+			}
+
+			bool testDirectFileNamespace()
+			{
+				helpers::TemporaryFile testFile("cNVMeDirectFileNamespaceTest");
+				const std::string &filePath = testFile.Path;
+				const UINT_64 namespaceSize = 1024 * 1024;
+
+				{
+					// Writes that don't cover whole blocks are read-modify-write
+					ns::DirectFileMedia directFileMedia(filePath, namespaceSize);
+					FAIL_IF(!directFileMedia.isOpen(), "Failed to open the direct I/O media file");
+					FAIL_IF(!directFileMedia.isAsynchronous(), "Direct I/O media should be asynchronous");
+					Payload pattern(DIRECT_IO_ALIGNMENT * 3);
+					helpers::randomizePayload(pattern);
+					FAIL_IF(!directFileMedia.write(0, pattern.getBuffer(), pattern.getSize()), "Failed to write whole blocks");
+					Payload middle(100);
+					helpers::randomizePayload(middle);
+					FAIL_IF(!directFileMedia.write(DIRECT_IO_ALIGNMENT - 50, middle.getBuffer(), middle.getSize()), "Failed to write across a block boundary");
+					memcpy_s(pattern.getBuffer() + DIRECT_IO_ALIGNMENT - 50, pattern.getSize() - DIRECT_IO_ALIGNMENT + 50, middle.getBuffer(), middle.getSize());
+
+					Payload readBack(pattern.getSize());
+					FAIL_IF(!directFileMedia.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read back the blocks");
+					FAIL_IF(readBack != pattern, "A partial block write clobbered the bytes around it");
+				}
+
+				cnvme::driver::Driver driver;
+				FAIL_IF(!driver.setNamespaceMediaFile(1, filePath, namespaceSize, true), "Failed to back the default namespace with a direct I/O file");
+
+				Payload payload(8192);
+				auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)payload.getBuffer();
+				pDriverCommand->Timeout = 5;
+
+				FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0x7), "Controller failed creating io queue pair 1");
+
+				// More commands than queue entries, so the asynchronous completions have to go around the queues
+				pDriverCommand->QueueId = 1;
+				pDriverCommand->TransferDataSize = DEFAULT_SECTOR_SIZE;
+				const UINT_8 numberOfSectors = 20;
+				for (UINT_8 sector = 0; sector < numberOfSectors; sector++)
+				{
+					memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+					pDriverCommand->Command.NSID = 1;
+					pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+					pDriverCommand->Command.SLBA = sector;
+					pDriverCommand->TransferDataDirection = cnvme::driver::WRITE;
+					memset(pDriverCommand->TransferData, sector + 1, DEFAULT_SECTOR_SIZE);
+					driver.sendCommand(payload.getBuffer(), payload.getSize());
+					FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write to the direct I/O namespace");
+				}
+
+				for (UINT_8 sector = 0; sector < numberOfSectors; sector++)
+				{
+					memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+					pDriverCommand->Command.NSID = 1;
+					pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+					pDriverCommand->Command.SLBA = sector;
+					pDriverCommand->TransferDataDirection = cnvme::driver::READ;
+					memset(pDriverCommand->TransferData, 0, DEFAULT_SECTOR_SIZE);
+					driver.sendCommand(payload.getBuffer(), payload.getSize());
+					FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read from the direct I/O namespace");
+					FAIL_IF(pDriverCommand->TransferData[0] != sector + 1 || pDriverCommand->TransferData[DEFAULT_SECTOR_SIZE - 1] != sector + 1, "Read back the wrong data from the direct I/O namespace");
+				}
+
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::FLUSH;
+				pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+				pDriverCommand->TransferDataSize = 0;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to flush the direct I/O namespace");
+
+				// The data went to the file itself
+				std::ifstream file(filePath, std::ios::binary);
+				char lastSectorByte = 0;
+				file.seekg((numberOfSectors - 1) * DEFAULT_SECTOR_SIZE);
+				file.read(&lastSectorByte, 1);
+				FAIL_IF(lastSectorByte != numberOfSectors, "The written data was not in the backing file");
+				file.close();
+
+				// Formatting waits for the namespace's I/O on an I/O worker, then erases it
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->QueueId = ADMIN_QUEUE_ID;
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::admin::FORMAT_NVM;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to format the direct I/O namespace");
+
+				memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+				pDriverCommand->QueueId = 1;
+				pDriverCommand->Command.NSID = 1;
+				pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+				pDriverCommand->TransferDataDirection = cnvme::driver::READ;
+				pDriverCommand->TransferDataSize = DEFAULT_SECTOR_SIZE;
+				driver.sendCommand(payload.getBuffer(), payload.getSize());
+				FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read from the formatted direct I/O namespace");
+				FAIL_IF(pDriverCommand->TransferData[0] != 0 || pDriverCommand->TransferData[DEFAULT_SECTOR_SIZE - 1] != 0, "Formatting didn't erase the direct I/O namespace");
+
+				return true;
+			}
+
+			bool testDatasetManagement()
+			{
+				const UINT_64 sectorsPerChunk = MEDIA_CHUNK_SIZE / DEFAULT_SECTOR_SIZE;
+				auto sparseMedia = std::make_shared<ns::SparseMedia>(MEDIA_CHUNK_SIZE * 4);
+				ns::Namespace sparseNamespace;
+				FAIL_IF(!sparseNamespace.setMedia(sparseMedia), "Failed to back a namespace with sparse media");
+				FAIL_IF(sparseNamespace.getIdentifyNamespaceStructure().DLFEAT != constants::commands::identify::dlfeat::DEALLOCATED_READS_ZEROES, "DLFEAT should say deallocated LBAs read as zeros");
+
+				Payload pattern(MEDIA_CHUNK_SIZE * 3);
+				helpers::randomizePayload(pattern);
+				FAIL_IF(!sparseMedia->write(0, pattern.getBuffer(), pattern.getSize()), "Failed to write the first three chunks");
+				FAIL_IF(sparseNamespace.getIdentifyNamespaceStructure().NUSE != sectorsPerChunk * 3, "NUSE should be three chunks after writing three chunks");
+
+				// All of the second chunk and a couple LBAs in the first one
+				Payload ranges(sizeof(DATASET_MANAGEMENT_RANGE) * 2);
+				auto pRanges = (PDATASET_MANAGEMENT_RANGE)ranges.getBuffer();
+				pRanges[0].StartingLBA = sectorsPerChunk;
+				pRanges[0].LengthInLogicalBlocks = (UINT_32)sectorsPerChunk;
+				pRanges[1].StartingLBA = 1;
+				pRanges[1].LengthInLogicalBlocks = 2;
+
+				NVME_COMMAND command = { 0 };
+				command.DPTR.DPTR1 = ranges.getMemoryAddress();
+				command.DW10_DatasetManagement.NR = 1;
+				FAIL_IF(!sparseNamespace.datasetManagement(command, 4096).succeeded(), "Dataset Management without the deallocate attribute failed");
+				FAIL_IF(sparseNamespace.getIdentifyNamespaceStructure().NUSE != sectorsPerChunk * 3, "Dataset Management without the deallocate attribute should not deallocate");
+
+				command.DW11_DatasetManagement.AD = 1;
+				FAIL_IF(!sparseNamespace.datasetManagement(command, 4096).succeeded(), "Failed to deallocate the ranges");
+				FAIL_IF(sparseNamespace.getIdentifyNamespaceStructure().NUSE != sectorsPerChunk * 2, "Deallocating a whole chunk should give it back to the media");
+
+				memset(pattern.getBuffer() + DEFAULT_SECTOR_SIZE, 0, DEFAULT_SECTOR_SIZE * 2);
+				memset(pattern.getBuffer() + MEDIA_CHUNK_SIZE, 0, MEDIA_CHUNK_SIZE);
+				Payload readBack(pattern.getSize());
+				FAIL_IF(!sparseMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read back the chunks");
+				FAIL_IF(readBack != pattern, "Deallocated LBAs should read as zeros and the rest should be untouched");
+
+				// The first range is fine but the second runs off the end, so neither should happen
+				pRanges[0].StartingLBA = 0;
+				pRanges[0].LengthInLogicalBlocks = (UINT_32)sectorsPerChunk * 3;
+				pRanges[1].StartingLBA = sectorsPerChunk * 4 - 1;
+				pRanges[1].LengthInLogicalBlocks = 2;
+				auto completionQueueEntry = sparseNamespace.datasetManagement(command, 4096);
+				FAIL_IF(completionQueueEntry.SC != constants::status::codes::generic::LBA_OUT_OF_RANGE, "Deallocating past the end of the namespace should be out of range");
+				FAIL_IF(sparseNamespace.getIdentifyNamespaceStructure().NUSE != sectorsPerChunk * 2, "A failed Dataset Management should not deallocate any range");
+
+				// Files get holes punched (or zeros written) instead
+				helpers::TemporaryFile testFile("cNVMeDatasetManagementTest");
+				const std::string &filePath = testFile.Path;
+				for (bool directIO : { false, true })
+				{
+					std::remove(filePath.c_str());
+					std::shared_ptr<ns::Media> fileMedia;
+					if (directIO)
+					{
+						fileMedia = std::make_shared<ns::DirectFileMedia>(filePath, 1024 * 1024);
+					}
+					else
+					{
+						fileMedia = std::make_shared<ns::MappedFileMedia>(filePath, 1024 * 1024);
+					}
+
+					Payload filePattern(4096 * 4);
+					helpers::randomizePayload(filePattern);
+					FAIL_IF(!fileMedia->write(0, filePattern.getBuffer(), filePattern.getSize()), "Failed to write to the file media");
+					FAIL_IF(!fileMedia->deallocate(4096, 4096 * 2 + DIRECT_IO_ALIGNMENT), "Failed to deallocate from the file media");
+					memset(filePattern.getBuffer() + 4096, 0, 4096 * 2 + DIRECT_IO_ALIGNMENT);
+
+					Payload fileReadBack(filePattern.getSize());
+					FAIL_IF(!fileMedia->read(0, fileReadBack.getBuffer(), fileReadBack.getSize()), "Failed to read back from the file media");
+					FAIL_IF(fileReadBack != filePattern, "Deallocated file media should read as zeros and the rest should be untouched");
+				}
+
+				return true;
+			}
+
+			bool testSnapshots()
+			{
+				ns::SparseMedia baseMedia(MEDIA_CHUNK_SIZE * 4);
+				Payload pattern(MEDIA_CHUNK_SIZE * 2);
+				helpers::randomizePayload(pattern);
+				FAIL_IF(!baseMedia.write(0, pattern.getBuffer(), pattern.getSize()), "Failed to write the base media");
+
+				auto clonedMedia = baseMedia.clone();
+				FAIL_IF(!clonedMedia, "Sparse media should be clonable");
+				FAIL_IF(clonedMedia->getAllocatedSize() != baseMedia.getAllocatedSize(), "A clone should have the same chunks as its base");
+
+				// The clone changes one chunk and drops the other. The base shouldn't see either.
+				Payload cloneData(MEDIA_CHUNK_SIZE);
+				helpers::randomizePayload(cloneData);
+				FAIL_IF(!clonedMedia->write(MEDIA_CHUNK_SIZE, cloneData.getBuffer(), cloneData.getSize()), "Failed to write the cloned media");
+				FAIL_IF(!clonedMedia->deallocate(0, MEDIA_CHUNK_SIZE), "Failed to deallocate from the cloned media");
+
+				Payload readBack(pattern.getSize());
+				FAIL_IF(!baseMedia.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the base media");
+				FAIL_IF(readBack != pattern, "Writing to a clone changed its base");
+
+				Payload expected(pattern.getSize());
+				memcpy_s(expected.getBuffer() + MEDIA_CHUNK_SIZE, MEDIA_CHUNK_SIZE, cloneData.getBuffer(), MEDIA_CHUNK_SIZE);
+				FAIL_IF(!clonedMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the cloned media");
+				FAIL_IF(readBack != expected, "The clone didn't keep its own writes");
+				FAIL_IF(clonedMedia->getAllocatedSize() != MEDIA_CHUNK_SIZE || baseMedia.getAllocatedSize() != MEDIA_CHUNK_SIZE * 2, "Allocated sizes should follow each side's own chunks");
+
+				// Going the other way
+				baseMedia.deallocateAll();
+				FAIL_IF(!clonedMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the cloned media after its base was cleared");
+				FAIL_IF(readBack != expected, "Clearing the base changed its clone");
+
+				// A golden image that gets reverted to between 'tests'
+				const UINT_64 namespaceSize = (UINT_64)4 * 1024 * 1024 * 1024 * 1024;
+				ns::Namespace bigNamespace(namespaceSize);
+				Payload golden(DEFAULT_SECTOR_SIZE);
+				helpers::randomizePayload(golden);
+				NVME_COMMAND command = { 0 };
+				command.SLBA = bigNamespace.getIdentifyNamespaceStructure().NSZE - 1;
+				command.DPTR.DPTR1 = golden.getMemoryAddress();
+				FAIL_IF(!bigNamespace.write(command, 4096).succeeded(), "Failed to write the golden data");
+				FAIL_IF(bigNamespace.revertToSnapshot(), "Reverted without a snapshot");
+				FAIL_IF(!bigNamespace.takeSnapshot(), "Failed to snapshot the namespace");
+
+				for (int i = 0; i < 2; i++)
+				{
+					Payload scribble(DEFAULT_SECTOR_SIZE);
+					helpers::randomizePayload(scribble);
+					command.DPTR.DPTR1 = scribble.getMemoryAddress();
+					FAIL_IF(!bigNamespace.write(command, 4096).succeeded(), "Failed to write over the golden data");
+					command.SLBA = 0;
+					FAIL_IF(!bigNamespace.write(command, 4096).succeeded(), "Failed to write a new LBA");
+					command.SLBA = bigNamespace.getIdentifyNamespaceStructure().NSZE - 1;
+					FAIL_IF(bigNamespace.getIdentifyNamespaceStructure().NUSE != (MEDIA_CHUNK_SIZE / DEFAULT_SECTOR_SIZE) * 2, "NUSE should count the new chunk");
+
+					FAIL_IF(!bigNamespace.revertToSnapshot(), "Failed to revert to the snapshot");
+					FAIL_IF(bigNamespace.getIdentifyNamespaceStructure().NUSE != MEDIA_CHUNK_SIZE / DEFAULT_SECTOR_SIZE, "NUSE should be back to the snapshot's");
+
+					Payload dataRead;
+					FAIL_IF(!bigNamespace.read(command, dataRead).succeeded(), "Failed to read the golden LBA");
+					FAIL_IF(dataRead != golden, "Reverting didn't bring back the golden data");
+					command.SLBA = 0;
+					FAIL_IF(!bigNamespace.read(command, dataRead).succeeded(), "Failed to read the new LBA");
+					FAIL_IF(dataRead != Payload(DEFAULT_SECTOR_SIZE), "Reverting didn't drop data written after the snapshot");
+					command.SLBA = bigNamespace.getIdentifyNamespaceStructure().NSZE - 1;
+				}
+
+				bigNamespace.deleteSnapshot();
+				FAIL_IF(bigNamespace.revertToSnapshot(), "Reverted to a deleted snapshot");
+
+				helpers::TemporaryFile testFile("cNVMeSnapshotTest");
+				const std::string &filePath = testFile.Path;
+				{
+					cnvme::driver::Driver driver;
+					FAIL_IF(driver.snapshotNamespace(2), "Was able to snapshot an inactive namespace");
+					FAIL_IF(driver.revertNamespaceToSnapshot(1), "Was able to revert a namespace without a snapshot");
+					FAIL_IF(!driver.snapshotNamespace(1), "Failed to snapshot the default namespace");
+					FAIL_IF(!driver.revertNamespaceToSnapshot(1), "Failed to revert the default namespace");
+
+					FAIL_IF(!driver.setNamespaceMediaFile(1, filePath, 1024 * 1024, false), "Failed to back the default namespace with a file");
+					FAIL_IF(driver.snapshotNamespace(1), "Was able to snapshot a file backed namespace");
+				}
+				return true;
+			}
+
+			bool testDedupMedia()
+			{
+				// Not a whole number of blocks, so the last block is partial
+				const UINT_64 mediaSize = DEDUP_BLOCK_SIZE * 64 + DEFAULT_SECTOR_SIZE;
+				ns::DedupMedia dedupMedia(mediaSize, true);
+				Payload expected(mediaSize);
+
+				// The same repeated pattern everywhere
+				Payload repeated(DEDUP_BLOCK_SIZE * 32);
+				memset(repeated.getBuffer(), 0xAB, repeated.getSize());
+				FAIL_IF(!dedupMedia.write(0, repeated.getBuffer(), repeated.getSize()), "Failed to write the repeated pattern");
+				memcpy_s(expected.getBuffer(), expected.getSize(), repeated.getBuffer(), repeated.getSize());
+
+				ns::DEDUP_STATISTICS statistics = dedupMedia.getStatistics();
+				FAIL_IF(statistics.MappedBlocks != 32 || statistics.UniqueBlocks != 1, "32 identical blocks should share one stored block");
+				FAIL_IF(statistics.CompressedBlocks != 1 || statistics.StoredBytes >= DEDUP_BLOCK_SIZE / 16, "A repeated byte should compress to almost nothing");
+				FAIL_IF(dedupMedia.getAllocatedSize() != DIRECT_IO_ALIGNMENT, "The allocated size should round up to a sector");
+
+				// Data that doesn't compress, twice
+				Payload noise(DEDUP_BLOCK_SIZE);
+				for (size_t i = 0; i < noise.getSize(); i++)
+				{
+					noise.getBuffer()[i] = (BYTE)helpers::randInt(0, 0xFF);
+				}
+				FAIL_IF(!dedupMedia.write(DEDUP_BLOCK_SIZE * 40, noise.getBuffer(), noise.getSize()), "Failed to write noise");
+				FAIL_IF(!dedupMedia.write(DEDUP_BLOCK_SIZE * 50, noise.getBuffer(), noise.getSize()), "Failed to write noise again");
+				memcpy_s(expected.getBuffer() + DEDUP_BLOCK_SIZE * 40, DEDUP_BLOCK_SIZE, noise.getBuffer(), DEDUP_BLOCK_SIZE);
+				memcpy_s(expected.getBuffer() + DEDUP_BLOCK_SIZE * 50, DEDUP_BLOCK_SIZE, noise.getBuffer(), DEDUP_BLOCK_SIZE);
+
+				statistics = dedupMedia.getStatistics();
+				FAIL_IF(statistics.MappedBlocks != 34 || statistics.UniqueBlocks != 2 || statistics.CompressedBlocks != 1, "The noise should be stored once, uncompressed");
+
+				// A sector in the middle of one shared block gives that block its own copy, and the tail of the media gets written
+				Payload sector(DEFAULT_SECTOR_SIZE);
+				memset(sector.getBuffer(), 0xCD, sector.getSize());
+				FAIL_IF(!dedupMedia.write(DEDUP_BLOCK_SIZE * 5 + DEFAULT_SECTOR_SIZE, sector.getBuffer(), sector.getSize()), "Failed to write a partial block");
+				FAIL_IF(!dedupMedia.write(mediaSize - DEFAULT_SECTOR_SIZE, sector.getBuffer(), sector.getSize()), "Failed to write the partial last block");
+				memcpy_s(expected.getBuffer() + DEDUP_BLOCK_SIZE * 5 + DEFAULT_SECTOR_SIZE, DEFAULT_SECTOR_SIZE, sector.getBuffer(), DEFAULT_SECTOR_SIZE);
+				memcpy_s(expected.getBuffer() + mediaSize - DEFAULT_SECTOR_SIZE, DEFAULT_SECTOR_SIZE, sector.getBuffer(), DEFAULT_SECTOR_SIZE);
+				FAIL_IF(dedupMedia.getStatistics().UniqueBlocks != 4, "Each partially written block should have been stored");
+
+				// Zeros unmap blocks, whether written or deallocated
+				Payload zeros(DEDUP_BLOCK_SIZE);
+				FAIL_IF(!dedupMedia.write(DEDUP_BLOCK_SIZE * 50, zeros.getBuffer(), zeros.getSize()), "Failed to write zeros");
+				FAIL_IF(!dedupMedia.deallocate(DEDUP_BLOCK_SIZE * 10, DEDUP_BLOCK_SIZE * 2 + DEFAULT_SECTOR_SIZE), "Failed to deallocate");
+				memset(expected.getBuffer() + DEDUP_BLOCK_SIZE * 50, 0, DEDUP_BLOCK_SIZE);
+				memset(expected.getBuffer() + DEDUP_BLOCK_SIZE * 10, 0, DEDUP_BLOCK_SIZE * 2 + DEFAULT_SECTOR_SIZE);
+				FAIL_IF(dedupMedia.getStatistics().MappedBlocks != 32, "Zeroed blocks should be unmapped");
+
+				Payload readBack(mediaSize);
+				FAIL_IF(!dedupMedia.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the media");
+				FAIL_IF(readBack != expected, "Deduplicated media didn't read back what was written");
+
+				// Clones share the block map and stored blocks but not writes
+				statistics = dedupMedia.getStatistics();
+				auto clonedMedia = dedupMedia.clone();
+				FAIL_IF(!clonedMedia, "Deduplicated media should be clonable");
+				FAIL_IF(!clonedMedia->deallocate(DEDUP_BLOCK_SIZE * 10, DEDUP_BLOCK_SIZE), "Failed to deallocate an unmapped block from the cloned media");
+				FAIL_IF(!clonedMedia->write(DEDUP_BLOCK_SIZE * 40, repeated.getBuffer(), DEDUP_BLOCK_SIZE), "Failed to write the cloned media");
+				ns::DEDUP_STATISTICS baseStatistics = dedupMedia.getStatistics();
+				FAIL_IF(baseStatistics.MappedBlocks != statistics.MappedBlocks || baseStatistics.UniqueBlocks != statistics.UniqueBlocks || baseStatistics.StoredBytes != statistics.StoredBytes, "Writing to a clone changed its base's block map");
+				FAIL_IF(!dedupMedia.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the media after writing its clone");
+				FAIL_IF(readBack != expected, "Writing to a clone changed its base");
+				dedupMedia.deallocateAll();
+				FAIL_IF(dedupMedia.getAllocatedSize() != 0, "Nothing should be stored after deallocating everything");
+				memcpy_s(expected.getBuffer() + DEDUP_BLOCK_SIZE * 40, DEDUP_BLOCK_SIZE, repeated.getBuffer(), DEDUP_BLOCK_SIZE);
+				FAIL_IF(!clonedMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the cloned media");
+				FAIL_IF(readBack != expected, "The clone lost data when its base was cleared");
+
+				// A namespace far larger than RAM, with the same data written all over it
+				const UINT_64 namespaceSize = (UINT_64)4 * 1024 * 1024 * 1024 * 1024;
+				ns::Namespace bigNamespace(DEFAULT_SECTOR_SIZE);
+				FAIL_IF(!bigNamespace.setMedia(std::make_shared<ns::DedupMedia>(namespaceSize, false)), "Failed to back a namespace with deduplicated media");
+				NVME_COMMAND command = { 0 };
+				command.DPTR.DPTR1 = noise.getMemoryAddress();
+				command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(DEDUP_BLOCK_SIZE / DEFAULT_SECTOR_SIZE);
+				for (UINT_64 i = 0; i < 100; i++)
+				{
+					command.SLBA = i * (namespaceSize / 100 / DEDUP_BLOCK_SIZE) * (DEDUP_BLOCK_SIZE / DEFAULT_SECTOR_SIZE); // Block aligned
+					FAIL_IF(!bigNamespace.write(command, 4096).succeeded(), "Failed to write the big namespace");
+				}
+				FAIL_IF(bigNamespace.getIdentifyNamespaceStructure().NUSE != DEDUP_BLOCK_SIZE / DEFAULT_SECTOR_SIZE, "NUSE should only count the one stored block");
+
+				Payload dataRead;
+				FAIL_IF(!bigNamespace.read(command, dataRead).succeeded(), "Failed to read the big namespace");
+				FAIL_IF(dataRead != noise, "The big namespace didn't read back what was written");
+
+				cnvme::driver::Driver driver;
+				ns::DEDUP_STATISTICS driverStatistics = { 0 };
+				FAIL_IF(driver.getNamespaceDedupStatistics(1, driverStatistics), "Got deduplication statistics for a namespace without deduplicated media");
+				FAIL_IF(driver.setNamespaceDeduplicatedMedia(2, true), "Was able to deduplicate an inactive namespace");
+				FAIL_IF(!driver.setNamespaceDeduplicatedMedia(1, true), "Failed to deduplicate the default namespace");
+				FAIL_IF(!driver.getNamespaceDedupStatistics(1, driverStatistics), "Failed to get deduplication statistics for the default namespace");
+				FAIL_IF(driverStatistics.MappedBlocks != 0, "New deduplicated media shouldn't have anything mapped");
+
+				return true;
+			}
+
+			bool testInstantErase()
+			{
+				const UINT_32 numberOfChunks = 64;
+				ns::SparseMedia sparseMedia(MEDIA_CHUNK_SIZE * numberOfChunks);
+				Payload pattern(MEDIA_CHUNK_SIZE * numberOfChunks);
+				memset(pattern.getBuffer(), 0x5A, pattern.getSize());
+				FAIL_IF(!sparseMedia.write(0, pattern.getBuffer(), pattern.getSize()), "Failed to write the sparse media");
+				auto clonedMedia = sparseMedia.clone();
+
+				// Other tests allocate at the same time, so check each media's own state rather than the process-wide counters
+				sparseMedia.deallocateAll();
+				FAIL_IF(sparseMedia.getAllocatedSize() != 0, "Erased media shouldn't have anything allocated");
+
+				Payload readBack(pattern.getSize());
+				FAIL_IF(!sparseMedia.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the erased media");
+				FAIL_IF(readBack != Payload(pattern.getSize()), "Erased media didn't read back as zeros");
+
+				// The clone still has every chunk, so nothing gets freed until it lets go
+				FAIL_IF(!clonedMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the clone of the erased media");
+				FAIL_IF(readBack != pattern, "Erasing media took the data out from under its clone");
+				FAIL_IF(clonedMedia->getAllocatedSize() != pattern.getSize(), "Erasing media took chunks away from its clone");
+				clonedMedia = nullptr;
+				ns::Media::waitForBackgroundReclamation();
+				FAIL_IF(sparseMedia.getAllocatedSize() != 0, "Reclaiming the erased chunks changed the media");
+
+				ns::DedupMedia dedupMedia(DEDUP_BLOCK_SIZE * numberOfChunks, false);
+				FAIL_IF(!dedupMedia.write(0, pattern.getBuffer(), DEDUP_BLOCK_SIZE * numberOfChunks), "Failed to write the deduplicated media");
+				dedupMedia.deallocateAll();
+				FAIL_IF(dedupMedia.getAllocatedSize() != 0 || dedupMedia.getStatistics().MappedBlocks != 0, "Erased deduplicated media shouldn't have anything stored");
+				FAIL_IF(!dedupMedia.read(0, readBack.getBuffer(), DEDUP_BLOCK_SIZE), "Failed to read the erased deduplicated media");
+				FAIL_IF(memcmp(readBack.getBuffer(), Payload(DEDUP_BLOCK_SIZE).getBuffer(), DEDUP_BLOCK_SIZE) != 0, "Erased deduplicated media didn't read back as zeros");
+
+				return true;
+			}
+
+			bool testImages()
+			{
+				// 1 TB with three written chunks (one of them all zeros) should only image the two with data
+				const UINT_64 mediaSize = (UINT_64)1024 * 1024 * 1024 * 1024;
+				ns::SparseMedia sparseMedia(mediaSize);
+				Payload pattern(MEDIA_CHUNK_SIZE);
+				helpers::randomizePayload(pattern);
+				const UINT_64 offsets[] = { 0, mediaSize / 2, mediaSize - MEDIA_CHUNK_SIZE };
+				FAIL_IF(!sparseMedia.write(offsets[0], pattern.getBuffer(), pattern.getSize()), "Failed to write the start of the media");
+				FAIL_IF(!sparseMedia.write(offsets[1], Payload(MEDIA_CHUNK_SIZE).getBuffer(), MEDIA_CHUNK_SIZE), "Failed to write zeros to the middle of the media");
+				FAIL_IF(!sparseMedia.write(offsets[2], pattern.getBuffer(), pattern.getSize()), "Failed to write the end of the media");
+
+				std::stringstream mediaImage;
+				FAIL_IF(!sparseMedia.saveImage(mediaImage), "Failed to save the media image");
+				FAIL_IF(mediaImage.str().size() != (sizeof(ns::MEDIA_IMAGE_EXTENT) + MEDIA_CHUNK_SIZE) * 2 + sizeof(ns::MEDIA_IMAGE_EXTENT), "The media image should only have the chunks with data");
+
+				ns::SparseMedia loadedMedia(mediaSize);
+				FAIL_IF(!loadedMedia.loadImage(mediaImage), "Failed to load the media image");
+				FAIL_IF(loadedMedia.getAllocatedSize() != MEDIA_CHUNK_SIZE * 2, "Loading the media image should only allocate the chunks with data");
+				for (UINT_64 offset : offsets)
+				{
+					Payload expected = offset == offsets[1] ? Payload(MEDIA_CHUNK_SIZE) : pattern;
+					Payload readBack(MEDIA_CHUNK_SIZE);
+					FAIL_IF(!loadedMedia.read(offset, readBack.getBuffer(), readBack.getSize()), "Failed to read the loaded media");
+					FAIL_IF(readBack != expected, "The loaded media didn't read back what was saved");
+				}
+
+				ns::SparseMedia smallMedia(MEDIA_CHUNK_SIZE);
+				mediaImage.clear();
+				mediaImage.seekg(0);
+				FAIL_IF_AND_HIDE_LOG(smallMedia.loadImage(mediaImage), "Loaded an image into media too small for it");
+
+				// A namespace with separate metadata keeps its LBA format and metadata through an image
+				ns::Namespace savedNamespace(MEDIA_CHUNK_SIZE * 16);
+				NVME_COMMAND formatCommand = { 0 };
+				formatCommand.DW10_Format.LBAF = 5;
+				FAIL_IF(!savedNamespace.formatNVM(formatCommand).succeeded(), "Failed to format the namespace with separate metadata");
+
+				const UINT_32 memoryPageSize = 4096;
+				Payload sector(memoryPageSize);
+				helpers::randomizePayload(sector);
+				UINT_8 metadata[16] = { 0 };
+				memset(metadata, 0x3C, sizeof(metadata));
+				NVME_COMMAND command = { 0 };
+				command.SLBA = savedNamespace.getIdentifyNamespaceStructure().NSZE - 1;
+				command.DPTR.DPTR1 = sector.getMemoryAddress();
+				command.DPTR.DPTR2 = (command.DPTR.DPTR1 & ~(UINT_64)(memoryPageSize - 1)) + memoryPageSize;
+				command.CompleteMPTR = (UINT_64)metadata;
+				FAIL_IF(!savedNamespace.write(command, memoryPageSize).succeeded(), "Failed to write the last LBA of the namespace");
+
+				std::stringstream namespaceImage;
+				FAIL_IF(!savedNamespace.saveImage(namespaceImage), "Failed to save the namespace image");
+
+				ns::Namespace loadedNamespace(MEDIA_CHUNK_SIZE * 16);
+				FAIL_IF(!loadedNamespace.loadImage(namespaceImage), "Failed to load the namespace image");
+				FAIL_IF(memcmp(&loadedNamespace.getIdentifyNamespaceStructure(), &savedNamespace.getIdentifyNamespaceStructure(), sizeof(identify::structures::IDENTIFY_NAMESPACE)) != 0,
+					"The loaded namespace didn't have the saved Identify Namespace");
+
+				Payload dataRead;
+				memset(metadata, 0, sizeof(metadata));
+				FAIL_IF(!loadedNamespace.read(command, dataRead).succeeded(), "Failed to read the last LBA of the loaded namespace");
+				FAIL_IF(dataRead != sector, "The loaded namespace didn't read back the saved data");
+				FAIL_IF(metadata[0] != 0x3C || metadata[15] != 0x3C, "The loaded namespace didn't read back the saved metadata");
+
+				// A cut off image shouldn't leave the namespace half loaded
+				std::string imageData = namespaceImage.str();
+				std::stringstream truncatedImage(imageData.substr(0, imageData.size() - sizeof(ns::MEDIA_IMAGE_EXTENT) * 2));
+				ns::Namespace untouchedNamespace(MEDIA_CHUNK_SIZE * 32);
+				FAIL_IF_AND_HIDE_LOG(untouchedNamespace.loadImage(truncatedImage), "Loaded a cut off namespace image");
+				FAIL_IF(untouchedNamespace.getIdentifyNamespaceStructure().NSZE != MEDIA_CHUNK_SIZE * 32 / DEFAULT_SECTOR_SIZE ||
+					untouchedNamespace.getIdentifyNamespaceStructure().FLBAS.CurrentLBAFormat != 0, "A failed load changed the namespace");
+
+				// Other media isn't silently swapped for memory, and an FTL model stays on
+				ns::Namespace wrappedNamespace(MEDIA_CHUNK_SIZE * 16);
+				ns::FTL_PARAMETERS ftlParameters = { 4096, 4, 75, constants::ftl::gc_policy::GREEDY, 1, 2 };
+				FAIL_IF(!wrappedNamespace.setMedia(std::make_shared<ns::DedupMedia>(MEDIA_CHUNK_SIZE * 16, false)), "Failed to back a namespace with deduplicated media");
+				FAIL_IF(!wrappedNamespace.setFtl(ftlParameters), "Failed to give the namespace an FTL model");
+				namespaceImage.clear();
+				namespaceImage.seekg(0);
+				FAIL_IF_AND_HIDE_LOG(wrappedNamespace.loadImage(namespaceImage), "Loaded an image over deduplicated media");
+				FAIL_IF(!wrappedNamespace.removeFtl() || !wrappedNamespace.setMedia(std::make_shared<ns::SparseMedia>(MEDIA_CHUNK_SIZE * 16)) || !wrappedNamespace.setFtl(ftlParameters),
+					"Failed to put the namespace back on in-memory media");
+				namespaceImage.clear();
+				namespaceImage.seekg(0);
+				FAIL_IF(!wrappedNamespace.loadImage(namespaceImage), "Failed to load the namespace image under an FTL model");
+				FAIL_IF(!wrappedNamespace.getFtl() || !std::dynamic_pointer_cast<ns::SparseMedia>(wrappedNamespace.getFtl()->getBackingMedia()), "Loading an image didn't keep the FTL model");
+				FAIL_IF(!wrappedNamespace.read(command, dataRead).succeeded() || dataRead != sector, "The namespace with an FTL model didn't read back the saved data");
+
+				// The whole controller, through the driver
+				helpers::TemporaryFile controllerImageFile("cNVMeControllerImageTest");
+				const std::string &controllerImagePath = controllerImageFile.Path;
+				helpers::TemporaryFile namespaceImageFile("cNVMeNamespaceImageTest");
+				const std::string &namespaceImagePath = namespaceImageFile.Path;
+				{
+					cnvme::driver::TestDriver savedDriver;
+					auto createResult = savedDriver.namespaceCreate(1ULL << 31, 16, 1, constants::commands::identify::csi::NVM);
+					FAIL_IF(!createResult.CompletionQueueEntry.succeeded(), "Failed to create a namespace to save");
+					UINT_32 createdNsid = createResult.CompletionQueueEntry.DWord0;
+
+					FAIL_IF(!savedDriver.saveControllerImage(controllerImagePath), "Failed to save the controller image");
+					FAIL_IF(!savedDriver.saveNamespaceImage(createdNsid, namespaceImagePath), "Failed to save the namespace image");
+					helpers::TemporaryFile missingImage("cNVMeMissingNamespaceImageTest");
+					FAIL_IF_AND_HIDE_LOG(savedDriver.saveNamespaceImage(createdNsid + 1, missingImage.Path), "Saved an image of a namespace that doesn't exist");
+
+					cnvme::driver::TestDriver loadedDriver;
+					FAIL_IF_AND_HIDE_LOG(loadedDriver.loadControllerImage(namespaceImagePath), "Loaded a namespace image as a controller image");
+					FAIL_IF(!loadedDriver.loadControllerImage(controllerImagePath), "Failed to load the controller image");
+
+					for (UINT_32 nsid : { (UINT_32)1, createdNsid })
+					{
+						auto savedIdentify = savedDriver.identify(constants::commands::identify::cns::NAMESPACES_ALLOCATED, nsid);
+						auto loadedIdentify = loadedDriver.identify(constants::commands::identify::cns::NAMESPACES_ALLOCATED, nsid);
+						FAIL_IF(!loadedIdentify.CompletionQueueEntry.succeeded() || loadedIdentify.OutputData != savedIdentify.OutputData, "A loaded namespace didn't match the saved one");
+					}
+					auto savedActiveList = savedDriver.identify(constants::commands::identify::cns::NAMESPACES_ACTIVE, 0);
+					auto loadedActiveList = loadedDriver.identify(constants::commands::identify::cns::NAMESPACES_ACTIVE, 0);
+					FAIL_IF(loadedActiveList.OutputData != savedActiveList.OutputData, "The loaded controller didn't have the same namespaces attached");
+
+					// Delete it, then bring it back from its own image
+					FAIL_IF(!loadedDriver.namespaceDelete(createdNsid).CompletionQueueEntry.succeeded(), "Failed to delete the loaded namespace");
+					FAIL_IF_AND_HIDE_LOG(loadedDriver.loadNamespaceImage(createdNsid, namespaceImagePath), "Loaded a namespace image into a deleted namespace");
+					FAIL_IF_AND_HIDE_LOG(loadedDriver.loadNamespaceImage(1, controllerImagePath), "Loaded a controller image as a namespace image");
+					FAIL_IF(!loadedDriver.loadNamespaceImage(1, namespaceImagePath), "Failed to load the namespace image over the default namespace");
+					auto identifyNamespace = loadedDriver.identify(constants::commands::identify::cns::NAMESPACE_ACTIVE, 1);
+					FAIL_IF(((identify::structures::IDENTIFY_NAMESPACE*)identifyNamespace.OutputData.getBuffer())->NSZE != 1ULL << 31, "The default namespace didn't take on the loaded namespace's size");
+				}
+
+				return true;
+			}
+
+			bool testWriteCache()
+			{
+				helpers::TemporaryFile testFile("cNVMeWriteCacheTest");
+				const std::string &filePath = testFile.Path;
+				const UINT_64 mediaSize = 1024 * 1024;
+
+				{
+					auto fileMedia = std::make_shared<ns::MappedFileMedia>(filePath, mediaSize);
+					FAIL_IF(!fileMedia->isMapped() || !fileMedia->isPersistent(), "File media should be mapped and persistent");
+					Payload expected(mediaSize);
+					helpers::randomizePayload(expected);
+					FAIL_IF(!fileMedia->write(0, expected.getBuffer(), expected.getSize()), "Failed to fill the file media");
+
+					const UINT_64 cacheSize = WRITE_CACHE_LINE_SIZE * 16;
+					ns::WriteCacheMedia writeCache(fileMedia, cacheSize);
+
+					// One sector in the middle of a line, then a few bytes inside another sector
+					Payload sector(DIRECT_IO_ALIGNMENT);
+					helpers::randomizePayload(sector);
+					FAIL_IF(!writeCache.write(WRITE_CACHE_LINE_SIZE + DIRECT_IO_ALIGNMENT, sector.getBuffer(), sector.getSize()), "Failed to write a sector to the cache");
+					memcpy_s(expected.getBuffer() + WRITE_CACHE_LINE_SIZE + DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT, sector.getBuffer(), DIRECT_IO_ALIGNMENT);
+					Payload fewBytes(10);
+					helpers::randomizePayload(fewBytes);
+					FAIL_IF(!writeCache.write(WRITE_CACHE_LINE_SIZE * 3 + 100, fewBytes.getBuffer(), fewBytes.getSize()), "Failed to write a few bytes to the cache");
+					memcpy_s(expected.getBuffer() + WRITE_CACHE_LINE_SIZE * 3 + 100, 10, fewBytes.getBuffer(), 10);
+
+					Payload readBack(mediaSize);
+					FAIL_IF(!writeCache.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read through the cache");
+					FAIL_IF(readBack != expected, "Reading through the cache didn't give the cached writes over the media");
+					FAIL_IF(!writeCache.read(WRITE_CACHE_LINE_SIZE + DIRECT_IO_ALIGNMENT, readBack.getBuffer(), DIRECT_IO_ALIGNMENT), "Failed to read a cached sector");
+					FAIL_IF(memcmp(readBack.getBuffer(), sector.getBuffer(), DIRECT_IO_ALIGNMENT) != 0, "A cached sector didn't read back");
+
+					FAIL_IF(!writeCache.flush(), "Failed to flush the cache");
+					FAIL_IF(writeCache.getDirtySize() != 0, "Nothing should be dirty after a flush");
+					FAIL_IF(!fileMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the file media");
+					FAIL_IF(readBack != expected, "A flush didn't put the cached writes on the media");
+
+					// More than the cache holds. Writes wait for it to destage instead of growing it.
+					Payload bigWrite(cacheSize * 4);
+					helpers::randomizePayload(bigWrite);
+					for (UINT_64 offset = 0; offset < bigWrite.getSize(); offset += DIRECT_IO_ALIGNMENT * 4)
+					{
+						FAIL_IF(!writeCache.write(offset, bigWrite.getBuffer() + offset, DIRECT_IO_ALIGNMENT * 4), "Failed to write more than the cache holds");
+						FAIL_IF(writeCache.getDirtySize() > cacheSize, "The cache grew past its size");
+					}
+					memcpy_s(expected.getBuffer(), expected.getSize(), bigWrite.getBuffer(), bigWrite.getSize());
+
+					// Throwing away part of what is cached
+					FAIL_IF(!writeCache.deallocate(DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT * 2), "Failed to deallocate through the cache");
+					memset(expected.getBuffer() + DIRECT_IO_ALIGNMENT, 0, DIRECT_IO_ALIGNMENT * 2);
+					FAIL_IF(!writeCache.read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read through the cache after a deallocate");
+					FAIL_IF(readBack != expected, "Deallocating through the cache didn't read back as zeros (with the rest untouched)");
+
+					// Left alone, the destager empties the cache
+					UINT_64 deathTime = helpers::getTimeInMilliseconds() + 5000;
+					while (writeCache.getDirtySize() != 0 && helpers::getTimeInMilliseconds() < deathTime)
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+					FAIL_IF(writeCache.getDirtySize() != 0, "The cache wasn't destaged in the background");
+					FAIL_IF(!fileMedia->read(0, readBack.getBuffer(), readBack.getSize()), "Failed to read the file media after destaging");
+					FAIL_IF(readBack != expected, "Destaging in the background didn't put the cached writes on the media");
+				}
+
+				// Through the Volatile Write Cache feature
+				{
+					using namespace constants::commands::features;
+					cnvme::driver::TestDriver driver;
+
+					auto identifyController = driver.identify(constants::commands::identify::cns::CONTROLLER, 0);
+					FAIL_IF(!(((identify::structures::IDENTIFY_CONTROLLER*)identifyController.OutputData.getBuffer())->VWC & constants::commands::identify::vwc::PRESENT), "Identify Controller should report a volatile write cache");
+					FAIL_IF(driver.getFeatures(fid::VOLATILE_WRITE_CACHE, sel::CURRENT).CompletionQueueEntry.DWord0 != 0, "The write cache should start off");
+					FAIL_IF(driver.getFeatures(fid::VOLATILE_WRITE_CACHE, sel::SUPPORTED_CAPABILITIES).CompletionQueueEntry.DWord0 != capabilities::CHANGEABLE, "The write cache should be changeable (but not saveable)");
+					FAIL_IF(driver.setFeatures(fid::VOLATILE_WRITE_CACHE, 1, true).CompletionQueueEntry.SC != constants::status::codes::specific::FEATURE_IDENTIFIER_NOT_SAVEABLE, "Saving the write cache setting should fail");
+					FAIL_IF_AND_HIDE_LOG(driver.setFeatures(0x7F, 0, false).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Setting an unsupported feature should fail");
+					FAIL_IF_AND_HIDE_LOG(driver.getFeatures(0x7F, sel::CURRENT).CompletionQueueEntry.SC != constants::status::codes::generic::INVALID_FIELD_IN_COMMAND, "Getting an unsupported feature should fail");
+
+					FAIL_IF(!driver.setNamespaceMediaFile(1, filePath, mediaSize, false), "Failed to back the default namespace with a file");
+					FAIL_IF(!driver.setFeatures(fid::VOLATILE_WRITE_CACHE, 1, false).CompletionQueueEntry.succeeded(), "Failed to turn the write cache on");
+					FAIL_IF(driver.getFeatures(fid::VOLATILE_WRITE_CACHE, sel::CURRENT).CompletionQueueEntry.DWord0 != 1, "The write cache didn't report being on");
+					FAIL_IF(driver.getFeatures(fid::VOLATILE_WRITE_CACHE, sel::DEFAULT).CompletionQueueEntry.DWord0 != 0, "The write cache should still default to off");
+
+					Payload payload(8192);
+					auto pDriverCommand = (cnvme::driver::PDRIVER_COMMAND)payload.getBuffer();
+					pDriverCommand->Timeout = 5;
+
+					FAIL_IF(!helpers::createIoQueuePair(driver, 1, 0x7), "Controller failed creating io queue pair 1");
+
+					pDriverCommand->QueueId = 1;
+					pDriverCommand->TransferDataSize = DEFAULT_SECTOR_SIZE;
+					const UINT_8 numberOfSectors = 20;
+					for (UINT_8 sector = 0; sector < numberOfSectors; sector++)
+					{
+						memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+						pDriverCommand->Command.NSID = 1;
+						pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+						pDriverCommand->Command.SLBA = sector;
+						pDriverCommand->TransferDataDirection = cnvme::driver::WRITE;
+						memset(pDriverCommand->TransferData, sector + 1, DEFAULT_SECTOR_SIZE);
+						driver.sendCommand(payload.getBuffer(), payload.getSize());
+						FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to write to the cached namespace");
+
+						pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::READ;
+						pDriverCommand->TransferDataDirection = cnvme::driver::READ;
+						memset(pDriverCommand->TransferData, 0, DEFAULT_SECTOR_SIZE);
+						driver.sendCommand(payload.getBuffer(), payload.getSize());
+						FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to read from the cached namespace");
+						FAIL_IF(pDriverCommand->TransferData[0] != sector + 1 || pDriverCommand->TransferData[DEFAULT_SECTOR_SIZE - 1] != sector + 1, "Read back the wrong data from the cached namespace");
+					}
+
+					// Flush every namespace at once
+					memset(&pDriverCommand->Command, 0, sizeof(pDriverCommand->Command));
+					pDriverCommand->Command.NSID = ALL_NAMESPACES;
+					pDriverCommand->Command.DWord0Breakdown.OPC = constants::opcodes::nvm::FLUSH;
+					pDriverCommand->TransferDataDirection = cnvme::driver::NO_DATA;
+					pDriverCommand->TransferDataSize = 0;
+					driver.sendCommand(payload.getBuffer(), payload.getSize());
+					FAIL_IF(!pDriverCommand->CompletionQueueEntry.succeeded(), "Failed to flush all namespaces");
+
+					std::ifstream file(filePath, std::ios::binary);
+					char lastSectorByte = 0;
+					file.seekg((numberOfSectors - 1) * DEFAULT_SECTOR_SIZE);
+					file.read(&lastSectorByte, 1);
+					FAIL_IF(lastSectorByte != numberOfSectors, "The flush didn't put the cached data in the backing file");
+					file.close();
+
+					FAIL_IF(!driver.setFeatures(fid::VOLATILE_WRITE_CACHE, 0, false).CompletionQueueEntry.succeeded(), "Failed to turn the write cache off");
+					FAIL_IF(driver.getFeatures(fid::VOLATILE_WRITE_CACHE, sel::CURRENT).CompletionQueueEntry.DWord0 != 0, "The write cache didn't report being off");
+				}
+
+				return true;
+			}
+
+			bool testFlashTranslationLayer()
+			{
+				// 4 blocks of 4 pages, with 3 spare blocks
+				ns::FTL_PARAMETERS parameters = { 0 };
+				parameters.PageSize = 4096;
+				parameters.PagesPerBlock = 4;
+				parameters.OverProvisioning = 75;
+				parameters.GcPolicy = constants::ftl::gc_policy::GREEDY;
+				parameters.GcLowWatermark = 1;
+				parameters.GcHighWatermark = 2;
+				const UINT_64 byteSize = 16 * 4096;
+				FAIL_IF(!ns::FlashTranslationLayer::isValid(byteSize, parameters), "The FTL should take these settings");
+				parameters.OverProvisioning = 25;
+				FAIL_IF(ns::FlashTranslationLayer::isValid(byteSize, parameters), "The FTL shouldn't take fewer spare blocks than the high watermark");
+				parameters.OverProvisioning = 75;
+
+				// Sequential overwrites leave whole blocks invalid, so nothing needs moving
+				ns::FlashTranslationLayer ftl(byteSize, parameters);
+				for (int pass = 0; pass < 3; pass++)
+				{
+					ftl.write(0, byteSize);
+				}
+				ns::FTL_STATISTICS statistics = ftl.getStatistics();
+				FAIL_IF(statistics.TotalBlocks != 7 || statistics.HostPagesWritten != 48 || statistics.ValidPages != 16, "The FTL didn't count the sequential writes");
+				FAIL_IF(statistics.PagesRelocated != 0 || statistics.MediaPagesWritten != 48, "Sequential overwrites shouldn't relocate anything");
+				FAIL_IF(statistics.GarbageCollections == 0 || statistics.FreeBlocks < parameters.GcLowWatermark, "Garbage collection should have kept blocks free");
+
+				// Overwriting one page per block leaves every block mostly valid
+				for (int pass = 0; pass < 4; pass++)
+				{
+					for (UINT_64 page = pass; page < 16; page += 4)
+					{
+						ftl.write(page * 4096, 1); // Less than a page still programs one
+					}
+				}
+				statistics = ftl.getStatistics();
+				FAIL_IF(statistics.PagesRelocated == 0, "Scattered overwrites should have made garbage collection relocate pages");
+				FAIL_IF(statistics.MediaPagesWritten != statistics.HostPagesWritten + statistics.PagesRelocated, "Media writes should be host writes plus relocations");
+				FAIL_IF(statistics.ValidPages != 16, "Every page should still be mapped");
+
+				ns::FTL_WORK backgroundWork = ftl.takeBackgroundWork();
+				FAIL_IF(backgroundWork.RelocatedBytes != statistics.PagesRelocated * parameters.PageSize || backgroundWork.BlocksErased != statistics.BlocksErased, "Background work didn't match the statistics");
+				backgroundWork = ftl.takeBackgroundWork();
+				FAIL_IF(backgroundWork.RelocatedBytes != 0 || backgroundWork.BlocksErased != 0, "Background work should only be handed out once");
+
+				// Once trimmed, nothing is left to relocate
+				ftl.deallocate(1, byteSize - 1); // Page 0 isn't fully covered
+				FAIL_IF(ftl.getStatistics().ValidPages != 1, "Deallocating should unmap the pages it fully covers");
+				UINT_64 pagesRelocated = ftl.getStatistics().PagesRelocated;
+				for (UINT_64 page = 1; page < 16; page++)
+				{
+					ftl.write(page * 4096, 4096);
+				}
+				FAIL_IF(ftl.getStatistics().PagesRelocated - pagesRelocated > 1, "Writing over trimmed pages shouldn't relocate more than the one page left");
+
+				// Random overwrites of a full drive amplify more than the same writes to a half full one, whatever the policy
+				parameters.PagesPerBlock = 32;
+				parameters.OverProvisioning = 10;
+				parameters.GcHighWatermark = 2;
+				const UINT_64 pages = 1024;
+				for (UINT_32 policy : { constants::ftl::gc_policy::GREEDY, constants::ftl::gc_policy::FIFO, constants::ftl::gc_policy::COST_BENEFIT })
+				{
+					parameters.GcPolicy = policy;
+					double writeAmplification[2] = { 0 };
+					for (UINT_64 usedPages : { pages, pages / 2 })
+					{
+						ns::FlashTranslationLayer drive(pages * 4096, parameters);
+						drive.write(0, usedPages * 4096);
+
+						std::mt19937 randomNumberEngine(policy);
+						std::uniform_int_distribution<UINT_64> distribution(0, usedPages - 1);
+						for (int i = 0; i < 8192; i++)
+						{
+							drive.write(distribution(randomNumberEngine) * 4096, 4096);
+						}
+
+						statistics = drive.getStatistics();
+						FAIL_IF(statistics.MediaPagesWritten != statistics.HostPagesWritten + statistics.PagesRelocated, "Media writes should be host writes plus relocations");
+						FAIL_IF(statistics.ValidPages != usedPages || statistics.FreeBlocks < parameters.GcLowWatermark, "The FTL lost track of its pages or blocks");
+						writeAmplification[usedPages == pages ? 0 : 1] = (double)statistics.MediaPagesWritten / statistics.HostPagesWritten;
+					}
+					FAIL_IF(writeAmplification[0] <= writeAmplification[1] * 2, "Policy " + std::to_string(policy) + ": a full drive should amplify writes far more than a half full one");
+				}
+
+				// Garbage collection keeps the die busy, so the next read on it waits
+				controller::LATENCY_MODEL_PARAMETERS latencyParameters;
+				memset(&latencyParameters, 0, sizeof(latencyParameters));
+				latencyParameters.NvmLatency[constants::opcodes::nvm::READ] = 100000;
+				latencyParameters.NumberOfChannels = 1;
+				latencyParameters.DiesPerChannel = 1;
+				latencyParameters.StripeSize = 4096;
+				latencyParameters.ChannelBandwidth = 409600000;
+				latencyParameters.EraseLatency = 1000000;
+				controller::LatencyModel latencyModel(latencyParameters);
+				auto now = std::chrono::steady_clock::now();
+				controller::TIMED_COMMAND read = { false, constants::opcodes::nvm::READ, 0, 4096, 4096, 1 };
+				FAIL_IF(latencyModel.getCompletionTime(read, now) != now + std::chrono::microseconds(100 + 1000 + 110), "A read didn't wait for garbage collection on its die");
+
+				// Through a namespace
+				parameters = ns::FlashTranslationLayer::getDefaultParameters();
+				ns::Namespace ftlNamespace(64 * 1024 * 1024);
+				FAIL_IF(!ftlNamespace.setFtl(parameters), "Failed to give a namespace an FTL model");
+				Payload data(4096);
+				NVME_COMMAND command = { 0 };
+				command.DPTR.DPTR1 = data.getMemoryAddress();
+				command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(4096 / DEFAULT_SECTOR_SIZE);
+				FAIL_IF(!ftlNamespace.write(command, 4096).succeeded(), "Failed to write a namespace with an FTL model");
+				FAIL_IF(!ftlNamespace.getFtl() || ftlNamespace.getFtl()->getStatistics().HostPagesWritten != 1, "The namespace's writes didn't go through its FTL model");
+				FAIL_IF(!ftlNamespace.removeFtl() || ftlNamespace.getFtl(), "Failed to take the FTL model away");
+				Payload dataRead;
+				FAIL_IF(!ftlNamespace.read(command, dataRead).succeeded() || dataRead != data, "Taking the FTL model away lost data");
+
+				// The default namespace is 4 pages, so it needs small blocks
+				cnvme::driver::Driver driver;
+				ns::FTL_STATISTICS driverStatistics = { 0 };
+				FAIL_IF(driver.getNamespaceFtlStatistics(1, driverStatistics), "Got FTL statistics for a namespace without an FTL model");
+				FAIL_IF(driver.setNamespaceFtl(1, parameters), "Gave the default namespace an FTL model with more pages per block than it has");
+				parameters.PagesPerBlock = 1;
+				parameters.OverProvisioning = 100;
+				parameters.GcLowWatermark = 1;
+				parameters.GcHighWatermark = 2;
+				FAIL_IF(driver.setNamespaceFtl(2, parameters), "Gave an inactive namespace an FTL model");
+				FAIL_IF(!driver.setNamespaceFtl(1, parameters), "Failed to give the default namespace an FTL model");
+				FAIL_IF(!driver.getNamespaceFtlStatistics(1, driverStatistics) || driverStatistics.TotalBlocks != 8, "Failed to get FTL statistics for the default namespace");
+				FAIL_IF(!driver.removeNamespaceFtl(1) || driver.getNamespaceFtlStatistics(1, driverStatistics), "Failed to take the FTL model away from the default namespace");
+
+				// Writes to asynchronous media are timed once they're done, so each carries the garbage collection it caused
+				class BackgroundWorkModel : public controller::TimingModel
+				{
+				public:
+					std::chrono::steady_clock::time_point getCompletionTime(const controller::TIMED_COMMAND &command, std::chrono::steady_clock::time_point now)
+					{
+						this->ErasedBlocks += command.ErasedBlocks;
+						return now;
+					}
+
+					std::atomic<UINT_64> ErasedBlocks{ 0 };
+				};
+
+				helpers::TemporaryFile testFile("cNVMeFtlTimingTest");
+				cnvme::driver::TestDriver testDriver;
+				FAIL_IF(!testDriver.setNamespaceMediaFile(1, testFile.Path, 4 * 4096, true), "Failed to back the default namespace with a direct I/O file");
+				FAIL_IF(!testDriver.setNamespaceFtl(1, parameters), "Failed to give the direct I/O namespace an FTL model");
+				auto backgroundWorkModel = std::make_shared<BackgroundWorkModel>();
+				testDriver.setTimingModel(backgroundWorkModel);
+				FAIL_IF(!helpers::createIoQueuePair(testDriver, 1, 0xF), "Controller failed creating io queue pair 1");
+
+				command = { 0 };
+				command.NSID = 1;
+				command.DWord0Breakdown.OPC = constants::opcodes::nvm::WRITE;
+				command.DW12_IO.NLB = ZERO_BASED_FROM_ONE_BASED(4096 / DEFAULT_SECTOR_SIZE);
+				for (UINT_64 page = 0; page < 12; page++)
+				{
+					command.SLBA = (page % 4) * 4096 / DEFAULT_SECTOR_SIZE;
+					FAIL_IF(!testDriver.writeCommand(command, 1, data).CompletionQueueEntry.succeeded(), "Failed to write the direct I/O namespace with an FTL model");
+					FAIL_IF(!testDriver.getNamespaceFtlStatistics(1, driverStatistics), "Failed to get FTL statistics for the direct I/O namespace");
+					FAIL_IF(backgroundWorkModel->ErasedBlocks != driverStatistics.BlocksErased, "Garbage collection wasn't charged to the write that caused it");
+				}
+				FAIL_IF(driverStatistics.BlocksErased == 0, "Overwriting the namespace should have made garbage collection erase blocks");
+				testDriver.setTimingModel(nullptr);
+
+				return true;
+			}
+		}
+
+		namespace queue
+		{
+			bool testCompletionQueueRing()
+			{
+				const UINT_32 queueSize = 8;
+				const UINT_16 entriesToPost = 1000;
+				Payload queueMemory(queueSize * sizeof(COMPLETION_QUEUE_ENTRY));
+				UINT_16 headDoorbell = 0;
+
+				// Both sides look at the same memory and doorbell, like the controller and driver do
+				Queue controllerSide(queueSize, 1, &headDoorbell, queueMemory.getMemoryAddress());
+				Queue hostSide(queueSize, 1, &headDoorbell, queueMemory.getMemoryAddress());
+
+				std::thread poster([&]() {
+					for (UINT_16 i = 0; i < entriesToPost; i++)
+					{
+						COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+						completionQueueEntry.CID = i;
+						completionQueueEntry.SQHD = i;
+						completionQueueEntry.DWord0 = i * 3;
+
+						controllerSide.setHeadPointer(controllerSide.readDoorbell());
+						while (!controllerSide.postCompletionQueueEntry(completionQueueEntry))
+						{
+							std::this_thread::yield();
+							controllerSide.setHeadPointer(controllerSide.readDoorbell());
+						}
+					}
+				});
+
+				bool inOrder = true;
+				for (UINT_16 i = 0; i < entriesToPost; i++)
+				{
+					COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+					while (!hostSide.consumeCompletionQueueEntry(completionQueueEntry))
+					{
+						std::this_thread::yield();
+					}
+					inOrder &= completionQueueEntry.CID == i && completionQueueEntry.SQHD == i && completionQueueEntry.DWord0 == (UINT_32)i * 3;
+				}
+				poster.join();
+
+				FAIL_IF(!inOrder, "Completions were lost, torn or reordered going around the ring");
+
+				COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+				FAIL_IF(hostSide.consumeCompletionQueueEntry(completionQueueEntry), "The host consumed an entry that was never posted");
+				FAIL_IF(hostSide.getPhaseTag() != controllerSide.getPhaseTag(), "Both sides should agree on the phase tag once the ring is drained");
+				FAIL_IF(headDoorbell != entriesToPost % queueSize, "The head doorbell should point just past the last consumed entry");
+
+				return true;
+			}
+		}
+
+		namespace payload
+		{
+			bool testSegmentedPayload()
+			{
+				std::vector<size_t> segmentSizes = { 8, 511, 4096, 4097, 8192 };
+
+				SegmentedPayload segmentedPayload;
+				Payload expectedPayload;
+				std::vector<Payload> referencedPayloads;
+				for (size_t i = 0; i < segmentSizes.size(); i++)
+				{
+					Payload segment(segmentSizes[i]);
+					helpers::randomizePayload(segment);
+					expectedPayload.append(segment);
+
+					// Mix the different ways to add a segment
+					if (i % 3 == 0)
+					{
+						segmentedPayload.append(std::move(segment));
+					}
+					else if (i % 3 == 1)
+					{
+						segmentedPayload.append(segment.getBuffer(), segment.getSize());
+					}
+					else
+					{
+						referencedPayloads.push_back(std::move(segment));
+						segmentedPayload.appendReference(referencedPayloads.back().getBuffer(), referencedPayloads.back().getSize());
+					}
+				}
+
+				FAIL_IF(segmentedPayload.getSize() != expectedPayload.getSize(), "SegmentedPayload size didn't match the sum of its segments");
+				FAIL_IF(segmentedPayload.getSegments().size() != segmentSizes.size(), "SegmentedPayload didn't keep one segment per append");
+
+				// Copy a range that spans a segment boundary
+				Payload range(1024);
+				FAIL_IF(!segmentedPayload.copyTo(4000, range.getBuffer(), range.getSize()), "Copying a valid range from a SegmentedPayload failed");
+				FAIL_IF(memcmp(range.getBuffer(), expectedPayload.getBuffer() + 4000, range.getSize()) != 0, "Range copied across segments didn't match");
+
+				FAIL_IF(Payload(std::move(segmentedPayload)) != expectedPayload, "Materialized SegmentedPayload didn't match the appended Payload");
+				FAIL_IF(segmentedPayload.getSize() != 0, "SegmentedPayload should be empty after being materialized");
+
+				// A single owned segment should be handed over without a copy
+				Payload singleSegment(4096);
+				UINT_8* singleSegmentBuffer = singleSegment.getBuffer();
+				segmentedPayload.append(std::move(singleSegment));
+				FAIL_IF(segmentedPayload.toPayload().getBuffer() != singleSegmentBuffer, "A single owned segment should be adopted without a copy");
+
+				return true;
+			}
+
+			bool testPayloadPoolAllocation()
+			{
+				// Other tests allocate at the same time, so only check what this thread's activity guarantees.
+				memory::ALLOCATION_STATISTICS statisticsBefore = memory::getAllocationStatistics();
+
+				UINT_8* firstBuffer = nullptr;
+				{
+					Payload payload(4096);
+					firstBuffer = payload.getBuffer();
+					FAIL_IF(firstBuffer == nullptr, "Payload didn't get a buffer");
+					FAIL_IF(payload.getMemoryAddress() % memory::MAX_ALLOCATION_ALIGNMENT != 0, "Page sized Payload wasn't page aligned");
+				}
+
+				{
+					// Same size class on the same thread should get the just freed buffer back
+					Payload payload(4000, false);
+					FAIL_IF(payload.getBuffer() != firstBuffer, "Payload of the same size class didn't reuse the pooled buffer");
+					FAIL_IF(payload.getSize() != 4000, "Uninitialized Payload had the wrong size");
+
+					Payload zeroedPayload(4000);
+					for (size_t i = 0; i < zeroedPayload.getSize(); i++)
+					{
+						FAIL_IF(zeroedPayload.getBuffer()[i] != 0, "Payload wasn't zeroed");
+					}
+				}
+
+				// Growing within a size class shouldn't move the buffer, and the new bytes should be 0
+				Payload growingPayload(100);
+				memset(growingPayload.getBuffer(), 0xAA, growingPayload.getSize());
+				UINT_8* growingBuffer = growingPayload.getBuffer();
+				growingPayload.resize(120);
+				FAIL_IF(growingPayload.getBuffer() != growingBuffer, "Resizing within a size class shouldn't reallocate");
+				FAIL_IF(growingPayload.getBuffer()[99] != 0xAA || growingPayload.getBuffer()[100] != 0, "Resizing within a size class didn't keep the data and zero the rest");
+
+				// Large allocations skip the pool
+				Payload largePayload(memory::MAX_POOLED_ALLOCATION_SIZE + 1);
+				FAIL_IF(largePayload.getMemoryAddress() % memory::MAX_ALLOCATION_ALIGNMENT != 0, "Large Payload wasn't page aligned");
+				FAIL_IF(growingPayload.getMemoryAddress() % memory::MIN_POOLED_ALLOCATION_SIZE != 0, "Small Payload wasn't cache line aligned");
+				FAIL_IF(largePayload.getBuffer()[memory::MAX_POOLED_ALLOCATION_SIZE] != 0, "Large Payload wasn't zeroed");
+
+				memory::ALLOCATION_STATISTICS statisticsAfter = memory::getAllocationStatistics();
+				FAIL_IF(statisticsAfter.Allocations < statisticsBefore.Allocations + 5, "Allocation statistics didn't count the allocations");
+				FAIL_IF(statisticsAfter.PoolHits < statisticsBefore.PoolHits + 1, "Allocation statistics didn't count the pool hit");
+				FAIL_IF(statisticsAfter.LargeAllocations < statisticsBefore.LargeAllocations + 1, "Allocation statistics didn't count the large allocation");
+
+				return true;
+			}
+
+			bool testMemoryAccounting()
+			{
+				// Other tests allocate at the same time, so only check what this thread's activity guarantees.
+				memory::MEMORY_STATISTICS statisticsBefore = memory::getMemoryStatistics();
+
+				Payload payload(8192);
+				payload.setAccountingSubsystem(memory::SUBSYSTEM_FIRMWARE_CACHE);
+				FAIL_IF(payload.getAccountingSubsystem() != memory::SUBSYSTEM_FIRMWARE_CACHE, "Payload didn't keep its accounting subsystem");
+
+				// Assigning keeps the subsystem and gives back the old buffer
+				payload = Payload(100);
+				payload = Payload(200);
+				FAIL_IF(payload.getAccountingSubsystem() != memory::SUBSYSTEM_FIRMWARE_CACHE, "Payload lost its accounting subsystem on assignment");
+
+				Payload copy(payload);
+				FAIL_IF(copy.getAccountingSubsystem() != memory::SUBSYSTEM_FIRMWARE_CACHE, "A copy of a Payload should be accounted to the same subsystem");
+				copy = payload;
+
+				memory::MEMORY_STATISTICS statisticsAfter = memory::getMemoryStatistics();
+				memory::SUBSYSTEM_STATISTICS &firmwareBefore = statisticsBefore.Subsystems[memory::SUBSYSTEM_FIRMWARE_CACHE];
+				memory::SUBSYSTEM_STATISTICS &firmwareAfter = statisticsAfter.Subsystems[memory::SUBSYSTEM_FIRMWARE_CACHE];
+
+				// 8192 transferred in, then swapped for 100 then 200, then a copy made and copy-assigned over
+				FAIL_IF(firmwareAfter.Allocations < firmwareBefore.Allocations + 5, "Firmware cache allocations weren't accounted");
+				FAIL_IF(firmwareAfter.Deallocations < firmwareBefore.Deallocations + 3, "Assigning to a Payload didn't give back its old buffer");
+				FAIL_IF(firmwareAfter.HighWaterBytes < 8192, "High-water mark didn't include the Payload");
+				for (size_t i = 0; i < memory::NUMBER_OF_SUBSYSTEMS; i++)
+				{
+					FAIL_IF(memory::subsystemToString((memory::Subsystem)i) == "Unknown", "Subsystem " + std::to_string(i) + " has no name");
+				}
+
+				return true;
+			}
+		}
+
 		namespace prp
 		{
 			bool testDifferentPRPSizes()
@@ -28,11 +28,16 @@ Tests.h - A header file for all unit testing
 #include "Constants.h"
 #include "Controller.h"
 #include "ControllerRegisters.h"
+#include "Crc.h"
 #include "Driver.h"
 #include "Identify.h"
+#include "LbaRangeLock.h"
 #include "LoopingThread.h"
+#include "Memory.h"
 #include "PCIe.h"
 #include "PRP.h"
+#include "SegmentedPayload.h"
+#include "Zones.h"
 
 using namespace cnvme;
 using namespace cnvme::controller;
@@ -68,6 +73,42 @@ namespace cnvme
 			/// Gets a firmware image binary with proper eye catcher and a given firmware revision. The file matches the give size.
 			/// </summary>
 			Payload getFirmwareImage(std::string firmwareRevision, size_t fileSizeInBytes);
+
+			/// <summary>
+			/// Creates an IO completion queue and an IO submission queue mapped to it, both with the given ID and size
+			/// </summary>
+			/// <param name="driver">Driver to send the Create IO Completion/Submission Queue commands through</param>
+			/// <param name="queueId">ID for both queues</param>
+			/// <param name="zeroBasedQueueSize">QSIZE for both queues</param>
+			/// <returns>true if both queues were created</returns>
+			bool createIoQueuePair(cnvme::driver::Driver &driver, UINT_16 queueId, UINT_16 zeroBasedQueueSize);
+
+			/// <summary>
+			/// A file in the current directory for one test run. Tests run more than once at a time, so each run gets its own name.
+			/// The file is removed when this goes out of scope, so a test that fails part way doesn't leave it behind.
+			/// </summary>
+			class TemporaryFile
+			{
+			public:
+				/// <summary>
+				/// Constructor. Picks a name and removes anything already there.
+				/// </summary>
+				/// <param name="prefix">Start of the file name</param>
+				TemporaryFile(const std::string &prefix);
+
+				/// <summary>
+				/// Destructor. Removes the file.
+				/// </summary>
+				~TemporaryFile();
+
+				TemporaryFile(const TemporaryFile&) = delete;
+				TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+				/// <summary>
+				/// Path to the file
+				/// </summary>
+				const std::string Path;
+			};
 		}
 
 		namespace general
@@ -76,6 +117,28 @@ namespace cnvme
 			/// Tests the LoopingThread class
 			/// </summary>
 			bool testLoopingThread();
+
+			/// <summary>
+			/// Tests that LbaRangeLock lets ranges that don't conflict go at once, makes conflicting ones wait for earlier ones,
+			///   and hands overlapping writes the lock in the order they were reserved
+			/// </summary>
+			bool testLbaRangeLock();
+
+			/// <summary>
+			/// Tests the CRC16 T10-DIF against its check value, and that the sliced CRC matches the bytewise one for any length and split
+			/// </summary>
+			bool testCrc16T10Dif();
+
+			/// <summary>
+			/// Tests that TimerWheel never runs a callback early, runs due ones in deadline order,
+			///   and holds deadlines more than a turn away until the turn they are due
+			/// </summary>
+			bool testTimerWheel();
+
+			/// <summary>
+			/// Tests that a failed write gives back its zone's LBAs, but not once the zone was reset and written again in the meantime
+			/// </summary>
+			bool testZoneWriteRelease();
 		}
 
 		namespace pci
@@ -94,6 +157,11 @@ namespace cnvme
 			/// Tests a controller level reset
 			/// </summary>
 			bool testControllerReset();
+
+			/// <summary>
+			/// Tests that the doorbells are laid out and used with the configured doorbell stride (CAP.DSTRD)
+			/// </summary>
+			bool testDoorbellStride();
 		}
 
 		namespace commands
@@ -118,10 +186,56 @@ namespace cnvme
 			/// </summary>
 			bool testNVMeIo();
 
+			/// <summary>
+			/// Tests that Write Zeroes clears only the LBAs it was given, without a data transfer, and fails past the end of the namespace
+			/// </summary>
+			bool testNVMeWriteZeroes();
+
+			/// <summary>
+			/// Tests Compare on its own and fused Compare and Write (through memory and direct I/O namespaces):
+			///   the write only lands when the compare passes, mismatched or lone fused commands fail, and pairs go around the queues fine.
+			/// </summary>
+			bool testNVMeCompareAndWrite();
+
+			/// <summary>
+			/// Tests formatting with metadata and end-to-end protection information: the controller inserting/stripping it (PRACT),
+			///   guard/application tag/reference tag checks failing without writing anything, and extended vs separate metadata
+			/// </summary>
+			bool testNVMeProtectionInformation();
+
 			/// <summary>
 			/// Tests that updating FW works correctly
 			/// </summary>
 			bool testNVMeFirmwareDownloadAndCommit();
+
+			/// <summary>
+			/// Tests that hundreds of (terabyte, thin provisioned) namespaces can be created, attached, used, detached and deleted
+			/// </summary>
+			bool testNVMeNamespaceManagementAndAttachment();
+
+			/// <summary>
+			/// Tests a zoned namespace: writes only at the write pointer, Zone Append returning where its data landed,
+			///   zone state changes through Zone Management Send, and Report Zones (filtered and partial)
+			/// </summary>
+			bool testNVMeZonedNamespace();
+
+			/// <summary>
+			/// Tests that the latency model overlaps work on different dies, queues work on a busy die,
+			///   and that the controller holds completions (admin and I/O) until the time the model gives
+			/// </summary>
+			bool testNVMeTimingModel();
+
+			/// <summary>
+			/// Tests that the QoS Limits feature holds back (but doesn't fail) commands over a namespace's IOPS limit
+			///   or a submission queue's bandwidth limit, and that limits can be read back and removed
+			/// </summary>
+			bool testNVMeQosLimits();
+
+			/// <summary>
+			/// Tests that Identify Controller reports the power states, that the Power Management and Autonomous Power State Transition features
+			///   move between them (on their own after idling), and that I/O waits out wake-up and runs slower in lower operational states
+			/// </summary>
+			bool testNVMePowerManagement();
 		}
 
 		namespace driver
@@ -137,6 +251,99 @@ namespace cnvme
 			bool testReadCommandViaDriver();
 		}
 
+		namespace media
+		{
+			/// <summary>
+			/// Tests that a multi-terabyte namespace only allocates the chunks that get written,
+			///   that unwritten LBAs read as zeros, and that NUSE follows the allocated chunks.
+			/// </summary>
+			bool testSparseNamespace();
+
+			/// <summary>
+			/// Tests that a namespace backed by a memory mapped file writes through to the file,
+			///   flushes it, and sees the same data when the file is mapped again.
+			/// </summary>
+			bool testMappedFileNamespace();
+
+			/// <summary>
+			/// Tests that a namespace doing direct I/O to a file completes reads, writes and flushes asynchronously through the driver,
+			///   going around the IO queues more than once, and that partial block writes keep the bytes around them.
+			/// </summary>
+			bool testDirectFileNamespace();
+
+			/// <summary>
+			/// Tests that Dataset Management deallocates give whole chunks back to sparse media (dropping NUSE),
+			///   that deallocated LBAs read as zeros on every kind of media, and that a bad range fails before anything is deallocated.
+			/// </summary>
+			bool testDatasetManagement();
+
+			/// <summary>
+			/// Tests that cloned sparse media shares data until either side writes, that a namespace reverts to its snapshot
+			///   (more than once), and that snapshots are refused for inactive or file backed namespaces.
+			/// </summary>
+			bool testSnapshots();
+
+			/// <summary>
+			/// Tests that deduplicated media stores identical blocks once and zero blocks not at all, that compression and
+			///   partial block writes read back right, that clones don't see each other's writes, and that NUSE reports the savings.
+			/// </summary>
+			bool testDedupMedia();
+
+			/// <summary>
+			/// Tests that erasing in-memory media reads back zeros right away, with the old chunks freed in the background
+			///   (but kept for a clone that still has them)
+			/// </summary>
+			bool testInstantErase();
+
+			/// <summary>
+			/// Tests that media, namespace and controller images only carry written data, load back exactly (LBA format and metadata included),
+			///   and that images of the wrong type or a mismatched size are refused without changing anything.
+			/// </summary>
+			bool testImages();
+
+			/// <summary>
+			/// Tests that a write cache reads back what was written (whole, partial and sub-sector), destages in the background,
+			///   on flush and when full, and that the Volatile Write Cache feature turns it on and off for file backed namespaces.
+			/// </summary>
+			bool testWriteCache();
+
+			/// <summary>
+			/// Tests that the FTL model only relocates when overwrites leave blocks partly valid, that write amplification grows as the drive fills up
+			///   under every garbage collection policy, that its work keeps dies busy in the latency model, and that namespaces take it on and off.
+			/// </summary>
+			bool testFlashTranslationLayer();
+		}
+
+		namespace queue
+		{
+			/// <summary>
+			/// Tests that a completion queue shared between a posting thread and a consuming thread
+			///   hands over every entry in order across many laps (phase tag flips) without overrunning the host.
+			/// </summary>
+			bool testCompletionQueueRing();
+		}
+
+		namespace payload
+		{
+			/// <summary>
+			/// Tests that a SegmentedPayload chains owned and referenced segments
+			///   and materializes them into the same bytes as a contiguous append would.
+			/// </summary>
+			bool testSegmentedPayload();
+
+			/// <summary>
+			/// Tests that Payload buffers are reused from the size-class pool
+			///   and that the allocation statistics track it.
+			/// </summary>
+			bool testPayloadPoolAllocation();
+
+			/// <summary>
+			/// Tests that Payload memory is accounted to subsystems and that
+			///   assigning to a Payload gives back its old buffer.
+			/// </summary>
+			bool testMemoryAccounting();
+		}
+
 		namespace prp
 		{
 			/// <summary>
@@ -0,0 +1,106 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+ThreadPool.cpp - An implementation file for the ThreadPool class
+*/
+
+#include "ThreadPool.h"
+
+namespace cnvme
+{
+	ThreadPool::ThreadPool(size_t numberOfThreads)
+	{
+		NumberOfThreads = numberOfThreads;
+		OutstandingWork = 0;
+		Stopping = false;
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock(WorkMutex);
+			Stopping = true;
+			WorkAvailable.notify_all();
+		}
+
+		for (auto &thread : Threads)
+		{
+			thread.join();
+		}
+	}
+
+	void ThreadPool::submit(std::function<void()> work)
+	{
+		std::unique_lock<std::mutex> lock(WorkMutex);
+
+		if (Threads.empty())
+		{
+			for (size_t i = 0; i < NumberOfThreads; i++)
+			{
+				Threads.push_back(std::thread(&ThreadPool::workerFunction, this));
+			}
+		}
+
+		PendingWork.push_back(std::move(work));
+		OutstandingWork++;
+		WorkAvailable.notify_one();
+	}
+
+	void ThreadPool::waitForIdle()
+	{
+		std::unique_lock<std::mutex> lock(WorkMutex);
+		while (OutstandingWork != 0)
+		{
+			WorkFinished.wait(lock);
+		}
+	}
+
+	void ThreadPool::workerFunction()
+	{
+		std::unique_lock<std::mutex> lock(WorkMutex);
+
+		while (true)
+		{
+			while (PendingWork.empty() && !Stopping)
+			{
+				WorkAvailable.wait(lock);
+			}
+
+			if (PendingWork.empty())
+			{
+				return; // Stopping, and everything submitted has been taken
+			}
+
+			std::function<void()> work = std::move(PendingWork.front());
+			PendingWork.pop_front();
+
+			lock.unlock();
+			work();
+			lock.lock();
+
+			if (--OutstandingWork == 0)
+			{
+				WorkFinished.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,117 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+ThreadPool.h - A header file for the ThreadPool class
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	/// <summary>
+	/// A fixed number of threads that run submitted work in the order it was submitted.
+	/// Threads are only started once there is work for them.
+	/// </summary>
+	class ThreadPool
+	{
+	public:
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="numberOfThreads">Number of threads to run work on</param>
+		ThreadPool(size_t numberOfThreads);
+
+		/// <summary>
+		/// Destructor. Finishes all submitted work, then stops the threads.
+		/// </summary>
+		~ThreadPool();
+
+		/// <summary>
+		/// Queues work to be run on one of the threads
+		/// </summary>
+		/// <param name="work">The work to run</param>
+		void submit(std::function<void()> work);
+
+		/// <summary>
+		/// Blocks until all submitted work has finished running
+		/// </summary>
+		void waitForIdle();
+
+	private:
+		/// <summary>
+		/// Copying a pool doesn't make sense
+		/// </summary>
+		ThreadPool(const ThreadPool&);
+
+		/// <summary>
+		/// Copying a pool doesn't make sense
+		/// </summary>
+		ThreadPool& operator=(const ThreadPool&);
+
+		/// <summary>
+		/// Run by each thread. Takes work off the queue until told to stop.
+		/// </summary>
+		void workerFunction();
+
+		/// <summary>
+		/// Number of threads to start
+		/// </summary>
+		size_t NumberOfThreads;
+
+		/// <summary>
+		/// The threads. Empty until the first submit().
+		/// </summary>
+		std::vector<std::thread> Threads;
+
+		/// <summary>
+		/// Work that hasn't started yet
+		/// </summary>
+		std::list<std::function<void()>> PendingWork;
+
+		/// <summary>
+		/// Number of pieces of work submitted but not finished
+		/// </summary>
+		size_t OutstandingWork;
+
+		/// <summary>
+		/// true once the threads should exit
+		/// </summary>
+		bool Stopping;
+
+		/// <summary>
+		/// Guards everything above
+		/// </summary>
+		std::mutex WorkMutex;
+
+		/// <summary>
+		/// Signaled when work is submitted (or the pool is stopping)
+		/// </summary>
+		std::condition_variable WorkAvailable;
+
+		/// <summary>
+		/// Signaled when OutstandingWork hits 0
+		/// </summary>
+		std::condition_variable WorkFinished;
+	};
+}
@@ -0,0 +1,148 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+TimerWheel.cpp - An implementation file for a hashed timer wheel
+*/
+
+#include "TimerWheel.h"
+
+namespace cnvme
+{
+	TimerWheel::TimerWheel(std::chrono::nanoseconds tickDuration, size_t numberOfSlots)
+	{
+		ASSERT_IF(tickDuration.count() <= 0 || numberOfSlots == 0, "A timer wheel needs at least one slot of at least one nanosecond");
+
+		this->Start = std::chrono::steady_clock::now();
+		this->TickDuration = tickDuration;
+		this->Slots.resize(numberOfSlots);
+		this->CurrentTick = 0;
+		this->NumberOfTimers = 0;
+	}
+
+	void TimerWheel::schedule(std::chrono::steady_clock::time_point deadline, std::function<void()> callback)
+	{
+		std::unique_lock<std::mutex> lock(this->WheelMutex);
+
+		// Anything already due goes in the next tick, so the next advance() runs it
+		UINT_64 tick = (std::max)(this->getTick(deadline), this->CurrentTick + 1);
+		this->Slots[(size_t)(tick % this->Slots.size())].push_back({ tick, std::move(callback) });
+		this->NumberOfTimers++;
+	}
+
+	size_t TimerWheel::advance(std::chrono::steady_clock::time_point now)
+	{
+		std::vector<TIMER> expiredTimers;
+		{
+			std::unique_lock<std::mutex> lock(this->WheelMutex);
+
+			// Only whole ticks that are over count. The current one may still get timers for it.
+			UINT_64 nowTick = (UINT_64)((now - this->Start) / this->TickDuration);
+			if (nowTick <= this->CurrentTick || this->NumberOfTimers == 0)
+			{
+				this->CurrentTick = (std::max)(this->CurrentTick, nowTick);
+				return 0;
+			}
+
+			// Past a full turn, every slot gets looked at once anyway
+			UINT_64 ticksToVisit = (std::min)(nowTick - this->CurrentTick, (UINT_64)this->Slots.size());
+			for (UINT_64 tick = this->CurrentTick + 1; tick <= this->CurrentTick + ticksToVisit; tick++)
+			{
+				std::list<TIMER> &slot = this->Slots[(size_t)(tick % this->Slots.size())];
+				for (auto itr = slot.begin(); itr != slot.end();)
+				{
+					if (itr->Tick <= nowTick)
+					{
+						expiredTimers.push_back(std::move(*itr));
+						itr = slot.erase(itr);
+					}
+					else
+					{
+						itr++; // Due on a later turn
+					}
+				}
+			}
+
+			this->CurrentTick = nowTick;
+			this->NumberOfTimers -= expiredTimers.size();
+		}
+
+		// Callbacks can schedule more, so they run without the lock
+		std::stable_sort(expiredTimers.begin(), expiredTimers.end(), [](const TIMER &a, const TIMER &b) { return a.Tick < b.Tick; });
+		for (auto &timer : expiredTimers)
+		{
+			timer.Callback();
+		}
+		return expiredTimers.size();
+	}
+
+	std::chrono::steady_clock::time_point TimerWheel::getNextDeadline()
+	{
+		std::unique_lock<std::mutex> lock(this->WheelMutex);
+		if (this->NumberOfTimers == 0)
+		{
+			return std::chrono::steady_clock::time_point::max();
+		}
+
+		// The first slot with a timer for this turn has the earliest one. Otherwise they are all on later turns.
+		UINT_64 earliestTick = UINT64_MAX;
+		for (UINT_64 tick = this->CurrentTick + 1; tick <= this->CurrentTick + this->Slots.size(); tick++)
+		{
+			for (auto &timer : this->Slots[(size_t)(tick % this->Slots.size())])
+			{
+				if (timer.Tick == tick)
+				{
+					return this->Start + this->TickDuration * tick;
+				}
+				earliestTick = (std::min)(earliestTick, timer.Tick);
+			}
+		}
+
+		return this->Start + this->TickDuration * earliestTick;
+	}
+
+	void TimerWheel::clear()
+	{
+		std::unique_lock<std::mutex> lock(this->WheelMutex);
+		for (auto &slot : this->Slots)
+		{
+			slot.clear();
+		}
+		this->NumberOfTimers = 0;
+	}
+
+	size_t TimerWheel::size()
+	{
+		std::unique_lock<std::mutex> lock(this->WheelMutex);
+		return this->NumberOfTimers;
+	}
+
+	UINT_64 TimerWheel::getTick(std::chrono::steady_clock::time_point time) const
+	{
+		if (time <= this->Start)
+		{
+			return 0;
+		}
+
+		std::chrono::nanoseconds sinceStart = std::chrono::duration_cast<std::chrono::nanoseconds>(time - this->Start);
+		return (UINT_64)((sinceStart.count() + this->TickDuration.count() - 1) / this->TickDuration.count());
+	}
+}
@@ -0,0 +1,127 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+TimerWheel.h - A header file for a hashed timer wheel
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	/// <summary>
+	/// Runs callbacks once their deadline has passed. Deadlines are hashed into slots of one tick each,
+	///   so scheduling is O(1) and each advance() only looks at the slots for the ticks that went by.
+	/// Deadlines more than a full turn of the wheel away wait in their slot until the turn they are due.
+	/// Nothing runs on its own: whoever owns the wheel calls advance().
+	/// </summary>
+	class TimerWheel
+	{
+	public:
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="tickDuration">Time covered by each slot. Callbacks run up to a tick after their deadline.</param>
+		/// <param name="numberOfSlots">Number of slots in a full turn of the wheel</param>
+		TimerWheel(std::chrono::nanoseconds tickDuration, size_t numberOfSlots);
+
+		/// <summary>
+		/// Schedules a callback. It runs in the first advance() at or after the deadline, never inside schedule().
+		/// Can be called from any thread.
+		/// </summary>
+		/// <param name="deadline">Time to run the callback at</param>
+		/// <param name="callback">What to run</param>
+		void schedule(std::chrono::steady_clock::time_point deadline, std::function<void()> callback);
+
+		/// <summary>
+		/// Runs every callback whose deadline has passed, in deadline order (by tick)
+		/// </summary>
+		/// <param name="now">The current time</param>
+		/// <returns>Number of callbacks run</returns>
+		size_t advance(std::chrono::steady_clock::time_point now);
+
+		/// <summary>
+		/// Gets the time the next callback will be due, so the owner knows when to call advance() next
+		/// </summary>
+		/// <returns>Start of the earliest scheduled tick. time_point::max() if nothing is scheduled.</returns>
+		std::chrono::steady_clock::time_point getNextDeadline();
+
+		/// <summary>
+		/// Throws away every scheduled callback without running it
+		/// </summary>
+		void clear();
+
+		/// <summary>
+		/// Gets the number of callbacks that haven't run yet
+		/// </summary>
+		/// <returns>Number of scheduled callbacks</returns>
+		size_t size();
+
+	private:
+		/// <summary>
+		/// A scheduled callback
+		/// </summary>
+		typedef struct TIMER
+		{
+			UINT_64 Tick; // Tick (since Start) the deadline falls in
+			std::function<void()> Callback;
+		} TIMER, *PTIMER;
+
+		/// <summary>
+		/// Gets the tick (since Start) a time falls in, rounded up so nothing runs early
+		/// </summary>
+		/// <param name="time">The time</param>
+		/// <returns>Tick</returns>
+		UINT_64 getTick(std::chrono::steady_clock::time_point time) const;
+
+		/// <summary>
+		/// Time tick 0 starts at
+		/// </summary>
+		std::chrono::steady_clock::time_point Start;
+
+		/// <summary>
+		/// Time covered by each slot
+		/// </summary>
+		std::chrono::nanoseconds TickDuration;
+
+		/// <summary>
+		/// Timers, hashed by tick
+		/// </summary>
+		std::vector<std::list<TIMER>> Slots;
+
+		/// <summary>
+		/// Last tick advance() went through. Everything at or before it has run.
+		/// </summary>
+		UINT_64 CurrentTick;
+
+		/// <summary>
+		/// Number of timers in Slots
+		/// </summary>
+		size_t NumberOfTimers;
+
+		/// <summary>
+		/// Guards everything above
+		/// </summary>
+		std::mutex WheelMutex;
+	};
+}
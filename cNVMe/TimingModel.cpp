@@ -0,0 +1,128 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+TimingModel.cpp - An implementation file for modeling how long the device takes to complete commands
+*/
+
+#include "Constants.h"
+#include "TimingModel.h"
+
+namespace cnvme
+{
+	namespace controller
+	{
+		TimingModel::~TimingModel()
+		{
+		}
+
+		LatencyModel::LatencyModel(const LATENCY_MODEL_PARAMETERS &parameters)
+		{
+			ASSERT_IF(!isValid(parameters), "The latency model was given settings it can't model");
+
+			this->Parameters = parameters;
+			this->NextBackgroundDie = 0;
+			this->DieBusyUntil.resize((size_t)parameters.NumberOfChannels * parameters.DiesPerChannel);
+			this->ChannelBusyUntil.resize(parameters.NumberOfChannels);
+		}
+
+		LATENCY_MODEL_PARAMETERS LatencyModel::getDefaultParameters()
+		{
+			LATENCY_MODEL_PARAMETERS parameters;
+			memset(&parameters, 0, sizeof(parameters));
+
+			for (size_t i = 0; i < sizeof(parameters.AdminLatency) / sizeof(parameters.AdminLatency[0]); i++)
+			{
+				parameters.AdminLatency[i] = 20000;
+			}
+
+			for (size_t i = 0; i < sizeof(parameters.NvmLatency) / sizeof(parameters.NvmLatency[0]); i++)
+			{
+				parameters.NvmLatency[i] = 10000;
+			}
+
+			// Page read and program times
+			parameters.NvmLatency[constants::opcodes::nvm::READ] = 60000;
+			parameters.NvmLatency[constants::opcodes::nvm::COMPARE] = 60000;
+			parameters.NvmLatency[constants::opcodes::nvm::WRITE] = 500000;
+			parameters.NvmLatency[constants::opcodes::nvm::ZONE_APPEND] = 500000;
+			parameters.NvmLatency[constants::opcodes::nvm::FLUSH] = 1000000;
+
+			parameters.ControllerOverhead = 2000;
+			parameters.NumberOfChannels = 8;
+			parameters.DiesPerChannel = 4;
+			parameters.StripeSize = 16 * 1024;
+			parameters.ChannelBandwidth = 800ULL * 1000 * 1000;
+			parameters.EraseLatency = 3000000;
+			return parameters;
+		}
+
+		bool LatencyModel::isValid(const LATENCY_MODEL_PARAMETERS &parameters)
+		{
+			return parameters.NumberOfChannels != 0 && parameters.DiesPerChannel != 0 && parameters.StripeSize != 0 && parameters.ChannelBandwidth != 0;
+		}
+
+		std::chrono::steady_clock::time_point LatencyModel::getCompletionTime(const TIMED_COMMAND &command, std::chrono::steady_clock::time_point now)
+		{
+			std::unique_lock<std::mutex> lock(this->ModelMutex);
+
+			this->ControllerBusyUntil = (std::max)(this->ControllerBusyUntil, now) + std::chrono::nanoseconds(this->Parameters.ControllerOverhead);
+			std::chrono::steady_clock::time_point completionTime = this->ControllerBusyUntil;
+
+			// Garbage collection keeps dies busy without this command waiting for it directly
+			std::chrono::nanoseconds relocationLatency((UINT_64)this->Parameters.NvmLatency[constants::opcodes::nvm::READ] + this->Parameters.NvmLatency[constants::opcodes::nvm::WRITE]);
+			UINT_64 relocatedStripes = (command.RelocatedBytes + this->Parameters.StripeSize - 1) / this->Parameters.StripeSize;
+			for (UINT_64 i = 0; i < relocatedStripes + command.ErasedBlocks; i++)
+			{
+				size_t die = this->NextBackgroundDie;
+				this->NextBackgroundDie = (this->NextBackgroundDie + 1) % this->DieBusyUntil.size();
+				this->DieBusyUntil[die] = (std::max)(this->DieBusyUntil[die], now) + (i < relocatedStripes ? relocationLatency : std::chrono::nanoseconds(this->Parameters.EraseLatency));
+			}
+
+			std::chrono::nanoseconds baseLatency(command.Admin ? this->Parameters.AdminLatency[command.Opcode] : this->Parameters.NvmLatency[command.Opcode]);
+			if (command.ByteCount == 0)
+			{
+				// Nothing on the media to wait for
+				return completionTime + baseLatency;
+			}
+
+			// Each stripe goes to its own die. Stripes on different dies overlap, ones on the same die or channel wait their turn.
+			UINT_64 endByte = command.ByteOffset + command.ByteCount;
+			for (UINT_64 stripeStart = command.ByteOffset; stripeStart < endByte; stripeStart = (stripeStart / this->Parameters.StripeSize + 1) * this->Parameters.StripeSize)
+			{
+				UINT_64 stripeBytes = (std::min)(endByte, (stripeStart / this->Parameters.StripeSize + 1) * this->Parameters.StripeSize) - stripeStart;
+				size_t die = (size_t)((stripeStart / this->Parameters.StripeSize) % this->DieBusyUntil.size());
+				size_t channel = die % this->ChannelBusyUntil.size();
+
+				std::chrono::steady_clock::time_point mediaDone = (std::max)(this->DieBusyUntil[die], this->ControllerBusyUntil) + baseLatency;
+				std::chrono::nanoseconds transferTime(stripeBytes * 1000000000ULL / this->Parameters.ChannelBandwidth);
+				std::chrono::steady_clock::time_point transferDone = (std::max)(mediaDone, this->ChannelBusyUntil[channel]) + transferTime;
+
+				// The die holds its data until the channel has moved it
+				this->DieBusyUntil[die] = transferDone;
+				this->ChannelBusyUntil[channel] = transferDone;
+				completionTime = (std::max)(completionTime, transferDone);
+			}
+
+			return completionTime;
+		}
+	}
+}
@@ -0,0 +1,155 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+TimingModel.h - A header file for modeling how long the device takes to complete commands
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	namespace controller
+	{
+		/// <summary>
+		/// What a timing model gets to know about a command
+		/// </summary>
+		typedef struct TIMED_COMMAND
+		{
+			bool Admin;
+			UINT_8 Opcode;
+			UINT_64 ByteOffset; // Where in the namespace the data is. Only meaningful if ByteCount isn't 0.
+			UINT_64 ByteCount; // Bytes of namespace data the command touches on the media. 0 for commands without any.
+			UINT_64 RelocatedBytes; // Bytes garbage collection moved on the media since the namespace's last timed command, including for this command's writes. The command doesn't wait for them, but its dies might.
+			UINT_64 ErasedBlocks; // Blocks garbage collection erased since the namespace's last timed command
+		} TIMED_COMMAND, *PTIMED_COMMAND;
+
+		/// <summary>
+		/// Settings for the LatencyModel. Every time is in nanoseconds.
+		/// </summary>
+		typedef struct LATENCY_MODEL_PARAMETERS
+		{
+			UINT_32 AdminLatency[256]; // Base latency of each admin opcode
+			UINT_32 NvmLatency[256]; // Base latency of each NVM opcode. For commands with data this is the media (die) time for each stripe.
+			UINT_32 ControllerOverhead; // Time the controller spends on every command, one command at a time
+			UINT_32 NumberOfChannels;
+			UINT_32 DiesPerChannel;
+			UINT_32 StripeSize; // Bytes of namespace data on one die before moving to the next
+			UINT_64 ChannelBandwidth; // Bytes per second each channel moves between its dies and the controller
+			UINT_32 EraseLatency; // Time a die spends erasing a block for garbage collection
+		} LATENCY_MODEL_PARAMETERS, *PLATENCY_MODEL_PARAMETERS;
+
+		/// <summary>
+		/// Decides when the completion of each command may be posted
+		/// </summary>
+		class TimingModel
+		{
+		public:
+			/// <summary>
+			/// Destructor
+			/// </summary>
+			virtual ~TimingModel();
+
+			/// <summary>
+			/// Gets the time the device would finish a command. Called once per command, after its writes reach the media.
+			/// Commands on asynchronous media call it from an I/O worker, so it has to be thread safe and can see commands out of fetch order.
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="now">Time the controller fetched it</param>
+			/// <returns>Time its completion may be posted</returns>
+			virtual std::chrono::steady_clock::time_point getCompletionTime(const TIMED_COMMAND &command, std::chrono::steady_clock::time_point now) = 0;
+		};
+
+		/// <summary>
+		/// Models a drive as a controller in front of channels of dies:
+		///   each command takes the controller's overhead, one at a time,
+		///   then every stripe it touches takes its opcode's base latency on that stripe's die,
+		///   then its bytes move over the die's channel at the channel's bandwidth.
+		/// Garbage collection work that comes with a command is spread over the dies first, each relocated stripe taking a read and a write
+		///   (copied within the die, so no channel time) and each erase taking EraseLatency.
+		/// A busy controller, die or channel makes later work wait for it, which is how queue depth shows up:
+		///   latency stays flat until the dies and channels are all busy, then grows with queue depth while bandwidth levels off.
+		/// </summary>
+		class LatencyModel : public TimingModel
+		{
+		public:
+			/// <summary>
+			/// Constructor
+			/// </summary>
+			/// <param name="parameters">Settings for the model</param>
+			LatencyModel(const LATENCY_MODEL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Gets the default settings: a small TLC drive
+			/// </summary>
+			/// <returns>LATENCY_MODEL_PARAMETERS</returns>
+			static LATENCY_MODEL_PARAMETERS getDefaultParameters();
+
+			/// <summary>
+			/// Checks that settings can be modeled
+			/// </summary>
+			/// <param name="parameters">Settings to check</param>
+			/// <returns>true if they are usable</returns>
+			static bool isValid(const LATENCY_MODEL_PARAMETERS &parameters);
+
+			/// <summary>
+			/// Gets the time the device would finish a command
+			/// </summary>
+			/// <param name="command">The command</param>
+			/// <param name="now">Time the controller fetched it</param>
+			/// <returns>Time its completion may be posted</returns>
+			std::chrono::steady_clock::time_point getCompletionTime(const TIMED_COMMAND &command, std::chrono::steady_clock::time_point now) override;
+
+		private:
+			/// <summary>
+			/// Settings for the model
+			/// </summary>
+			LATENCY_MODEL_PARAMETERS Parameters;
+
+			/// <summary>
+			/// Die the next piece of garbage collection work goes to. Work goes round the dies so it is spread evenly.
+			/// </summary>
+			size_t NextBackgroundDie;
+
+			/// <summary>
+			/// Time the controller is done with the commands it has so far
+			/// </summary>
+			std::chrono::steady_clock::time_point ControllerBusyUntil;
+
+			/// <summary>
+			/// Time each die is done with the work it has so far. Dies are numbered across channels: die i is on channel i % NumberOfChannels.
+			/// </summary>
+			std::vector<std::chrono::steady_clock::time_point> DieBusyUntil;
+
+			/// <summary>
+			/// Time each channel is done with the transfers it has so far
+			/// </summary>
+			std::vector<std::chrono::steady_clock::time_point> ChannelBusyUntil;
+
+			/// <summary>
+			/// Guards everything above
+			/// </summary>
+			std::mutex ModelMutex;
+		};
+	}
+}
@@ -0,0 +1,77 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+TokenBucket.cpp - An implementation file for a token bucket rate limiter
+*/
+
+#include "TokenBucket.h"
+
+namespace cnvme
+{
+	TokenBucket::TokenBucket() : TokenBucket(0, 0)
+	{
+	}
+
+	TokenBucket::TokenBucket(UINT_64 tokensPerSecond, UINT_64 burstSize)
+	{
+		this->TokensPerSecond = tokensPerSecond;
+		this->BurstSize = (double)burstSize;
+		this->Tokens = this->BurstSize;
+		this->LastRefill = std::chrono::steady_clock::now();
+	}
+
+	bool TokenBucket::hasTokens(std::chrono::steady_clock::time_point now)
+	{
+		if (this->TokensPerSecond == 0)
+		{
+			return true;
+		}
+
+		this->refill(now);
+		return this->Tokens > 0;
+	}
+
+	void TokenBucket::consume(UINT_64 tokens)
+	{
+		if (this->TokensPerSecond != 0)
+		{
+			this->Tokens -= (double)tokens;
+		}
+	}
+
+	UINT_64 TokenBucket::getTokensPerSecond() const
+	{
+		return this->TokensPerSecond;
+	}
+
+	void TokenBucket::refill(std::chrono::steady_clock::time_point now)
+	{
+		if (now <= this->LastRefill)
+		{
+			return;
+		}
+
+		double seconds = std::chrono::duration<double>(now - this->LastRefill).count();
+		this->Tokens = (std::min)(this->BurstSize, this->Tokens + seconds * this->TokensPerSecond);
+		this->LastRefill = now;
+	}
+}
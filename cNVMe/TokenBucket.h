@@ -0,0 +1,99 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+TokenBucket.h - A header file for a token bucket rate limiter
+*/
+
+#pragma once
+
+#include "Types.h"
+
+namespace cnvme
+{
+	/// <summary>
+	/// Limits a rate (of commands, bytes, ...) to tokensPerSecond, with bursts of up to burstSize.
+	/// The bucket may go into debt: anything is let through while there are tokens left, and what it costs
+	///   is paid back before anything else gets through. That way something bigger than a burst still goes.
+	/// Not thread safe. The owner serializes access.
+	/// </summary>
+	class TokenBucket
+	{
+	public:
+		/// <summary>
+		/// Constructor for a bucket that never runs out
+		/// </summary>
+		TokenBucket();
+
+		/// <summary>
+		/// Constructor. The bucket starts full.
+		/// </summary>
+		/// <param name="tokensPerSecond">Rate tokens come back at. 0 means the bucket never runs out.</param>
+		/// <param name="burstSize">Most tokens the bucket can hold</param>
+		TokenBucket(UINT_64 tokensPerSecond, UINT_64 burstSize);
+
+		/// <summary>
+		/// Checks if anything can get through right now
+		/// </summary>
+		/// <param name="now">The current time</param>
+		/// <returns>True if there are tokens left</returns>
+		bool hasTokens(std::chrono::steady_clock::time_point now);
+
+		/// <summary>
+		/// Takes tokens out of the bucket, going into debt if there aren't enough
+		/// </summary>
+		/// <param name="tokens">Number of tokens to take</param>
+		void consume(UINT_64 tokens);
+
+		/// <summary>
+		/// Gets the rate tokens come back at
+		/// </summary>
+		/// <returns>Tokens per second. 0 means the bucket never runs out.</returns>
+		UINT_64 getTokensPerSecond() const;
+
+	private:
+		/// <summary>
+		/// Puts back the tokens earned since the last refill
+		/// </summary>
+		/// <param name="now">The current time</param>
+		void refill(std::chrono::steady_clock::time_point now);
+
+		/// <summary>
+		/// Rate tokens come back at. 0 means the bucket never runs out.
+		/// </summary>
+		UINT_64 TokensPerSecond;
+
+		/// <summary>
+		/// Most tokens the bucket can hold
+		/// </summary>
+		double BurstSize;
+
+		/// <summary>
+		/// Tokens in the bucket. Negative while in debt.
+		/// </summary>
+		double Tokens;
+
+		/// <summary>
+		/// Time of the last refill
+		/// </summary>
+		std::chrono::steady_clock::time_point LastRefill;
+	};
+}
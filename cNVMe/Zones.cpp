@@ -0,0 +1,445 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Zones.cpp - An implementation file for the zones of a zoned namespace
+*/
+
+#include "Constants.h"
+#include "Zones.h"
+
+using namespace cnvme::constants::commands::zones;
+
+namespace cnvme
+{
+	namespace ns
+	{
+		/// <summary>
+		/// Makes a completion queue entry for a command specific zone error
+		/// </summary>
+		/// <param name="statusCode">constants::status::codes::specific value</param>
+		/// <returns>Completion queue entry</returns>
+		static command::COMPLETION_QUEUE_ENTRY zoneError(UINT_8 statusCode)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+			completionQueueEntry.DNR = true;
+			completionQueueEntry.SCT = constants::status::types::COMMAND_SPECIFIC;
+			completionQueueEntry.SC = statusCode;
+			return completionQueueEntry;
+		}
+
+		/// <summary>
+		/// Makes a completion queue entry for a generic error
+		/// </summary>
+		/// <param name="statusCode">constants::status::codes::generic value</param>
+		/// <returns>Completion queue entry</returns>
+		static command::COMPLETION_QUEUE_ENTRY genericError(UINT_8 statusCode)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+			completionQueueEntry.DNR = true;
+			completionQueueEntry.SCT = constants::status::types::GENERIC_COMMAND;
+			completionQueueEntry.SC = statusCode;
+			return completionQueueEntry;
+		}
+
+		/// <summary>
+		/// Gets the error for writing to a zone in the given state, if it can't be written
+		/// </summary>
+		/// <param name="state">constants::commands::zones::zs value</param>
+		/// <param name="completionQueueEntry">Filled in with the error</param>
+		/// <returns>true if the zone can't be written</returns>
+		static bool getUnwritableZoneError(UINT_8 state, command::COMPLETION_QUEUE_ENTRY &completionQueueEntry)
+		{
+			if (state == zs::FULL)
+			{
+				completionQueueEntry = zoneError(constants::status::codes::specific::ZONE_IS_FULL);
+			}
+			else if (state == zs::READ_ONLY)
+			{
+				completionQueueEntry = zoneError(constants::status::codes::specific::ZONE_IS_READ_ONLY);
+			}
+			else if (state == zs::OFFLINE)
+			{
+				completionQueueEntry = zoneError(constants::status::codes::specific::ZONE_IS_OFFLINE);
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		}
+
+		Zones::Zones(UINT_64 numberOfZones, UINT_64 zoneSize)
+		{
+			ASSERT_IF(zoneSize == 0, "Zones need at least one LBA");
+			this->ZoneSize = zoneSize;
+
+			ZONE emptyZone = { 0, zs::EMPTY, 0 };
+			this->ZoneList.resize((size_t)numberOfZones, emptyZone);
+			for (size_t i = 0; i < this->ZoneList.size(); i++)
+			{
+				this->ZoneList[i].WritePointer = i * zoneSize;
+			}
+		}
+
+		UINT_64 Zones::getZoneSize() const
+		{
+			return this->ZoneSize;
+		}
+
+		UINT_64 Zones::getNumberOfZones() const
+		{
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+			return this->ZoneList.size();
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Zones::reserveWrite(UINT_64 firstLba, UINT_64 numberOfLbas, ZONE_WRITE_RESERVATION &reservation)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			UINT_64 zoneIndex = firstLba / this->ZoneSize;
+			if (zoneIndex >= this->ZoneList.size())
+			{
+				return genericError(constants::status::codes::generic::LBA_OUT_OF_RANGE);
+			}
+
+			ZONE &zone = this->ZoneList[(size_t)zoneIndex];
+			if (getUnwritableZoneError(zone.State, completionQueueEntry))
+			{
+				return completionQueueEntry;
+			}
+
+			if (numberOfLbas > (zoneIndex + 1) * this->ZoneSize - firstLba)
+			{
+				return zoneError(constants::status::codes::specific::ZONE_BOUNDARY_ERROR);
+			}
+
+			if (firstLba != zone.WritePointer)
+			{
+				return zoneError(constants::status::codes::specific::ZONE_INVALID_WRITE);
+			}
+
+			this->advanceWritePointer(zoneIndex, numberOfLbas, reservation);
+			return completionQueueEntry;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Zones::reserveAppend(UINT_64 zoneStartLba, UINT_64 numberOfLbas, ZONE_WRITE_RESERVATION &reservation)
+		{
+			command::COMPLETION_QUEUE_ENTRY completionQueueEntry = { 0 };
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			UINT_64 zoneIndex = zoneStartLba / this->ZoneSize;
+			if (zoneIndex >= this->ZoneList.size())
+			{
+				return genericError(constants::status::codes::generic::LBA_OUT_OF_RANGE);
+			}
+
+			if (zoneStartLba % this->ZoneSize != 0)
+			{
+				return genericError(constants::status::codes::generic::INVALID_FIELD_IN_COMMAND);
+			}
+
+			ZONE &zone = this->ZoneList[(size_t)zoneIndex];
+			if (getUnwritableZoneError(zone.State, completionQueueEntry))
+			{
+				return completionQueueEntry;
+			}
+
+			// Appends that don't fit in what is left of the zone aren't split
+			if (numberOfLbas > zoneStartLba + this->ZoneSize - zone.WritePointer)
+			{
+				return zoneError(constants::status::codes::specific::ZONE_BOUNDARY_ERROR);
+			}
+
+			this->advanceWritePointer(zoneIndex, numberOfLbas, reservation);
+			return completionQueueEntry;
+		}
+
+		bool Zones::releaseWrite(const ZONE_WRITE_RESERVATION &reservation)
+		{
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			UINT_64 zoneIndex = reservation.FirstLba / this->ZoneSize;
+			if (reservation.NumberOfLbas == 0 || zoneIndex >= this->ZoneList.size())
+			{
+				return false;
+			}
+
+			// Anything else has moved the write pointer since, so the LBAs aren't ours to give back.
+			//  A reset followed by a write of the same size leaves it in the same place, so check the generation too.
+			ZONE &zone = this->ZoneList[(size_t)zoneIndex];
+			if (zone.Generation != reservation.Generation || zone.WritePointer != reservation.FirstLba + reservation.NumberOfLbas)
+			{
+				return false;
+			}
+
+			zone.WritePointer = reservation.FirstLba;
+			if (zone.State == reservation.ReservedState)
+			{
+				zone.State = reservation.PreviousState;
+			}
+			return true;
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Zones::manage(UINT_64 zoneStartLba, UINT_8 action, bool selectAll, std::vector<UINT_64> &resetZoneStartLbas)
+		{
+			resetZoneStartLbas.clear();
+			if (action != zsa::CLOSE_ZONE && action != zsa::FINISH_ZONE && action != zsa::OPEN_ZONE && action != zsa::RESET_ZONE && action != zsa::OFFLINE_ZONE)
+			{
+				// We don't have zone descriptor extensions to set
+				return genericError(constants::status::codes::generic::INVALID_FIELD_IN_COMMAND);
+			}
+
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			if (selectAll)
+			{
+				// Zones in states the action doesn't apply to are left alone, without an error
+				for (UINT_64 zoneIndex = 0; zoneIndex < this->ZoneList.size(); zoneIndex++)
+				{
+					UINT_8 state = this->ZoneList[(size_t)zoneIndex].State;
+					bool isOpen = state == zs::IMPLICITLY_OPENED || state == zs::EXPLICITLY_OPENED;
+					bool applies = (action == zsa::CLOSE_ZONE && isOpen) ||
+						(action == zsa::FINISH_ZONE && (isOpen || state == zs::CLOSED)) ||
+						(action == zsa::OPEN_ZONE && state == zs::CLOSED) ||
+						(action == zsa::RESET_ZONE && (isOpen || state == zs::CLOSED || state == zs::FULL)) ||
+						(action == zsa::OFFLINE_ZONE && state == zs::READ_ONLY);
+
+					if (applies && this->manageZone(zoneIndex, action) && action == zsa::RESET_ZONE)
+					{
+						resetZoneStartLbas.push_back(zoneIndex * this->ZoneSize);
+					}
+				}
+				return command::COMPLETION_QUEUE_ENTRY{ 0 };
+			}
+
+			UINT_64 zoneIndex = zoneStartLba / this->ZoneSize;
+			if (zoneIndex >= this->ZoneList.size())
+			{
+				return genericError(constants::status::codes::generic::LBA_OUT_OF_RANGE);
+			}
+
+			if (zoneStartLba % this->ZoneSize != 0)
+			{
+				return genericError(constants::status::codes::generic::INVALID_FIELD_IN_COMMAND);
+			}
+
+			bool wasEmpty = this->ZoneList[(size_t)zoneIndex].State == zs::EMPTY;
+			if (!this->manageZone(zoneIndex, action))
+			{
+				return zoneError(constants::status::codes::specific::INVALID_ZONE_STATE_TRANSITION);
+			}
+
+			if (action == zsa::RESET_ZONE && !wasEmpty)
+			{
+				resetZoneStartLbas.push_back(zoneStartLba);
+			}
+			return command::COMPLETION_QUEUE_ENTRY{ 0 };
+		}
+
+		command::COMPLETION_QUEUE_ENTRY Zones::report(UINT_64 firstLba, UINT_8 stateFilter, bool partial, Payload &report) const
+		{
+			const UINT_8 stateForFilter[] = { 0, zs::EMPTY, zs::IMPLICITLY_OPENED, zs::EXPLICITLY_OPENED, zs::CLOSED, zs::FULL, zs::READ_ONLY, zs::OFFLINE };
+			if (stateFilter >= sizeof(stateForFilter))
+			{
+				return genericError(constants::status::codes::generic::INVALID_FIELD_IN_COMMAND);
+			}
+
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			UINT_64 zoneIndex = firstLba / this->ZoneSize;
+			if (zoneIndex >= this->ZoneList.size())
+			{
+				return genericError(constants::status::codes::generic::LBA_OUT_OF_RANGE);
+			}
+
+			report.clear();
+			size_t descriptorsThatFit = report.getSize() > sizeof(command::ZONE_REPORT_HEADER) ? (report.getSize() - sizeof(command::ZONE_REPORT_HEADER)) / sizeof(command::ZONE_DESCRIPTOR) : 0;
+			auto pDescriptors = (command::ZONE_DESCRIPTOR*)(report.getBuffer() + sizeof(command::ZONE_REPORT_HEADER));
+
+			command::ZONE_REPORT_HEADER header = { 0 };
+			for (; zoneIndex < this->ZoneList.size(); zoneIndex++)
+			{
+				if (stateFilter != zrasf::ALL_ZONES && this->ZoneList[(size_t)zoneIndex].State != stateForFilter[stateFilter])
+				{
+					continue;
+				}
+
+				if (header.NumberOfZones < descriptorsThatFit)
+				{
+					pDescriptors[header.NumberOfZones] = this->getDescriptor(zoneIndex);
+				}
+				else if (partial)
+				{
+					break; // Only count what made it in
+				}
+				header.NumberOfZones++;
+			}
+
+			// The host can ask for less than the whole header
+			memcpy_s(report.getBuffer(), report.getSize(), &header, (std::min)(report.getSize(), sizeof(header)));
+			return command::COMPLETION_QUEUE_ENTRY{ 0 };
+		}
+
+		std::vector<command::ZONE_DESCRIPTOR> Zones::getDescriptors() const
+		{
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			std::vector<command::ZONE_DESCRIPTOR> descriptors;
+			descriptors.reserve(this->ZoneList.size());
+			for (UINT_64 zoneIndex = 0; zoneIndex < this->ZoneList.size(); zoneIndex++)
+			{
+				descriptors.push_back(this->getDescriptor(zoneIndex));
+			}
+			return descriptors;
+		}
+
+		bool Zones::setDescriptors(const std::vector<command::ZONE_DESCRIPTOR> &descriptors)
+		{
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+
+			if (descriptors.size() != this->ZoneList.size())
+			{
+				LOG_ERROR("Got " + std::to_string(descriptors.size()) + " zone descriptors for " + std::to_string(this->ZoneList.size()) + " zones");
+				return false;
+			}
+
+			for (size_t i = 0; i < descriptors.size(); i++)
+			{
+				UINT_64 zoneStartLba = i * this->ZoneSize;
+				if (descriptors[i].ZSLBA != zoneStartLba || descriptors[i].WP < zoneStartLba || descriptors[i].WP > zoneStartLba + this->ZoneSize)
+				{
+					LOG_ERROR("Zone descriptor " + std::to_string(i) + " doesn't fit a zone of " + std::to_string(this->ZoneSize) + " LBAs");
+					return false;
+				}
+			}
+
+			for (size_t i = 0; i < descriptors.size(); i++)
+			{
+				this->ZoneList[i].WritePointer = descriptors[i].WP;
+				this->ZoneList[i].State = descriptors[i].ZS;
+				this->ZoneList[i].Generation++;
+			}
+			return true;
+		}
+
+		std::shared_ptr<Zones> Zones::clone() const
+		{
+			std::shared_ptr<Zones> zones = std::make_shared<Zones>(0, this->ZoneSize);
+
+			std::unique_lock<std::mutex> lock(this->ZoneMutex);
+			zones->ZoneList = this->ZoneList;
+			return zones;
+		}
+
+		command::ZONE_DESCRIPTOR Zones::getDescriptor(UINT_64 zoneIndex) const
+		{
+			command::ZONE_DESCRIPTOR descriptor = { 0 };
+			descriptor.ZT = zt::SEQUENTIAL_WRITE_REQUIRED;
+			descriptor.ZS = this->ZoneList[(size_t)zoneIndex].State;
+			descriptor.ZCAP = this->ZoneSize; // Every LBA in a zone is writable
+			descriptor.ZSLBA = zoneIndex * this->ZoneSize;
+			descriptor.WP = this->ZoneList[(size_t)zoneIndex].WritePointer;
+			return descriptor;
+		}
+
+		void Zones::advanceWritePointer(UINT_64 zoneIndex, UINT_64 numberOfLbas, ZONE_WRITE_RESERVATION &reservation)
+		{
+			ZONE &zone = this->ZoneList[(size_t)zoneIndex];
+			reservation.FirstLba = zone.WritePointer;
+			reservation.NumberOfLbas = numberOfLbas;
+			reservation.PreviousState = zone.State;
+			reservation.Generation = zone.Generation;
+			zone.WritePointer += numberOfLbas;
+
+			if (zone.WritePointer == (zoneIndex + 1) * this->ZoneSize)
+			{
+				zone.State = zs::FULL;
+			}
+			else if (zone.State == zs::EMPTY || zone.State == zs::CLOSED)
+			{
+				zone.State = zs::IMPLICITLY_OPENED;
+			}
+			reservation.ReservedState = zone.State;
+		}
+
+		bool Zones::manageZone(UINT_64 zoneIndex, UINT_8 action)
+		{
+			ZONE &zone = this->ZoneList[(size_t)zoneIndex];
+			UINT_64 zoneStartLba = zoneIndex * this->ZoneSize;
+			bool isOpen = zone.State == zs::IMPLICITLY_OPENED || zone.State == zs::EXPLICITLY_OPENED;
+
+			if (action == zsa::CLOSE_ZONE)
+			{
+				if (isOpen)
+				{
+					zone.State = zone.WritePointer == zoneStartLba ? zs::EMPTY : zs::CLOSED; // Nothing written, so nothing to keep active
+					return true;
+				}
+				return zone.State == zs::CLOSED;
+			}
+			else if (action == zsa::FINISH_ZONE)
+			{
+				if (isOpen || zone.State == zs::CLOSED || zone.State == zs::EMPTY)
+				{
+					zone.State = zs::FULL;
+					zone.WritePointer = zoneStartLba + this->ZoneSize; // What wasn't written reads as zeros
+					zone.Generation++;
+					return true;
+				}
+				return zone.State == zs::FULL;
+			}
+			else if (action == zsa::OPEN_ZONE)
+			{
+				if (isOpen || zone.State == zs::CLOSED || zone.State == zs::EMPTY)
+				{
+					zone.State = zs::EXPLICITLY_OPENED;
+					return true;
+				}
+				return false;
+			}
+			else if (action == zsa::RESET_ZONE)
+			{
+				if (isOpen || zone.State == zs::CLOSED || zone.State == zs::FULL || zone.State == zs::EMPTY)
+				{
+					zone.State = zs::EMPTY;
+					zone.WritePointer = zoneStartLba;
+					zone.Generation++;
+					return true;
+				}
+				return false;
+			}
+			else if (action == zsa::OFFLINE_ZONE)
+			{
+				if (zone.State == zs::READ_ONLY || zone.State == zs::OFFLINE)
+				{
+					zone.State = zs::OFFLINE;
+					zone.Generation++;
+					return true;
+				}
+				return false;
+			}
+
+			return false;
+		}
+	}
+}
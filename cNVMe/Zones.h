@@ -0,0 +1,195 @@
+/*
+###########################################################################################
+// cNVMe - An Open Source NVMe Device Simulation - MIT License
+// Copyright 2017 - Intel Corporation
+
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+// PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+############################################################################################
+Zones.h - A header file for the zones of a zoned namespace
+*/
+
+#pragma once
+
+#include "Command.h"
+#include "Payload.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define DEFAULT_ZONE_SIZE (16ULL * 1024 * 1024) // Bytes. Zones hold this much data in every LBA format.
+
+namespace cnvme
+{
+	namespace ns
+	{
+		/// <summary>
+		/// What a write took up in its zone, so it can be given back if the write fails
+		/// </summary>
+		typedef struct ZONE_WRITE_RESERVATION
+		{
+			UINT_64 FirstLba;       // First LBA the write goes to
+			UINT_64 NumberOfLbas;   // Number of LBAs reserved (one based). 0 if nothing was.
+			UINT_8 PreviousState;   // State of the zone before the write (constants::commands::zones::zs value)
+			UINT_8 ReservedState;   // State the write left the zone in
+			UINT_64 Generation;     // Zone generation the write was reserved in
+		}ZONE_WRITE_RESERVATION, *PZONE_WRITE_RESERVATION;
+
+		/// <summary>
+		/// Keeps the state and write pointer of each zone in a zoned namespace, and moves them through the zone state machine.
+		/// Only the bookkeeping lives here. The data stays in the namespace's media.
+		/// </summary>
+		class Zones
+		{
+		public:
+			/// <summary>
+			/// Constructor. Every zone starts empty.
+			/// </summary>
+			/// <param name="numberOfZones">Number of zones</param>
+			/// <param name="zoneSize">Size of each zone in LBAs</param>
+			Zones(UINT_64 numberOfZones, UINT_64 zoneSize);
+
+			/// <summary>
+			/// Gets the size of each zone in LBAs
+			/// </summary>
+			/// <returns>Zone size</returns>
+			UINT_64 getZoneSize() const;
+
+			/// <summary>
+			/// Gets the number of zones
+			/// </summary>
+			/// <returns>Number of zones</returns>
+			UINT_64 getNumberOfZones() const;
+
+			/// <summary>
+			/// Checks a write against its zone and moves the write pointer past it.
+			/// An empty or closed zone is implicitly opened. A zone written to its end is full.
+			/// </summary>
+			/// <param name="firstLba">First LBA written. Has to be the zone's write pointer.</param>
+			/// <param name="numberOfLbas">Number of LBAs written (one based). Can't go past the end of the zone.</param>
+			/// <param name="reservation">Filled in with what the write took up, for releaseWrite()</param>
+			/// <returns>Completion queue entry with the error if the write isn't allowed</returns>
+			command::COMPLETION_QUEUE_ENTRY reserveWrite(UINT_64 firstLba, UINT_64 numberOfLbas, ZONE_WRITE_RESERVATION &reservation);
+
+			/// <summary>
+			/// Picks where a Zone Append lands (the zone's write pointer) and moves the write pointer past it
+			/// </summary>
+			/// <param name="zoneStartLba">First LBA of the zone</param>
+			/// <param name="numberOfLbas">Number of LBAs appended (one based)</param>
+			/// <param name="reservation">Filled in with what the append took up. FirstLba is where the data goes.</param>
+			/// <returns>Completion queue entry with the error if the append isn't allowed</returns>
+			command::COMPLETION_QUEUE_ENTRY reserveAppend(UINT_64 zoneStartLba, UINT_64 numberOfLbas, ZONE_WRITE_RESERVATION &reservation);
+
+			/// <summary>
+			/// Gives back what a failed write reserved. Only done if the zone hasn't been reset, finished or taken offline since,
+			///   and the write pointer is still at the end of the reservation, since a later write may have built on it.
+			/// </summary>
+			/// <param name="reservation">From reserveWrite() or reserveAppend()</param>
+			/// <returns>true if the write pointer was moved back</returns>
+			bool releaseWrite(const ZONE_WRITE_RESERVATION &reservation);
+
+			/// <summary>
+			/// Performs a Zone Management Send action on one zone, or on every zone it applies to
+			/// </summary>
+			/// <param name="zoneStartLba">First LBA of the zone. Ignored if selectAll is true.</param>
+			/// <param name="action">constants::commands::zones::zsa value</param>
+			/// <param name="selectAll">true to act on every zone in a state the action applies to</param>
+			/// <param name="resetZoneStartLbas">Filled in with the first LBA of each zone that was reset. Their data should be thrown away.</param>
+			/// <returns>Completion queue entry for the action</returns>
+			command::COMPLETION_QUEUE_ENTRY manage(UINT_64 zoneStartLba, UINT_8 action, bool selectAll, std::vector<UINT_64> &resetZoneStartLbas);
+
+			/// <summary>
+			/// Fills in a Zone Management Receive report: a header, then a descriptor for each zone that fits
+			/// </summary>
+			/// <param name="firstLba">Zones from the one this LBA is in onwards are reported</param>
+			/// <param name="stateFilter">constants::commands::zones::zrasf value</param>
+			/// <param name="partial">true if the header counts only the zones in the report, instead of every matching one</param>
+			/// <param name="report">Report to fill in. Its size is what the host asked for.</param>
+			/// <returns>Completion queue entry for the report</returns>
+			command::COMPLETION_QUEUE_ENTRY report(UINT_64 firstLba, UINT_8 stateFilter, bool partial, Payload &report) const;
+
+			/// <summary>
+			/// Gets a descriptor for every zone (to put in an image)
+			/// </summary>
+			/// <returns>Zone descriptors, in order</returns>
+			std::vector<command::ZONE_DESCRIPTOR> getDescriptors() const;
+
+			/// <summary>
+			/// Puts every zone in the state and at the write pointer given by descriptors from getDescriptors()
+			/// </summary>
+			/// <param name="descriptors">A descriptor for every zone, in order</param>
+			/// <returns>true on success. false (with nothing changed) if the descriptors don't fit these zones.</returns>
+			bool setDescriptors(const std::vector<command::ZONE_DESCRIPTOR> &descriptors);
+
+			/// <summary>
+			/// Copies the zones, so the copy can change without changing these
+			/// </summary>
+			/// <returns>Copy of the zones</returns>
+			std::shared_ptr<Zones> clone() const;
+
+		private:
+			/// <summary>
+			/// State of a single zone
+			/// </summary>
+			typedef struct ZONE
+			{
+				UINT_64 WritePointer;
+				UINT_8 State;       // constants::commands::zones::zs value
+				UINT_64 Generation; // Bumped each time the write pointer is moved other than by a write
+			}ZONE, *PZONE;
+
+			/// <summary>
+			/// Fills in the descriptor of a zone. Call with ZoneMutex held.
+			/// </summary>
+			/// <param name="zoneIndex">Index of the zone</param>
+			/// <returns>Zone descriptor</returns>
+			command::ZONE_DESCRIPTOR getDescriptor(UINT_64 zoneIndex) const;
+
+			/// <summary>
+			/// Moves a zone's write pointer forward, opening it implicitly or filling it up. Call with ZoneMutex held.
+			/// </summary>
+			/// <param name="zoneIndex">Index of the zone</param>
+			/// <param name="numberOfLbas">Number of LBAs written (one based)</param>
+			/// <param name="reservation">Filled in with what the write took up</param>
+			void advanceWritePointer(UINT_64 zoneIndex, UINT_64 numberOfLbas, ZONE_WRITE_RESERVATION &reservation);
+
+			/// <summary>
+			/// Performs a Zone Management Send action on a single zone. Call with ZoneMutex held.
+			/// </summary>
+			/// <param name="zoneIndex">Index of the zone</param>
+			/// <param name="action">constants::commands::zones::zsa value</param>
+			/// <returns>true if the zone was in a state the action applies to</returns>
+			bool manageZone(UINT_64 zoneIndex, UINT_8 action);
+
+			/// <summary>
+			/// Each zone, in LBA order
+			/// </summary>
+			std::vector<ZONE> ZoneList;
+
+			/// <summary>
+			/// Size of each zone in LBAs
+			/// </summary>
+			UINT_64 ZoneSize;
+
+			/// <summary>
+			/// Guards ZoneList
+			/// </summary>
+			mutable std::mutex ZoneMutex;
+		};
+	}
+}
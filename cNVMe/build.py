@@ -9,10 +9,11 @@ import subprocess
 VALID_BITNESS = 32, 64
 VALID_CONFIG_TYPE = 'Debug', 'Release'
 VALID_OUTPUT_TYPE = 'DLL', 'EXE'
+VALID_SANITIZER = None, 'thread', 'address'
 
 THIS_FOLDER = os.path.abspath(os.path.dirname(os.path.abspath(__file__)))
 
-def build(bitness, configType, outputType):
+def build(bitness, configType, outputType, sanitizer=None):
     '''
     Brief:
         Simple function to build cNVMe via g++/Linux
@@ -29,6 +30,12 @@ def build(bitness, configType, outputType):
     elif configType == 'Debug':
         gppArgs += '-g -O0 -D_DEBUG ' # define preprocessor directive
 
+    if sanitizer not in VALID_SANITIZER:
+        raise ValueError("Invalid sanitizer")
+    elif sanitizer:
+        # The host and controller threads share queue memory, so ThreadSanitizer is the one to run after touching Queue
+        gppArgs += '-fsanitize=%s -fno-omit-frame-pointer ' % sanitizer
+
     if outputType not in VALID_OUTPUT_TYPE:
         raise ValueError("Invalid output type.")
     elif outputType == 'DLL':
@@ -37,7 +44,7 @@ def build(bitness, configType, outputType):
     else:
         ext = 'out'
 
-    print ("About to build cNVMe as: %d-bit %s %s" % (bitness, configType, outputType))
+    print ("About to build cNVMe as: %d-bit %s %s%s" % (bitness, configType, outputType, (' (%s sanitizer)' % sanitizer) if sanitizer else ''))
 
     gppArgs += "-o cNVMe%d.%s" % (bitness, ext) 
 
@@ -57,6 +64,7 @@ if __name__ == '__main__':
     parser.add_argument("-bitness", "-b", help="Bitness to build cNVMe for (32 or 64)", type=int, default=64)
     parser.add_argument("-config_type", "-c", help="Config type to build (Release or Debug)", type=str, default="Debug")
     parser.add_argument("-output_type", "-o", help="Output binary type (EXE or DLL)", type=str, default='EXE')
+    parser.add_argument("-sanitizer", "-s", help="Sanitizer to build with (thread or address)", type=str, default=None)
     parser.add_argument("-clean", help="Clean all outputs (and don't build)", action='store_true')
     args = parser.parse_args()
 
@@ -71,4 +79,4 @@ if __name__ == '__main__':
         finally:
             os.chdir(origFolder)
     else:
-        build(args.bitness, args.config_type, args.output_type)
\ No newline at end of file
+        build(args.bitness, args.config_type, args.output_type, args.sanitizer)
\ No newline at end of file